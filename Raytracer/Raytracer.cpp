@@ -3,16 +3,38 @@
 
 #include "Raytracer.h"
 
+#include <string_view>
+
 #include <spdlog/spdlog.h>
 #include "ui/application.h"
+#include "render/scene_io.h"
+#include "ui/batch_application.h"
+#include "ui/distributed_application.h"
 
 using std::cout, std::endl;
 
-int main() {
+int main(int argc, char **argv) {
+    // Raytracer --convert scene.obj scene.rtscene
+    if (argc == 4 && std::string_view(argv[1]) == "--convert")
+        return convert_scene(argv[2], argv[3]) ? 0 : 1;
+
+    // headless runs never touch GLFW, OpenGL or ImGui, so they work without a display
+    if (is_batch_invocation(argc, argv)) {
+        BatchSettings settings;
+        if (!parse_batch_settings(argc, argv, settings))
+            return 2;
+        if (!settings.worker.empty())
+            return WorkerApplication(std::move(settings)).run();
+        if (settings.coordinator_port != 0)
+            return CoordinatorApplication(std::move(settings)).run();
+        return BatchApplication(std::move(settings)).run();
+    }
+
     cout << "Hello CMake." << endl;
     spdlog::info("info");
 
-    Application app(1440, 1024);
+    // Raytracer [scene], the scene loads while the window comes up
+    Application app(1440, 1024, argc == 2 ? argv[1] : "cornell");
 
     spdlog::info("info");
 
@@ -0,0 +1,434 @@
+// raytracer_bench : micro benchmarks for intersection, BVH build and traversal.
+//
+// Runs on generated scenes only and prints a JSON report, so numbers can be compared across
+// commits and machines:
+//
+//     raytracer_bench --output bench.json
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include "render/camera.h"
+#include "render/integrator.h"
+#include "render/procedural.h"
+#include "render/rng.h"
+#include "render/scene.h"
+#include "utils/cpu_features.h"
+#include "utils/json_writer.h"
+#include "utils/thread_pool.h"
+
+using std::chrono::steady_clock;
+
+namespace {
+
+constexpr char const *USAGE = R"(usage: raytracer_bench [options]
+
+  --output FILE       write the JSON report to FILE instead of stdout
+  --threads N         worker threads for build and traversal, 0 uses every hardware thread (0)
+  --repeat N          runs per measurement, the median is reported (5)
+  --resolution N      primary rays are N x N camera rays (1024)
+  --scenes A,B,...    scenes for build and traversal (cornell,spheres,soup)
+  --help              print this message
+)";
+
+struct Options {
+    std::string output;
+    unsigned threads = 0;
+    int repeat       = 5;
+    int resolution   = 1024;
+    std::vector<std::string> scenes{"cornell", "spheres", "soup"};
+};
+
+template <typename T> auto parse_number(std::string_view text, T &value) -> bool {
+    auto const [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc{} && end == text.data() + text.size();
+}
+
+auto parse_options(int argc, char **argv, Options &options) -> bool {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view const option = argv[i];
+        if (option == "--help" || i + 1 == argc) {
+            std::fputs(USAGE, option == "--help" ? stdout : stderr);
+            return false;
+        }
+        std::string_view const value = argv[++i];
+        bool ok                      = true;
+        if (option == "--output") {
+            options.output = value;
+        } else if (option == "--threads") {
+            ok = parse_number(value, options.threads);
+        } else if (option == "--repeat") {
+            ok = parse_number(value, options.repeat) && options.repeat > 0;
+        } else if (option == "--resolution") {
+            ok = parse_number(value, options.resolution) && options.resolution > 0;
+        } else if (option == "--scenes") {
+            options.scenes.clear();
+            for (size_t begin = 0; begin <= value.size();) {
+                size_t const end = std::min(value.find(',', begin), value.size());
+                options.scenes.emplace_back(value.substr(begin, end - begin));
+                begin = end + 1;
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            spdlog::error("invalid option {} {}", option, value);
+            std::fputs(USAGE, stderr);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// median wall time of `repeat` runs of `f` in milliseconds
+template <typename F> auto median_ms(int repeat, F &&f) -> double {
+    std::vector<double> times;
+    for (int i = 0; i < repeat; ++i) {
+        auto const start = steady_clock::now();
+        f();
+        times.push_back(std::chrono::duration<double, std::milli>(steady_clock::now() - start)
+                            .count());
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+/// millions of operations per second
+auto mops(double count, double ms) -> double { return count / (ms * 1.0e3); }
+
+/// keeps results alive so the compiler can't drop the measured work
+std::atomic<uint64_t> g_sink{0};
+
+// ---- Intersection primitives --------------------------------------------------------------------
+
+auto random_ray(Pcg32 &rng) -> Ray {
+    Vec3 const origin{rng.next_float() * 2.0f - 1.0f, rng.next_float() * 2.0f - 1.0f,
+                      rng.next_float() * 2.0f - 1.0f};
+    Vec3 const target{rng.next_float() * 2.0f - 1.0f, rng.next_float() * 2.0f - 1.0f,
+                      rng.next_float() * 2.0f - 1.0f};
+    return {origin, normalize(target - origin)};
+}
+
+void bench_primitives(JsonWriter &json, int repeat) {
+    constexpr int PRIMS  = 1024;
+    constexpr int RAYS   = 1024;
+    constexpr int PASSES = 16;
+
+    Pcg32 rng(7);
+    std::vector<Ray> rays;
+    std::vector<Vec3> vertices;
+    std::vector<Aabb> boxes;
+    for (int i = 0; i < RAYS; ++i)
+        rays.push_back(random_ray(rng));
+    for (int i = 0; i < PRIMS; ++i) {
+        Vec3 const p = random_ray(rng).origin;
+        Aabb box;
+        for (int c = 0; c < 3; ++c) {
+            vertices.push_back(p + Vec3{rng.next_float(), rng.next_float(), rng.next_float()} *
+                                       0.5f);
+            box.extend(vertices.back());
+        }
+        boxes.push_back(box);
+    }
+
+    double const tests = static_cast<double>(PRIMS) * RAYS * PASSES;
+
+    double const triangle_ms = median_ms(repeat, [&]() {
+        uint64_t hits = 0;
+        for (int pass = 0; pass < PASSES; ++pass) {
+            for (Ray const &ray : rays) {
+                for (int i = 0; i < PRIMS; ++i) {
+                    float t, u, v;
+                    hits += intersect_triangle(ray, vertices[3 * i], vertices[3 * i + 1],
+                                               vertices[3 * i + 2], ray.t_max, t, u, v);
+                }
+            }
+        }
+        g_sink += hits;
+    });
+
+    double const box_ms = median_ms(repeat, [&]() {
+        uint64_t hits = 0;
+        for (int pass = 0; pass < PASSES; ++pass) {
+            for (Ray const &ray : rays) {
+                Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y,
+                                   1.0f / ray.direction.z};
+                for (Aabb const &box : boxes) {
+                    float t_near;
+                    hits += intersect_aabb(box, ray.origin, inv_dir, ray.t_min, ray.t_max, t_near);
+                }
+            }
+        }
+        g_sink += hits;
+    });
+
+    json.key("intersection").begin_object();
+    json.key("tests").value(tests);
+    json.key("triangle_ms").value(triangle_ms);
+    json.key("triangle_mtests_per_s").value(mops(tests, triangle_ms));
+    json.key("box_ms").value(box_ms);
+    json.key("box_mtests_per_s").value(mops(tests, box_ms));
+    json.end_object();
+}
+
+// ---- Ray distributions --------------------------------------------------------------------------
+
+struct RaySets {
+    /// camera rays, consecutive groups of eight form 4x2 pixel blocks
+    std::vector<Ray> primary;
+    /// from the primary hits that aren't lights towards random points on the lights
+    std::vector<Ray> shadow;
+    /// cosine distributed from the primary hits
+    std::vector<Ray> diffuse;
+};
+
+auto make_ray_sets(ThreadPool &pool, Scene const &scene, int resolution) -> RaySets {
+    RaySets sets;
+    PinholeCamera const projection(Camera{}, resolution, resolution);
+    Pcg32 rng(11);
+    for (int by = 0; by < resolution; by += 2) {
+        for (int bx = 0; bx < resolution; bx += 4) {
+            for (int lane = 0; lane < 8; ++lane) {
+                float const px = static_cast<float>(bx + (lane & 3)) + rng.next_float();
+                float const py = static_cast<float>(by + (lane >> 2)) + rng.next_float();
+                sets.primary.push_back(projection.generate_ray(px, py));
+            }
+        }
+    }
+
+    std::vector<Hit> hits(sets.primary.size());
+    pool.parallel_for(0, hits.size(), 4096,
+                      [&](size_t i) { scene.intersect(sets.primary[i], hits[i]); });
+
+    for (size_t i = 0; i < hits.size(); ++i) {
+        if (!hits[i].is_valid())
+            continue;
+        Ray const &ray = sets.primary[i];
+        Vec3 n         = scene.geometric_normal(hits[i].prim);
+        if (dot(n, ray.direction) > 0.0f)
+            n = -n;
+        Vec3 const p = ray.origin + ray.direction * hits[i].t + n * 1.0e-4f;
+
+        // no shadow rays from the lights themselves, they would graze their own surface
+        if (!scene.emissive_triangles.empty() && !scene.material(hits[i].prim).is_emissive()) {
+            uint32_t const light = scene.emissive_triangles[rng.next_u32() %
+                                                            scene.emissive_triangles.size()];
+            float b0 = rng.next_float(), b1 = rng.next_float();
+            if (b0 + b1 > 1.0f) {
+                b0 = 1.0f - b0;
+                b1 = 1.0f - b1;
+            }
+            Vec3 const q = scene.vertex(light, 0) * (1.0f - b0 - b1) +
+                           scene.vertex(light, 1) * b0 + scene.vertex(light, 2) * b1;
+            float const distance = length(q - p);
+            sets.shadow.push_back({p, (q - p) / distance, EPSILON, distance * (1.0f - 1.0e-3f)});
+        }
+        sets.diffuse.push_back(
+            {p, sample_cosine_hemisphere(n, rng.next_float(), rng.next_float())});
+    }
+    return sets;
+}
+
+// ---- Build and traversal ------------------------------------------------------------------------
+
+/// closest hits of `rays`, returns the number of hits
+auto trace(ThreadPool &pool, Scene const &scene, std::vector<Ray> const &rays) -> uint64_t {
+    std::atomic<uint64_t> hits{0};
+    constexpr size_t CHUNK = 4096;
+    pool.parallel_for(0, (rays.size() + CHUNK - 1) / CHUNK, 1, [&](size_t chunk) {
+        uint64_t count = 0;
+        for (size_t i = chunk * CHUNK; i < std::min(rays.size(), (chunk + 1) * CHUNK); ++i) {
+            Hit hit;
+            hit.t = rays[i].t_max;
+            count += scene.intersect(rays[i], hit);
+        }
+        hits += count;
+    });
+    return hits;
+}
+
+/// any hits of `rays`, returns the number of occluded rays
+auto trace_occlusion(ThreadPool &pool, Scene const &scene, std::vector<Ray> const &rays)
+    -> uint64_t {
+    std::atomic<uint64_t> hits{0};
+    constexpr size_t CHUNK = 4096;
+    pool.parallel_for(0, (rays.size() + CHUNK - 1) / CHUNK, 1, [&](size_t chunk) {
+        uint64_t count = 0;
+        for (size_t i = chunk * CHUNK; i < std::min(rays.size(), (chunk + 1) * CHUNK); ++i)
+            count += scene.occluded(rays[i]);
+        hits += count;
+    });
+    return hits;
+}
+
+/// closest hits of `rays` in packets of eight, returns the number of hits
+auto trace_packets(ThreadPool &pool, Scene const &scene, std::vector<Ray> const &rays)
+    -> uint64_t {
+    std::atomic<uint64_t> hits{0};
+    constexpr size_t CHUNK = 512;
+    size_t const packets   = (rays.size() + 7) / 8;
+    pool.parallel_for(0, (packets + CHUNK - 1) / CHUNK, 1, [&](size_t chunk) {
+        uint64_t count = 0;
+        for (size_t p = chunk * CHUNK; p < std::min(packets, (chunk + 1) * CHUNK); ++p) {
+            RayPacket8 packet{};
+            for (int lane = 0; lane < 8 && 8 * p + lane < rays.size(); ++lane)
+                packet.set(lane, rays[8 * p + lane]);
+            scene.intersect(packet);
+            for (int lane = 0; lane < 8; ++lane)
+                count += packet.prim[lane] != ~0u && (packet.active & (1u << lane));
+        }
+        hits += count;
+    });
+    return hits;
+}
+
+/// rays of `sets` against `scene` with its current traversal kernels
+void bench_traversal(JsonWriter &json, ThreadPool &pool, Scene const &scene, RaySets const &sets,
+                     Options const &options) {
+    json.begin_object();
+    json.key("simd").value(simd_level_name(scene.kernels->level));
+    json.key("bvh_width").value(std::max(scene.kernels->bvh_width, 2));
+
+    auto measure = [&](char const *key, std::vector<Ray> const &rays, auto &&run) {
+        uint64_t hits   = 0;
+        double const ms = median_ms(options.repeat, [&]() { hits = run(pool, scene, rays); });
+        json.key(key).begin_object();
+        json.key("mrays_per_s").value(mops(static_cast<double>(rays.size()), ms));
+        json.key("ms").value(ms);
+        json.key("hits").value(hits);
+        json.end_object();
+    };
+    measure("primary", sets.primary, trace);
+    measure("primary_packet", sets.primary, trace_packets);
+    measure("shadow", sets.shadow, trace_occlusion);
+    measure("diffuse", sets.diffuse, trace);
+    json.end_object();
+}
+
+void bench_scene(JsonWriter &json, ThreadPool &pool, std::string const &name, Scene scene,
+                 Options const &options) {
+    spdlog::info("benchmarking {} ({} triangles)", name, scene.triangle_count());
+
+    json.begin_object();
+    json.key("scene").value(name);
+    json.key("triangles").value(static_cast<uint64_t>(scene.triangle_count()));
+
+    double const build_ms = median_ms(options.repeat, [&]() { scene.bvh.build(pool, scene); });
+    json.key("bvh_build").begin_object();
+    json.key("ms").value(build_ms);
+    json.key("mtriangles_per_s").value(mops(static_cast<double>(scene.triangle_count()), build_ms));
+    json.key("nodes").value(static_cast<uint64_t>(scene.bvh.nodes().size()));
+    json.end_object();
+
+    scene.set_simd_level(SimdLevel::Scalar);
+    RaySets const sets = make_ray_sets(pool, scene, options.resolution);
+    json.key("rays").begin_object();
+    json.key("primary").value(static_cast<uint64_t>(sets.primary.size()));
+    json.key("shadow").value(static_cast<uint64_t>(sets.shadow.size()));
+    json.key("diffuse").value(static_cast<uint64_t>(sets.diffuse.size()));
+    json.end_object();
+
+    json.key("traversal").begin_array();
+    for (auto level : {SimdLevel::Scalar, SimdLevel::Sse41, SimdLevel::Avx2, SimdLevel::Avx512}) {
+        if (level > best_simd_level())
+            break;
+        scene.set_simd_level(level);
+        bench_traversal(json, pool, scene, sets, options);
+    }
+    json.end_array();
+
+    // the same rays against the compact form of the scene, the hits only differ where quantized
+    // vertices moved a triangle edge across a ray
+    double const bytes_before = static_cast<double>(scene.geometry_bytes());
+    bool compacted            = false;
+    double const compact_ms   = median_ms(1, [&]() { compacted = scene.make_compact(pool); });
+    if (compacted) {
+        auto const triangles = static_cast<double>(scene.triangle_count());
+        json.key("compact").begin_object();
+        json.key("ms").value(compact_ms);
+        json.key("bytes_per_triangle_before").value(bytes_before / triangles);
+        json.key("bytes_per_triangle").value(static_cast<double>(scene.geometry_bytes()) /
+                                             triangles);
+        json.key("quantized_vertices").value(scene.compact.quantized_vertex_share());
+        json.key("traversal").begin_array();
+        for (auto level : {SimdLevel::Scalar, SimdLevel::Avx2}) {
+            if (level > best_simd_level())
+                break;
+            scene.set_simd_level(level);
+            bench_traversal(json, pool, scene, sets, options);
+        }
+        json.end_array();
+        json.end_object();
+    }
+    json.end_object();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    // the report goes to stdout, keep the log out of it
+    spdlog::set_default_logger(spdlog::stderr_color_mt("bench"));
+
+    Options options;
+    if (!parse_options(argc, argv, options))
+        return 2;
+
+    std::vector<std::pair<std::string, Scene>> scenes;
+    for (auto const &name : options.scenes) {
+        auto scene = make_procedural_scene(name);
+        if (!scene) {
+            spdlog::error("unknown scene '{}'", name);
+            return 2;
+        }
+        scenes.emplace_back(name, std::move(*scene));
+    }
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            spdlog::error("couldn't open {} for writing", options.output);
+            return 1;
+        }
+    }
+    std::ostream &out = options.output.empty() ? std::cout : file;
+
+    ThreadPool pool(options.threads);
+    auto const &cpu = cpu_features();
+
+    JsonWriter json(out);
+    json.begin_object();
+    json.key("version").value(1);
+    json.key("cpu").begin_object();
+    json.key("brand").value(cpu.brand);
+    json.key("threads").value(pool.size());
+    json.key("simd").value(simd_level_name(best_simd_level()));
+    json.end_object();
+    json.key("repeat").value(options.repeat);
+
+    spdlog::info("benchmarking ray/primitive intersection");
+    bench_primitives(json, options.repeat);
+
+    json.key("scenes").begin_array();
+    for (auto &[name, scene] : scenes)
+        bench_scene(json, pool, name, std::move(scene), options);
+    json.end_array();
+    json.end_object();
+
+    if (!out) {
+        spdlog::error("writing the report failed");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,741 @@
+// raytracer_perf : time-to-quality regression runs of the CPU renderer.
+//
+// Renders generated scenes progressively like the interactive renderer does and measures, after
+// each of several time budgets, the error against a reference rendered at a high sample count.
+// Catches what the micro benchmarks of raytracer_bench can't: kernels that got faster while the
+// image converges slower.
+//
+// The references are committed in bench/perf_references, rendered by a known-good build, so a
+// regression of the renderer can't hide in references rendered by the build under test. Without
+// them the harness refuses to run. Only render them again for intended changes of the images,
+// with a build of a commit that is known to be good, and commit them.
+//
+//     raytracer_perf --output perf.json
+//     raytracer_perf --baseline perf.json       # exits with 1 if anything got worse
+//     raytracer_perf --update-references        # deliberately, see above
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+// needs the types of Windows.h
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "render/accumulator.h"
+#include "render/camera.h"
+#include "render/framebuffer.h"
+#include "render/image_io.h"
+#include "render/procedural.h"
+#include "render/scene.h"
+#include "render/tile_renderer.h"
+#include "utils/cpu_features.h"
+#include "utils/json_reader.h"
+#include "utils/json_writer.h"
+#include "utils/thread_pool.h"
+
+// set by the build to the committed references
+#ifndef RAYTRACER_PERF_REFERENCES
+#define RAYTRACER_PERF_REFERENCES "bench/perf_references"
+#endif
+
+using std::chrono::steady_clock;
+
+namespace {
+
+constexpr char const *USAGE = R"(usage: raytracer_perf [options]
+
+  --output FILE         write the JSON report to FILE instead of stdout
+  --references DIR      reference images, one PFM per scene (the committed ones)
+  --update-references   render the references instead of measuring, only with a
+                        known-good build
+  --reference-spp N     samples per pixel of the references (4096)
+  --baseline FILE       report of an earlier run to compare with, exits with 1 on regressions
+  --tolerance X         relative change of a metric counted as a regression (0.1)
+  --threads N           render threads, 0 uses every hardware thread (0)
+  --resolution N        images are N x N pixels (256)
+  --budgets A,B,...     seconds of rendering after which the error is measured (0.5,2,8)
+  --scenes A,B,...      scenes to render (cornell,spheres,instances,city)
+  --help                print this message
+)";
+
+/// first frame index of the references, their samples come from a part of the sample sequence
+/// the measured renders never reach, so their noise is independent
+constexpr uint32_t REFERENCE_FRAME = 1u << 20;
+/// samples per pixel and pass of the references
+constexpr int REFERENCE_PASS_SPP = 16;
+
+struct Options {
+    std::string output;
+    std::filesystem::path references = RAYTRACER_PERF_REFERENCES;
+    bool update_references           = false;
+    int reference_spp                = 4096;
+    std::string baseline;
+    double tolerance = 0.1;
+    unsigned threads = 0;
+    int resolution   = 256;
+    std::vector<double> budgets{0.5, 2.0, 8.0};
+    std::vector<std::string> scenes{"cornell", "spheres", "instances", "city"};
+};
+
+template <typename T> auto parse_number(std::string_view text, T &value) -> bool {
+    auto const [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc{} && end == text.data() + text.size();
+}
+
+/// the comma separated parts of `text`
+auto split_list(std::string_view text) -> std::vector<std::string_view> {
+    std::vector<std::string_view> parts;
+    for (size_t begin = 0; begin <= text.size();) {
+        size_t const end = std::min(text.find(',', begin), text.size());
+        parts.push_back(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return parts;
+}
+
+auto parse_budgets(std::string_view text, std::vector<double> &budgets) -> bool {
+    budgets.clear();
+    for (auto part : split_list(text)) {
+        double seconds = 0.0;
+        if (!parse_number(part, seconds) || !(seconds > 0.0))
+            return false;
+        budgets.push_back(seconds);
+    }
+    // the budgets are checkpoints of one progressive render
+    std::sort(budgets.begin(), budgets.end());
+    budgets.erase(std::unique(budgets.begin(), budgets.end()), budgets.end());
+    return true;
+}
+
+auto parse_options(int argc, char **argv, Options &options) -> bool {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view const option = argv[i];
+        if (option == "--update-references") {
+            options.update_references = true;
+            continue;
+        }
+        if (option == "--help" || i + 1 == argc) {
+            std::fputs(USAGE, option == "--help" ? stdout : stderr);
+            return false;
+        }
+        std::string_view const value = argv[++i];
+        bool ok                      = true;
+        if (option == "--output") {
+            options.output = value;
+        } else if (option == "--references") {
+            options.references = value;
+        } else if (option == "--reference-spp") {
+            ok = parse_number(value, options.reference_spp) && options.reference_spp > 0;
+        } else if (option == "--baseline") {
+            options.baseline = value;
+        } else if (option == "--tolerance") {
+            ok = parse_number(value, options.tolerance) && options.tolerance >= 0.0;
+        } else if (option == "--threads") {
+            ok = parse_number(value, options.threads);
+        } else if (option == "--resolution") {
+            ok = parse_number(value, options.resolution) && options.resolution > 0;
+        } else if (option == "--budgets") {
+            ok = parse_budgets(value, options.budgets);
+        } else if (option == "--scenes") {
+            options.scenes.clear();
+            for (auto name : split_list(value))
+                options.scenes.emplace_back(name);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            spdlog::error("invalid option {} {}", option, value);
+            std::fputs(USAGE, stderr);
+            return false;
+        }
+    }
+    return true;
+}
+
+auto milliseconds(steady_clock::duration duration) -> double {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// ---- Memory -------------------------------------------------------------------------------------
+
+/// @brief starts a new high water mark for `peak_rss_mb()` where the OS allows it (Linux), so
+/// every scene reports its own peak. Elsewhere the peak of the whole run is reported.
+void reset_peak_rss() {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+/// high water mark of the resident memory of the process in MB
+auto peak_rss_mb() -> double {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0.0;
+    return static_cast<double>(counters.PeakWorkingSetSize) / (1 << 20);
+#elif defined(__linux__)
+    // VmHWM follows `reset_peak_rss()`, the maximum of getrusage() doesn't
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.starts_with("VmHWM:")) {
+            double kb = 0.0;
+            std::istringstream(line.substr(6)) >> kb;
+            return kb / 1024.0;
+        }
+    }
+    return 0.0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    // bytes on macOS
+    return static_cast<double>(usage.ru_maxrss) / (1 << 20);
+#endif
+}
+
+// ---- Error metrics ------------------------------------------------------------------------------
+
+/// what the display shows of linear radiance, see `pack_rgba8()`
+auto display(Vec3 c) -> Vec3 {
+    return {std::clamp(c.x, 0.0f, 1.0f), std::clamp(c.y, 0.0f, 1.0f), std::clamp(c.z, 0.0f, 1.0f)};
+}
+
+/// @brief root mean square error over all channels of the display images. Of the unclamped
+/// radiance the rare bright paths of light sources and caustics dominate, which keeps it from
+/// going down with more samples for a long time.
+auto rmse(Vec3 const *image, Vec3 const *reference, size_t pixels) -> double {
+    double sum = 0.0;
+    for (size_t i = 0; i < pixels; ++i) {
+        Vec3 const d  = display(image[i]) - display(reference[i]);
+        sum          += static_cast<double>(dot(d, d));
+    }
+    return std::sqrt(sum / (3.0 * static_cast<double>(pixels)));
+}
+
+auto linear_rgb_to_xyz(Vec3 c) -> Vec3 {
+    return {0.4124564f * c.x + 0.3575761f * c.y + 0.1804375f * c.z,
+            0.2126729f * c.x + 0.7151522f * c.y + 0.0721750f * c.z,
+            0.0193339f * c.x + 0.1191920f * c.y + 0.9503041f * c.z};
+}
+
+auto xyz_to_linear_rgb(Vec3 c) -> Vec3 {
+    return {3.2404542f * c.x - 1.5371385f * c.y - 0.4985314f * c.z,
+            -0.9692660f * c.x + 1.8760108f * c.y + 0.0415560f * c.z,
+            0.0556434f * c.x - 0.2040259f * c.y + 1.0572252f * c.z};
+}
+
+/// XYZ of linear RGB white, the reference white of the opponent and Lab spaces
+constexpr Vec3 WHITE{0.9504285f, 1.0f, 1.0889004f};
+
+/// the cube root of CIELAB with its linear part near black
+auto lab_f(float t) -> float {
+    constexpr float DELTA = 6.0f / 29.0f;
+    return t > DELTA * DELTA * DELTA ? std::cbrt(t) : t / (3.0f * DELTA * DELTA) + 4.0f / 29.0f;
+}
+
+/// CIELAB with the Hunt adjustment of FLIP, chroma shrinks with lightness
+auto hunt_lab(Vec3 rgb) -> Vec3 {
+    Vec3 const xyz = linear_rgb_to_xyz(rgb);
+    float const fx = lab_f(xyz.x / WHITE.x);
+    float const fy = lab_f(xyz.y / WHITE.y);
+    float const fz = lab_f(xyz.z / WHITE.z);
+    float const l  = 116.0f * fy - 16.0f;
+    return {l, 0.01f * l * 500.0f * (fx - fy), 0.01f * l * 200.0f * (fy - fz)};
+}
+
+/// distance in lightness plus Euclidean distance in chroma (Abasi et al. 2020)
+auto hyab(Vec3 a, Vec3 b) -> float {
+    float const da = a.y - b.y;
+    float const db = a.z - b.z;
+    return std::fabs(a.x - b.x) + std::sqrt(da * da + db * db);
+}
+
+/// @brief `channel` convolved with a 2D kernel that is a sum of Gaussians, each applied as two
+/// separable 1D passes with clamped borders
+/// @param gaussians weight and 1D kernel (of odd size) of every Gaussian
+auto convolve(std::vector<float> const &channel, int width, int height,
+              std::vector<std::pair<float, std::vector<float>>> const &gaussians)
+    -> std::vector<float> {
+    std::vector<float> result(channel.size(), 0.0f);
+    std::vector<float> rows(channel.size());
+    for (auto const &[weight, kernel] : gaussians) {
+        int const radius = static_cast<int>(kernel.size() / 2);
+        for (int y = 0; y < height; ++y) {
+            float const *row = channel.data() + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; ++x) {
+                float sum = 0.0f;
+                for (int k = -radius; k <= radius; ++k)
+                    sum += kernel[k + radius] * row[std::clamp(x + k, 0, width - 1)];
+                rows[static_cast<size_t>(y) * width + x] = sum;
+            }
+        }
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                float sum = 0.0f;
+                for (int k = -radius; k <= radius; ++k) {
+                    int const sy  = std::clamp(y + k, 0, height - 1);
+                    sum          += kernel[k + radius] * rows[static_cast<size_t>(sy) * width + x];
+                }
+                result[static_cast<size_t>(y) * width + x] += weight * sum;
+            }
+        }
+    }
+    return result;
+}
+
+/// @brief the display images of `linear` in the opponent space of FLIP, filtered by the contrast
+/// sensitivity of the eye at `ppd` pixels per degree
+/// @return Y, Cx and Cz planes
+auto csf_filter(Vec3 const *linear, int width, int height, float ppd)
+    -> std::array<std::vector<float>, 3> {
+    size_t const pixels = static_cast<size_t>(width) * height;
+    std::array<std::vector<float>, 3> planes;
+    for (auto &plane : planes)
+        plane.resize(pixels);
+    for (size_t i = 0; i < pixels; ++i) {
+        Vec3 const xyz = linear_rgb_to_xyz(display(linear[i]));
+        float const y  = xyz.y / WHITE.y;
+        planes[0][i]   = 116.0f * y - 16.0f;
+        planes[1][i]   = 500.0f * (xyz.x / WHITE.x - y);
+        planes[2][i]   = 200.0f * (y - xyz.z / WHITE.z);
+    }
+
+    // a1, b1, a2, b2 of the achromatic and the two chromatic channels (Mullen 1985, as in FLIP)
+    constexpr float CSF[3][4] = {{1.0f, 0.0047f, 0.0f, 1.0e-5f},
+                                 {1.0f, 0.0053f, 0.0f, 1.0e-5f},
+                                 {34.1f, 0.04f, 13.5f, 0.025f}};
+    // three standard deviations of the widest Gaussian
+    float const sigma = std::sqrt(0.04f / (2.0f * PI * PI)) * ppd;
+    int const radius  = static_cast<int>(std::ceil(3.0f * sigma));
+    for (int channel = 0; channel < 3; ++channel) {
+        std::vector<std::pair<float, std::vector<float>>> gaussians;
+        float total = 0.0f;
+        for (int g = 0; g < 2; ++g) {
+            float const a = CSF[channel][2 * g];
+            float const b = CSF[channel][2 * g + 1];
+            if (a == 0.0f)
+                continue;
+            std::vector<float> kernel(2 * radius + 1);
+            float sum = 0.0f;
+            for (int k = -radius; k <= radius; ++k) {
+                float const degrees  = static_cast<float>(k) / ppd;
+                kernel[k + radius]   = std::exp(-PI * PI * degrees * degrees / b);
+                sum                 += kernel[k + radius];
+            }
+            float const weight  = a * std::sqrt(PI / b);
+            total              += weight * sum * sum;
+            gaussians.emplace_back(weight, std::move(kernel));
+        }
+        // the 2D kernel sums to one
+        for (auto &gaussian : gaussians)
+            gaussian.first /= total;
+        planes[channel] = convolve(planes[channel], width, height, gaussians);
+    }
+    return planes;
+}
+
+/// @brief mean of the color error of FLIP (Andersson et al. 2020) over the display images, 0 for
+/// identical and 1 for the most different images. The edge and point feature term of the full
+/// metric is left out; the color term alone already weighs noise by how visible it is.
+/// @param ppd pixels per degree of visual angle, the default is a 4K monitor 70 cm wide seen from
+/// 70 cm
+auto flip_color_error(Vec3 const *image, Vec3 const *reference, int width, int height,
+                      float ppd = 67.0206f) -> double {
+    auto const a = csf_filter(image, width, height, ppd);
+    auto const b = csf_filter(reference, width, height, ppd);
+
+    auto to_hunt_lab = [&](std::array<std::vector<float>, 3> const &planes, size_t i) {
+        float const y = (planes[0][i] + 16.0f) / 116.0f;
+        Vec3 const xyz{(planes[1][i] / 500.0f + y) * WHITE.x, y * WHITE.y,
+                       (y - planes[2][i] / 200.0f) * WHITE.z};
+        return hunt_lab(display(xyz_to_linear_rgb(xyz)));
+    };
+
+    // the largest difference is the one between pure green and pure blue, errors up to `PC` of it
+    // are compressed into `PT` of the range
+    constexpr float QC = 0.7f;
+    constexpr float PC = 0.4f;
+    constexpr float PT = 0.95f;
+    float const cmax =
+        std::pow(hyab(hunt_lab({0.0f, 1.0f, 0.0f}), hunt_lab({0.0f, 0.0f, 1.0f})), QC);
+
+    size_t const pixels = static_cast<size_t>(width) * height;
+    double sum          = 0.0;
+    for (size_t i = 0; i < pixels; ++i) {
+        float const e     = std::pow(hyab(to_hunt_lab(a, i), to_hunt_lab(b, i)), QC);
+        float const error = e < PC * cmax ? e * PT / (PC * cmax)
+                                          : PT + (e - PC * cmax) / (cmax - PC * cmax) * (1.0f - PT);
+        sum              += std::min(error, 1.0f);
+    }
+    return sum / static_cast<double>(pixels);
+}
+
+// ---- Rendering ----------------------------------------------------------------------------------
+
+/// the progressive render of a scene after one time budget
+struct Checkpoint {
+    double seconds = 0.0;
+    /// time actually rendered, the pass running when the budget ran out is finished
+    double time_ms  = 0.0;
+    uint32_t passes = 0;
+    /// samples per pixel, less than `passes` once adaptive sampling skips converged pixels
+    double mean_spp = 0.0;
+    /// traced since the render started
+    uint64_t rays = 0;
+    double rmse   = 0.0;
+    double flip   = 0.0;
+
+    auto mrays_per_s() const -> double { return static_cast<double>(rays) / (time_ms * 1.0e3); }
+};
+
+struct SceneResult {
+    std::string name;
+    size_t triangles = 0;
+    size_t lights    = 0;
+    double build_ms  = 0.0;
+    double peak_rss  = 0.0;
+    std::vector<Checkpoint> checkpoints;
+};
+
+auto reference_path(Options const &options, std::string const &name) -> std::filesystem::path {
+    return options.references / (name + ".pfm");
+}
+
+/// loads and prepares the scene, logging the time it took
+auto make_scene(ThreadPool &pool, std::string const &name, double &build_ms)
+    -> std::optional<Scene> {
+    auto const start = steady_clock::now();
+    auto scene       = make_procedural_scene(name);
+    if (!scene) {
+        spdlog::error("unknown scene '{}'", name);
+        return std::nullopt;
+    }
+    scene->build_acceleration(pool);
+    build_ms = milliseconds(steady_clock::now() - start);
+    return scene;
+}
+
+/// renders the reference of `name` without adaptive sampling and writes it to the references
+auto update_reference(ThreadPool &pool, std::string const &name, Options const &options) -> bool {
+    double build_ms = 0.0;
+    auto scene      = make_scene(pool, name, build_ms);
+    if (!scene)
+        return false;
+
+    int const size = options.resolution;
+    TileRenderer renderer(pool);
+    renderer.adaptive.enabled = false;
+    renderer.resize(size, size);
+    Accumulator accumulator;
+    accumulator.reset(size, size, renderer.tiles().size());
+    Framebuffer image;
+    image.resize(size, size);
+
+    spdlog::info("rendering the reference of {} at {} spp", name, options.reference_spp);
+    auto const start = steady_clock::now();
+    for (int done = 0; done < options.reference_spp; done += REFERENCE_PASS_SPP) {
+        int const spp = std::min(REFERENCE_PASS_SPP, options.reference_spp - done);
+        renderer.accumulate(*scene, Camera{}, accumulator, image,
+                            REFERENCE_FRAME + static_cast<uint32_t>(done / REFERENCE_PASS_SPP),
+                            spp);
+    }
+    spdlog::info("rendered {} in {:.1f} s", name, milliseconds(steady_clock::now() - start) / 1e3);
+
+    std::error_code error;
+    std::filesystem::create_directories(options.references, error);
+    return write_pfm(reference_path(options, name), image);
+}
+
+/// @brief loads the reference of `name`, which has to match the resolution of the measurements
+auto load_reference(std::string const &name, Options const &options, std::vector<Vec3> &reference)
+    -> bool {
+    int const size = options.resolution;
+    int width      = 0;
+    int height     = 0;
+    if (!read_pfm(reference_path(options, name), width, height, reference)) {
+        spdlog::error("no reference for {} in {}, the references of a known-good build are "
+                      "committed in bench/perf_references",
+                      name, options.references.string());
+        return false;
+    }
+    if (width != size || height != size) {
+        spdlog::error("the reference of {} is {}x{}, not {}x{}", name, width, height, size, size);
+        return false;
+    }
+    return true;
+}
+
+/// renders `name` progressively, one sample per pixel and pass, and measures it at every budget
+/// against `reference`
+auto measure_scene(ThreadPool &pool, std::string const &name, std::vector<Vec3> const &reference,
+                   Options const &options) -> std::optional<SceneResult> {
+    int const size = options.resolution;
+
+    reset_peak_rss();
+    SceneResult result;
+    result.name = name;
+    auto scene  = make_scene(pool, name, result.build_ms);
+    if (!scene)
+        return std::nullopt;
+    result.triangles = scene->triangle_count();
+    result.lights    = scene->emissive_triangles.size();
+    spdlog::info("measuring {} ({} triangles, {} lights)", name, result.triangles, result.lights);
+
+    TileRenderer renderer(pool);
+    renderer.resize(size, size);
+    Accumulator accumulator;
+    accumulator.reset(size, size, renderer.tiles().size());
+    Framebuffer image;
+    image.resize(size, size);
+
+    // only the rendering counts against the budgets, not the measurements
+    steady_clock::duration rendered{};
+    uint32_t frame = 0;
+    for (double const seconds : options.budgets) {
+        auto const budget = std::chrono::duration<double>(seconds);
+        while (rendered < budget) {
+            auto const start = steady_clock::now();
+            renderer.accumulate(*scene, Camera{}, accumulator, image, frame++);
+            rendered += steady_clock::now() - start;
+        }
+
+        Checkpoint checkpoint;
+        checkpoint.seconds = seconds;
+        checkpoint.time_ms = milliseconds(rendered);
+        checkpoint.passes  = accumulator.passes();
+        checkpoint.rays    = renderer.rays_traced();
+        uint64_t samples   = 0;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x)
+                samples += accumulator.samples(x, y);
+        }
+        auto const pixels   = static_cast<size_t>(size) * size;
+        checkpoint.mean_spp = static_cast<double>(samples) / static_cast<double>(pixels);
+        checkpoint.rmse     = rmse(image.color_data(), reference.data(), pixels);
+        checkpoint.flip     = flip_color_error(image.color_data(), reference.data(), size, size);
+        spdlog::info("{} after {:.2f} s: {} passes, {:.1f} Mrays/s, rmse {:.5f}, flip {:.5f}", name,
+                     checkpoint.time_ms / 1e3, checkpoint.passes, checkpoint.mrays_per_s(),
+                     checkpoint.rmse, checkpoint.flip);
+        result.checkpoints.push_back(checkpoint);
+    }
+    result.peak_rss = peak_rss_mb();
+    return result;
+}
+
+// ---- Baseline -----------------------------------------------------------------------------------
+
+struct Regression {
+    std::string scene;
+    double seconds = 0.0;
+    std::string metric;
+    double baseline = 0.0;
+    double value    = 0.0;
+};
+
+/// @brief the metrics of `results` that are worse than in `baseline` by more than the tolerance:
+/// higher error at the same budget, fewer rays per second or more memory. Scenes and budgets the
+/// baseline doesn't have are skipped. The build time is only reported, for the small scenes it is
+/// a few milliseconds and mostly noise.
+auto compare(JsonValue const &baseline, std::vector<SceneResult> const &results,
+             Options const &options) -> std::vector<Regression> {
+    std::vector<Regression> regressions;
+    if (baseline["resolution"].number() != options.resolution) {
+        spdlog::warn("the baseline was rendered at {} pixels, not compared",
+                     baseline["resolution"].number());
+        return regressions;
+    }
+
+    double const worse = 1.0 + options.tolerance;
+    auto check = [&](std::string const &scene, double seconds, char const *metric,
+                     JsonValue const &old, double value, bool lower_is_better) {
+        if (!old.is_number() || !std::isfinite(value))
+            return;
+        double const base = old.number();
+        if (lower_is_better ? value > base * worse : value * worse < base) {
+            if (seconds > 0.0)
+                spdlog::warn("{} regressed: {} {} -> {} after {} s", scene, metric, base, value,
+                             seconds);
+            else
+                spdlog::warn("{} regressed: {} {} -> {}", scene, metric, base, value);
+            regressions.push_back({scene, seconds, metric, base, value});
+        }
+    };
+
+    for (auto const &result : results) {
+        JsonValue const *old_scene = nullptr;
+        for (auto const &candidate : baseline["scenes"].elements()) {
+            if (candidate["scene"].string() == result.name)
+                old_scene = &candidate;
+        }
+        if (!old_scene) {
+            spdlog::info("{} is not in the baseline", result.name);
+            continue;
+        }
+        check(result.name, 0.0, "peak_rss_mb", (*old_scene)["peak_rss_mb"], result.peak_rss,
+              true);
+
+        for (auto const &checkpoint : result.checkpoints) {
+            for (auto const &old : (*old_scene)["checkpoints"].elements()) {
+                if (old["seconds"].number() != checkpoint.seconds)
+                    continue;
+                check(result.name, checkpoint.seconds, "rmse", old["rmse"], checkpoint.rmse, true);
+                check(result.name, checkpoint.seconds, "flip", old["flip"], checkpoint.flip, true);
+                check(result.name, checkpoint.seconds, "mrays_per_s", old["mrays_per_s"],
+                      checkpoint.mrays_per_s(), false);
+            }
+        }
+    }
+    return regressions;
+}
+
+auto load_baseline(std::string const &path) -> std::optional<JsonValue> {
+    std::ifstream file(path);
+    if (!file) {
+        spdlog::error("couldn't open {}", path);
+        return std::nullopt;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return JsonValue::parse(text.str());
+}
+
+void write_report(JsonWriter &json, ThreadPool const &pool, Options const &options,
+                  std::vector<SceneResult> const &results,
+                  std::vector<Regression> const &regressions) {
+    auto const &cpu = cpu_features();
+    json.begin_object();
+    json.key("version").value(1);
+    json.key("cpu").begin_object();
+    json.key("brand").value(cpu.brand);
+    json.key("threads").value(pool.size());
+    json.key("simd").value(simd_level_name(best_simd_level()));
+    json.end_object();
+    json.key("resolution").value(options.resolution);
+
+    json.key("scenes").begin_array();
+    for (auto const &result : results) {
+        json.begin_object();
+        json.key("scene").value(result.name);
+        json.key("triangles").value(static_cast<uint64_t>(result.triangles));
+        json.key("lights").value(static_cast<uint64_t>(result.lights));
+        json.key("build_ms").value(result.build_ms);
+        json.key("peak_rss_mb").value(result.peak_rss);
+        json.key("checkpoints").begin_array();
+        for (auto const &checkpoint : result.checkpoints) {
+            json.begin_object();
+            json.key("seconds").value(checkpoint.seconds);
+            json.key("time_ms").value(checkpoint.time_ms);
+            json.key("passes").value(checkpoint.passes);
+            json.key("mean_spp").value(checkpoint.mean_spp);
+            json.key("rays").value(checkpoint.rays);
+            json.key("mrays_per_s").value(checkpoint.mrays_per_s());
+            json.key("rmse").value(checkpoint.rmse);
+            json.key("flip").value(checkpoint.flip);
+            json.end_object();
+        }
+        json.end_array();
+        json.end_object();
+    }
+    json.end_array();
+
+    if (!options.baseline.empty()) {
+        json.key("baseline").value(options.baseline);
+        json.key("tolerance").value(options.tolerance);
+        json.key("regressions").begin_array();
+        for (auto const &regression : regressions) {
+            json.begin_object();
+            json.key("scene").value(regression.scene);
+            json.key("seconds").value(regression.seconds);
+            json.key("metric").value(regression.metric);
+            json.key("baseline").value(regression.baseline);
+            json.key("value").value(regression.value);
+            json.end_object();
+        }
+        json.end_array();
+    }
+    json.end_object();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    // the report goes to stdout, keep the log out of it
+    spdlog::set_default_logger(spdlog::stderr_color_mt("perf"));
+
+    Options options;
+    if (!parse_options(argc, argv, options))
+        return 2;
+
+    ThreadPool pool(options.threads);
+
+    if (options.update_references) {
+        spdlog::warn("rendering the references into {}, commit them only if this build is known "
+                     "to be good",
+                     options.references.string());
+        for (auto const &name : options.scenes) {
+            if (!update_reference(pool, name, options))
+                return 1;
+        }
+        return 0;
+    }
+
+    // files are opened before rendering, so a bad path doesn't waste a whole run
+    std::vector<std::vector<Vec3>> references(options.scenes.size());
+    for (size_t i = 0; i < options.scenes.size(); ++i) {
+        if (!load_reference(options.scenes[i], options, references[i]))
+            return 1;
+    }
+    std::optional<JsonValue> baseline;
+    if (!options.baseline.empty()) {
+        baseline = load_baseline(options.baseline);
+        if (!baseline)
+            return 1;
+    }
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            spdlog::error("couldn't open {} for writing", options.output);
+            return 1;
+        }
+    }
+
+    std::vector<SceneResult> results;
+    for (size_t i = 0; i < options.scenes.size(); ++i) {
+        auto result = measure_scene(pool, options.scenes[i], references[i], options);
+        if (!result)
+            return 1;
+        results.push_back(std::move(*result));
+    }
+
+    std::vector<Regression> regressions;
+    if (baseline)
+        regressions = compare(*baseline, results, options);
+
+    JsonWriter json(options.output.empty() ? std::cout : file);
+    write_report(json, pool, options, results, regressions);
+
+    if (!regressions.empty()) {
+        spdlog::error("{} regressions against {}", regressions.size(), options.baseline);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "render/math.h"
+
+struct AdaptiveSettings {
+    /// skip pixels whose estimate is good enough, otherwise every pixel is sampled every pass
+    bool enabled = true;
+    /// samples a pixel gets before its variance estimate is trusted
+    uint32_t min_samples = 16;
+    /// a pixel is converged when the standard error of its mean luminance drops below this
+    /// fraction of the mean
+    float threshold = 0.05f;
+    /// pixels stop sampling after this many samples, converged or not
+    uint32_t max_samples = 4096;
+
+    auto operator==(AdaptiveSettings const &) const -> bool = default;
+};
+
+/// Running per-pixel sums of a progressive render, rows top to bottom. Keeps the first and second
+/// moment of the luminance so the variance of every pixel estimate is known.
+class Accumulator {
+    int m_width  = 0;
+    int m_height = 0;
+    std::vector<Vec3> m_sum;
+    std::vector<float> m_sum_sq;
+    std::vector<uint32_t> m_samples;
+    /// one flag per tile of the renderer, set once every pixel of the tile converged
+    std::vector<uint8_t> m_tile_converged;
+    uint32_t m_passes = 0;
+
+  public:
+    /// drops all samples, sized for `width x height` pixels in `tile_count` tiles
+    void reset(int width, int height, size_t tile_count) {
+        auto const pixels = static_cast<size_t>(width) * height;
+        m_width           = width;
+        m_height          = height;
+        m_sum.assign(pixels, Vec3{0.0f});
+        m_sum_sq.assign(pixels, 0.0f);
+        m_samples.assign(pixels, 0);
+        m_tile_converged.assign(tile_count, 0);
+        m_passes = 0;
+    }
+
+    auto width() const -> int { return m_width; }
+    auto height() const -> int { return m_height; }
+    auto passes() const -> uint32_t { return m_passes; }
+    auto tile_count() const -> size_t { return m_tile_converged.size(); }
+
+    void add(int x, int y, Vec3 sum, float sum_sq, uint32_t samples) {
+        size_t const i = index(x, y);
+        m_sum[i]     += sum;
+        m_sum_sq[i]  += sum_sq;
+        m_samples[i] += samples;
+    }
+
+    auto samples(int x, int y) const -> uint32_t { return m_samples[index(x, y)]; }
+    auto mean(int x, int y) const -> Vec3 {
+        size_t const i = index(x, y);
+        return m_samples[i] > 0 ? m_sum[i] / static_cast<float>(m_samples[i]) : Vec3{0.0f};
+    }
+
+    /// @brief whether pixel `(x, y)` needs no more samples
+    auto is_converged(int x, int y, AdaptiveSettings const &settings) const -> bool {
+        size_t const i   = index(x, y);
+        uint32_t const n = m_samples[i];
+        if (n >= settings.max_samples)
+            return true;
+        if (!settings.enabled || n < std::max(settings.min_samples, 2u))
+            return false;
+        // variance of the sample mean from the running moments
+        float const inv_n    = 1.0f / static_cast<float>(n);
+        float const mean     = luminance(m_sum[i]) * inv_n;
+        float const variance = std::max(0.0f, m_sum_sq[i] * inv_n - mean * mean);
+        float const error    = std::sqrt(variance / static_cast<float>(n - 1));
+        return error <= settings.threshold * std::max(mean, 1.0e-2f);
+    }
+
+    auto is_tile_converged(size_t tile) const -> bool { return m_tile_converged[tile] != 0; }
+    void set_tile_converged(size_t tile) { m_tile_converged[tile] = 1; }
+    auto converged_tiles() const -> size_t {
+        return std::count(m_tile_converged.begin(), m_tile_converged.end(), uint8_t{1});
+    }
+
+    void finish_pass() { ++m_passes; }
+
+  private:
+    auto index(int x, int y) const -> size_t { return static_cast<size_t>(y) * m_width + x; }
+};
@@ -0,0 +1,577 @@
+#include "bvh.h"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+#include "render/scene.h"
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+constexpr int MAX_BINS = 64;
+/// from this depth on only median splits are made, which halve the primitives, so even 2^32 of them
+/// end up in leaves by `Bvh::MAX_DEPTH`
+constexpr int MAX_SAH_DEPTH = Bvh::MAX_DEPTH - 32;
+
+struct Bin {
+    Aabb bounds;
+    uint32_t count = 0;
+};
+
+using AxisBins = std::array<std::array<Bin, MAX_BINS>, 3>;
+
+struct BuildContext {
+    ThreadPool &pool;
+    BvhBuildSettings const &settings;
+    std::vector<Aabb> prim_bounds;
+    std::vector<Vec3> centroids;
+    std::vector<uint32_t> &indices;
+    std::vector<BvhNode> &nodes;
+    std::atomic<uint32_t> next_node{1};
+    TaskGroup tasks;
+
+    BuildContext(ThreadPool &pool, BvhBuildSettings const &settings,
+                 std::vector<uint32_t> &indices, std::vector<BvhNode> &nodes)
+        : pool(pool), settings(settings), indices(indices), nodes(nodes), tasks(pool) {}
+};
+
+/// bounds of the primitives and of their centroids in `[begin, end)`
+void range_bounds(BuildContext &ctx, uint32_t begin, uint32_t end, Aabb &bounds,
+                  Aabb &centroid_bounds) {
+    auto accumulate = [&ctx](uint32_t from, uint32_t to, Aabb &b, Aabb &c) {
+        for (uint32_t i = from; i < to; ++i) {
+            uint32_t const prim = ctx.indices[i];
+            b.extend(ctx.prim_bounds[prim]);
+            c.extend(ctx.centroids[prim]);
+        }
+    };
+
+    uint32_t const count = end - begin;
+    if (count <= ctx.settings.parallel_bin_threshold) {
+        accumulate(begin, end, bounds, centroid_bounds);
+        return;
+    }
+
+    uint32_t const chunk  = ctx.settings.parallel_bin_threshold / 4;
+    size_t const chunks   = (count + chunk - 1) / chunk;
+    std::vector<Aabb> partial(2 * chunks);
+    ctx.pool.parallel_for(0, chunks, 1, [&](size_t c) {
+        uint32_t const from = begin + static_cast<uint32_t>(c) * chunk;
+        accumulate(from, std::min(from + chunk, end), partial[2 * c], partial[2 * c + 1]);
+    });
+    for (size_t c = 0; c < chunks; ++c) {
+        bounds.extend(partial[2 * c]);
+        centroid_bounds.extend(partial[2 * c + 1]);
+    }
+}
+
+auto bin_of(Vec3 centroid, int axis, Aabb const &centroid_bounds, float scale, int bin_count)
+    -> int {
+    int const bin =
+        static_cast<int>((centroid[axis] - centroid_bounds.lo[axis]) * scale);
+    return std::clamp(bin, 0, bin_count - 1);
+}
+
+/// sorts the primitives in `[begin, end)` into bins along all three axes
+void fill_bins(BuildContext &ctx, uint32_t begin, uint32_t end, Aabb const &centroid_bounds,
+               AxisBins &bins) {
+    int const bin_count = ctx.settings.bin_count;
+    Vec3 const extent   = centroid_bounds.extent();
+    Vec3 scale;
+    for (int axis = 0; axis < 3; ++axis)
+        scale[axis] = extent[axis] > 0.0f ? static_cast<float>(bin_count) / extent[axis] : 0.0f;
+
+    auto accumulate = [&](uint32_t from, uint32_t to, AxisBins &target) {
+        for (uint32_t i = from; i < to; ++i) {
+            uint32_t const prim = ctx.indices[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                auto &bin =
+                    target[axis][bin_of(ctx.centroids[prim], axis, centroid_bounds, scale[axis],
+                                        bin_count)];
+                bin.bounds.extend(ctx.prim_bounds[prim]);
+                ++bin.count;
+            }
+        }
+    };
+
+    uint32_t const count = end - begin;
+    if (count <= ctx.settings.parallel_bin_threshold) {
+        accumulate(begin, end, bins);
+        return;
+    }
+
+    uint32_t const chunk = ctx.settings.parallel_bin_threshold / 4;
+    size_t const chunks  = (count + chunk - 1) / chunk;
+    std::vector<AxisBins> partial(chunks);
+    ctx.pool.parallel_for(0, chunks, 1, [&](size_t c) {
+        uint32_t const from = begin + static_cast<uint32_t>(c) * chunk;
+        accumulate(from, std::min(from + chunk, end), partial[c]);
+    });
+    for (auto const &p : partial) {
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int b = 0; b < bin_count; ++b) {
+                bins[axis][b].bounds.extend(p[axis][b].bounds);
+                bins[axis][b].count += p[axis][b].count;
+            }
+        }
+    }
+}
+
+/// @brief evaluates the SAH for every bin boundary on every axis
+/// @return the unnormalised cost (area times primitive count summed over both sides) of the best
+/// split, `INF` if there is none
+auto find_split(BuildContext &ctx, uint32_t begin, uint32_t end, Aabb const &centroid_bounds,
+                int &best_axis, int &best_split) -> float {
+    int const bin_count  = ctx.settings.bin_count;
+    uint32_t const count = end - begin;
+    float best_cost      = INF;
+    if (max_component(centroid_bounds.extent()) <= 0.0f)
+        return best_cost;
+
+    AxisBins bins{};
+    fill_bins(ctx, begin, end, centroid_bounds, bins);
+
+    for (int axis = 0; axis < 3; ++axis) {
+        if (centroid_bounds.extent()[axis] <= 0.0f)
+            continue;
+
+        // sweep from the right to get the cost of all right hand sides
+        std::array<float, MAX_BINS> right_cost{};
+        Aabb right;
+        uint32_t right_count = 0;
+        for (int b = bin_count - 1; b > 0; --b) {
+            right.extend(bins[axis][b].bounds);
+            right_count += bins[axis][b].count;
+            right_cost[b] = right.area() * static_cast<float>(right_count);
+        }
+
+        Aabb left;
+        uint32_t left_count = 0;
+        for (int b = 0; b < bin_count - 1; ++b) {
+            left.extend(bins[axis][b].bounds);
+            left_count += bins[axis][b].count;
+            float const cost = left.area() * static_cast<float>(left_count) + right_cost[b + 1];
+            if (left_count > 0 && left_count < count && cost < best_cost) {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = b + 1;
+            }
+        }
+    }
+    return best_cost;
+}
+
+void build_node(BuildContext &ctx, uint32_t node_index, uint32_t begin, uint32_t end, int depth) {
+    auto const &settings = ctx.settings;
+    uint32_t const count = end - begin;
+
+    Aabb bounds, centroid_bounds;
+    range_bounds(ctx, begin, end, bounds, centroid_bounds);
+
+    BvhNode &node = ctx.nodes[node_index];
+    node.bounds   = bounds;
+
+    auto make_leaf = [&]() {
+        node.offset = begin;
+        node.count  = static_cast<uint16_t>(count);
+    };
+
+    if (count <= 1) {
+        make_leaf();
+        return;
+    }
+
+    // ---- find the cheapest split over all axes ----
+    int const bin_count = settings.bin_count;
+    int best_axis       = -1;
+    int best_split      = 0;
+    float best_cost     = depth < MAX_SAH_DEPTH
+                              ? find_split(ctx, begin, end, centroid_bounds, best_axis, best_split)
+                              : INF;
+
+    float const leaf_cost = static_cast<float>(count);
+    float const area      = bounds.area();
+    if (area > 0.0f)
+        best_cost = settings.traversal_cost + best_cost / area;
+
+    if (count <= static_cast<uint32_t>(settings.max_leaf_size) && best_cost >= leaf_cost) {
+        make_leaf();
+        return;
+    }
+
+    // ---- partition ----
+    auto *const first = ctx.indices.data() + begin;
+    auto *const last  = ctx.indices.data() + end;
+    uint32_t mid      = begin + count / 2;
+
+    if (best_axis >= 0) {
+        float const scale =
+            static_cast<float>(bin_count) / centroid_bounds.extent()[best_axis];
+        auto *const split = std::partition(first, last, [&](uint32_t prim) {
+            return bin_of(ctx.centroids[prim], best_axis, centroid_bounds, scale, bin_count) <
+                   best_split;
+        });
+        mid = begin + static_cast<uint32_t>(split - first);
+    }
+    if (best_axis < 0 || mid == begin || mid == end) {
+        // no usable split (all centroids on top of each other), fall back to a median split
+        best_axis = centroid_bounds.largest_axis();
+        mid       = begin + count / 2;
+        std::nth_element(first, ctx.indices.data() + mid, last, [&](uint32_t a, uint32_t b) {
+            return ctx.centroids[a][best_axis] < ctx.centroids[b][best_axis];
+        });
+    }
+
+    uint32_t const children = ctx.next_node.fetch_add(2, std::memory_order_relaxed);
+    node.offset             = children;
+    node.count              = 0;
+    node.axis               = static_cast<uint16_t>(best_axis);
+
+    if (count > settings.task_threshold) {
+        ctx.tasks.run([&ctx, children, begin, mid, depth]() {
+            build_node(ctx, children, begin, mid, depth + 1);
+        });
+    } else {
+        build_node(ctx, children, begin, mid, depth + 1);
+    }
+    build_node(ctx, children + 1, mid, end, depth + 1);
+}
+
+} // namespace
+
+namespace {
+
+/// bounds of every triangle of `scene`
+auto triangle_bounds(ThreadPool &pool, Scene const &scene) -> std::vector<Aabb> {
+    std::vector<Aabb> bounds(scene.triangle_count());
+    pool.parallel_for(0, bounds.size(), 4096,
+                      [&](size_t i) { bounds[i] = scene.triangle_bounds(i); });
+    return bounds;
+}
+
+} // namespace
+
+void Bvh::build(ThreadPool &pool, Scene const &scene, BvhBuildSettings const &settings) {
+    build(pool, triangle_bounds(pool, scene), settings);
+}
+
+void Bvh::build(ThreadPool &pool, std::vector<Aabb> prim_bounds,
+                BvhBuildSettings const &settings) {
+    PROFILE_SCOPE("bvh");
+    auto const prim_count = static_cast<uint32_t>(prim_bounds.size());
+    m_nodes.clear();
+    m_prim_indices.clear();
+    if (prim_count == 0)
+        return;
+
+    BvhBuildSettings clamped = settings;
+    clamped.bin_count        = std::clamp(settings.bin_count, 2, MAX_BINS);
+    clamped.max_leaf_size    = std::clamp(settings.max_leaf_size, 1, 0xffff);
+
+    // a binary tree with at least one primitive per leaf has at most 2n - 1 nodes
+    m_nodes.resize(2 * static_cast<size_t>(prim_count));
+    m_prim_indices.resize(prim_count);
+
+    BuildContext ctx(pool, clamped, m_prim_indices, m_nodes);
+    ctx.prim_bounds = std::move(prim_bounds);
+    ctx.centroids.resize(prim_count);
+    pool.parallel_for(0, prim_count, 4096, [&](size_t i) {
+        ctx.centroids[i]  = ctx.prim_bounds[i].centroid();
+        m_prim_indices[i] = static_cast<uint32_t>(i);
+    });
+
+    build_node(ctx, 0, 0, prim_count, 0);
+    ctx.tasks.wait();
+
+    m_nodes.resize(ctx.next_node.load());
+    m_nodes.shrink_to_fit();
+}
+
+void Bvh::refit(std::vector<Aabb> const &prim_bounds) {
+    PROFILE_SCOPE("refit");
+    // children are allocated after their parent, so walking the nodes backwards visits every
+    // child before its parent
+    for (size_t i = m_nodes.size(); i-- > 0;) {
+        BvhNode &node = m_nodes[i];
+        Aabb bounds;
+        if (node.is_leaf()) {
+            for (uint32_t p = node.offset; p < node.offset + node.count; ++p)
+                bounds.extend(prim_bounds[m_prim_indices[p]]);
+        } else {
+            bounds.extend(m_nodes[node.offset].bounds);
+            bounds.extend(m_nodes[node.offset + 1].bounds);
+        }
+        node.bounds = bounds;
+    }
+}
+
+void Bvh::refit(ThreadPool &pool, Scene const &scene) {
+    if (scene.triangle_count() != m_prim_indices.size()) {
+        spdlog::error("can't refit a BVH over {} triangles to {} triangles", m_prim_indices.size(),
+                      scene.triangle_count());
+        return;
+    }
+    refit(triangle_bounds(pool, scene));
+}
+
+auto Bvh::intersect(Scene const &scene, Ray const &ray, Hit &hit) const -> bool {
+    if (m_nodes.empty())
+        return false;
+
+    struct Entry {
+        uint32_t node;
+        float t;
+    };
+    Entry stack[traversal_stack_size(2)];
+    int size = 0;
+
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+    float t_near;
+    if (!intersect_aabb(m_nodes[0].bounds, ray.origin, inv_dir, ray.t_min, hit.t, t_near))
+        return false;
+
+    bool found          = false;
+    uint32_t node_index = 0;
+    while (true) {
+        BvhNode const &node = m_nodes[node_index];
+        if (node.is_leaf()) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                uint32_t const prim = m_prim_indices[i];
+                float t, u, v;
+                if (intersect_triangle(ray, scene.vertex(prim, 0), scene.vertex(prim, 1),
+                                       scene.vertex(prim, 2), hit.t, t, u, v)) {
+                    hit   = {t, prim, u, v};
+                    found = true;
+                }
+            }
+        } else {
+            uint32_t near_child = node.offset;
+            uint32_t far_child  = node.offset + 1;
+            float t_a, t_b;
+            bool const hit_a = intersect_aabb(m_nodes[near_child].bounds, ray.origin, inv_dir,
+                                              ray.t_min, hit.t, t_a);
+            bool const hit_b = intersect_aabb(m_nodes[far_child].bounds, ray.origin, inv_dir,
+                                              ray.t_min, hit.t, t_b);
+            if (hit_a && hit_b) {
+                if (t_b < t_a) {
+                    std::swap(near_child, far_child);
+                    std::swap(t_a, t_b);
+                }
+                stack[size++] = {far_child, t_b};
+                node_index    = near_child;
+                continue;
+            }
+            if (hit_a || hit_b) {
+                node_index = hit_a ? near_child : far_child;
+                continue;
+            }
+        }
+
+        // pop the next node that can still contain a closer hit
+        while (size > 0 && stack[size - 1].t > hit.t)
+            --size;
+        if (size == 0)
+            break;
+        node_index = stack[--size].node;
+    }
+    return found;
+}
+
+auto Bvh::occluded(Scene const &scene, Ray const &ray) const -> bool {
+    if (m_nodes.empty())
+        return false;
+
+    uint32_t stack[traversal_stack_size(2)];
+    int size = 0;
+
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+    float t_near;
+    if (!intersect_aabb(m_nodes[0].bounds, ray.origin, inv_dir, ray.t_min, ray.t_max, t_near))
+        return false;
+
+    uint32_t node_index = 0;
+    while (true) {
+        BvhNode const &node = m_nodes[node_index];
+        if (node.is_leaf()) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                uint32_t const prim = m_prim_indices[i];
+                float t, u, v;
+                if (intersect_triangle(ray, scene.vertex(prim, 0), scene.vertex(prim, 1),
+                                       scene.vertex(prim, 2), ray.t_max, t, u, v))
+                    return true;
+            }
+        } else {
+            bool const hit_a = intersect_aabb(m_nodes[node.offset].bounds, ray.origin, inv_dir,
+                                              ray.t_min, ray.t_max, t_near);
+            bool const hit_b = intersect_aabb(m_nodes[node.offset + 1].bounds, ray.origin,
+                                              inv_dir, ray.t_min, ray.t_max, t_near);
+            if (hit_a && hit_b)
+                stack[size++] = node.offset + 1;
+            if (hit_a || hit_b) {
+                node_index = hit_a ? node.offset : node.offset + 1;
+                continue;
+            }
+        }
+
+        if (size == 0)
+            break;
+        node_index = stack[--size];
+    }
+    return false;
+}
+
+// ---- Cache --------------------------------------------------------------------------------------
+
+namespace {
+
+constexpr char BVH_MAGIC[8] = {'R', 'T', 'B', 'V', 'H', 0, 0, 1};
+
+struct BvhFileHeader {
+    char magic[8];
+    uint64_t geometry_key;
+    uint64_t node_count;
+    uint64_t prim_count;
+};
+
+/// @brief checks a tree read from a cache before anything traverses it: child and primitive
+/// ranges have to lie inside the arrays, children after their parent (which `Bvh::refit()` relies
+/// on), every node has to be reached once and no deeper than `Bvh::MAX_DEPTH`, and every primitive
+/// index has to be below `prim_count`
+/// @return what is wrong, nullptr if the tree is fine
+auto check_tree(std::vector<BvhNode> const &nodes, std::vector<uint32_t> const &prim_indices,
+                size_t prim_count) -> char const * {
+    if (prim_indices.size() != prim_count)
+        return "it has a different primitive count";
+    if (nodes.empty())
+        return prim_count == 0 ? nullptr : "it has no nodes";
+    for (uint32_t const prim : prim_indices) {
+        if (prim >= prim_count)
+            return "a primitive index is out of range";
+    }
+
+    std::vector<bool> reached(nodes.size(), false);
+    std::vector<std::pair<uint32_t, int>> stack{{0, 0}};
+    reached[0] = true;
+    while (!stack.empty()) {
+        auto const [index, depth] = stack.back();
+        stack.pop_back();
+        BvhNode const &node = nodes[index];
+        if (node.is_leaf()) {
+            if (uint64_t{node.offset} + node.count > prim_indices.size())
+                return "a leaf is out of range";
+            continue;
+        }
+        if (node.offset <= index || uint64_t{node.offset} + 1 >= nodes.size() || node.axis > 2)
+            return "an interior node is invalid";
+        if (depth == Bvh::MAX_DEPTH)
+            return "it is too deep";
+        for (uint32_t const child : {node.offset, node.offset + 1}) {
+            if (reached[child])
+                return "a node is reached twice";
+            reached[child] = true;
+            stack.push_back({child, depth + 1});
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+auto Bvh::save(std::filesystem::path const &path, uint64_t geometry_key) const -> bool {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        spdlog::error("couldn't open BVH cache {} for writing", path.string());
+        return false;
+    }
+
+    BvhFileHeader header{};
+    std::memcpy(header.magic, BVH_MAGIC, sizeof(BVH_MAGIC));
+    header.geometry_key = geometry_key;
+    header.node_count   = m_nodes.size();
+    header.prim_count   = m_prim_indices.size();
+
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const *>(m_nodes.data()),
+               static_cast<std::streamsize>(m_nodes.size() * sizeof(BvhNode)));
+    file.write(reinterpret_cast<char const *>(m_prim_indices.data()),
+               static_cast<std::streamsize>(m_prim_indices.size() * sizeof(uint32_t)));
+
+    if (!file) {
+        spdlog::error("writing BVH cache {} failed", path.string());
+        return false;
+    }
+    return true;
+}
+
+auto Bvh::load(std::filesystem::path const &path, uint64_t geometry_key, size_t prim_count)
+    -> bool {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    BvhFileHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, BVH_MAGIC, sizeof(BVH_MAGIC)) != 0) {
+        spdlog::warn("{} is not a BVH cache of this version, ignoring it", path.string());
+        return false;
+    }
+    if (header.geometry_key != geometry_key) {
+        spdlog::info("BVH cache {} was built for different geometry, ignoring it", path.string());
+        return false;
+    }
+    // the counts are checked against the file size before anything is allocated for them
+    std::error_code error;
+    auto const file_size = std::filesystem::file_size(path, error);
+    if (error || header.node_count > file_size / sizeof(BvhNode) ||
+        header.prim_count > file_size / sizeof(uint32_t) ||
+        file_size != sizeof(header) + header.node_count * sizeof(BvhNode) +
+                         header.prim_count * sizeof(uint32_t)) {
+        spdlog::warn("BVH cache {} has the wrong size, ignoring it", path.string());
+        return false;
+    }
+
+    std::vector<BvhNode> nodes(header.node_count);
+    std::vector<uint32_t> prim_indices(header.prim_count);
+    file.read(reinterpret_cast<char *>(nodes.data()),
+              static_cast<std::streamsize>(nodes.size() * sizeof(BvhNode)));
+    file.read(reinterpret_cast<char *>(prim_indices.data()),
+              static_cast<std::streamsize>(prim_indices.size() * sizeof(uint32_t)));
+    if (!file) {
+        spdlog::warn("BVH cache {} is truncated, ignoring it", path.string());
+        return false;
+    }
+    if (char const *problem = check_tree(nodes, prim_indices, prim_count)) {
+        spdlog::warn("BVH cache {} is damaged ({}), ignoring it", path.string(), problem);
+        return false;
+    }
+
+    m_nodes        = std::move(nodes);
+    m_prim_indices = std::move(prim_indices);
+    return true;
+}
+
+auto geometry_hash(Scene const &scene) -> uint64_t {
+    // word-wise multiply/rotate hash, a lot faster than FNV on multi-GB vertex buffers
+    uint64_t h = 0x243F6A8885A308D3ULL;
+    auto mix   = [&h](void const *data, size_t bytes) {
+        auto const *p = static_cast<unsigned char const *>(data);
+        size_t i      = 0;
+        for (; i + 8 <= bytes; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, p + i, 8);
+            h = (h ^ (word * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+            h = (h << 27) | (h >> 37);
+        }
+        for (; i < bytes; ++i)
+            h = (h ^ p[i]) * 0x100000001B3ULL;
+        h ^= bytes;
+    };
+    mix(scene.positions.data(), scene.positions.size() * sizeof(Vec3));
+    mix(scene.indices.data(), scene.indices.size() * sizeof(uint32_t));
+    return h;
+}
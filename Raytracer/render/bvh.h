@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "render/intersect.h"
+#include "render/math.h"
+
+class ThreadPool;
+struct Scene;
+
+/// One node of the flattened BVH, two of them fill a cache line.
+///
+/// The two children of an interior node are stored next to each other, so traversal can test both
+/// child boxes with a single cache line fetch.
+struct alignas(32) BvhNode {
+    Aabb bounds;
+    /// interior nodes: index of the first child, the second one follows it.
+    /// leaves: index of the first primitive in `Bvh::prim_indices()`
+    uint32_t offset = 0;
+    /// number of primitives in a leaf, `0` for interior nodes
+    uint16_t count = 0;
+    /// split axis of interior nodes
+    uint16_t axis = 0;
+
+    auto is_leaf() const -> bool { return count > 0; }
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode should be half a cache line");
+
+struct BvhBuildSettings {
+    /// number of centroid bins per axis the SAH is evaluated on
+    int bin_count = 16;
+    /// leaves are split as long as they hold more primitives than this
+    int max_leaf_size = 8;
+    /// cost of a traversal step relative to one triangle intersection
+    float traversal_cost = 1.0f;
+    /// subtrees with more primitives than this are built as separate tasks
+    uint32_t task_threshold = 4096;
+    /// nodes with more primitives than this bin their primitives in parallel
+    uint32_t parallel_bin_threshold = 1u << 16;
+};
+
+/// Bounding volume hierarchy over the triangles of a `Scene`, built with binned SAH.
+///
+/// Also used over other primitives (the instances of an `InstanceLayer`), the tree only needs the
+/// bounds of every primitive.
+class Bvh {
+    std::vector<BvhNode> m_nodes;
+    std::vector<uint32_t> m_prim_indices;
+
+  public:
+    /// no leaf of a tree is deeper than this, which bounds the traversal stacks, see
+    /// `traversal_stack_size()`
+    static constexpr int MAX_DEPTH = 96;
+
+    /// (re)builds the tree, top levels bin in parallel and subtrees are built as separate tasks
+    void build(ThreadPool &pool, Scene const &scene, BvhBuildSettings const &settings = {});
+    /// builds the tree over primitives with the given bounds
+    void build(ThreadPool &pool, std::vector<Aabb> prim_bounds,
+               BvhBuildSettings const &settings = {});
+
+    /// @brief recomputes the node bounds bottom up for primitives that moved, keeping the
+    /// topology. A lot cheaper than a rebuild, but the tree gets worse the further the primitives
+    /// move from where they were at build time.
+    /// @param prim_bounds new bounds of every primitive, indexed like at build time
+    void refit(std::vector<Aabb> const &prim_bounds);
+    /// refits the tree to the current triangles of `scene`, which has to have the same triangle
+    /// count as the one it was built for
+    void refit(ThreadPool &pool, Scene const &scene);
+
+    auto empty() const -> bool { return m_nodes.empty(); }
+    auto nodes() const -> std::vector<BvhNode> const & { return m_nodes; }
+    auto prim_indices() const -> std::vector<uint32_t> const & { return m_prim_indices; }
+
+    /// closest hit along `ray` that is nearer than `hit.t`
+    auto intersect(Scene const &scene, Ray const &ray, Hit &hit) const -> bool;
+
+    /// any hit along `ray`
+    auto occluded(Scene const &scene, Ray const &ray) const -> bool;
+
+    // ---- Cache ----------------------------------------------------------------------------------
+
+    /// @brief writes the tree to `path`
+    /// @param geometry_key identifies the geometry the tree was built for, see `geometry_hash()`
+    auto save(std::filesystem::path const &path, uint64_t geometry_key) const -> bool;
+
+    /// @brief reads a tree written by `save()`, checking that it can be traversed safely
+    /// @param prim_count primitives the tree has to be over, the triangles of the scene
+    /// @return false if the file is missing, damaged or was built for different geometry
+    auto load(std::filesystem::path const &path, uint64_t geometry_key, size_t prim_count) -> bool;
+};
+
+/// Entries a traversal stack needs for `width`-wide nodes, collapsed from a `Bvh` or the binary
+/// tree itself: every level pops one node and pushes at most all of its children.
+constexpr auto traversal_stack_size(int width) -> int { return Bvh::MAX_DEPTH * (width - 1) + 1; }
+
+/// hash over the vertex and index buffers of `scene`, used to validate cached trees
+auto geometry_hash(Scene const &scene) -> uint64_t;
+
+/// the BVH of a scene file is cached next to it, `scene.ext` -> `scene.ext.bvh`
+inline auto bvh_cache_path(std::filesystem::path const &scene_path) -> std::filesystem::path {
+    auto path = scene_path;
+    path += ".bvh";
+    return path;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cmath>
+
+#include "render/math.h"
+
+/// user facing camera state, this is what the UI edits
+struct Camera {
+    Vec3 position{0.0f, 1.0f, 2.2f};
+    Vec3 target{0.0f, 1.0f, 0.0f};
+    Vec3 up{0.0f, 1.0f, 0.0f};
+    /// vertical field of view in degrees
+    float fov = 90.0f;
+
+    auto operator==(Camera const &) const -> bool = default;
+};
+
+/// pinhole projection of a `Camera` onto an image of a given resolution
+class PinholeCamera {
+    Vec3 m_origin;
+    Vec3 m_forward;
+    Vec3 m_right;
+    Vec3 m_up;
+    float m_inv_width   = 1.0f;
+    float m_inv_height  = 1.0f;
+    float m_pixel_angle = 0.0f;
+
+  public:
+    PinholeCamera(Camera const &camera, int width, int height)
+        : m_origin(camera.position), m_inv_width(1.0f / static_cast<float>(width)),
+          m_inv_height(1.0f / static_cast<float>(height)) {
+        float const aspect = static_cast<float>(width) / static_cast<float>(height);
+        float const tan_half_fov =
+            std::tan(0.5f * std::clamp(camera.fov, 1.0f, 179.0f) * PI / 180.0f);
+
+        m_forward     = normalize(camera.target - camera.position);
+        m_right       = normalize(cross(m_forward, camera.up)) * (tan_half_fov * aspect);
+        m_up          = normalize(cross(m_right, m_forward)) * tan_half_fov;
+        m_pixel_angle = 2.0f * tan_half_fov * m_inv_height;
+    }
+
+    /// angle between the rays through neighbouring pixels at the image center
+    auto pixel_angle() const -> float { return m_pixel_angle; }
+
+    /// @brief primary ray through the image plane point `(px, py)`
+    /// @param px horizontal pixel coordinate, `[0, width)`, can be fractional
+    /// @param py vertical pixel coordinate, `[0, height)`, top to bottom
+    auto generate_ray(float px, float py) const -> Ray {
+        float const sx = 2.0f * px * m_inv_width - 1.0f;
+        float const sy = 1.0f - 2.0f * py * m_inv_height;
+        return {m_origin, normalize(m_forward + m_right * sx + m_up * sy)};
+    }
+};
@@ -0,0 +1,330 @@
+#include "compact_geometry.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+#include "render/bvh.h"
+#include "render/scene.h"
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+/// smallest `e` with `2^e >= value`, within the exponents of normal floats
+auto exponent_for(float value) -> int {
+    if (!(value > 0.0f))
+        return -126;
+    int e;
+    float const mantissa = std::frexp(value, &e);
+    return std::clamp(mantissa == 0.5f ? e - 1 : e, -126, 127);
+}
+
+/// @brief planes of `boxes` along `axis` as multiples of `2^e` above `origin`, lower planes rounded
+/// down and upper ones up. The products are exact, so the decoded planes are exactly
+/// `origin + q * 2^e` however the decoding rounds.
+/// @return false if 8 bits aren't enough for that step
+auto quantize_axis(CompressedBvhNode &node, Aabb const *boxes, uint32_t used, int axis, int e)
+    -> bool {
+    float const origin = node.origin[axis];
+    float const scale  = std::ldexp(1.0f, e);
+    for (int slot = 0; slot < 8; ++slot) {
+        if (!(used & (1u << slot))) {
+            node.bounds[2 * axis][slot]     = 255;
+            node.bounds[2 * axis + 1][slot] = 0;
+            continue;
+        }
+        float const lo = boxes[slot].lo[axis];
+        float const hi = boxes[slot].hi[axis];
+
+        float q_lo = std::clamp(std::floor((lo - origin) / scale), 0.0f, 255.0f);
+        while (q_lo > 0.0f && origin + q_lo * scale > lo)
+            q_lo -= 1.0f;
+        float q_hi = std::ceil((hi - origin) / scale);
+        if (!(q_hi <= 255.0f))
+            return false;
+        q_hi = std::max(q_hi, 0.0f);
+        while (q_hi < 255.0f && origin + q_hi * scale < hi)
+            q_hi += 1.0f;
+        if (origin + q_hi * scale < hi)
+            return false;
+
+        node.bounds[2 * axis][slot]     = static_cast<uint8_t>(q_lo);
+        node.bounds[2 * axis + 1][slot] = static_cast<uint8_t>(q_hi);
+    }
+    return true;
+}
+
+void quantize_node(CompressedBvhNode &node, Aabb const &box, Aabb const *boxes) {
+    uint32_t const used = node.used();
+    for (int axis = 0; axis < 3; ++axis) {
+        node.origin[axis] = box.lo[axis];
+        int e = exponent_for((box.hi[axis] - box.lo[axis]) / 255.0f);
+        // the extent is rounded, one step more always covers it
+        while (!quantize_axis(node, boxes, used, axis, e) && e < 127)
+            ++e;
+        node.exponent[axis] = static_cast<int8_t>(e);
+    }
+}
+
+} // namespace
+
+auto CompactGeometry::build_nodes(Bvh const &bvh, std::vector<uint32_t> &order) -> bool {
+    auto const &binary = bvh.nodes();
+    auto const &prims  = bvh.prim_indices();
+    m_nodes.assign(1, CompressedBvhNode{});
+    order.clear();
+    order.reserve(prims.size());
+
+    if (binary[0].is_leaf()) {
+        // a single leaf, wrap it in a node of its own
+        if (binary[0].count > 255)
+            return false;
+        m_nodes[0].count[0] = static_cast<uint8_t>(binary[0].count);
+        order.assign(prims.begin(), prims.end());
+        return true;
+    }
+
+    // compressed nodes whose children still have to be gathered, with their binary node. The
+    // interior children of a node are allocated together, after their parent.
+    std::vector<std::pair<uint32_t, uint32_t>> stack{{0, 0}};
+    while (!stack.empty()) {
+        auto const [index, binary_index] = stack.back();
+        stack.pop_back();
+
+        // open up the interior child with the largest surface area until all slots are used, like
+        // `WideBvh::build()`
+        uint32_t children[8] = {binary[binary_index].offset, binary[binary_index].offset + 1};
+        int child_count      = 2;
+        while (child_count < 8) {
+            int best        = -1;
+            float best_area = -1.0f;
+            for (int i = 0; i < child_count; ++i) {
+                BvhNode const &c = binary[children[i]];
+                if (!c.is_leaf() && c.bounds.area() > best_area) {
+                    best      = i;
+                    best_area = c.bounds.area();
+                }
+            }
+            if (best < 0)
+                break;
+            uint32_t const opened   = binary[children[best]].offset;
+            children[best]          = opened;
+            children[child_count++] = opened + 1;
+        }
+
+        CompressedBvhNode &node = m_nodes[index];
+        node.child_base         = static_cast<uint32_t>(m_nodes.size());
+        node.prim_base          = static_cast<uint32_t>(order.size());
+        for (int slot = 0; slot < child_count; ++slot) {
+            BvhNode const &c = binary[children[slot]];
+            if (!c.is_leaf()) {
+                node.interior |= static_cast<uint8_t>(1u << slot);
+                continue;
+            }
+            if (c.count > 255)
+                return false;
+            node.count[slot] = static_cast<uint8_t>(c.count);
+            order.insert(order.end(), prims.begin() + c.offset, prims.begin() + c.offset + c.count);
+        }
+
+        // pushed in reverse, so the first child is gathered first and its subtree stays close
+        uint32_t const child_base = node.child_base;
+        uint32_t const interior   = node.interior;
+        m_nodes.resize(m_nodes.size() + std::popcount(interior));
+        for (int slot = child_count - 1; slot >= 0; --slot) {
+            if (interior & (1u << slot)) {
+                uint32_t const child = child_base + std::popcount(interior & ((1u << slot) - 1));
+                stack.emplace_back(child, children[slot]);
+            }
+        }
+    }
+    return true;
+}
+
+void CompactGeometry::build_triangles(ThreadPool &pool, Scene const &scene,
+                                      std::vector<uint32_t> const &order,
+                                      CompactSettings const &settings) {
+    size_t const triangle_count = order.size();
+
+    // number the vertices by first use, the triangles of a leaf and of the leaves next to it then
+    // reference vertices with close indices. Vertices no triangle uses are dropped.
+    std::vector<uint32_t> remap(scene.positions.size(), ~0u);
+    std::vector<uint32_t> indices(3 * triangle_count);
+    std::vector<Vec3> positions;
+    positions.reserve(scene.positions.size());
+    for (size_t i = 0; i < triangle_count; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            uint32_t const old = scene.indices[3 * size_t{order[i]} + c];
+            if (remap[old] == ~0u) {
+                remap[old] = static_cast<uint32_t>(positions.size());
+                positions.push_back(scene.positions[old]);
+            }
+            indices[3 * i + c] = remap[old];
+        }
+    }
+
+    m_index_blocks.resize((triangle_count + TRIANGLES_PER_BLOCK - 1) / TRIANGLES_PER_BLOCK);
+    auto index_range = [&](size_t block) {
+        size_t const first = 3 * block * TRIANGLES_PER_BLOCK;
+        return std::pair{first, std::min(first + 3 * TRIANGLES_PER_BLOCK, indices.size())};
+    };
+    pool.parallel_for(0, m_index_blocks.size(), 256, [&](size_t b) {
+        auto const [first, last] = index_range(b);
+        auto const [lo, hi]      = std::minmax_element(indices.begin() + first,
+                                                       indices.begin() + last);
+        m_index_blocks[b].base   = *lo;
+        m_index_blocks[b].offset = *hi - *lo > 0xffffu ? EXACT : 0;
+    });
+    size_t narrow_count = 0;
+    size_t wide_count   = 0;
+    for (size_t b = 0; b < m_index_blocks.size(); ++b) {
+        auto const [first, last] = index_range(b);
+        IndexBlock &block        = m_index_blocks[b];
+        if (block.offset & EXACT) {
+            block.offset = EXACT | static_cast<uint32_t>(wide_count);
+            wide_count += last - first;
+        } else {
+            block.offset = static_cast<uint32_t>(narrow_count);
+            narrow_count += last - first;
+        }
+    }
+    m_narrow_indices.resize(narrow_count);
+    m_wide_indices.resize(wide_count);
+    pool.parallel_for(0, m_index_blocks.size(), 256, [&](size_t b) {
+        auto const [first, last] = index_range(b);
+        IndexBlock const &block  = m_index_blocks[b];
+        if (block.offset & EXACT) {
+            std::copy(indices.begin() + first, indices.begin() + last,
+                      m_wide_indices.begin() + (block.offset & ~EXACT));
+            return;
+        }
+        uint16_t *narrow = m_narrow_indices.data() + block.offset;
+        for (size_t i = first; i < last; ++i)
+            narrow[i - first] = static_cast<uint16_t>(indices[i] - block.base);
+    });
+
+    // steps are powers of two, so decoding a position is exact whether or not it is fused
+    Aabb const &scene_bounds = scene.bvh.nodes()[0].bounds;
+    float const max_step     = settings.position_tolerance * length(scene_bounds.extent());
+
+    m_vertex_blocks.resize((positions.size() + VERTICES_PER_BLOCK - 1) / VERTICES_PER_BLOCK);
+    auto vertex_range = [&](size_t block) {
+        size_t const first = block * VERTICES_PER_BLOCK;
+        return std::pair{first, std::min(first + VERTICES_PER_BLOCK, positions.size())};
+    };
+    pool.parallel_for(0, m_vertex_blocks.size(), 64, [&](size_t b) {
+        auto const [first, last] = vertex_range(b);
+        Aabb box;
+        for (size_t i = first; i < last; ++i)
+            box.extend(positions[i]);
+        VertexBlock &block = m_vertex_blocks[b];
+        block.origin       = box.lo;
+        for (int axis = 0; axis < 3; ++axis) {
+            float const extent = box.hi[axis] - box.lo[axis];
+            block.step[axis]   = std::ldexp(1.0f, exponent_for(extent / 65535.0f));
+        }
+        bool const quantize = settings.quantize_positions && max_component(block.step) <= max_step;
+        block.offset        = quantize ? 0 : EXACT;
+    });
+    size_t quantized_count = 0;
+    size_t exact_count     = 0;
+    for (size_t b = 0; b < m_vertex_blocks.size(); ++b) {
+        auto const [first, last] = vertex_range(b);
+        VertexBlock &block       = m_vertex_blocks[b];
+        if (block.offset & EXACT) {
+            block.offset = EXACT | static_cast<uint32_t>(exact_count);
+            exact_count += last - first;
+        } else {
+            block.offset = static_cast<uint32_t>(quantized_count);
+            quantized_count += last - first;
+        }
+    }
+    m_quantized.resize(3 * quantized_count);
+    m_exact_positions.resize(exact_count);
+    pool.parallel_for(0, m_vertex_blocks.size(), 64, [&](size_t b) {
+        auto const [first, last] = vertex_range(b);
+        VertexBlock const &block = m_vertex_blocks[b];
+        if (block.offset & EXACT) {
+            std::copy(positions.begin() + first, positions.begin() + last,
+                      m_exact_positions.begin() + (block.offset & ~EXACT));
+            return;
+        }
+        uint16_t *q = m_quantized.data() + 3 * size_t{block.offset};
+        for (size_t i = first; i < last; ++i) {
+            for (int axis = 0; axis < 3; ++axis) {
+                float const steps = std::round((positions[i][axis] - block.origin[axis]) /
+                                               block.step[axis]);
+                *q++              = static_cast<uint16_t>(std::clamp(steps, 0.0f, 65535.0f));
+            }
+        }
+    });
+}
+
+void CompactGeometry::fit_bounds(ThreadPool &pool) {
+    size_t const node_count = m_nodes.size();
+    std::vector<std::array<Aabb, 8>> slot_bounds(node_count);
+    std::vector<Aabb> node_bounds(node_count);
+
+    // the boxes are fit to the triangles as they are stored, quantized or not
+    pool.parallel_for(0, node_count, 256, [&](size_t i) {
+        CompressedBvhNode const &node = m_nodes[i];
+        uint32_t first                = node.prim_base;
+        for (int slot = 0; slot < 8; ++slot) {
+            for (uint32_t t = first; t < first + node.count[slot]; ++t) {
+                for (int c = 0; c < 3; ++c)
+                    slot_bounds[i][slot].extend(vertex(t, c));
+            }
+            first += node.count[slot];
+        }
+    });
+    // children have higher indices than their parents
+    for (size_t i = node_count; i-- > 0;) {
+        CompressedBvhNode const &node = m_nodes[i];
+        for (int slot = 0; slot < 8; ++slot) {
+            if (node.interior & (1u << slot))
+                slot_bounds[i][slot] = node_bounds[node.child(slot)];
+            node_bounds[i].extend(slot_bounds[i][slot]);
+        }
+    }
+    pool.parallel_for(0, node_count, 256, [&](size_t i) {
+        quantize_node(m_nodes[i], node_bounds[i], slot_bounds[i].data());
+    });
+    m_bounds = node_bounds[0];
+}
+
+auto CompactGeometry::build(ThreadPool &pool, Scene const &scene, CompactSettings const &settings)
+    -> std::vector<uint32_t> {
+    PROFILE_SCOPE("compact");
+    *this = {};
+    std::vector<uint32_t> order;
+    if (scene.bvh.empty())
+        return order;
+    if (!build_nodes(scene.bvh, order)) {
+        spdlog::warn("BVH has leaves with more than 255 triangles, it can't be compressed");
+        *this = {};
+        return {};
+    }
+    build_triangles(pool, scene, order, settings);
+    fit_bounds(pool);
+    return order;
+}
+
+auto CompactGeometry::quantized_vertex_share() const -> float {
+    size_t const count = vertex_count();
+    return count ? static_cast<float>(m_quantized.size() / 3) / static_cast<float>(count) : 0.0f;
+}
+
+auto CompactGeometry::narrow_index_share() const -> float {
+    size_t const count = m_narrow_indices.size() + m_wide_indices.size();
+    return count ? static_cast<float>(m_narrow_indices.size()) / static_cast<float>(count) : 0.0f;
+}
+
+auto CompactGeometry::memory_bytes() const -> size_t {
+    return m_nodes.size() * sizeof(CompressedBvhNode) +
+           m_index_blocks.size() * sizeof(IndexBlock) + m_narrow_indices.size() * sizeof(uint16_t) +
+           m_wide_indices.size() * sizeof(uint32_t) + m_vertex_blocks.size() * sizeof(VertexBlock) +
+           m_quantized.size() * sizeof(uint16_t) + m_exact_positions.size() * sizeof(Vec3);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "render/math.h"
+
+class Bvh;
+class ThreadPool;
+struct Scene;
+
+struct CompactSettings {
+    /// store vertex positions as 16 bit offsets within blocks of vertices instead of floats
+    bool quantize_positions = true;
+    /// largest quantization step a block of vertices may get, relative to the diagonal of the
+    /// scene bounds. Blocks that are spread out further keep float positions.
+    float position_tolerance = 1.0e-5f;
+};
+
+/// 8-wide BVH node whose child boxes are stored with 8 bits per plane, relative to the node's own
+/// box. Planes are rounded outwards, so a child box may be a bit larger than its content but never
+/// smaller, and hits are decided by the exact triangle test.
+///
+/// Children are not addressed individually: the interior children of a node are stored next to
+/// each other, as are the triangles of its leaf children, both in slot order.
+struct alignas(16) CompressedBvhNode {
+    /// lower corner of the node's box, plane `q` of axis `a` lies at `origin[a] + q * 2^exponent[a]`
+    float origin[3];
+    int8_t exponent[3];
+    /// bit `i` set: slot `i` is an interior node
+    uint8_t interior;
+    /// node index of the first interior child
+    uint32_t child_base;
+    /// first triangle of the first leaf child
+    uint32_t prim_base;
+    /// triangles of leaf slots, `0` for interior and unused slots
+    uint8_t count[8];
+    /// per child planes: lo.x, hi.x, lo.y, hi.y, lo.z, hi.z
+    uint8_t bounds[6][8];
+
+    /// bit `i` set: slot `i` holds a child
+    auto used() const -> uint32_t {
+        uint32_t mask = interior;
+        for (int slot = 0; slot < 8; ++slot)
+            mask |= count[slot] > 0 ? 1u << slot : 0u;
+        return mask;
+    }
+    auto child(int slot) const -> uint32_t {
+        return child_base + static_cast<uint32_t>(std::popcount(interior & ((1u << slot) - 1)));
+    }
+    auto first_prim(int slot) const -> uint32_t {
+        uint32_t first = prim_base;
+        for (int i = 0; i < slot; ++i)
+            first += count[i];
+        return first;
+    }
+    /// distance between neighbouring planes of `axis`
+    auto scale(int axis) const -> float {
+        return std::bit_cast<float>(static_cast<uint32_t>(exponent[axis] + 127) << 23);
+    }
+    /// decoded box of the child in `slot`
+    auto child_bounds(int slot) const -> Aabb {
+        Aabb box;
+        for (int axis = 0; axis < 3; ++axis) {
+            float const lo = static_cast<float>(bounds[2 * axis][slot]);
+            float const hi = static_cast<float>(bounds[2 * axis + 1][slot]);
+            box.lo[axis]   = origin[axis] + lo * scale(axis);
+            box.hi[axis]   = origin[axis] + hi * scale(axis);
+        }
+        return box;
+    }
+};
+static_assert(sizeof(CompressedBvhNode) == 80, "CompressedBvhNode should be 80 bytes");
+
+/// Memory saving form of a scene's triangles and BVH for scenes that would not fit otherwise,
+/// see `Scene::make_compact()`.
+///
+/// - the BVH is made of `CompressedBvhNode`s, 80 bytes per 8 children instead of 32 bytes per
+///   binary node plus 4 bytes per triangle of leaf references
+/// - triangles are stored in the order of the leaves, vertices are numbered by their first use
+///   in that order, which keeps the indices of neighbouring triangles close together. Blocks of
+///   64 triangles store them as 16 bit offsets from the smallest, blocks where they are too far
+///   apart keep 32 bit indices.
+/// - with `CompactSettings::quantize_positions` blocks of 256 vertices store 16 bit offsets
+///   within the bounds of the block. The geometry that is traced and shaded is the quantized one,
+///   shared vertices stay shared so meshes stay watertight, and the node boxes are computed from
+///   the quantized triangles.
+///
+/// Compact geometry is static, it can't be refit.
+class CompactGeometry {
+  public:
+    static constexpr size_t TRIANGLES_PER_BLOCK = 64;
+    static constexpr size_t VERTICES_PER_BLOCK  = 256;
+
+  private:
+    /// marks blocks that are stored with full precision
+    static constexpr uint32_t EXACT = 0x80000000u;
+
+    struct IndexBlock {
+        /// smallest vertex index of the block
+        uint32_t base;
+        /// first entry in `m_narrow_indices`, or in `m_wide_indices` with `EXACT` set
+        uint32_t offset;
+    };
+    struct VertexBlock {
+        Vec3 origin;
+        Vec3 step;
+        /// first vertex in `m_quantized` (three values each), or in `m_exact_positions` with
+        /// `EXACT` set
+        uint32_t offset;
+    };
+
+    std::vector<CompressedBvhNode> m_nodes;
+    Aabb m_bounds;
+
+    std::vector<IndexBlock> m_index_blocks;
+    std::vector<uint16_t> m_narrow_indices;
+    std::vector<uint32_t> m_wide_indices;
+
+    std::vector<VertexBlock> m_vertex_blocks;
+    std::vector<uint16_t> m_quantized;
+    std::vector<Vec3> m_exact_positions;
+
+    auto build_nodes(Bvh const &bvh, std::vector<uint32_t> &order) -> bool;
+    void build_triangles(ThreadPool &pool, Scene const &scene, std::vector<uint32_t> const &order,
+                         CompactSettings const &settings);
+    void fit_bounds(ThreadPool &pool);
+
+  public:
+    /// @brief builds the compact form of `scene`, whose BVH must have been built
+    /// @return the triangles of `scene` in their new order, `result[i]` became triangle `i`.
+    /// Empty if the tree can't be compressed (a leaf with more than 255 triangles).
+    auto build(ThreadPool &pool, Scene const &scene, CompactSettings const &settings)
+        -> std::vector<uint32_t>;
+
+    auto empty() const -> bool { return m_nodes.empty(); }
+    auto nodes() const -> std::vector<CompressedBvhNode> const & { return m_nodes; }
+    auto bounds() const -> Aabb const & { return m_bounds; }
+
+    auto vertex_index(size_t triangle, int corner) const -> uint32_t {
+        IndexBlock const &block = m_index_blocks[triangle / TRIANGLES_PER_BLOCK];
+        size_t const i          = 3 * (triangle % TRIANGLES_PER_BLOCK) + corner;
+        if (block.offset & EXACT)
+            return m_wide_indices[(block.offset & ~EXACT) + i];
+        return block.base + m_narrow_indices[block.offset + i];
+    }
+
+    auto position(uint32_t vertex) const -> Vec3 {
+        VertexBlock const &block = m_vertex_blocks[vertex / VERTICES_PER_BLOCK];
+        size_t const i           = vertex % VERTICES_PER_BLOCK;
+        if (block.offset & EXACT)
+            return m_exact_positions[(block.offset & ~EXACT) + i];
+        uint16_t const *q = m_quantized.data() + 3 * (block.offset + i);
+        return block.origin + Vec3{static_cast<float>(q[0]), static_cast<float>(q[1]),
+                                   static_cast<float>(q[2])} *
+                                  block.step;
+    }
+
+    auto vertex(size_t triangle, int corner) const -> Vec3 {
+        return position(vertex_index(triangle, corner));
+    }
+
+    auto vertex_count() const -> size_t {
+        return m_quantized.size() / 3 + m_exact_positions.size();
+    }
+
+    /// share of the vertices stored as 16 bit offsets, and of the triangles with 16 bit indices
+    auto quantized_vertex_share() const -> float;
+    auto narrow_index_share() const -> float;
+
+    /// bytes of nodes, indices and positions
+    auto memory_bytes() const -> size_t;
+};
@@ -0,0 +1,273 @@
+#include "denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#ifdef RT_X86
+#include <immintrin.h>
+#endif
+
+#include "utils/profiler.h"
+
+namespace {
+
+/// taps of the 5x5 kernel are the outer product of this
+constexpr float KERNEL[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+/// albedo is clamped to this so black surfaces don't divide by zero
+constexpr float MIN_ALBEDO = 1.0e-3f;
+
+struct PassInput {
+    int width, height;
+    /// pixels between taps
+    int step;
+    float inv_sigma_color_sq;
+    float sigma_depth;
+    float const *r, *g, *b;
+    float const *nx, *ny, *nz, *depth;
+    float *out_r, *out_g, *out_b;
+};
+
+/// filters the pixel at `(x, y)`, taps outside the image are skipped
+void filter_pixel(PassInput const &in, int x, int y) {
+    size_t const p   = static_cast<size_t>(y) * in.width + x;
+    float sum_weight = 0.0f;
+    float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
+    for (int ky = 0; ky < 5; ++ky) {
+        int const qy = y + (ky - 2) * in.step;
+        if (qy < 0 || qy >= in.height)
+            continue;
+        for (int kx = 0; kx < 5; ++kx) {
+            int const qx = x + (kx - 2) * in.step;
+            if (qx < 0 || qx >= in.width)
+                continue;
+            size_t const q = static_cast<size_t>(qy) * in.width + qx;
+
+            float const dr = in.r[p] - in.r[q];
+            float const dg = in.g[p] - in.g[q];
+            float const db = in.b[p] - in.b[q];
+            float const dc = (dr * dr + dg * dg + db * db) * in.inv_sigma_color_sq;
+            float const dd = std::abs(in.depth[p] - in.depth[q]) /
+                             (in.sigma_depth * std::max(in.depth[p], in.depth[q]) + 1.0e-4f);
+
+            float const dnx = in.nx[p] - in.nx[q];
+            float const dny = in.ny[p] - in.ny[q];
+            float const dnz = in.nz[p] - in.nz[q];
+            // cosine of the angle between unit normals, to the power of 128
+            float wn = std::max(0.0f, 1.0f - 0.5f * (dnx * dnx + dny * dny + dnz * dnz));
+            for (int i = 0; i < 7; ++i)
+                wn *= wn;
+
+            float const w = KERNEL[ky] * KERNEL[kx] * std::exp(-(dc + dd)) * wn;
+            sum_weight += w;
+            sum_r      += w * in.r[q];
+            sum_g      += w * in.g[q];
+            sum_b      += w * in.b[q];
+        }
+    }
+    // the center tap always has a positive weight
+    in.out_r[p] = sum_r / sum_weight;
+    in.out_g[p] = sum_g / sum_weight;
+    in.out_b[p] = sum_b / sum_weight;
+}
+
+#ifdef RT_X86
+
+/// `e^x` for `x <= 0`, relative error below 1e-6
+RT_TARGET("avx2,fma") auto exp_negative(__m256 x) -> __m256 {
+    x              = _mm256_max_ps(x, _mm256_set1_ps(-87.0f));
+    __m256 const n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    // x - n * ln(2) in two steps to keep the precision
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r        = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+    __m256 p = _mm256_set1_ps(1.0f / 720.0f);
+    p        = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 120.0f));
+    p        = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 24.0f));
+    p        = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 6.0f));
+    p        = _mm256_fmadd_ps(p, r, _mm256_set1_ps(0.5f));
+    p        = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f));
+    p        = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f));
+
+    __m256i const e = _mm256_slli_epi32(
+        _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+/// `filter_pixel()` for the 8 pixels starting at `(x, y)`, all taps must be inside the image
+RT_TARGET("avx2,fma") void filter_pixels_avx2(PassInput const &in, int x, int y) {
+    size_t const p    = static_cast<size_t>(y) * in.width + x;
+    __m256 const pr   = _mm256_loadu_ps(in.r + p);
+    __m256 const pg   = _mm256_loadu_ps(in.g + p);
+    __m256 const pb   = _mm256_loadu_ps(in.b + p);
+    __m256 const pnx  = _mm256_loadu_ps(in.nx + p);
+    __m256 const pny  = _mm256_loadu_ps(in.ny + p);
+    __m256 const pnz  = _mm256_loadu_ps(in.nz + p);
+    __m256 const pd   = _mm256_loadu_ps(in.depth + p);
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const one  = _mm256_set1_ps(1.0f);
+    __m256 const half = _mm256_set1_ps(0.5f);
+    __m256 const abs  = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    __m256 const inv_sigma_color_sq = _mm256_set1_ps(in.inv_sigma_color_sq);
+    __m256 const sigma_depth        = _mm256_set1_ps(in.sigma_depth);
+
+    __m256 sum_weight = zero;
+    __m256 sum_r = zero, sum_g = zero, sum_b = zero;
+    for (int ky = 0; ky < 5; ++ky) {
+        for (int kx = 0; kx < 5; ++kx) {
+            ptrdiff_t const offset =
+                static_cast<ptrdiff_t>((ky - 2) * in.step) * in.width + (kx - 2) * in.step;
+            size_t const q = p + offset;
+
+            __m256 const qr = _mm256_loadu_ps(in.r + q);
+            __m256 const qg = _mm256_loadu_ps(in.g + q);
+            __m256 const qb = _mm256_loadu_ps(in.b + q);
+            __m256 const dr = _mm256_sub_ps(pr, qr);
+            __m256 const dg = _mm256_sub_ps(pg, qg);
+            __m256 const db = _mm256_sub_ps(pb, qb);
+            __m256 dc       = _mm256_mul_ps(dr, dr);
+            dc              = _mm256_fmadd_ps(dg, dg, dc);
+            dc              = _mm256_fmadd_ps(db, db, dc);
+            dc              = _mm256_mul_ps(dc, inv_sigma_color_sq);
+
+            __m256 const qd = _mm256_loadu_ps(in.depth + q);
+            // an approximate reciprocal is plenty for a weight
+            __m256 const dd = _mm256_mul_ps(
+                _mm256_and_ps(_mm256_sub_ps(pd, qd), abs),
+                _mm256_rcp_ps(_mm256_fmadd_ps(sigma_depth, _mm256_max_ps(pd, qd),
+                                              _mm256_set1_ps(1.0e-4f))));
+
+            __m256 const dnx = _mm256_sub_ps(pnx, _mm256_loadu_ps(in.nx + q));
+            __m256 const dny = _mm256_sub_ps(pny, _mm256_loadu_ps(in.ny + q));
+            __m256 const dnz = _mm256_sub_ps(pnz, _mm256_loadu_ps(in.nz + q));
+            __m256 dn        = _mm256_mul_ps(dnx, dnx);
+            dn               = _mm256_fmadd_ps(dny, dny, dn);
+            dn               = _mm256_fmadd_ps(dnz, dnz, dn);
+            __m256 wn        = _mm256_max_ps(zero, _mm256_fnmadd_ps(half, dn, one));
+            for (int i = 0; i < 7; ++i)
+                wn = _mm256_mul_ps(wn, wn);
+
+            __m256 const h = _mm256_set1_ps(KERNEL[ky] * KERNEL[kx]);
+            __m256 const w = _mm256_mul_ps(
+                _mm256_mul_ps(h, exp_negative(_mm256_sub_ps(zero, _mm256_add_ps(dc, dd)))), wn);
+            sum_weight = _mm256_add_ps(sum_weight, w);
+            sum_r      = _mm256_fmadd_ps(w, qr, sum_r);
+            sum_g      = _mm256_fmadd_ps(w, qg, sum_g);
+            sum_b      = _mm256_fmadd_ps(w, qb, sum_b);
+        }
+    }
+    __m256 const inv_weight = _mm256_div_ps(one, sum_weight);
+    _mm256_storeu_ps(in.out_r + p, _mm256_mul_ps(sum_r, inv_weight));
+    _mm256_storeu_ps(in.out_g + p, _mm256_mul_ps(sum_g, inv_weight));
+    _mm256_storeu_ps(in.out_b + p, _mm256_mul_ps(sum_b, inv_weight));
+}
+
+#endif
+
+void filter_row(PassInput const &in, int y, bool avx2) {
+    int x = 0;
+#ifdef RT_X86
+    // the vector kernel doesn't check bounds, it only runs where all taps are inside
+    int const border = 2 * in.step;
+    if (avx2 && y >= border && y < in.height - border) {
+        for (; x < border; ++x)
+            filter_pixel(in, x, y);
+        for (; x + 8 <= in.width - border; x += 8)
+            filter_pixels_avx2(in, x, y);
+    }
+#else
+    (void)avx2;
+#endif
+    for (; x < in.width; ++x)
+        filter_pixel(in, x, y);
+}
+
+} // namespace
+
+Denoiser::Denoiser(ThreadPool &pool) : m_pool(pool) { set_simd_level(default_simd_level()); }
+
+void Denoiser::set_simd_level(SimdLevel level) {
+    CpuFeatures const &cpu = cpu_features();
+    m_avx2                 = level >= SimdLevel::Avx2 && cpu.avx2 && cpu.fma;
+}
+
+void Denoiser::denoise(Framebuffer &image, DenoiserSettings const &settings, bool replace_color) {
+    PROFILE_SCOPE("denoise");
+    int const width    = image.width();
+    int const height   = image.height();
+    auto const pixels  = static_cast<size_t>(width) * height;
+    int const passes   = std::clamp(settings.iterations, 1, MAX_DENOISER_ITERATIONS);
+    // rows per task, about 4k pixels
+    size_t const grain = std::max<size_t>(1, 4096 / std::max(width, 1));
+    if (pixels == 0)
+        return;
+
+    for (Planes *planes : {&m_color[0], &m_color[1], &m_albedo}) {
+        planes->r.resize(pixels);
+        planes->g.resize(pixels);
+        planes->b.resize(pixels);
+    }
+    for (auto *plane : {&m_nx, &m_ny, &m_nz, &m_depth})
+        plane->resize(pixels);
+
+    // demodulate and split into planes
+    m_pool.parallel_for(0, static_cast<size_t>(height), grain, [&](size_t y) {
+        for (size_t i = y * width; i < (y + 1) * width; ++i) {
+            Vec3 const c    = image.color_data()[i];
+            Vec3 const a    = image.albedo_data()[i];
+            Vec3 const n    = image.normal_data()[i];
+            m_albedo.r[i]   = std::max(a.x, MIN_ALBEDO);
+            m_albedo.g[i]   = std::max(a.y, MIN_ALBEDO);
+            m_albedo.b[i]   = std::max(a.z, MIN_ALBEDO);
+            m_color[0].r[i] = c.x / m_albedo.r[i];
+            m_color[0].g[i] = c.y / m_albedo.g[i];
+            m_color[0].b[i] = c.z / m_albedo.b[i];
+            m_nx[i]         = n.x;
+            m_ny[i]         = n.y;
+            m_nz[i]         = n.z;
+            m_depth[i]      = image.depth_data()[i];
+        }
+    });
+
+    float sigma_color = std::max(settings.sigma_color, 1.0e-4f);
+    for (int pass = 0; pass < passes; ++pass) {
+        Planes const &src = m_color[pass & 1];
+        Planes &dst       = m_color[(pass + 1) & 1];
+
+        PassInput in;
+        in.width              = width;
+        in.height             = height;
+        in.step               = 1 << pass;
+        in.inv_sigma_color_sq = 1.0f / (sigma_color * sigma_color);
+        in.sigma_depth        = std::max(settings.sigma_depth, 1.0e-4f);
+        in.r                  = src.r.data();
+        in.g                  = src.g.data();
+        in.b                  = src.b.data();
+        in.nx                 = m_nx.data();
+        in.ny                 = m_ny.data();
+        in.nz                 = m_nz.data();
+        in.depth              = m_depth.data();
+        in.out_r              = dst.r.data();
+        in.out_g              = dst.g.data();
+        in.out_b              = dst.b.data();
+        bool const last = pass == passes - 1;
+
+        m_pool.parallel_for(0, static_cast<size_t>(height), grain, [&](size_t y) {
+            filter_row(in, static_cast<int>(y), m_avx2);
+            if (!last)
+                return;
+            // remodulate right away while the row is still in the cache
+            for (size_t i = y * width; i < (y + 1) * width; ++i) {
+                Vec3 const c = {dst.r[i] * m_albedo.r[i], dst.g[i] * m_albedo.g[i],
+                                dst.b[i] * m_albedo.b[i]};
+                image.rgba8_data()[i] = pack_rgba8(c);
+                if (replace_color)
+                    image.color_data()[i] = c;
+            }
+        });
+        sigma_color *= 0.5f;
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "render/framebuffer.h"
+#include "utils/cpu_features.h"
+#include "utils/thread_pool.h"
+
+/// passes beyond this reach further than any sensible kernel, more are clamped to it
+inline constexpr int MAX_DENOISER_ITERATIONS = 8;
+
+struct DenoiserSettings {
+    bool enabled = false;
+    /// filter passes, pass `i` reaches `2^(i + 1)` pixels in every direction, at most
+    /// `MAX_DENOISER_ITERATIONS`
+    int iterations = 5;
+    /// color difference at which neighbours stop contributing, halved every pass as the image
+    /// gets smoother
+    float sigma_color = 1.0f;
+    /// depth difference, relative to the depth of the pixel, at which neighbours stop contributing
+    float sigma_depth = 0.1f;
+
+    auto operator==(DenoiserSettings const &) const -> bool = default;
+};
+
+/// Edge-aware à-trous wavelet filter for noisy path traced images, guided by the first hit albedo,
+/// normal and depth the renderer keeps in the `Framebuffer`.
+///
+/// The color is divided by the albedo first so texture detail isn't blurred, then filtered with a
+/// 5x5 B-spline kernel whose taps are spread `2^i` pixels apart in pass `i`. Neighbours across
+/// depth, normal or color edges get little weight. Rows are filtered in parallel on the pool, with
+/// an AVX2 kernel for 8 pixels at a time where the CPU has it.
+class Denoiser {
+    ThreadPool &m_pool;
+    bool m_avx2 = false;
+
+    /// structure of arrays copies of the image, two color planes to ping-pong between passes
+    struct Planes {
+        std::vector<float> r, g, b;
+    };
+    Planes m_color[2];
+    Planes m_albedo;
+    std::vector<float> m_nx, m_ny, m_nz, m_depth;
+
+  public:
+    explicit Denoiser(ThreadPool &pool);
+
+    /// uses the AVX2 kernel if `level` allows it and the CPU has it, the scalar one otherwise
+    void set_simd_level(SimdLevel level);
+
+    /// @brief filters the color of `image` and writes the result to its display version
+    /// @param replace_color also overwrite the color, otherwise it stays as rendered (needed
+    /// when the color is a progressive estimate that more samples get added to)
+    void denoise(Framebuffer &image, DenoiserSettings const &settings, bool replace_color);
+};
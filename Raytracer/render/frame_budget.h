@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+struct FrameBudgetSettings {
+    /// off renders every frame at full resolution and one sample per pixel
+    bool enabled = true;
+    /// render time per frame the controller aims for while the camera moves
+    float target_ms = 33.3f;
+    /// lowest fraction of the full width/height a frame is rendered at
+    float min_scale = 0.25f;
+    /// samples per pixel are raised up to this when full resolution is cheap enough
+    int max_spp = 8;
+    /// the camera counts as moving for this long after it last changed
+    float settle_ms = 150.0f;
+
+    auto operator==(FrameBudgetSettings const &) const -> bool = default;
+};
+
+/// Picks the render resolution and samples per pixel of the next frame from the render times of
+/// the previous ones, so interactive frames stay within `FrameBudgetSettings::target_ms`.
+///
+/// Render time is modelled as proportional to the number of samples, `scale^2 * spp`. Resolution
+/// goes down first, samples per pixel only go up once full resolution fits into the budget.
+class FrameBudget {
+    /// smoothed render time of one sample per pixel at full resolution
+    float m_cost_ms = 0.0f;
+    float m_scale   = 1.0f;
+    int m_spp       = 1;
+
+  public:
+    /// fraction of the full width/height to render the next frame at, a multiple of 1/16
+    auto scale() const -> float { return m_scale; }
+    auto spp() const -> int { return m_spp; }
+
+    /// forgets the measured cost, e.g. after the scene changed
+    void reset() {
+        m_cost_ms = 0.0f;
+        m_scale   = 1.0f;
+        m_spp     = 1;
+    }
+
+    /// @brief updates the cost model with a frame rendered at `scale()`/`spp()` and picks the
+    /// resolution and samples of the next one
+    void update(FrameBudgetSettings const &settings, float render_ms) {
+        float const cost = render_ms / (m_scale * m_scale * static_cast<float>(m_spp));
+        // the first frame is taken as is, later ones smooth out noise from the OS and the UI
+        m_cost_ms = m_cost_ms > 0.0f ? 0.5f * (m_cost_ms + cost) : cost;
+
+        float const budget = settings.target_ms / std::max(m_cost_ms, 1.0e-3f);
+        if (budget >= 1.0f) {
+            m_scale = 1.0f;
+            m_spp   = std::clamp(static_cast<int>(budget), 1, std::max(settings.max_spp, 1));
+        } else {
+            // rounded down so the budget holds, coarse steps so the framebuffer isn't resized
+            // for every bit of noise
+            float const min_scale = std::clamp(settings.min_scale, 0.0625f, 1.0f);
+            float const scale     = std::floor(std::sqrt(budget) * 16.0f) / 16.0f;
+            m_scale               = std::clamp(scale, min_scale, 1.0f);
+            m_spp                 = 1;
+        }
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "render/math.h"
+
+/// linear radiance image plus its 8 bit RGBA display version, rows top to bottom. Also keeps the
+/// albedo, geometric normal and distance of the first hit of every pixel, averaged over its samples,
+/// which guide the denoiser.
+class Framebuffer {
+    int m_width  = 0;
+    int m_height = 0;
+    std::vector<Vec3> m_color;
+    std::vector<uint32_t> m_rgba8;
+    std::vector<Vec3> m_albedo;
+    std::vector<Vec3> m_normal;
+    std::vector<float> m_depth;
+    /// where the display version goes, `m_rgba8` or memory of the display (mapped pixel buffers)
+    uint32_t *m_display = nullptr;
+
+  public:
+    void resize(int width, int height) {
+        m_width  = width;
+        m_height = height;
+        m_color.assign(static_cast<size_t>(width) * height, Vec3{0.0f});
+        m_rgba8.assign(static_cast<size_t>(width) * height, 0xff000000u);
+        m_albedo.assign(static_cast<size_t>(width) * height, Vec3{0.0f});
+        m_normal.assign(static_cast<size_t>(width) * height, Vec3{0.0f});
+        m_depth.assign(static_cast<size_t>(width) * height, 0.0f);
+        m_display = m_rgba8.data();
+    }
+
+    /// @brief writes the display version to `pixels` instead of the own buffer from now on,
+    /// `nullptr` switches back. `pixels` must hold `width * height` values and has to be written
+    /// completely by the next render, old content isn't carried over.
+    void set_display_target(uint32_t *pixels) { m_display = pixels ? pixels : m_rgba8.data(); }
+
+    /// @brief takes over size, radiance, display version and features of `other`, keeping the
+    /// own display target. Reuses the buffers if the size didn't change.
+    void copy_from(Framebuffer const &other) {
+        if (m_width != other.m_width || m_height != other.m_height)
+            resize(other.m_width, other.m_height);
+        m_color  = other.m_color;
+        m_albedo = other.m_albedo;
+        m_normal = other.m_normal;
+        m_depth  = other.m_depth;
+        std::copy_n(other.m_display, static_cast<size_t>(m_width) * m_height, m_display);
+    }
+
+    auto width() const -> int { return m_width; }
+    auto height() const -> int { return m_height; }
+
+    auto color(int x, int y) -> Vec3 & { return m_color[static_cast<size_t>(y) * m_width + x]; }
+    auto color(int x, int y) const -> Vec3 const & {
+        return m_color[static_cast<size_t>(y) * m_width + x];
+    }
+    auto rgba8(int x, int y) -> uint32_t & {
+        return m_display[static_cast<size_t>(y) * m_width + x];
+    }
+
+    /// first hit features, zero normal and depth where the camera ray escaped
+    auto albedo(int x, int y) -> Vec3 & { return m_albedo[static_cast<size_t>(y) * m_width + x]; }
+    auto normal(int x, int y) -> Vec3 & { return m_normal[static_cast<size_t>(y) * m_width + x]; }
+    auto depth(int x, int y) -> float & { return m_depth[static_cast<size_t>(y) * m_width + x]; }
+
+    auto color_data() const -> Vec3 const * { return m_color.data(); }
+    auto color_data() -> Vec3 * { return m_color.data(); }
+    auto rgba8_data() const -> uint32_t const * { return m_display; }
+    auto rgba8_data() -> uint32_t * { return m_display; }
+    auto albedo_data() const -> Vec3 const * { return m_albedo.data(); }
+    auto normal_data() const -> Vec3 const * { return m_normal.data(); }
+    auto depth_data() const -> float const * { return m_depth.data(); }
+};
+
+/// clamps and gamma encodes a linear value to 8 bit sRGB-ish
+inline auto to_srgb8(float v) -> uint32_t {
+    v = std::clamp(v, 0.0f, 1.0f);
+    v = v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint32_t>(v * 255.0f + 0.5f);
+}
+
+/// packs a linear color into the RGBA8 layout OpenGL expects with `GL_RGBA, GL_UNSIGNED_BYTE`
+inline auto pack_rgba8(Vec3 c) -> uint32_t {
+    return to_srgb8(c.x) | (to_srgb8(c.y) << 8) | (to_srgb8(c.z) << 16) | 0xff000000u;
+}
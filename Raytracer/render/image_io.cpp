@@ -0,0 +1,542 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#include "render/tonemap.h"
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+struct FileCloser {
+    void operator()(std::FILE *file) const { std::fclose(file); }
+};
+using File = std::unique_ptr<std::FILE, FileCloser>;
+
+auto open_for_writing(std::filesystem::path const &path) -> File {
+    File file(std::fopen(path.string().c_str(), "wb"));
+    if (!file)
+        spdlog::error("couldn't open {} for writing", path.string());
+    return file;
+}
+
+auto finish(File file, std::filesystem::path const &path) -> bool {
+    bool const ok = !std::ferror(file.get()) && std::fclose(file.release()) == 0;
+    if (!ok)
+        spdlog::error("couldn't write {}", path.string());
+    return ok;
+}
+
+/// calls `f(i)` for every block `i < count`, in parallel if there is a pool
+template <typename F> void for_each_block(ThreadPool *pool, size_t count, F &&f) {
+    if (pool) {
+        pool->parallel_for(0, count, 1, f);
+    } else {
+        for (size_t i = 0; i < count; ++i)
+            f(i);
+    }
+}
+
+void put_u32_be(std::vector<uint8_t> &out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+template <typename T> void put_le(std::vector<uint8_t> &out, T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    if constexpr (std::endian::native == std::endian::big)
+        std::reverse(std::begin(bytes), std::end(bytes));
+    out.insert(out.end(), std::begin(bytes), std::end(bytes));
+}
+
+void put_string(std::vector<uint8_t> &out, std::string_view text) {
+    out.insert(out.end(), text.begin(), text.end());
+    out.push_back(0);
+}
+
+/// Raw deflate of `size` bytes, continuing the stream whose last bytes are `dictionary`. Blocks
+/// other than the `last` one end on a byte boundary (`Z_SYNC_FLUSH`), so the outputs of all
+/// blocks concatenate into one valid deflate stream, the way pigz compresses in parallel.
+auto deflate_block(uint8_t const *data, size_t size, uint8_t const *dictionary,
+                   size_t dictionary_size, bool last, std::vector<uint8_t> &out) -> bool {
+    z_stream stream{};
+    // negative window bits: no zlib header or checksum, they are added for the whole stream
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) !=
+        Z_OK)
+        return false;
+    if (dictionary_size > 0)
+        deflateSetDictionary(&stream, dictionary, static_cast<uInt>(dictionary_size));
+
+    // the bound covers the final block, the sync flush adds an empty stored block
+    out.resize(deflateBound(&stream, static_cast<uLong>(size)) + 16);
+    stream.next_in   = const_cast<uint8_t *>(data);
+    stream.avail_in  = static_cast<uInt>(size);
+    stream.next_out  = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+    int const result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    bool const ok    = last ? result == Z_STREAM_END : result == Z_OK && stream.avail_in == 0;
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return ok;
+}
+
+/// appends a PNG chunk, `data` being the payload
+void put_png_chunk(std::vector<uint8_t> &out, char const (&type)[5], uint8_t const *data,
+                   size_t size) {
+    put_u32_be(out, static_cast<uint32_t>(size));
+    size_t const start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    uLong const crc = crc32(0, out.data() + start, static_cast<uInt>(out.size() - start));
+    put_u32_be(out, static_cast<uint32_t>(crc));
+}
+
+/// Filters row `y` of RGB8 `pixels` for PNG, picking the filter with the smallest sum of
+/// absolute (signed) residuals. `out` gets the filter type and `row_bytes` residuals.
+void filter_png_row(uint8_t const *pixels, size_t row_bytes, int y, uint8_t *out) {
+    constexpr size_t BPP = 3;
+    uint8_t const *row   = pixels + static_cast<size_t>(y) * row_bytes;
+    uint8_t const *up    = y > 0 ? row - row_bytes : nullptr;
+
+    auto predict = [&](int filter, size_t i) -> uint8_t {
+        int const a = i >= BPP ? row[i - BPP] : 0;
+        int const b = up ? up[i] : 0;
+        int const c = up && i >= BPP ? up[i - BPP] : 0;
+        switch (filter) {
+        case 1:
+            return static_cast<uint8_t>(a);
+        case 2:
+            return static_cast<uint8_t>(b);
+        case 3:
+            return static_cast<uint8_t>((a + b) / 2);
+        case 4: {
+            int const p  = a + b - c;
+            int const pa = std::abs(p - a);
+            int const pb = std::abs(p - b);
+            int const pc = std::abs(p - c);
+            return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+        }
+        default:
+            return 0;
+        }
+    };
+
+    int best_filter   = 0;
+    uint64_t best_cost = UINT64_MAX;
+    for (int filter = 0; filter < 5; ++filter) {
+        uint64_t cost = 0;
+        for (size_t i = 0; i < row_bytes && cost < best_cost; ++i) {
+            auto const residual  = static_cast<int8_t>(row[i] - predict(filter, i));
+            cost                += static_cast<uint64_t>(std::abs(residual));
+        }
+        if (cost < best_cost) {
+            best_cost   = cost;
+            best_filter = filter;
+        }
+    }
+    out[0] = static_cast<uint8_t>(best_filter);
+    for (size_t i = 0; i < row_bytes; ++i)
+        out[i + 1] = static_cast<uint8_t>(row[i] - predict(best_filter, i));
+}
+
+/// OpenEXR ZIP compression of one block: bytes split into even and odd halves, delta coded,
+/// zlib compressed. Blocks that don't get smaller are stored as they are.
+void compress_exr_block(std::vector<uint8_t> const &raw, std::vector<uint8_t> &scratch,
+                        std::vector<uint8_t> &out) {
+    size_t const size = raw.size();
+    scratch.resize(size);
+    size_t const half = (size + 1) / 2;
+    for (size_t i = 0; i < size; ++i)
+        scratch[(i & 1) ? half + i / 2 : i / 2] = raw[i];
+    for (size_t i = size; i-- > 1;)
+        scratch[i] = static_cast<uint8_t>(scratch[i] - scratch[i - 1] + 128);
+
+    uLongf compressed_size = compressBound(static_cast<uLong>(size));
+    out.resize(compressed_size);
+    if (compress2(out.data(), &compressed_size, scratch.data(), static_cast<uLong>(size),
+                  Z_DEFAULT_COMPRESSION) != Z_OK ||
+        compressed_size >= size) {
+        out = raw;
+        return;
+    }
+    out.resize(compressed_size);
+}
+
+/// the next number of a PPM header, skipping whitespace and comments
+auto read_header_number(std::FILE *file, int &value) -> bool {
+    int c = std::fgetc(file);
+    while (c == '#' || std::isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF)
+                c = std::fgetc(file);
+        }
+        c = std::fgetc(file);
+    }
+    if (c == EOF || !std::isdigit(c))
+        return false;
+    value = 0;
+    for (; std::isdigit(c); c = std::fgetc(file)) {
+        if (value > 1'000'000)
+            return false;
+        value = 10 * value + (c - '0');
+    }
+    // exactly one whitespace character separates the header from the pixels
+    return std::isspace(c);
+}
+
+} // namespace
+
+auto read_ppm(std::filesystem::path const &path, int &width, int &height,
+              std::vector<uint32_t> &pixels) -> bool {
+    File file(std::fopen(path.string().c_str(), "rb"));
+    if (!file) {
+        spdlog::error("couldn't open {}", path.string());
+        return false;
+    }
+
+    char magic[2] = {};
+    int max_value = 0;
+    if (std::fread(magic, 1, 2, file.get()) != 2 || magic[0] != 'P' || magic[1] != '6' ||
+        !read_header_number(file.get(), width) || !read_header_number(file.get(), height) ||
+        !read_header_number(file.get(), max_value) || width <= 0 || height <= 0) {
+        spdlog::error("{} is not a binary PPM", path.string());
+        return false;
+    }
+    if (max_value != 255) {
+        spdlog::error("{} has {} levels per channel, only 8 bit PPMs are supported", path.string(),
+                      max_value + 1);
+        return false;
+    }
+
+    pixels.resize(static_cast<size_t>(width) * height);
+    std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+    for (int y = 0; y < height; ++y) {
+        if (std::fread(row.data(), 1, row.size(), file.get()) != row.size()) {
+            spdlog::error("{} is truncated", path.string());
+            return false;
+        }
+        uint32_t *rgba = pixels.data() + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x) {
+            rgba[x] = row[3 * x] | (uint32_t{row[3 * x + 1]} << 8) |
+                      (uint32_t{row[3 * x + 2]} << 16) | 0xff000000u;
+        }
+    }
+    return true;
+}
+
+auto write_ppm(std::filesystem::path const &path, Framebuffer const &image) -> bool {
+    auto file = open_for_writing(path);
+    if (!file)
+        return false;
+
+    int const width  = image.width();
+    int const height = image.height();
+    std::fprintf(file.get(), "P6\n%d %d\n255\n", width, height);
+
+    std::vector<uint8_t> row(static_cast<size_t>(width) * 3);
+    for (int y = 0; y < height; ++y) {
+        uint32_t const *rgba = image.rgba8_data() + static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x) {
+            row[3 * x + 0] = static_cast<uint8_t>(rgba[x]);
+            row[3 * x + 1] = static_cast<uint8_t>(rgba[x] >> 8);
+            row[3 * x + 2] = static_cast<uint8_t>(rgba[x] >> 16);
+        }
+        std::fwrite(row.data(), 1, row.size(), file.get());
+    }
+    return finish(std::move(file), path);
+}
+
+auto write_pfm(std::filesystem::path const &path, Framebuffer const &image) -> bool {
+    auto file = open_for_writing(path);
+    if (!file)
+        return false;
+
+    // a negative scale marks little endian data, rows are stored bottom to top
+    int const width  = image.width();
+    int const height = image.height();
+    std::fprintf(file.get(), "PF\n%d %d\n-1.0\n", width, height);
+    for (int y = height - 1; y >= 0; --y) {
+        Vec3 const *row = image.color_data() + static_cast<size_t>(y) * width;
+        static_assert(sizeof(Vec3) == 3 * sizeof(float));
+        std::fwrite(row, sizeof(Vec3), static_cast<size_t>(width), file.get());
+    }
+    return finish(std::move(file), path);
+}
+
+auto read_pfm(std::filesystem::path const &path, int &width, int &height,
+              std::vector<Vec3> &pixels) -> bool {
+    File file(std::fopen(path.string().c_str(), "rb"));
+    if (!file) {
+        spdlog::error("couldn't open {}", path.string());
+        return false;
+    }
+
+    char magic[2] = {};
+    float scale   = 0.0f;
+    if (std::fread(magic, 1, 2, file.get()) != 2 || magic[0] != 'P' || magic[1] != 'F' ||
+        !read_header_number(file.get(), width) || !read_header_number(file.get(), height) ||
+        std::fscanf(file.get(), "%f", &scale) != 1 || !std::isspace(std::fgetc(file.get())) ||
+        width <= 0 || height <= 0 || scale == 0.0f) {
+        spdlog::error("{} is not a color PFM", path.string());
+        return false;
+    }
+
+    // a negative scale marks little endian data, rows are stored bottom to top
+    bool const swap = (scale < 0.0f) != (std::endian::native == std::endian::little);
+    pixels.resize(static_cast<size_t>(width) * height);
+    for (int y = height - 1; y >= 0; --y) {
+        Vec3 *row = pixels.data() + static_cast<size_t>(y) * width;
+        if (std::fread(row, sizeof(Vec3), static_cast<size_t>(width), file.get()) !=
+            static_cast<size_t>(width)) {
+            spdlog::error("{} is truncated", path.string());
+            return false;
+        }
+        if (swap) {
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    auto const bits = std::byteswap(std::bit_cast<uint32_t>(row[x][c]));
+                    row[x][c]       = std::bit_cast<float>(bits);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+auto write_png(std::filesystem::path const &path, Framebuffer const &image,
+               ImageWriteOptions const &options) -> bool {
+    PROFILE_SCOPE("encode png");
+    int const width        = image.width();
+    int const height       = image.height();
+    size_t const row_bytes = static_cast<size_t>(width) * 3;
+
+    std::vector<uint8_t> rgb(row_bytes * height);
+    uint32_t const *rgba = image.rgba8_data();
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) {
+        rgb[3 * i + 0] = static_cast<uint8_t>(rgba[i]);
+        rgb[3 * i + 1] = static_cast<uint8_t>(rgba[i] >> 8);
+        rgb[3 * i + 2] = static_cast<uint8_t>(rgba[i] >> 16);
+    }
+
+    // Rows are filtered and deflated in bands of about 256 KB. Every band continues the stream
+    // of the one before, with its last 32 KB as dictionary, so the result is close to
+    // compressing it all in one go.
+    size_t const filtered_row = row_bytes + 1;
+    int const rows_per_band   = std::max(1, static_cast<int>((256 << 10) / filtered_row));
+    size_t const band_count   = (static_cast<size_t>(height) + rows_per_band - 1) / rows_per_band;
+    std::vector<uint8_t> filtered(filtered_row * height);
+
+    struct Band {
+        std::vector<uint8_t> deflated;
+        uLong checksum = 0;
+        size_t size    = 0;
+        bool ok        = false;
+    };
+    std::vector<Band> bands(band_count);
+
+    // the dictionary of a band is filtered data of the band before, filter everything first
+    for_each_block(options.pool, band_count, [&](size_t band) {
+        int const first = static_cast<int>(band) * rows_per_band;
+        int const last  = std::min(height, first + rows_per_band);
+        for (int y = first; y < last; ++y)
+            filter_png_row(rgb.data(), row_bytes, y, filtered.data() + y * filtered_row);
+    });
+    for_each_block(options.pool, band_count, [&](size_t band) {
+        size_t const begin      = band * rows_per_band * filtered_row;
+        size_t const end        = std::min(filtered.size(), begin + rows_per_band * filtered_row);
+        size_t const dictionary = std::min<size_t>(begin, 32 << 10);
+        uint8_t const *data     = filtered.data() + begin;
+
+        Band &out    = bands[band];
+        out.size     = end - begin;
+        out.checksum = adler32(adler32(0, nullptr, 0), data, static_cast<uInt>(out.size));
+        out.ok       = deflate_block(data, out.size, data - dictionary, dictionary,
+                                     band + 1 == band_count, out.deflated);
+    });
+    if (!std::all_of(bands.begin(), bands.end(), [](Band const &band) { return band.ok; })) {
+        spdlog::error("couldn't compress {}", path.string());
+        return false;
+    }
+
+    // zlib stream: header (deflate, 32 KB window, default level), the bands, Adler-32
+    std::vector<uint8_t> stream = {0x78, 0x9c};
+    uLong checksum              = adler32(0, nullptr, 0);
+    for (auto const &band : bands) {
+        checksum = adler32_combine(checksum, band.checksum, static_cast<z_off_t>(band.size));
+        stream.insert(stream.end(), band.deflated.begin(), band.deflated.end());
+    }
+    put_u32_be(stream, static_cast<uint32_t>(checksum));
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> header;
+    put_u32_be(header, static_cast<uint32_t>(width));
+    put_u32_be(header, static_cast<uint32_t>(height));
+    // 8 bit RGB, deflate, adaptive filtering, not interlaced
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+    put_png_chunk(png, "IHDR", header.data(), header.size());
+    // the pixels are encoded with the sRGB transfer function, perceptual rendering intent
+    uint8_t const intent = 0;
+    put_png_chunk(png, "sRGB", &intent, 1);
+    put_png_chunk(png, "IDAT", stream.data(), stream.size());
+    put_png_chunk(png, "IEND", nullptr, 0);
+
+    PROFILE_SCOPE("write file");
+    auto file = open_for_writing(path);
+    if (!file)
+        return false;
+    std::fwrite(png.data(), 1, png.size(), file.get());
+    return finish(std::move(file), path);
+}
+
+auto write_exr(std::filesystem::path const &path, Framebuffer const &image,
+               ImageWriteOptions const &options) -> bool {
+    PROFILE_SCOPE("encode exr");
+    int const width  = image.width();
+    int const height = image.height();
+
+    // channels have to be sorted by name, interleaved values are read with a stride
+    struct Channel {
+        char const *name;
+        float const *values;
+        size_t stride;
+        bool half;
+    };
+    auto const *color  = reinterpret_cast<float const *>(image.color_data());
+    auto const *albedo = reinterpret_cast<float const *>(image.albedo_data());
+    auto const *normal = reinterpret_cast<float const *>(image.normal_data());
+    bool const half    = options.exr_half;
+
+    std::vector<Channel> channels = {
+        {"B", color + 2, 3, half}, {"G", color + 1, 3, half}, {"R", color, 3, half}};
+    if (options.exr_layers) {
+        channels.insert(channels.end(), {{"Z", image.depth_data(), 1, false},
+                                         {"albedo.B", albedo + 2, 3, half},
+                                         {"albedo.G", albedo + 1, 3, half},
+                                         {"albedo.R", albedo, 3, half},
+                                         {"normal.X", normal, 3, half},
+                                         {"normal.Y", normal + 1, 3, half},
+                                         {"normal.Z", normal + 2, 3, half}});
+    }
+
+    std::vector<uint8_t> header = {0x76, 0x2f, 0x31, 0x01};
+    // version 2, single part scanline file with short names
+    put_le<int32_t>(header, 2);
+    auto attribute = [&](std::string_view name, std::string_view type, size_t size) {
+        put_string(header, name);
+        put_string(header, type);
+        put_le(header, static_cast<int32_t>(size));
+    };
+    size_t channel_list_size = 1;
+    for (auto const &channel : channels)
+        channel_list_size += std::strlen(channel.name) + 1 + 16;
+    attribute("channels", "chlist", channel_list_size);
+    for (auto const &channel : channels) {
+        put_string(header, channel.name);
+        // pixel type, linear flag and reserved bytes, x and y sampling
+        put_le<int32_t>(header, channel.half ? 1 : 2);
+        put_le<uint32_t>(header, 0);
+        put_le<int32_t>(header, 1);
+        put_le<int32_t>(header, 1);
+    }
+    header.push_back(0);
+    attribute("compression", "compression", 1);
+    header.push_back(3); // ZIP, blocks of 16 scanlines
+    for (char const *window : {"dataWindow", "displayWindow"}) {
+        attribute(window, "box2i", 16);
+        put_le<int32_t>(header, 0);
+        put_le<int32_t>(header, 0);
+        put_le<int32_t>(header, width - 1);
+        put_le<int32_t>(header, height - 1);
+    }
+    attribute("lineOrder", "lineOrder", 1);
+    header.push_back(0); // increasing y
+    attribute("pixelAspectRatio", "float", 4);
+    put_le(header, 1.0f);
+    attribute("screenWindowCenter", "v2f", 8);
+    put_le(header, 0.0f);
+    put_le(header, 0.0f);
+    attribute("screenWindowWidth", "float", 4);
+    put_le(header, 1.0f);
+    header.push_back(0);
+
+    constexpr int BLOCK_LINES = 16;
+    size_t const block_count  = (static_cast<size_t>(height) + BLOCK_LINES - 1) / BLOCK_LINES;
+    std::vector<std::vector<uint8_t>> blocks(block_count);
+    for_each_block(options.pool, block_count, [&](size_t block) {
+        int const first = static_cast<int>(block) * BLOCK_LINES;
+        int const last  = std::min(height, first + BLOCK_LINES);
+
+        // every line holds all values of the first channel, then all of the second and so on
+        std::vector<uint8_t> raw;
+        std::vector<float> line(static_cast<size_t>(width));
+        std::vector<uint16_t> halves(static_cast<size_t>(width));
+        for (int y = first; y < last; ++y) {
+            for (auto const &channel : channels) {
+                float const *values =
+                    channel.values + static_cast<size_t>(y) * width * channel.stride;
+                for (int x = 0; x < width; ++x)
+                    line[x] = values[x * channel.stride];
+                uint8_t const *bytes = reinterpret_cast<uint8_t const *>(line.data());
+                size_t size          = line.size() * sizeof(float);
+                if (channel.half) {
+                    convert_to_half(line.data(), halves.data(), line.size(), options.simd);
+                    bytes = reinterpret_cast<uint8_t const *>(halves.data());
+                    size  = halves.size() * sizeof(uint16_t);
+                }
+                raw.insert(raw.end(), bytes, bytes + size);
+            }
+        }
+
+        std::vector<uint8_t> scratch, compressed;
+        compress_exr_block(raw, scratch, compressed);
+        auto &out = blocks[block];
+        put_le<int32_t>(out, first);
+        put_le(out, static_cast<int32_t>(compressed.size()));
+        out.insert(out.end(), compressed.begin(), compressed.end());
+    });
+
+    // the offset table points at every block, which follow right after it
+    uint64_t offset = header.size() + block_count * sizeof(uint64_t);
+    for (auto const &block : blocks) {
+        put_le(header, offset);
+        offset += block.size();
+    }
+
+    PROFILE_SCOPE("write file");
+    auto file = open_for_writing(path);
+    if (!file)
+        return false;
+    std::fwrite(header.data(), 1, header.size(), file.get());
+    for (auto const &block : blocks)
+        std::fwrite(block.data(), 1, block.size(), file.get());
+    return finish(std::move(file), path);
+}
+
+auto write_image(std::filesystem::path const &path, Framebuffer const &image,
+                 ImageWriteOptions const &options) -> bool {
+    auto const extension = path.extension();
+    if (extension == ".ppm")
+        return write_ppm(path, image);
+    if (extension == ".pfm")
+        return write_pfm(path, image);
+    if (extension == ".png")
+        return write_png(path, image, options);
+    if (extension == ".exr")
+        return write_exr(path, image, options);
+    spdlog::error("unknown image format '{}', use .ppm, .pfm, .png or .exr", extension.string());
+    return false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "render/framebuffer.h"
+#include "utils/cpu_features.h"
+
+class ThreadPool;
+
+/// how `write_image()` encodes the formats that have a choice
+struct ImageWriteOptions {
+    /// EXR color and feature channels as 16 bit half floats instead of 32 bit floats, depth is
+    /// always stored as float
+    bool exr_half = true;
+    /// EXR also gets the denoiser features as layers: `Z` (depth), `albedo.RGB` and `normal.XYZ`
+    bool exr_layers = false;
+    /// instruction set of the float to half conversion
+    SimdLevel simd = default_simd_level();
+    /// compresses the blocks of PNG and EXR files in parallel if set, the calling thread helps.
+    /// The files come out the same either way.
+    ThreadPool *pool = nullptr;
+};
+
+/// @brief writes the display version of `image` as binary PPM (8 bit sRGB)
+auto write_ppm(std::filesystem::path const &path, Framebuffer const &image) -> bool;
+
+/// @brief writes the linear radiance of `image` as little endian PFM (32 bit float RGB)
+auto write_pfm(std::filesystem::path const &path, Framebuffer const &image) -> bool;
+
+/// @brief reads a binary PPM with 8 bit channels into RGBA8 pixels laid out like
+/// `Framebuffer::rgba8()`
+/// @return false if the file can't be read or is no such PPM, the reason is logged
+auto read_ppm(std::filesystem::path const &path, int &width, int &height,
+              std::vector<uint32_t> &pixels) -> bool;
+
+/// @brief reads a PFM with three channels into linear radiance, rows top to bottom like
+/// `Framebuffer::color()`
+/// @return false if the file can't be read or is no such PFM, the reason is logged
+auto read_pfm(std::filesystem::path const &path, int &width, int &height,
+              std::vector<Vec3> &pixels) -> bool;
+
+/// @brief writes the display version of `image` as 8 bit sRGB PNG, deflate compressed with
+/// adaptive per-row filters
+auto write_png(std::filesystem::path const &path, Framebuffer const &image,
+               ImageWriteOptions const &options = {}) -> bool;
+
+/// @brief writes the linear radiance of `image`, and optionally its features, as scanline
+/// OpenEXR with ZIP compression
+auto write_exr(std::filesystem::path const &path, Framebuffer const &image,
+               ImageWriteOptions const &options = {}) -> bool;
+
+/// @brief writes `image` in the format given by the extension of `path`, `.ppm`, `.pfm`, `.png`
+/// or `.exr`
+/// @return false if the format is unknown or the file can't be written, the reason is logged
+auto write_image(std::filesystem::path const &path, Framebuffer const &image,
+                 ImageWriteOptions const &options = {}) -> bool;
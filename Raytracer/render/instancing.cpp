@@ -0,0 +1,256 @@
+#include "instancing.h"
+
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+#include "render/scene.h"
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
+
+auto Transform::translation(Vec3 offset) -> Transform {
+    Transform t;
+    t.m[0][3] = offset.x;
+    t.m[1][3] = offset.y;
+    t.m[2][3] = offset.z;
+    return t;
+}
+
+auto Transform::scaling(float scale) -> Transform {
+    Transform t;
+    for (int i = 0; i < 3; ++i)
+        t.m[i][i] = scale;
+    return t;
+}
+
+auto Transform::rotation_y(float angle) -> Transform {
+    float const c = std::cos(angle);
+    float const s = std::sin(angle);
+    Transform t;
+    t.m[0][0] = c;
+    t.m[0][2] = s;
+    t.m[2][0] = -s;
+    t.m[2][2] = c;
+    return t;
+}
+
+auto Transform::operator*(Transform const &b) const -> Transform {
+    Transform r;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j)
+            r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+        r.m[i][3] += m[i][3];
+    }
+    return r;
+}
+
+auto Transform::inverse() const -> Transform {
+    // inverse of the linear part from its cofactors, the translation is undone afterwards
+    float const c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    float const c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    float const c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    float const det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    if (std::fabs(det) < 1.0e-12f)
+        return {};
+
+    float const inv_det = 1.0f / det;
+    Transform r;
+    r.m[0][0] = c00 * inv_det;
+    r.m[1][0] = c01 * inv_det;
+    r.m[2][0] = c02 * inv_det;
+    r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+    r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+    r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+    r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+    r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+    r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+    Vec3 const t = r.vector({m[0][3], m[1][3], m[2][3]});
+    r.m[0][3]    = -t.x;
+    r.m[1][3]    = -t.y;
+    r.m[2][3]    = -t.z;
+    return r;
+}
+
+auto Transform::bounds(Aabb const &box) const -> Aabb {
+    Aabb result;
+    if (box.is_empty())
+        return result;
+    for (int corner = 0; corner < 8; ++corner) {
+        result.extend(point({corner & 1 ? box.hi.x : box.lo.x, corner & 2 ? box.hi.y : box.lo.y,
+                             corner & 4 ? box.hi.z : box.lo.z}));
+    }
+    return result;
+}
+
+// ---- InstanceLayer ------------------------------------------------------------------------------
+
+auto InstanceLayer::add_mesh(std::shared_ptr<Scene> mesh) -> uint32_t {
+    m_meshes.push_back(std::move(mesh));
+    return static_cast<uint32_t>(m_meshes.size() - 1);
+}
+
+auto InstanceLayer::add_instance(uint32_t mesh, Transform const &object_to_world) -> uint32_t {
+    if (mesh >= m_meshes.size()) {
+        spdlog::error("instance of unknown mesh {}, there are {}", mesh, m_meshes.size());
+        return ~0u;
+    }
+    Instance instance;
+    instance.mesh = mesh;
+    m_instances.push_back(instance);
+    auto const index = static_cast<uint32_t>(m_instances.size() - 1);
+    set_transform(index, object_to_world);
+    return index;
+}
+
+void InstanceLayer::set_transform(uint32_t instance, Transform const &object_to_world) {
+    Instance &target       = m_instances[instance];
+    target.object_to_world = object_to_world;
+    target.world_to_object = object_to_world.inverse();
+}
+
+auto InstanceLayer::instance_bounds(Instance const &instance) const -> Aabb {
+    Aabb const bounds = m_meshes[instance.mesh]->bounds();
+    if (bounds.is_empty())
+        return {};
+    return instance.object_to_world.bounds(bounds);
+}
+
+void InstanceLayer::build(ThreadPool &pool) {
+    PROFILE_SCOPE("tlas");
+    std::vector<Aabb> bounds(m_instances.size());
+    pool.parallel_for(0, m_instances.size(), 1024, [&](size_t i) {
+        m_instances[i].bounds = instance_bounds(m_instances[i]);
+        bounds[i]             = m_instances[i].bounds;
+    });
+    m_bvh.build(pool, std::move(bounds));
+}
+
+void InstanceLayer::refit(ThreadPool &pool) {
+    PROFILE_SCOPE("tlas refit");
+    std::vector<Aabb> bounds(m_instances.size());
+    pool.parallel_for(0, m_instances.size(), 1024, [&](size_t i) {
+        m_instances[i].bounds = instance_bounds(m_instances[i]);
+        bounds[i]             = m_instances[i].bounds;
+    });
+    if (m_bvh.prim_indices().size() != m_instances.size())
+        m_bvh.build(pool, std::move(bounds));
+    else
+        m_bvh.refit(bounds);
+}
+
+auto InstanceLayer::intersect(uint32_t index, Ray const &ray, Hit &hit) const -> bool {
+    Instance const &instance = m_instances[index];
+    Ray const local{instance.world_to_object.point(ray.origin),
+                    instance.world_to_object.vector(ray.direction), ray.t_min, ray.t_max};
+    Hit local_hit;
+    local_hit.t = hit.t;
+    if (!m_meshes[instance.mesh]->intersect(local, local_hit))
+        return false;
+    hit          = local_hit;
+    hit.instance = index;
+    return true;
+}
+
+auto InstanceLayer::intersect(Ray const &ray, Hit &hit) const -> bool {
+    auto const &nodes = m_bvh.nodes();
+    if (nodes.empty())
+        return false;
+
+    struct Entry {
+        uint32_t node;
+        float t;
+    };
+    Entry stack[traversal_stack_size(2)];
+    int size = 0;
+
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+    float t_near;
+    if (!intersect_aabb(nodes[0].bounds, ray.origin, inv_dir, ray.t_min, hit.t, t_near))
+        return false;
+
+    bool found          = false;
+    uint32_t node_index = 0;
+    while (true) {
+        BvhNode const &node = nodes[node_index];
+        if (node.is_leaf()) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                if (intersect(m_bvh.prim_indices()[i], ray, hit))
+                    found = true;
+            }
+        } else {
+            uint32_t near_child = node.offset;
+            uint32_t far_child  = node.offset + 1;
+            float t_a, t_b;
+            bool const hit_a = intersect_aabb(nodes[near_child].bounds, ray.origin, inv_dir,
+                                              ray.t_min, hit.t, t_a);
+            bool const hit_b = intersect_aabb(nodes[far_child].bounds, ray.origin, inv_dir,
+                                              ray.t_min, hit.t, t_b);
+            if (hit_a && hit_b) {
+                if (t_b < t_a) {
+                    std::swap(near_child, far_child);
+                    std::swap(t_a, t_b);
+                }
+                stack[size++] = {far_child, t_b};
+                node_index    = near_child;
+                continue;
+            }
+            if (hit_a || hit_b) {
+                node_index = hit_a ? near_child : far_child;
+                continue;
+            }
+        }
+
+        while (size > 0 && stack[size - 1].t > hit.t)
+            --size;
+        if (size == 0)
+            break;
+        node_index = stack[--size].node;
+    }
+    return found;
+}
+
+auto InstanceLayer::occluded(Ray const &ray) const -> bool {
+    auto const &nodes = m_bvh.nodes();
+    if (nodes.empty())
+        return false;
+
+    uint32_t stack[traversal_stack_size(2)];
+    int size = 0;
+
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+    float t_near;
+    if (!intersect_aabb(nodes[0].bounds, ray.origin, inv_dir, ray.t_min, ray.t_max, t_near))
+        return false;
+
+    uint32_t node_index = 0;
+    while (true) {
+        BvhNode const &node = nodes[node_index];
+        if (node.is_leaf()) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                Instance const &instance = m_instances[m_bvh.prim_indices()[i]];
+                Ray const local{instance.world_to_object.point(ray.origin),
+                                instance.world_to_object.vector(ray.direction), ray.t_min,
+                                ray.t_max};
+                if (m_meshes[instance.mesh]->occluded(local))
+                    return true;
+            }
+        } else {
+            bool const hit_a = intersect_aabb(nodes[node.offset].bounds, ray.origin, inv_dir,
+                                              ray.t_min, ray.t_max, t_near);
+            bool const hit_b = intersect_aabb(nodes[node.offset + 1].bounds, ray.origin, inv_dir,
+                                              ray.t_min, ray.t_max, t_near);
+            if (hit_a && hit_b)
+                stack[size++] = node.offset + 1;
+            if (hit_a || hit_b) {
+                node_index = hit_a ? node.offset : node.offset + 1;
+                continue;
+            }
+        }
+
+        if (size == 0)
+            break;
+        node_index = stack[--size];
+    }
+    return false;
+}
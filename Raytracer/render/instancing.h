@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "render/bvh.h"
+#include "render/intersect.h"
+#include "render/math.h"
+
+class ThreadPool;
+struct Scene;
+
+/// affine transform, the upper 3x4 part of a 4x4 matrix acting on column vectors
+struct Transform {
+    float m[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+
+    static auto translation(Vec3 offset) -> Transform;
+    static auto scaling(float scale) -> Transform;
+    /// `angle` radians around the y axis
+    static auto rotation_y(float angle) -> Transform;
+
+    /// applies `b` first, then this transform
+    auto operator*(Transform const &b) const -> Transform;
+    /// the identity if the transform is singular
+    auto inverse() const -> Transform;
+
+    auto point(Vec3 p) const -> Vec3 {
+        return {m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]};
+    }
+    auto vector(Vec3 v) const -> Vec3 {
+        return {m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z};
+    }
+    /// multiplies `v` with the transposed linear part, which turns normals from object to world
+    /// space when applied with the inverse (world to object) transform
+    auto transposed_vector(Vec3 v) const -> Vec3 {
+        return {m[0][0] * v.x + m[1][0] * v.y + m[2][0] * v.z,
+                m[0][1] * v.x + m[1][1] * v.y + m[2][1] * v.z,
+                m[0][2] * v.x + m[1][2] * v.y + m[2][2] * v.z};
+    }
+    /// bounds of the transformed corners of `box`
+    auto bounds(Aabb const &box) const -> Aabb;
+};
+
+/// one placement of a mesh
+struct Instance {
+    uint32_t mesh = 0;
+    Transform object_to_world;
+    Transform world_to_object;
+    /// world space bounds of the transformed mesh
+    Aabb bounds;
+};
+
+/// Two-level acceleration structure: meshes with a BVH of their own (the bottom level) placed any
+/// number of times by instances, with a BVH over the instance bounds on top.
+///
+/// Rays are intersected with a mesh by moving them into its object space. Directions are not
+/// renormalised, so hit distances stay comparable between instances and the top level scene.
+///
+/// Moving instances only needs `refit()`, which recomputes the bounds of the instances and of the
+/// top level nodes without touching the meshes. Meshes whose vertices moved are refit on their
+/// own, see `Scene::refit_acceleration()`. Meshes can't contain instances themselves.
+class InstanceLayer {
+    std::vector<std::shared_ptr<Scene>> m_meshes;
+    std::vector<Instance> m_instances;
+    /// over `m_instances`
+    Bvh m_bvh;
+
+    auto instance_bounds(Instance const &instance) const -> Aabb;
+    /// intersects `ray` with `instance`, `hit` is only updated for a closer hit
+    auto intersect(uint32_t instance, Ray const &ray, Hit &hit) const -> bool;
+
+  public:
+    auto empty() const -> bool { return m_instances.empty(); }
+
+    /// @brief adds a mesh instances can refer to. Its acceleration structure has to be built
+    /// before `build()`, the layer shares ownership so one mesh can be placed in several scenes.
+    /// @return the id for `add_instance()`
+    auto add_mesh(std::shared_ptr<Scene> mesh) -> uint32_t;
+    auto add_instance(uint32_t mesh, Transform const &object_to_world) -> uint32_t;
+
+    /// takes effect with the next `refit()` or `build()`
+    void set_transform(uint32_t instance, Transform const &object_to_world);
+
+    auto meshes() const -> std::vector<std::shared_ptr<Scene>> const & { return m_meshes; }
+    auto instances() const -> std::vector<Instance> const & { return m_instances; }
+    auto instance(uint32_t index) const -> Instance const & { return m_instances[index]; }
+    auto mesh_of(uint32_t instance) const -> Scene const & {
+        return *m_meshes[m_instances[instance].mesh];
+    }
+
+    /// builds the top level BVH, after adding or removing instances
+    void build(ThreadPool &pool);
+    /// updates the top level after instances moved or meshes were refit, keeping its topology
+    void refit(ThreadPool &pool);
+
+    /// @brief closest hit along the world space `ray` that is nearer than `hit.t`
+    /// @return true if there is one, `hit.instance` tells which instance it is on
+    auto intersect(Ray const &ray, Hit &hit) const -> bool;
+    /// any hit along `ray`
+    auto occluded(Ray const &ray) const -> bool;
+};
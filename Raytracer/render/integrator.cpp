@@ -0,0 +1,112 @@
+#include "integrator.h"
+
+auto sample_light(Scene const &scene, Vec3 p, Vec3 n, Vec3 albedo, Sampler &sampler,
+                  Ray &shadow) -> Vec3 {
+    auto const light_count = scene.emissive_triangles.size();
+    if (light_count == 0)
+        return Vec3{0.0f};
+
+    // both numbers are drawn even without a light, so the later dimensions stay the same
+    float const u_light = sampler.next_1d();
+    auto const [u1, u2] = sampler.next_2d();
+
+    uint32_t light;
+    float pick_pmf;
+    if (!scene.light_bvh.empty()) {
+        light = scene.light_bvh.sample(p, n, u_light, pick_pmf);
+        if (light == LightBvh::NO_LIGHT)
+            return Vec3{0.0f};
+    } else {
+        auto const pick =
+            std::min(static_cast<size_t>(u_light * static_cast<float>(light_count)),
+                     light_count - 1);
+        light    = scene.emissive_triangles[pick];
+        pick_pmf = 1.0f / static_cast<float>(light_count);
+    }
+
+    // uniform point on the triangle
+    float const su = std::sqrt(u1);
+    float const b0 = 1.0f - su;
+    float const b1 = u2 * su;
+    Vec3 const p0  = scene.vertex(light, 0);
+    Vec3 const q =
+        p0 * (1.0f - b0 - b1) + scene.vertex(light, 1) * b0 + scene.vertex(light, 2) * b1;
+
+    Vec3 to_light     = q - p;
+    float const dist2 = dot(to_light, to_light);
+    float const dist  = std::sqrt(dist2);
+    to_light          = to_light / dist;
+    float const cos_p = dot(n, to_light);
+    float const cos_l = std::fabs(dot(scene.geometric_normal(light), to_light));
+    if (cos_p <= 0.0f || cos_l <= 0.0f)
+        return Vec3{0.0f};
+
+    shadow = Ray{p, to_light, EPSILON, dist * (1.0f - 1.0e-3f)};
+
+    // area pdf converted to solid angle, times the probability of picking the light
+    float const pdf = dist2 / (cos_l * scene.triangle_area(light)) * pick_pmf;
+    return scene.material(light).emission * albedo * (cos_p * INV_PI / pdf);
+}
+
+auto trace_path(Scene const &scene, Ray ray, Sampler &sampler, IntegratorSettings const &settings,
+                Hit const *primary_hit, float spread, uint64_t *rays) -> Vec3 {
+    Vec3 radiance{0.0f};
+    Vec3 throughput{1.0f};
+    // width of the ray cone, grows with the distance travelled
+    float footprint = 0.0f;
+    uint64_t traced = 0;
+
+    for (int depth = 0; depth < settings.max_depth; ++depth) {
+        Hit hit;
+        bool found;
+        if (depth == 0 && primary_hit) {
+            hit   = *primary_hit;
+            found = hit.is_valid();
+        } else {
+            found = scene.intersect(ray, hit);
+            ++traced;
+        }
+        if (!found) {
+            radiance += throughput * scene.background;
+            break;
+        }
+
+        Material const &material = scene.material(hit);
+        // emission is picked up by next event estimation on all bounces but the first, instanced
+        // meshes aren't sampled as lights so theirs counts wherever it is hit
+        if (depth == 0 || hit.instance != ~0u)
+            radiance += throughput * material.emission;
+
+        Vec3 const p = ray.origin + ray.direction * hit.t;
+        Vec3 n       = scene.geometric_normal(hit);
+        if (dot(n, ray.direction) > 0.0f)
+            n = -n;
+
+        footprint        += hit.t * spread;
+        Vec3 const albedo = scene.albedo(hit, footprint);
+        Ray shadow;
+        Vec3 const direct = sample_light(scene, p, n, albedo, sampler, shadow);
+        if (max_component(direct) > 0.0f) {
+            ++traced;
+            if (!scene.occluded(shadow))
+                radiance += throughput * direct;
+        }
+
+        // diffuse bounce, the cosine and pdf cancel out
+        throughput = throughput * albedo;
+        spread     = std::max(spread, DIFFUSE_SPREAD);
+        if (depth + 1 >= settings.rr_depth) {
+            float const survive = std::min(0.95f, max_component(throughput));
+            if (sampler.next_1d() >= survive)
+                break;
+            throughput = throughput / survive;
+        }
+
+        auto const [u1, u2] = sampler.next_2d();
+        ray                 = Ray{p, sample_cosine_hemisphere(n, u1, u2)};
+    }
+
+    if (rays)
+        *rays += traced;
+    return radiance;
+}
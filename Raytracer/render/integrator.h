@@ -0,0 +1,49 @@
+#pragma once
+
+#include "render/math.h"
+#include "render/sampler.h"
+#include "render/scene.h"
+
+struct IntegratorSettings {
+    int max_depth = 5;
+    /// paths are terminated with russian roulette from this bounce on
+    int rr_depth = 3;
+    /// trace tiles stage by stage with `WavefrontIntegrator` instead of path by path
+    bool wavefront = false;
+    /// where the random numbers of the paths come from
+    SamplerType sampler = SamplerType::Sobol;
+
+    auto operator==(IntegratorSettings const &) const -> bool = default;
+};
+
+/// diffuse bounces scatter over the whole hemisphere, so the cones of later bounces are wide and
+/// their texture lookups use coarse mip levels that touch few tiles
+inline constexpr float DIFFUSE_SPREAD = 0.2f;
+
+/// @brief unidirectional path tracer with next event estimation, diffuse materials only
+/// @param primary_hit the already traced first hit of `ray` (e.g. from a packet), if any
+/// @param spread angle of the cone around `ray` that the path stands for, e.g. the angle of a
+/// pixel for camera rays. Picks the mip level of texture lookups.
+/// @param rays if given, the number of rays traced (closest hit and shadow) is added to it
+/// @return the radiance arriving along `ray`
+auto trace_path(Scene const &scene, Ray ray, Sampler &sampler, IntegratorSettings const &settings,
+                Hit const *primary_hit = nullptr, float spread = 0.0f, uint64_t *rays = nullptr)
+    -> Vec3;
+
+/// @brief next event estimation towards one emissive triangle, picked by `Scene::light_bvh` in
+/// proportion to its estimated contribution (uniformly if the scene has no light BVH), without
+/// the visibility test
+/// @param shadow set to the ray that has to be unoccluded for the light to count
+/// @return the direct light at `p` if `shadow` is unoccluded, zero if no shadow ray is needed
+auto sample_light(Scene const &scene, Vec3 p, Vec3 n, Vec3 albedo, Sampler &sampler,
+                  Ray &shadow) -> Vec3;
+
+/// cosine weighted direction around `n`
+inline auto sample_cosine_hemisphere(Vec3 n, float u1, float u2) -> Vec3 {
+    float const r   = std::sqrt(u1);
+    float const phi = 2.0f * PI * u2;
+    Vec3 t, b;
+    orthonormal_basis(n, t, b);
+    return t * (r * std::cos(phi)) + b * (r * std::sin(phi)) +
+           n * std::sqrt(std::max(0.0f, 1.0f - u1));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "render/math.h"
+
+/// closest hit found so far along a ray
+struct Hit {
+    float t       = INF;
+    uint32_t prim = ~0u;
+    float u       = 0.0f;
+    float v       = 0.0f;
+    /// instance of `Scene::instances` the hit is on, `prim` is a triangle of its mesh then
+    uint32_t instance = ~0u;
+
+    auto is_valid() const -> bool { return prim != ~0u; }
+};
+
+/// Moeller-Trumbore ray/triangle test. Returns the distance in `t` and the barycentrics in `u, v`
+/// if the triangle is hit within `(ray.t_min, t_max)`.
+inline auto intersect_triangle(Ray const &ray, Vec3 p0, Vec3 p1, Vec3 p2, float t_max, float &t,
+                               float &u, float &v) -> bool {
+    Vec3 const e1  = p1 - p0;
+    Vec3 const e2  = p2 - p0;
+    Vec3 const pv  = cross(ray.direction, e2);
+    float const det = dot(e1, pv);
+    if (std::fabs(det) < 1.0e-12f)
+        return false;
+
+    float const inv_det = 1.0f / det;
+    Vec3 const tv       = ray.origin - p0;
+    u                   = dot(tv, pv) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    Vec3 const qv = cross(tv, e1);
+    v             = dot(ray.direction, qv) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    t = dot(e2, qv) * inv_det;
+    return t > ray.t_min && t < t_max;
+}
+
+/// slab test, `inv_dir` is the component-wise inverse of the ray direction. Returns the entry
+/// distance in `t_near`.
+inline auto intersect_aabb(Aabb const &box, Vec3 origin, Vec3 inv_dir, float t_min, float t_max,
+                           float &t_near) -> bool {
+    t_near      = t_min;
+    float t_far = t_max;
+    for (int axis = 0; axis < 3; ++axis) {
+        float const t0 = (box.lo[axis] - origin[axis]) * inv_dir[axis];
+        float const t1 = (box.hi[axis] - origin[axis]) * inv_dir[axis];
+        // 0 * inf = NaN for an origin on a face the ray runs parallel to, the ray touches the
+        // box and the axis doesn't constrain it
+        if (std::isnan(t0) || std::isnan(t1))
+            continue;
+        t_near = std::max(t_near, std::min(t0, t1));
+        t_far  = std::min(t_far, std::max(t0, t1));
+    }
+    return t_near <= t_far;
+}
@@ -0,0 +1,326 @@
+#include "light_bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#include "render/scene.h"
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+constexpr int MAX_BINS = 32;
+/// largest float below one, keeps remapped random numbers in [0, 1)
+constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+auto safe_sqrt(float x) -> float { return std::sqrt(std::max(0.0f, x)); }
+auto safe_acos(float x) -> float { return std::acos(std::clamp(x, -1.0f, 1.0f)); }
+
+// cos and sin of max(0, a - b) for angles in [0, pi], from their cosines and sines
+
+auto cos_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) -> float {
+    if (cos_a > cos_b)
+        return 1.0f;
+    return cos_a * cos_b + sin_a * sin_b;
+}
+
+auto sin_sub_clamped(float sin_a, float cos_a, float sin_b, float cos_b) -> float {
+    if (cos_a > cos_b)
+        return 0.0f;
+    return sin_a * cos_b - cos_a * sin_b;
+}
+
+/// bounds of one emissive triangle
+auto triangle_light(Scene const &scene, uint32_t triangle) -> LightBounds {
+    LightBounds light;
+    light.bounds = scene.triangle_bounds(triangle);
+    light.axis   = scene.geometric_normal(triangle);
+    light.power  = luminance(scene.material(triangle).emission) * scene.triangle_area(triangle);
+    return light;
+}
+
+struct BuildContext {
+    ThreadPool &pool;
+    LightBvhBuildSettings const &settings;
+    std::vector<uint32_t> const &triangles;
+    std::vector<LightBounds> lights;
+    std::vector<Vec3> centroids;
+    std::vector<uint32_t> indices;
+    std::vector<LightBvhNode> &nodes;
+    std::atomic<uint32_t> next_node{1};
+    TaskGroup tasks;
+
+    BuildContext(ThreadPool &pool, LightBvhBuildSettings const &settings,
+                 std::vector<uint32_t> const &triangles, std::vector<LightBvhNode> &nodes)
+        : pool(pool), settings(settings), triangles(triangles), nodes(nodes), tasks(pool) {}
+};
+
+/// @brief surface area orientation heuristic: power times the solid angle the light is sent to
+/// times the surface area of the bounds
+auto orientation_cost(LightBounds const &light) -> float {
+    if (light.is_empty())
+        return 0.0f;
+    float const cos_o   = light.cos_theta_o;
+    float const sin_o   = safe_sqrt(1.0f - cos_o * cos_o);
+    float const theta_o = safe_acos(cos_o);
+    float const theta_w = std::min(theta_o + 0.5f * PI, PI);
+    float const m_omega = 2.0f * PI * (1.0f - cos_o) +
+                          0.5f * PI *
+                              (2.0f * theta_w * sin_o - std::cos(theta_o - 2.0f * theta_w) -
+                               2.0f * theta_o * sin_o + cos_o);
+    return light.power * m_omega * light.bounds.area();
+}
+
+auto bin_of(Vec3 centroid, int axis, Aabb const &centroid_bounds, float scale, int bin_count)
+    -> int {
+    int const bin = static_cast<int>((centroid[axis] - centroid_bounds.lo[axis]) * scale);
+    return std::clamp(bin, 0, bin_count - 1);
+}
+
+/// @brief evaluates the cost of every bin boundary on every axis
+/// @return false if there is no split, when all centroids are on top of each other
+auto find_split(BuildContext &ctx, uint32_t begin, uint32_t end, Aabb const &bounds,
+                Aabb const &centroid_bounds, int &best_axis, int &best_split) -> bool {
+    int const bin_count  = ctx.settings.bin_count;
+    uint32_t const count = end - begin;
+    Vec3 const extent    = bounds.extent();
+    float best_cost      = INF;
+
+    for (int axis = 0; axis < 3; ++axis) {
+        float const centroid_extent = centroid_bounds.extent()[axis];
+        if (centroid_extent <= 0.0f)
+            continue;
+
+        std::array<LightBounds, MAX_BINS> bins{};
+        std::array<uint32_t, MAX_BINS> counts{};
+        float const scale = static_cast<float>(bin_count) / centroid_extent;
+        for (uint32_t i = begin; i < end; ++i) {
+            uint32_t const light = ctx.indices[i];
+            int const bin        = bin_of(ctx.centroids[light], axis, centroid_bounds, scale,
+                                          bin_count);
+            bins[bin].extend(ctx.lights[light]);
+            ++counts[bin];
+        }
+
+        // sweep from the right to get the cost of all right hand sides
+        std::array<float, MAX_BINS> right_cost{};
+        LightBounds right;
+        for (int b = bin_count - 1; b > 0; --b) {
+            right.extend(bins[b]);
+            right_cost[b] = orientation_cost(right);
+        }
+
+        // thin boxes are split across their long side rather than into slivers
+        float const regularization = max_component(extent) / extent[axis];
+        LightBounds left;
+        uint32_t left_count = 0;
+        for (int b = 0; b < bin_count - 1; ++b) {
+            left.extend(bins[b]);
+            left_count      += counts[b];
+            float const cost = regularization * (orientation_cost(left) + right_cost[b + 1]);
+            if (left_count > 0 && left_count < count && cost < best_cost) {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = b + 1;
+            }
+        }
+    }
+    return best_axis >= 0;
+}
+
+void build_node(BuildContext &ctx, uint32_t node_index, uint32_t begin, uint32_t end) {
+    uint32_t const count = end - begin;
+
+    LightBounds light;
+    Aabb centroid_bounds;
+    for (uint32_t i = begin; i < end; ++i) {
+        light.extend(ctx.lights[ctx.indices[i]]);
+        centroid_bounds.extend(ctx.centroids[ctx.indices[i]]);
+    }
+
+    LightBvhNode &node = ctx.nodes[node_index];
+    node.light         = light;
+    if (count == 1) {
+        node.offset = ctx.triangles[ctx.indices[begin]];
+        node.leaf   = true;
+        return;
+    }
+
+    int const bin_count = ctx.settings.bin_count;
+    int best_axis       = -1;
+    int best_split      = 0;
+    auto *const first   = ctx.indices.data() + begin;
+    auto *const last    = ctx.indices.data() + end;
+    uint32_t mid        = begin + count / 2;
+
+    if (find_split(ctx, begin, end, light.bounds, centroid_bounds, best_axis, best_split)) {
+        float const scale =
+            static_cast<float>(bin_count) / centroid_bounds.extent()[best_axis];
+        auto *const split = std::partition(first, last, [&](uint32_t l) {
+            return bin_of(ctx.centroids[l], best_axis, centroid_bounds, scale, bin_count) <
+                   best_split;
+        });
+        mid = begin + static_cast<uint32_t>(split - first);
+    }
+    if (best_axis < 0 || mid == begin || mid == end) {
+        // lights on top of each other, split them in the middle
+        best_axis = centroid_bounds.largest_axis();
+        mid       = begin + count / 2;
+        std::nth_element(first, ctx.indices.data() + mid, last, [&](uint32_t a, uint32_t b) {
+            return ctx.centroids[a][best_axis] < ctx.centroids[b][best_axis];
+        });
+    }
+
+    uint32_t const children = ctx.next_node.fetch_add(2, std::memory_order_relaxed);
+    node.offset             = children;
+    node.leaf               = false;
+
+    if (count > ctx.settings.task_threshold) {
+        ctx.tasks.run([&ctx, children, begin, mid]() { build_node(ctx, children, begin, mid); });
+    } else {
+        build_node(ctx, children, begin, mid);
+    }
+    build_node(ctx, children + 1, mid, end);
+}
+
+} // namespace
+
+void LightBounds::extend(LightBounds const &b) {
+    if (b.is_empty())
+        return;
+    if (is_empty()) {
+        *this = b;
+        return;
+    }
+    bounds.extend(b.bounds);
+    power += b.power;
+
+    // a cone of 90 degrees holds every normal already
+    if (cos_theta_o <= 0.0f)
+        return;
+    // the normals are only known up to their sign, merge with the closer of the two axes
+    Vec3 const other    = dot(axis, b.axis) < 0.0f ? -b.axis : b.axis;
+    float const cos_d   = dot(axis, other);
+    // single normals, the common case while building, are inside when they are close enough
+    if (b.cos_theta_o >= 1.0f && cos_d >= cos_theta_o)
+        return;
+    float const theta_a = safe_acos(cos_theta_o);
+    float const theta_b = safe_acos(b.cos_theta_o);
+    float const theta_d = safe_acos(cos_d);
+    if (std::min(theta_d + theta_b, PI) <= theta_a)
+        return;
+    if (std::min(theta_d + theta_a, PI) <= theta_b) {
+        axis        = other;
+        cos_theta_o = b.cos_theta_o;
+        return;
+    }
+
+    // the smallest cone around both touches the far edges of the two
+    float const theta_o = 0.5f * (theta_a + theta_d + theta_b);
+    Vec3 const rotation = cross(axis, other);
+    if (theta_o >= 0.5f * PI || dot(rotation, rotation) == 0.0f) {
+        // every direction is within 90 degrees of the axis or its opposite
+        cos_theta_o = 0.0f;
+        return;
+    }
+    // turns the axis towards `other` until the cone touches the far edge of the first one
+    float const theta_r = theta_o - theta_a;
+    Vec3 const k        = normalize(rotation);
+    axis                = normalize(axis * std::cos(theta_r) + cross(k, axis) * std::sin(theta_r));
+    cos_theta_o         = std::cos(theta_o);
+}
+
+auto LightBounds::importance(Vec3 p, Vec3 n) const -> float {
+    Vec3 const to_p     = p - bounds.centroid();
+    float const dist2   = dot(to_p, to_p);
+    Vec3 const extent   = bounds.extent();
+    float const radius2 = 0.25f * dot(extent, extent);
+    // `p` in the bounding sphere may be lit from anywhere
+    if (dist2 <= radius2)
+        return power / std::max(radius2, EPSILON * EPSILON);
+
+    // angles are widened by the angle the bounding sphere spans as seen from `p`
+    float const sin2_b = radius2 / dist2;
+    float const sin_b  = std::sqrt(sin2_b);
+    float const cos_b  = safe_sqrt(1.0f - sin2_b);
+    Vec3 const wi      = to_p / std::sqrt(dist2);
+
+    // emission: the direction towards `p` is at least the normal cone away from the normals,
+    // diffuse emitters send nothing past 90 degrees
+    float const cos_o = cos_theta_o;
+    float const sin_o = safe_sqrt(1.0f - cos_o * cos_o);
+    float const cos_w = std::fabs(dot(axis, wi));
+    float const sin_w = safe_sqrt(1.0f - cos_w * cos_w);
+    float const cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, cos_o);
+    float const sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, cos_o);
+    float const cos_e = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+    if (cos_e <= 0.0f)
+        return 0.0f;
+
+    // reception: light arriving from behind the surface doesn't count
+    float const cos_i = -dot(n, wi);
+    float const sin_i = safe_sqrt(1.0f - cos_i * cos_i);
+    float const cos_r = cos_sub_clamped(sin_i, cos_i, sin_b, cos_b);
+    if (cos_r <= 0.0f)
+        return 0.0f;
+
+    return power * cos_e * cos_r / dist2;
+}
+
+void LightBvh::build(ThreadPool &pool, Scene const &scene,
+                     LightBvhBuildSettings const &settings) {
+    PROFILE_SCOPE("light bvh");
+    auto const &triangles  = scene.emissive_triangles;
+    auto const light_count = static_cast<uint32_t>(triangles.size());
+    m_nodes.clear();
+    if (light_count == 0)
+        return;
+
+    LightBvhBuildSettings clamped = settings;
+    clamped.bin_count             = std::clamp(settings.bin_count, 2, MAX_BINS);
+
+    // one light per leaf, so exactly 2n - 1 nodes
+    m_nodes.resize(2 * static_cast<size_t>(light_count) - 1);
+
+    BuildContext ctx(pool, clamped, triangles, m_nodes);
+    ctx.lights.resize(light_count);
+    ctx.centroids.resize(light_count);
+    ctx.indices.resize(light_count);
+    pool.parallel_for(0, light_count, 1024, [&](size_t i) {
+        ctx.lights[i]    = triangle_light(scene, triangles[i]);
+        ctx.centroids[i] = ctx.lights[i].bounds.centroid();
+        ctx.indices[i]   = static_cast<uint32_t>(i);
+    });
+
+    build_node(ctx, 0, 0, light_count);
+    ctx.tasks.wait();
+}
+
+auto LightBvh::sample(Vec3 p, Vec3 n, float u, float &pmf) const -> uint32_t {
+    if (m_nodes.empty() || !(m_nodes[0].light.importance(p, n) > 0.0f))
+        return NO_LIGHT;
+
+    pmf            = 1.0f;
+    uint32_t index = 0;
+    while (!m_nodes[index].leaf) {
+        uint32_t const children = m_nodes[index].offset;
+        float const left        = m_nodes[children].light.importance(p, n);
+        float const right       = m_nodes[children + 1].light.importance(p, n);
+        if (!(left + right > 0.0f))
+            return NO_LIGHT;
+
+        // picks a child and stretches the part of `u` that picked it back to [0, 1)
+        float const p_left = left / (left + right);
+        if (u < p_left) {
+            u     = std::min(u / p_left, ONE_MINUS_EPSILON);
+            pmf  *= p_left;
+            index = children;
+        } else {
+            u     = std::min((u - p_left) / (1.0f - p_left), ONE_MINUS_EPSILON);
+            pmf  *= 1.0f - p_left;
+            index = children + 1;
+        }
+    }
+    return m_nodes[index].offset;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "render/math.h"
+
+class ThreadPool;
+struct Scene;
+
+/// Conservative bounds of the light a group of emitters sends out (Conty Estevez and Kulla 2018).
+///
+/// The emitters are diffuse and two-sided like the emissive triangles of a `Scene`, so the cone
+/// bounds the normals up to their sign: every normal is within `acos(cos_theta_o)` of `axis` or
+/// of `-axis`, and light leaves within 90 degrees around it.
+struct LightBounds {
+    Aabb bounds;
+    /// emitted power (luminance of the emission times the area)
+    float power = 0.0f;
+    Vec3 axis{0.0f, 0.0f, 1.0f};
+    float cos_theta_o = 1.0f;
+
+    auto is_empty() const -> bool { return bounds.is_empty(); }
+
+    void extend(LightBounds const &b);
+
+    /// @brief upper bound estimate of the light arriving at `p` on the side `n` points to, up to a
+    /// constant factor. Zero only if no emitter in the bounds can light `p`.
+    auto importance(Vec3 p, Vec3 n) const -> float;
+};
+
+/// One node of a `LightBvh`, leaves hold a single light.
+struct LightBvhNode {
+    LightBounds light;
+    /// interior nodes: index of the first child, the second one follows it.
+    /// leaves: the emissive triangle
+    uint32_t offset = 0;
+    bool leaf       = false;
+};
+
+struct LightBvhBuildSettings {
+    /// number of centroid bins per axis the cost is evaluated on
+    int bin_count = 12;
+    /// subtrees with more lights than this are built as separate tasks
+    uint32_t task_threshold = 1024;
+};
+
+/// Bounding volume hierarchy over the emissive triangles of a `Scene` that picks the light for
+/// next event estimation.
+///
+/// Every node bounds position, normals and power of the lights below it. Sampling walks from the
+/// root to a single leaf, choosing each child with a probability proportional to the importance
+/// of its bounds for the shading point, so a light is found in time logarithmic in the number of
+/// lights and far away, faint or averted lights are rarely picked. Built top down with the
+/// surface area orientation heuristic.
+class LightBvh {
+    std::vector<LightBvhNode> m_nodes;
+
+  public:
+    static constexpr uint32_t NO_LIGHT = ~0u;
+
+    /// (re)builds the tree over `Scene::emissive_triangles`, subtrees are built as separate tasks
+    void build(ThreadPool &pool, Scene const &scene, LightBvhBuildSettings const &settings = {});
+
+    auto empty() const -> bool { return m_nodes.empty(); }
+    auto nodes() const -> std::vector<LightBvhNode> const & { return m_nodes; }
+
+    /// @brief picks a light for shading the point `p` whose surface faces `n`
+    /// @param u uniform number in [0, 1)
+    /// @param pmf set to the probability the light is picked with
+    /// @return the emissive triangle, `NO_LIGHT` if none of the lights can light `p`
+    auto sample(Vec3 p, Vec3 n, float u, float &pmf) const -> uint32_t;
+};
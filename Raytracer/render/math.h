@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+constexpr float PI      = 3.14159265358979323846f;
+constexpr float INV_PI  = 1.0f / PI;
+constexpr float INF     = std::numeric_limits<float>::infinity();
+constexpr float EPSILON = 1.0e-4f;
+
+struct Vec3 {
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+
+    constexpr Vec3() = default;
+    constexpr Vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+    constexpr explicit Vec3(float v) : x(v), y(v), z(v) {}
+
+    constexpr auto operator[](int i) const -> float { return i == 0 ? x : (i == 1 ? y : z); }
+    constexpr auto operator[](int i) -> float & { return i == 0 ? x : (i == 1 ? y : z); }
+
+    constexpr auto operator-() const -> Vec3 { return {-x, -y, -z}; }
+    constexpr auto operator+=(Vec3 b) -> Vec3 & {
+        x += b.x;
+        y += b.y;
+        z += b.z;
+        return *this;
+    }
+    constexpr auto operator*=(float s) -> Vec3 & {
+        x *= s;
+        y *= s;
+        z *= s;
+        return *this;
+    }
+
+    constexpr auto operator==(Vec3 const &) const -> bool = default;
+};
+
+constexpr auto operator+(Vec3 a, Vec3 b) -> Vec3 { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+constexpr auto operator-(Vec3 a, Vec3 b) -> Vec3 { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+constexpr auto operator*(Vec3 a, Vec3 b) -> Vec3 { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+constexpr auto operator/(Vec3 a, Vec3 b) -> Vec3 { return {a.x / b.x, a.y / b.y, a.z / b.z}; }
+constexpr auto operator*(Vec3 a, float s) -> Vec3 { return {a.x * s, a.y * s, a.z * s}; }
+constexpr auto operator*(float s, Vec3 a) -> Vec3 { return {a.x * s, a.y * s, a.z * s}; }
+constexpr auto operator/(Vec3 a, float s) -> Vec3 { return a * (1.0f / s); }
+
+constexpr auto dot(Vec3 a, Vec3 b) -> float { return a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr auto cross(Vec3 a, Vec3 b) -> Vec3 {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline auto length(Vec3 a) -> float { return std::sqrt(dot(a, a)); }
+inline auto normalize(Vec3 a) -> Vec3 { return a / length(a); }
+
+constexpr auto min(Vec3 a, Vec3 b) -> Vec3 {
+    return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+}
+constexpr auto max(Vec3 a, Vec3 b) -> Vec3 {
+    return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+}
+constexpr auto max_component(Vec3 a) -> float { return std::max(a.x, std::max(a.y, a.z)); }
+constexpr auto luminance(Vec3 c) -> float { return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; }
+
+/// builds an orthonormal basis `(t, b, n)` around the unit vector `n` (Duff et al. 2017)
+inline void orthonormal_basis(Vec3 n, Vec3 &t, Vec3 &b) {
+    float const sign = std::copysign(1.0f, n.z);
+    float const a    = -1.0f / (sign + n.z);
+    float const c    = n.x * n.y * a;
+    t                = {1.0f + sign * n.x * n.x * a, sign * c, -sign * n.x};
+    b                = {c, sign + n.y * n.y * a, -n.y};
+}
+
+struct Ray {
+    Vec3 origin;
+    Vec3 direction;
+    float t_min = EPSILON;
+    float t_max = INF;
+};
+
+/// axis aligned bounding box, default constructed boxes are empty
+struct Aabb {
+    Vec3 lo{INF};
+    Vec3 hi{-INF};
+
+    constexpr void extend(Vec3 p) {
+        lo = min(lo, p);
+        hi = max(hi, p);
+    }
+    constexpr void extend(Aabb const &b) {
+        lo = min(lo, b.lo);
+        hi = max(hi, b.hi);
+    }
+
+    constexpr auto is_empty() const -> bool { return lo.x > hi.x; }
+    constexpr auto extent() const -> Vec3 { return hi - lo; }
+    constexpr auto centroid() const -> Vec3 { return (lo + hi) * 0.5f; }
+
+    constexpr auto area() const -> float {
+        if (is_empty())
+            return 0.0f;
+        Vec3 const e = extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    constexpr auto largest_axis() const -> int {
+        Vec3 const e = extent();
+        return e.x > e.y ? (e.x > e.z ? 0 : 2) : (e.y > e.z ? 1 : 2);
+    }
+};
@@ -0,0 +1,85 @@
+#include "output_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+#include "render/tonemap.h"
+#include "utils/profiler.h"
+
+using std::chrono::steady_clock;
+
+namespace {
+auto milliseconds_since(steady_clock::time_point start) -> double {
+    return std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+}
+} // namespace
+
+OutputPipeline::OutputPipeline(OutputSettings const &settings)
+    : m_options(settings.image), m_queue(std::max(1u, settings.queue)),
+      m_pool(settings.threads, "output") {
+    m_options.pool = &m_pool;
+}
+
+OutputPipeline::~OutputPipeline() { finish(); }
+
+void OutputPipeline::submit(Framebuffer const &image, std::filesystem::path path) {
+    Framebuffer *frame = nullptr;
+    {
+        std::unique_lock lock(m_mutex);
+        if (m_in_flight == m_queue) {
+            PROFILE_SCOPE("output stall");
+            auto const start = steady_clock::now();
+            m_frame_done.wait(lock, [this]() { return m_in_flight < m_queue; });
+            m_stats.stall_ms += milliseconds_since(start);
+        }
+        ++m_in_flight;
+        if (m_free.empty()) {
+            m_frames.push_back(std::make_unique<Framebuffer>());
+            frame = m_frames.back().get();
+        } else {
+            frame = m_free.back();
+            m_free.pop_back();
+        }
+    }
+
+    {
+        PROFILE_SCOPE("output copy");
+        frame->copy_from(image);
+    }
+    m_pool.submit([this, frame, path = std::move(path)]() { write(*frame, path); });
+}
+
+void OutputPipeline::write(Framebuffer &frame, std::filesystem::path const &path) {
+    auto const start = steady_clock::now();
+    bool ok          = false;
+    {
+        PROFILE_SCOPE("output");
+        {
+            PROFILE_SCOPE("tonemap");
+            auto const width = static_cast<size_t>(frame.width());
+            m_pool.parallel_for(0, static_cast<size_t>(frame.height()), 16, [&](size_t y) {
+                tonemap_rgba8(frame.color_data() + y * width, frame.rgba8_data() + y * width,
+                              width, m_options.simd);
+            });
+        }
+        ok = write_image(path, frame, m_options);
+    }
+    double const encode_ms = milliseconds_since(start);
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_free.push_back(&frame);
+        --m_in_flight;
+        ++m_stats.frames;
+        m_stats.failed    += ok ? 0 : 1;
+        m_stats.encode_ms += encode_ms;
+    }
+    m_frame_done.notify_all();
+}
+
+auto OutputPipeline::finish() -> OutputStats {
+    std::unique_lock lock(m_mutex);
+    m_frame_done.wait(lock, [this]() { return m_in_flight == 0; });
+    return m_stats;
+}
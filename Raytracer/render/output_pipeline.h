@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "render/framebuffer.h"
+#include "render/image_io.h"
+#include "utils/thread_pool.h"
+
+struct OutputSettings {
+    /// encoding of the files, the pool is the pipeline's own
+    ImageWriteOptions image;
+    /// threads that tonemap, compress and write, `0` uses every hardware thread
+    unsigned threads = 2;
+    /// frames that may be waiting or in progress at once before `submit()` blocks
+    unsigned queue = 2;
+};
+
+struct OutputStats {
+    int frames = 0;
+    int failed = 0;
+    /// time `submit()` waited for a free slot, frames were rendered faster than written
+    double stall_ms = 0.0;
+    /// time spent on the frames on the output threads, summed over all frames
+    double encode_ms = 0.0;
+};
+
+/// Writes frames on its own threads while the next ones are rendered.
+///
+/// `submit()` copies the frame into one of `OutputSettings::queue` recycled buffers and returns;
+/// an output thread then tonemaps the radiance with SIMD, encodes and writes the file, with the
+/// other output threads helping to compress its blocks. When all buffers are taken `submit()`
+/// blocks in the "output stall" profiler zone until a frame is done, which keeps memory bounded
+/// and shows in a trace when writing can't keep up with rendering.
+class OutputPipeline {
+    ImageWriteOptions m_options;
+    unsigned m_queue;
+
+    std::mutex m_mutex;
+    std::condition_variable m_frame_done;
+    std::vector<std::unique_ptr<Framebuffer>> m_frames;
+    /// frames that aren't being written, for the next `submit()`
+    std::vector<Framebuffer *> m_free;
+    unsigned m_in_flight = 0;
+    OutputStats m_stats;
+
+    /// last so its threads are joined before anything they use goes away
+    ThreadPool m_pool;
+
+    void write(Framebuffer &frame, std::filesystem::path const &path);
+
+  public:
+    explicit OutputPipeline(OutputSettings const &settings);
+    /// waits for the queued frames
+    ~OutputPipeline();
+
+    OutputPipeline(OutputPipeline const &)            = delete;
+    OutputPipeline &operator=(OutputPipeline const &) = delete;
+
+    /// @brief queues `image` to be written to `path`, see `write_image()` for the formats.
+    /// `image` may be changed again as soon as this returns.
+    void submit(Framebuffer const &image, std::filesystem::path path);
+
+    /// @brief waits until every submitted frame is written
+    /// @return counts and timings of all frames so far, failures have been logged
+    auto finish() -> OutputStats;
+
+    auto thread_count() const -> unsigned { return m_pool.size(); }
+};
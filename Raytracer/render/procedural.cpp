@@ -0,0 +1,235 @@
+#include "procedural.h"
+
+#include "render/rng.h"
+
+namespace {
+
+/// floor and a small ceiling light shared by the generated scenes
+void add_stage(Scene &scene) {
+    auto const floor = scene.add_material({Vec3{0.73f}});
+    auto const light = scene.add_material({Vec3{0.78f}, Vec3{12.0f}});
+    scene.add_quad({-1, 0, -1}, {-1, 0, 1}, {1, 0, 1}, {1, 0, -1}, floor);
+    scene.add_quad({-0.3f, 2.0f, -0.3f}, {0.3f, 2.0f, -0.3f}, {0.3f, 2.0f, 0.3f},
+                   {-0.3f, 2.0f, 0.3f}, light);
+    scene.background = Vec3{0.1f};
+}
+
+/// appends a UV sphere, `4 * segments^2` triangles
+void add_sphere(std::vector<Vec3> &positions, std::vector<uint32_t> &indices,
+                std::vector<uint32_t> &material_ids, Vec3 center, float radius, int segments,
+                uint32_t material) {
+    int const rings   = segments;
+    int const sectors = 2 * segments;
+    auto const base   = static_cast<uint32_t>(positions.size());
+
+    // shared vertices per sphere, poles are rings of degenerate quads which keeps indexing simple
+    for (int r = 0; r <= rings; ++r) {
+        float const theta = PI * static_cast<float>(r) / static_cast<float>(rings);
+        for (int s = 0; s < sectors; ++s) {
+            float const phi = 2.0f * PI * static_cast<float>(s) / sectors;
+            Vec3 const normal{std::sin(theta) * std::cos(phi), std::cos(theta),
+                              std::sin(theta) * std::sin(phi)};
+            positions.push_back(center + normal * radius);
+        }
+    }
+    for (int r = 0; r < rings; ++r) {
+        for (int s = 0; s < sectors; ++s) {
+            auto const a = base + static_cast<uint32_t>(r * sectors + s);
+            auto const b = base + static_cast<uint32_t>(r * sectors + (s + 1) % sectors);
+            auto const c = b + static_cast<uint32_t>(sectors);
+            auto const d = a + static_cast<uint32_t>(sectors);
+            indices.insert(indices.end(), {a, d, c, a, c, b});
+            material_ids.insert(material_ids.end(), {material, material});
+        }
+    }
+}
+
+} // namespace
+
+auto make_sphere_grid(int grid, int segments) -> Scene {
+    Scene scene;
+    add_stage(scene);
+    uint32_t const materials[] = {
+        scene.add_material({Vec3{0.65f, 0.05f, 0.05f}}),
+        scene.add_material({Vec3{0.12f, 0.45f, 0.15f}}),
+        scene.add_material({Vec3{0.2f, 0.3f, 0.7f}}),
+    };
+
+    float const spacing = 2.0f / static_cast<float>(grid);
+    float const radius  = 0.4f * spacing;
+
+    std::vector<Vec3> positions(scene.positions.begin(), scene.positions.end());
+    std::vector<uint32_t> indices(scene.indices.begin(), scene.indices.end());
+    std::vector<uint32_t> material_ids(scene.material_ids.begin(), scene.material_ids.end());
+
+    for (int gz = 0; gz < grid; ++gz) {
+        for (int gx = 0; gx < grid; ++gx) {
+            Vec3 const center{-1.0f + (static_cast<float>(gx) + 0.5f) * spacing, radius,
+                              -1.0f + (static_cast<float>(gz) + 0.5f) * spacing};
+            add_sphere(positions, indices, material_ids, center, radius, segments,
+                       materials[(gx + gz) % 3]);
+        }
+    }
+
+    scene.positions    = std::move(positions);
+    scene.indices      = std::move(indices);
+    scene.material_ids = std::move(material_ids);
+    scene.collect_lights();
+    return scene;
+}
+
+auto make_instanced_grid(int grid, int segments) -> Scene {
+    Scene scene;
+    add_stage(scene);
+    scene.collect_lights();
+
+    // one sphere and one box of unit size, placed `grid x grid` times with a random rotation,
+    // scale and height
+    float const spacing = 2.0f / static_cast<float>(grid);
+    for (int shape = 0; shape < 2; ++shape) {
+        auto mesh           = std::make_shared<Scene>();
+        auto const material = mesh->add_material(
+            {shape == 0 ? Vec3{0.65f, 0.35f, 0.05f} : Vec3{0.15f, 0.35f, 0.6f}});
+        if (shape == 0) {
+            std::vector<Vec3> positions;
+            std::vector<uint32_t> indices, material_ids;
+            add_sphere(positions, indices, material_ids, Vec3{0.0f, 0.5f, 0.0f}, 0.5f, segments,
+                       material);
+            mesh->positions    = std::move(positions);
+            mesh->indices      = std::move(indices);
+            mesh->material_ids = std::move(material_ids);
+        } else {
+            mesh->add_box({-0.5f, 0.0f, -0.5f}, {0.5f, 1.0f, 0.5f}, 0.0f, material);
+        }
+        scene.instances.add_mesh(std::move(mesh));
+    }
+
+    Pcg32 rng(7);
+    for (int gz = 0; gz < grid; ++gz) {
+        for (int gx = 0; gx < grid; ++gx) {
+            Vec3 const center{-1.0f + (static_cast<float>(gx) + 0.5f) * spacing, 0.0f,
+                              -1.0f + (static_cast<float>(gz) + 0.5f) * spacing};
+            float const scale = spacing * (0.4f + 0.4f * rng.next_float());
+            float const angle = 2.0f * PI * rng.next_float();
+            scene.instances.add_instance(static_cast<uint32_t>(gx + gz) % 2,
+                                         Transform::translation(center) *
+                                             Transform::rotation_y(angle) *
+                                             Transform::scaling(scale));
+        }
+    }
+    return scene;
+}
+
+auto make_triangle_soup(size_t count, uint64_t seed) -> Scene {
+    Scene scene;
+    add_stage(scene);
+    auto const material = scene.add_material({Vec3{0.6f, 0.5f, 0.4f}});
+
+    std::vector<Vec3> positions(scene.positions.begin(), scene.positions.end());
+    std::vector<uint32_t> indices(scene.indices.begin(), scene.indices.end());
+    std::vector<uint32_t> material_ids(scene.material_ids.begin(), scene.material_ids.end());
+    positions.reserve(positions.size() + 3 * count);
+    indices.reserve(indices.size() + 3 * count);
+    material_ids.reserve(material_ids.size() + count);
+
+    Pcg32 rng(seed);
+    auto uniform = [&rng](float lo, float hi) { return lo + (hi - lo) * rng.next_float(); };
+    for (size_t i = 0; i < count; ++i) {
+        Vec3 const center{uniform(-0.9f, 0.9f), uniform(0.05f, 1.6f), uniform(-0.9f, 0.9f)};
+        auto const base = static_cast<uint32_t>(positions.size());
+        for (int corner = 0; corner < 3; ++corner) {
+            positions.push_back(center + Vec3{uniform(-0.03f, 0.03f), uniform(-0.03f, 0.03f),
+                                              uniform(-0.03f, 0.03f)});
+        }
+        indices.insert(indices.end(), {base, base + 1, base + 2});
+        material_ids.push_back(material);
+    }
+
+    scene.positions    = std::move(positions);
+    scene.indices      = std::move(indices);
+    scene.material_ids = std::move(material_ids);
+    scene.collect_lights();
+    return scene;
+}
+
+auto make_city_lights(int grid, uint64_t seed) -> Scene {
+    Scene scene;
+    auto const ground = scene.add_material({Vec3{0.3f}});
+    auto const facade = scene.add_material({Vec3{0.5f, 0.45f, 0.4f}});
+    // warm and cold windows from dim to bright, a few orders of magnitude apart like real ones
+    uint32_t windows[8];
+    for (int i = 0; i < 8; ++i) {
+        Vec3 const tint = i % 2 ? Vec3{1.0f, 0.75f, 0.45f} : Vec3{0.7f, 0.85f, 1.0f};
+        windows[i]      = scene.add_material({Vec3{0.8f}, tint * (2.0f * std::pow(2.0f, i))});
+    }
+    auto const lamp = scene.add_material({Vec3{0.8f}, Vec3{60.0f, 45.0f, 25.0f}});
+    scene.add_quad({-1, 0, -1}, {-1, 0, 1}, {1, 0, 1}, {1, 0, -1}, ground);
+    scene.background = Vec3{0.005f};
+
+    Pcg32 rng(seed);
+    auto uniform = [&rng](float lo, float hi) { return lo + (hi - lo) * rng.next_float(); };
+    float const spacing = 2.0f / static_cast<float>(grid);
+    float const half    = 0.35f * spacing;
+    float const window  = 0.12f * spacing;
+    float const floor_h = 0.05f;
+    float const offset  = 0.002f;
+    for (int gz = 0; gz < grid; ++gz) {
+        for (int gx = 0; gx < grid; ++gx) {
+            Vec3 const center{-1.0f + (static_cast<float>(gx) + 0.5f) * spacing, 0.0f,
+                              -1.0f + (static_cast<float>(gz) + 0.5f) * spacing};
+            float const height = uniform(0.2f, 1.2f);
+            scene.add_box(center + Vec3{-half, 0.0f, -half}, center + Vec3{half, height, half},
+                          0.0f, facade);
+
+            // half of the windows lit on every side, three per floor
+            int const floors = static_cast<int>(height / floor_h) - 1;
+            for (int side = 0; side < 4; ++side) {
+                // outward normal and the direction along the facade
+                Vec3 const normal = side == 0   ? Vec3{0, 0, 1}
+                                    : side == 1 ? Vec3{0, 0, -1}
+                                    : side == 2 ? Vec3{1, 0, 0}
+                                                : Vec3{-1, 0, 0};
+                Vec3 const along{normal.z, 0.0f, -normal.x};
+                for (int f = 0; f < floors; ++f) {
+                    for (int w = -1; w <= 1; ++w) {
+                        if (rng.next_float() < 0.5f)
+                            continue;
+                        Vec3 const c = center + normal * (half + offset) +
+                                       along * (static_cast<float>(w) * 2.0f * window) +
+                                       Vec3{0.0f, (static_cast<float>(f) + 1.0f) * floor_h, 0.0f};
+                        Vec3 const u = along * (0.5f * window);
+                        Vec3 const v{0.0f, 0.3f * floor_h, 0.0f};
+                        scene.add_quad(c - u - v, c + u - v, c + u + v, c - u + v,
+                                       windows[rng.next_u32() % 8]);
+                    }
+                }
+            }
+
+            // a street lamp facing down at the corner of the block
+            Vec3 const l  = center + Vec3{half + 0.1f * spacing, 0.12f, half + 0.1f * spacing};
+            float const r = 0.01f;
+            scene.add_quad(l + Vec3{-r, 0, -r}, l + Vec3{r, 0, -r}, l + Vec3{r, 0, r},
+                           l + Vec3{-r, 0, r}, lamp);
+        }
+    }
+    scene.collect_lights();
+    return scene;
+}
+
+auto procedural_scene_names() -> std::vector<std::string_view> {
+    return {"cornell", "spheres", "soup", "instances", "city"};
+}
+
+auto make_procedural_scene(std::string_view name) -> std::optional<Scene> {
+    if (name == "cornell")
+        return Scene::make_cornell_box();
+    if (name == "spheres")
+        return make_sphere_grid(16, 20);
+    if (name == "soup")
+        return make_triangle_soup(500'000, 1);
+    if (name == "instances")
+        return make_instanced_grid(32, 20);
+    if (name == "city")
+        return make_city_lights(12, 3);
+    return std::nullopt;
+}
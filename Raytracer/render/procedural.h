@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "render/scene.h"
+
+// Procedurally generated scenes, so benchmarks and regression runs need no assets. All of them
+// fit the default `Camera` like the Cornell box: floor at y = 0, light at y = 2, within x, z in
+// [-1, 1].
+
+/// @brief `grid x grid` UV spheres on a floor under an area light
+/// @param segments tessellation of every sphere, `4 * segments^2` triangles each
+auto make_sphere_grid(int grid, int segments) -> Scene;
+
+/// @brief `count` small randomly oriented triangles filling the box, under an area light. Lots of
+/// overlap, the worst case for BVH quality
+auto make_triangle_soup(size_t count, uint64_t seed) -> Scene;
+
+/// @brief `grid x grid` randomly rotated and scaled instances of a sphere and a box mesh on a
+/// floor under an area light, see `InstanceLayer`
+/// @param segments tessellation of the sphere, `4 * segments^2` triangles
+auto make_instanced_grid(int grid, int segments) -> Scene;
+
+/// @brief `grid x grid` box buildings at night, lit only by thousands of small emissive windows of
+/// very different brightness and a street lamp per block. The many-light case for `LightBvh`.
+auto make_city_lights(int grid, uint64_t seed) -> Scene;
+
+/// names accepted by `make_procedural_scene()`
+auto procedural_scene_names() -> std::vector<std::string_view>;
+
+/// @brief one of the canonical scenes: `cornell`, `spheres` (410k triangles), `soup` (500k),
+/// `instances` (1024 instances of a 1.6k triangle sphere and a box) or `city` (10k small lights)
+/// @return nothing for unknown names
+auto make_procedural_scene(std::string_view name) -> std::optional<Scene>;
@@ -0,0 +1,166 @@
+#include "renderer.h"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "render/framebuffer.h"
+#include "render/procedural.h"
+#include "render/scene_io.h"
+#include "render/tile_renderer.h"
+#include "utils/profiler.h"
+
+namespace {
+
+auto milliseconds(std::chrono::steady_clock::duration duration) -> double {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+/// the images `job` asked for, copied out of `image`
+auto make_result(RenderJob const &job, Framebuffer const &image) -> RenderResult {
+    size_t const pixels = static_cast<size_t>(image.width()) * image.height();
+    RenderResult result;
+    result.ok     = true;
+    result.width  = image.width();
+    result.height = image.height();
+    result.color.assign(image.color_data(), image.color_data() + pixels);
+    if (job.albedo)
+        result.albedo.assign(image.albedo_data(), image.albedo_data() + pixels);
+    if (job.normal)
+        result.normal.assign(image.normal_data(), image.normal_data() + pixels);
+    if (job.depth)
+        result.depth.assign(image.depth_data(), image.depth_data() + pixels);
+    return result;
+}
+
+} // namespace
+
+Renderer::Renderer(RendererSettings const &settings) : m_pool(settings.threads, "render") {
+    m_textures.set_capacity(settings.texture_cache_mb << 20);
+    unsigned const jobs = std::max(settings.concurrent_jobs, 1u);
+    for (unsigned i = 0; i < jobs; ++i)
+        m_job_threads.emplace_back([this, i]() { job_loop(i); });
+    spdlog::info("renderer uses {} threads for up to {} jobs at a time", m_pool.size(), jobs);
+}
+
+Renderer::~Renderer() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto &thread : m_job_threads)
+        thread.join();
+}
+
+auto Renderer::load_scene(std::string const &name, std::filesystem::path const &bvh_cache)
+    -> std::shared_ptr<Scene const> {
+    auto const names      = procedural_scene_names();
+    bool const procedural = std::find(names.begin(), names.end(), name) != names.end();
+    auto scene            = procedural ? make_procedural_scene(name) : ::load_scene(name);
+    if (!scene) {
+        spdlog::error("couldn't load scene '{}'", name);
+        return nullptr;
+    }
+    return add_scene(std::move(*scene), bvh_cache);
+}
+
+auto Renderer::add_scene(Scene scene, std::filesystem::path const &bvh_cache)
+    -> std::shared_ptr<Scene const> {
+    spdlog::info("scene has {} triangles, {} of them emissive", scene.triangle_count(),
+                 scene.emissive_triangles.size());
+    scene.build_acceleration(m_pool, bvh_cache);
+
+    // lookups of running jobs would race with the textures being added, so new jobs are held back
+    // and the running ones finish first
+    {
+        std::unique_lock lock(m_mutex);
+        m_idle.wait(lock, [this]() { return !m_registering; });
+        m_registering = true;
+        m_idle.wait(lock, [this]() { return m_rendering == 0; });
+    }
+    scene.bind_textures(m_textures);
+    {
+        std::lock_guard lock(m_mutex);
+        m_registering = false;
+    }
+    m_idle.notify_all();
+    m_wake.notify_all();
+    return std::make_shared<Scene const>(std::move(scene));
+}
+
+auto Renderer::submit(std::shared_ptr<Scene const> scene, RenderJob const &job)
+    -> std::future<RenderResult> {
+    std::promise<RenderResult> promise;
+    auto future = promise.get_future();
+    if (!scene) {
+        spdlog::error("render job without a scene");
+        promise.set_value({});
+        return future;
+    }
+    if (job.width < 1 || job.height < 1 || job.spp < 1) {
+        spdlog::error("render job for {}x{} pixels at {} spp", job.width, job.height, job.spp);
+        promise.set_value({});
+        return future;
+    }
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_queue.push_back({std::move(scene), job, std::move(promise), Clock::now()});
+    }
+    m_wake.notify_one();
+    return future;
+}
+
+auto Renderer::queued() -> size_t {
+    std::lock_guard lock(m_mutex);
+    return m_queue.size();
+}
+
+void Renderer::job_loop(unsigned index) {
+    Profiler::instance().set_thread_name(fmt::format("job {}", index));
+    // kept across jobs, so their buffers and arenas are only allocated for the first ones
+    TileRenderer renderer(m_pool);
+    Denoiser denoiser(m_pool);
+    Framebuffer image;
+
+    for (;;) {
+        Pending pending;
+        {
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [this]() {
+                return m_stop || (!m_queue.empty() && !m_registering);
+            });
+            if (m_queue.empty())
+                return;
+            pending = std::move(m_queue.front());
+            m_queue.pop_front();
+            ++m_rendering;
+        }
+
+        auto const start     = Clock::now();
+        RenderJob const &job = pending.job;
+        {
+            PROFILE_SCOPE("job");
+            if (image.width() != job.width || image.height() != job.height) {
+                image.resize(job.width, job.height);
+                renderer.resize(job.width, job.height);
+            }
+            renderer.settings = job.integrator;
+            renderer.render(*pending.scene, job.camera, image, job.frame_index, job.spp);
+            if (job.denoise.enabled)
+                denoiser.denoise(image, job.denoise, true);
+        }
+
+        RenderResult result = make_result(job, image);
+        result.queued_ms    = milliseconds(start - pending.submitted);
+        result.render_ms    = milliseconds(Clock::now() - start);
+        pending.scene.reset();
+        {
+            std::lock_guard lock(m_mutex);
+            --m_rendering;
+        }
+        m_idle.notify_all();
+        pending.promise.set_value(std::move(result));
+    }
+}
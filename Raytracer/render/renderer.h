@@ -0,0 +1,141 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "render/camera.h"
+#include "render/denoiser.h"
+#include "render/integrator.h"
+#include "render/scene.h"
+#include "render/texture_cache.h"
+#include "utils/thread_pool.h"
+
+struct RendererSettings {
+    /// render threads, `0` uses every hardware thread
+    unsigned threads = 0;
+    /// jobs rendering at the same time. Their tiles share the pool, so a second job fills the
+    /// threads the first one leaves idle while its last tiles finish.
+    unsigned concurrent_jobs = 2;
+    /// memory for the texture tiles of all scenes
+    size_t texture_cache_mb = 256;
+};
+
+/// one image to render of a scene loaded into a `Renderer`
+struct RenderJob {
+    Camera camera;
+    int width  = 1280;
+    int height = 720;
+    int spp    = 64;
+    /// seeds the random streams, jobs with the same index and settings give the same image
+    uint32_t frame_index = 0;
+    IntegratorSettings integrator;
+    DenoiserSettings denoise;
+    // first hit features returned besides the color, see `Framebuffer`
+    bool albedo = false;
+    bool normal = false;
+    bool depth  = false;
+};
+
+/// what a `RenderJob` produced, linear images with rows top to bottom
+struct RenderResult {
+    /// false if the job was invalid, the images are empty then
+    bool ok    = false;
+    int width  = 0;
+    int height = 0;
+    std::vector<Vec3> color;
+    /// empty unless the job asked for them
+    std::vector<Vec3> albedo;
+    std::vector<Vec3> normal;
+    std::vector<float> depth;
+    /// time the job waited in the queue and took to render
+    double queued_ms = 0.0;
+    double render_ms = 0.0;
+};
+
+/// Embeddable CPU renderer for services that render many views of the same scenes.
+///
+/// Scenes are loaded and their acceleration structures built once, then shared read-only by every
+/// job rendering them. Jobs are queued and rendered `RendererSettings::concurrent_jobs` at a time,
+/// all on one shared thread pool; each comes back through a future. No window, GPU or UI code is
+/// involved.
+///
+///     Renderer renderer;
+///     auto scene = renderer.load_scene("cornell");
+///     std::vector<std::future<RenderResult>> views;
+///     for (Camera const &camera : cameras)
+///         views.push_back(renderer.submit(scene, {.camera = camera, .spp = 256}));
+///
+/// Scenes keep pointing at the texture cache of the renderer, so they must not be rendered once
+/// it is gone.
+class Renderer {
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        std::shared_ptr<Scene const> scene;
+        RenderJob job;
+        std::promise<RenderResult> promise;
+        Clock::time_point submitted;
+    };
+
+    ThreadPool m_pool;
+    TextureCache m_textures;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<Pending> m_queue;
+    bool m_stop = false;
+    /// a scene is adding its textures to `m_textures`, which isn't safe while lookups run, so no
+    /// job starts until it is done
+    bool m_registering = false;
+    /// jobs rendering right now
+    unsigned m_rendering = 0;
+    /// signalled when a job finishes or a scene is done registering its textures
+    std::condition_variable m_idle;
+    /// one thread per concurrent job, each with its own tile renderer and denoiser buffers
+    std::vector<std::thread> m_job_threads;
+
+    void job_loop(unsigned index);
+
+  public:
+    explicit Renderer(RendererSettings const &settings = {});
+    /// finishes the submitted jobs, then stops
+    ~Renderer();
+
+    Renderer(Renderer const &)            = delete;
+    Renderer &operator=(Renderer const &) = delete;
+
+    /// @brief loads a generated scene (see `make_procedural_scene()`) or a scene file (see
+    /// `load_scene()`) and prepares it like `add_scene()`
+    /// @param bvh_cache where to cache the BVH of a scene file, empty to always build it
+    /// @return nothing if the scene couldn't be loaded
+    auto load_scene(std::string const &name, std::filesystem::path const &bvh_cache = {})
+        -> std::shared_ptr<Scene const>;
+
+    /// builds the acceleration structures of `scene` on the pool and registers its textures with
+    /// the renderer, after which it can't change any more. Safe to call while jobs render: queued
+    /// jobs wait and the running ones finish before the textures are registered.
+    auto add_scene(Scene scene, std::filesystem::path const &bvh_cache = {})
+        -> std::shared_ptr<Scene const>;
+
+    /// @brief queues `job`, safe to call from any thread
+    /// @param scene returned by `load_scene()` or `add_scene()` of this renderer, kept alive
+    /// until the job is done
+    auto submit(std::shared_ptr<Scene const> scene, RenderJob const &job)
+        -> std::future<RenderResult>;
+
+    /// jobs submitted that haven't started rendering
+    auto queued() -> size_t;
+
+    auto thread_count() const -> unsigned { return m_pool.size(); }
+    /// only for settings and statistics, textures are registered through `add_scene()`
+    auto textures() -> TextureCache & { return m_textures; }
+};
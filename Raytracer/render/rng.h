@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+
+/// PCG32 random number generator (O'Neill 2014), small and fast enough to live on the stack of
+/// every render task
+class Pcg32 {
+    uint64_t m_state = 0;
+    uint64_t m_inc   = 1;
+
+  public:
+    Pcg32() = default;
+    explicit Pcg32(uint64_t seed, uint64_t sequence = 1) : m_inc((sequence << 1u) | 1u) {
+        next_u32();
+        m_state += seed;
+        next_u32();
+    }
+
+    auto next_u32() -> uint32_t {
+        uint64_t const old = m_state;
+        m_state            = old * 6364136223846793005ULL + m_inc;
+        auto const xorshifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        auto const rot        = static_cast<uint32_t>(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1u) & 31u));
+    }
+
+    /// uniform float in [0, 1)
+    auto next_float() -> float { return static_cast<float>(next_u32() >> 8) * 0x1.0p-24f; }
+};
+
+/// hashes a few integers into a seed, so that every pixel/frame pair gets its own stream
+constexpr auto hash_seed(uint32_t a, uint32_t b, uint32_t c = 0) -> uint64_t {
+    uint64_t h = 0x9E3779B97F4A7C15ULL;
+    for (uint64_t v : {uint64_t{a}, uint64_t{b}, uint64_t{c}}) {
+        h ^= v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+        h *= 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    return h;
+}
@@ -0,0 +1,236 @@
+#include "sampler.h"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// ---- Sobol --------------------------------------------------------------------------------------
+
+constexpr int SOBOL_DIMENSIONS = 2;
+constexpr int SOBOL_BITS       = 32;
+
+/// @brief direction numbers of the first Sobol dimensions (Joe and Kuo 2008), computed at compile
+/// time: the first is the van der Corput sequence, the second comes from the primitive polynomial
+/// x + 1 with the initial direction number m1 = 1
+constexpr auto make_sobol_directions() {
+    std::array<std::array<uint32_t, SOBOL_BITS>, SOBOL_DIMENSIONS> directions{};
+    for (int bit = 0; bit < SOBOL_BITS; ++bit)
+        directions[0][bit] = 1u << (31 - bit);
+    directions[1][0] = 1u << 31;
+    for (int bit = 1; bit < SOBOL_BITS; ++bit)
+        directions[1][bit] = directions[1][bit - 1] ^ (directions[1][bit - 1] >> 1);
+    return directions;
+}
+
+constexpr auto SOBOL_DIRECTIONS = make_sobol_directions();
+
+auto sobol(uint32_t index, int dimension) -> uint32_t {
+    uint32_t x = 0;
+    for (int bit = 0; index != 0; index >>= 1, ++bit) {
+        if (index & 1u)
+            x ^= SOBOL_DIRECTIONS[dimension][bit];
+    }
+    return x;
+}
+
+auto reverse_bits(uint32_t x) -> uint32_t {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+/// @brief Owen scrambling by hashing (Burley 2020): flips every bit depending on the bits above
+/// it only, which keeps the stratification of the points while making each seed an independent
+/// randomisation of the sequence
+auto owen_scramble(uint32_t x, uint32_t seed) -> uint32_t {
+    // Laine-Karras permutation on the reversed bits, where carries only go upwards
+    x  = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6C50B47Cu;
+    x ^= x * 0xB82F1E52u;
+    x ^= x * 0xC7AFE638u;
+    x ^= x * 0x8D22F6E6u;
+    return reverse_bits(x);
+}
+
+auto hash(uint32_t a, uint32_t b) -> uint32_t { return static_cast<uint32_t>(hash_seed(a, b)); }
+
+auto to_float(uint32_t x) -> float { return static_cast<float>(x >> 8) * 0x1.0p-24f; }
+
+// ---- Blue noise ---------------------------------------------------------------------------------
+
+constexpr uint32_t MASK_TEXELS = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+/// the ranks are stored in the top bits of a 32 bit fraction
+constexpr int MASK_SHIFT = 32 - std::countr_zero(MASK_TEXELS);
+
+/// @brief void and cluster (Ulichney 1993) on the torus: the energy of a texel is the sum of a
+/// Gaussian over the set texels around it. Starting from a relaxed random pattern, the set texel
+/// in the tightest cluster is removed (ranked from the top down) and the unset texel in the
+/// largest void is added (ranked from the middle up) until every texel has a rank.
+auto make_blue_noise_mask() -> std::vector<uint16_t> {
+    constexpr int SIZE    = static_cast<int>(BLUE_NOISE_SIZE);
+    constexpr int RADIUS  = 6;
+    constexpr float SIGMA = 1.5f;
+    float kernel[2 * RADIUS + 1][2 * RADIUS + 1];
+    for (int dy = -RADIUS; dy <= RADIUS; ++dy) {
+        for (int dx = -RADIUS; dx <= RADIUS; ++dx) {
+            kernel[dy + RADIUS][dx + RADIUS] =
+                std::exp(-static_cast<float>(dx * dx + dy * dy) / (2.0f * SIGMA * SIGMA));
+        }
+    }
+
+    std::vector<uint8_t> set(MASK_TEXELS, 0);
+    std::vector<float> energy(MASK_TEXELS, 0.0f);
+    auto toggle = [&](uint32_t texel, bool on) {
+        set[texel]       = on;
+        float const sign = on ? 1.0f : -1.0f;
+        int const x      = static_cast<int>(texel % BLUE_NOISE_SIZE);
+        int const y      = static_cast<int>(texel / BLUE_NOISE_SIZE);
+        for (int dy = -RADIUS; dy <= RADIUS; ++dy) {
+            int const row = (y + dy + SIZE) % SIZE * SIZE;
+            for (int dx = -RADIUS; dx <= RADIUS; ++dx)
+                energy[row + (x + dx + SIZE) % SIZE] += sign * kernel[dy + RADIUS][dx + RADIUS];
+        }
+    };
+    // the set texel with the most energy, or the unset one with the least
+    auto tightest_cluster = [&]() {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < MASK_TEXELS; ++i) {
+            if (set[i] && (!set[best] || energy[i] > energy[best]))
+                best = i;
+        }
+        return best;
+    };
+    auto largest_void = [&]() {
+        uint32_t best = 0;
+        for (uint32_t i = 1; i < MASK_TEXELS; ++i) {
+            if (!set[i] && (set[best] || energy[i] < energy[best]))
+                best = i;
+        }
+        return best;
+    };
+
+    // a tenth of the texels at random, then moved from clusters into voids until it settles
+    Pcg32 rng(0xB1E);
+    uint32_t initial = 0;
+    while (initial < MASK_TEXELS / 10) {
+        uint32_t const texel = rng.next_u32() % MASK_TEXELS;
+        if (!set[texel]) {
+            toggle(texel, true);
+            ++initial;
+        }
+    }
+    for (;;) {
+        uint32_t const cluster = tightest_cluster();
+        toggle(cluster, false);
+        uint32_t const hole = largest_void();
+        toggle(hole, true);
+        if (hole == cluster)
+            break;
+    }
+
+    std::vector<uint16_t> rank(MASK_TEXELS);
+    auto const initial_set    = set;
+    auto const initial_energy = energy;
+    for (uint32_t r = initial; r-- > 0;) {
+        uint32_t const cluster = tightest_cluster();
+        toggle(cluster, false);
+        rank[cluster] = static_cast<uint16_t>(r);
+    }
+    // with the set and unset texels swapping roles past the middle, the tightest cluster of unset
+    // texels is the largest void of the set ones, so one loop ranks the rest
+    set    = initial_set;
+    energy = initial_energy;
+    for (uint32_t r = initial; r < MASK_TEXELS; ++r) {
+        uint32_t const hole = largest_void();
+        toggle(hole, true);
+        rank[hole] = static_cast<uint16_t>(r);
+    }
+    return rank;
+}
+
+/// offset of the mask for `dimension`, spread over the tile by the R2 sequence so the dimensions
+/// see uncorrelated parts of it
+auto mask_rank(uint32_t x, uint32_t y, uint32_t dimension) -> uint32_t {
+    float const t     = static_cast<float>(dimension * BLUE_NOISE_SIZE);
+    uint32_t const mx = (x + static_cast<uint32_t>(t * 0.7548776662f)) % BLUE_NOISE_SIZE;
+    uint32_t const my = (y + static_cast<uint32_t>(t * 0.5698402910f)) % BLUE_NOISE_SIZE;
+    return blue_noise_mask()[my * BLUE_NOISE_SIZE + mx];
+}
+
+} // namespace
+
+auto sampler_name(SamplerType type) -> char const * {
+    switch (type) {
+    case SamplerType::Independent:
+        return "independent";
+    case SamplerType::Sobol:
+        return "sobol";
+    case SamplerType::BlueNoise:
+        return "blue-noise";
+    }
+    return "unknown";
+}
+
+auto parse_sampler_type(std::string_view name, SamplerType &type) -> bool {
+    for (auto candidate : SAMPLER_TYPES) {
+        if (name == sampler_name(candidate)) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+auto blue_noise_mask() -> uint16_t const * {
+    static std::vector<uint16_t> const mask = make_blue_noise_mask();
+    return mask.data();
+}
+
+Sampler::Sampler(SamplerType type, uint32_t x, uint32_t y, uint32_t frame_index, uint64_t stream)
+    : m_type(type), m_x(x), m_y(y) {
+    if (type == SamplerType::Independent)
+        m_rng = Pcg32(hash_seed(x, y, frame_index), stream);
+    else
+        m_seed = hash(x, y);
+}
+
+// A dimension shuffles the sample index with its own seed, so the points of different dimensions
+// of one sample are unrelated, then scrambles the Sobol point with another.
+
+auto Sampler::sobol_1d() -> float {
+    uint32_t const seed  = hash(m_seed, m_dimension++);
+    uint32_t const index = owen_scramble(m_index, seed);
+    return to_float(owen_scramble(sobol(index, 0), hash(seed, 1)));
+}
+
+auto Sampler::sobol_2d() -> Sample2D {
+    uint32_t const seed  = hash(m_seed, m_dimension++);
+    uint32_t const index = owen_scramble(m_index, seed);
+    return {to_float(owen_scramble(sobol(index, 0), hash(seed, 1))),
+            to_float(owen_scramble(sobol(index, 1), hash(seed, 2)))};
+}
+
+// Every pixel uses the same shuffled, unscrambled Sobol points, shifted (Cranley-Patterson
+// rotation) by the mask rank of the pixel. The first sample of neighbouring pixels is then as
+// different as the mask ranks, and so is their error (Georgiev and Fajardo 2016).
+
+auto Sampler::blue_noise_1d() -> float {
+    uint32_t const dimension = m_dimension++;
+    uint32_t const index     = owen_scramble(m_index, hash(dimension, 0xB1E));
+    uint32_t const shift     = mask_rank(m_x, m_y, 2 * dimension) << MASK_SHIFT;
+    return to_float(sobol(index, 0) + shift);
+}
+
+auto Sampler::blue_noise_2d() -> Sample2D {
+    uint32_t const dimension = m_dimension++;
+    uint32_t const index     = owen_scramble(m_index, hash(dimension, 0xB1E));
+    uint32_t const shift_x   = mask_rank(m_x, m_y, 2 * dimension) << MASK_SHIFT;
+    uint32_t const shift_y   = mask_rank(m_x, m_y, 2 * dimension + 1) << MASK_SHIFT;
+    return {to_float(sobol(index, 0) + shift_x), to_float(sobol(index, 1) + shift_y)};
+}
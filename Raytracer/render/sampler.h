@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "render/rng.h"
+
+/// where the random numbers of the paths come from, see `Sampler`
+enum class SamplerType : uint8_t {
+    /// independent uniform random numbers, the baseline
+    Independent,
+    /// Owen scrambled Sobol points, stratified over the samples of a pixel
+    Sobol,
+    /// Sobol points shifted by a blue noise mask, so the error of neighbouring pixels differs and
+    /// looks like fine grain rather than blotches at low sample counts
+    BlueNoise,
+};
+
+inline constexpr SamplerType SAMPLER_TYPES[] = {SamplerType::Independent, SamplerType::Sobol,
+                                                SamplerType::BlueNoise};
+
+auto sampler_name(SamplerType type) -> char const *;
+
+/// parses the names returned by `sampler_name()`, returns false for unknown names
+auto parse_sampler_type(std::string_view name, SamplerType &type) -> bool;
+
+struct Sample2D {
+    float x, y;
+};
+
+/// Random numbers of the paths through one pixel.
+///
+/// Every sample of the pixel consumes its numbers in the same order, one dimension per
+/// `next_1d()`/`next_2d()` call (camera jitter, light choice, point on the light, russian
+/// roulette, bounce direction, ...). The Sobol and blue noise samplers draw the n-th number of a
+/// dimension from a low discrepancy sequence indexed by the sample index, so the samples of a
+/// pixel cover every dimension evenly instead of clumping. Dimensions are decorrelated by
+/// shuffling the sequence per dimension (padding), so a single 2D sequence serves every bounce.
+///
+/// Small and trivially copyable, render code keeps one per pixel or path.
+class Sampler {
+    Pcg32 m_rng;
+    SamplerType m_type = SamplerType::Independent;
+    uint32_t m_x       = 0;
+    uint32_t m_y       = 0;
+    /// scrambles the Sobol points of the pixel
+    uint32_t m_seed      = 0;
+    uint32_t m_index     = 0;
+    uint32_t m_dimension = 0;
+
+    auto sobol_1d() -> float;
+    auto sobol_2d() -> Sample2D;
+    auto blue_noise_1d() -> float;
+    auto blue_noise_2d() -> Sample2D;
+
+  public:
+    Sampler() = default;
+
+    /// @param x, y the pixel
+    /// @param frame_index seeds the random numbers of the independent sampler, the other ones
+    /// take the frame into account through the sample index
+    /// @param stream independent random stream of the pixel, e.g. one per sample
+    Sampler(SamplerType type, uint32_t x, uint32_t y, uint32_t frame_index, uint64_t stream = 1);
+
+    /// @brief starts the next sample of the pixel, from the first dimension on
+    /// @param index of the sample in the pixel's sequence, consecutive passes continue it
+    void start_sample(uint32_t index) {
+        m_index     = index;
+        m_dimension = 0;
+    }
+
+    /// uniform number in [0, 1)
+    auto next_1d() -> float {
+        switch (m_type) {
+        case SamplerType::Sobol:
+            return sobol_1d();
+        case SamplerType::BlueNoise:
+            return blue_noise_1d();
+        default:
+            return m_rng.next_float();
+        }
+    }
+
+    /// uniform point in [0, 1)^2, stratified in both dimensions together
+    auto next_2d() -> Sample2D {
+        switch (m_type) {
+        case SamplerType::Sobol:
+            return sobol_2d();
+        case SamplerType::BlueNoise:
+            return blue_noise_2d();
+        default: {
+            float const x = m_rng.next_float();
+            return {x, m_rng.next_float()};
+        }
+        }
+    }
+};
+
+/// side length of the tiled blue noise mask, a power of two
+inline constexpr uint32_t BLUE_NOISE_SIZE = 64;
+
+/// @brief rank of every texel of a blue noise mask made with the void and cluster method, row by
+/// row. Built on first use and tiled over the image. Thresholding the mask at any rank gives
+/// evenly spread points without low frequency clumps.
+auto blue_noise_mask() -> uint16_t const *;
@@ -0,0 +1,328 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+#include "utils/profiler.h"
+
+auto Scene::geometric_normal(Hit const &hit) const -> Vec3 {
+    if (hit.instance == ~0u)
+        return geometric_normal(hit.prim);
+    // normals transform with the inverse transpose
+    Vec3 const n = instances.mesh_of(hit.instance).geometric_normal(hit.prim);
+    return normalize(instances.instance(hit.instance).world_to_object.transposed_vector(n));
+}
+
+auto Scene::albedo(Hit const &hit, float footprint) const -> Vec3 {
+    if (hit.instance != ~0u) {
+        // the footprint is looked up in object space, scaled like the instance
+        Transform const &to_object = instances.instance(hit.instance).world_to_object;
+        float const scale          = length(to_object.vector(Vec3{1.0f})) / std::sqrt(3.0f);
+        Hit local                  = hit;
+        local.instance             = ~0u;
+        return instances.mesh_of(hit.instance).albedo(local, footprint * scale);
+    }
+
+    Material const &m = material(hit.prim);
+    if (m.albedo_texture >= texture_ids.size() || texcoords.empty())
+        return m.albedo;
+    uint32_t const texture = texture_ids[m.albedo_texture];
+    if (texture == NO_TEXTURE)
+        return m.albedo;
+
+    float const *uv = texcoords.data() + 6 * size_t{hit.prim};
+    float const w   = 1.0f - hit.u - hit.v;
+    float const u   = w * uv[0] + hit.u * uv[2] + hit.v * uv[4];
+    float const v   = w * uv[1] + hit.u * uv[3] + hit.v * uv[5];
+
+    // texture space is stretched relative to world space by the ratio of the triangle areas
+    float const uv_area = 0.5f * std::fabs((uv[2] - uv[0]) * (uv[5] - uv[1]) -
+                                           (uv[4] - uv[0]) * (uv[3] - uv[1]));
+    float const scale   = std::sqrt(uv_area / std::max(triangle_area(hit.prim), 1.0e-12f));
+    return m.albedo * textures->sample(texture, u, v, footprint * scale);
+}
+
+void Scene::bind_textures(TextureCache &cache) {
+    textures = &cache;
+    texture_ids.clear();
+    for (auto const &path : texture_paths)
+        texture_ids.push_back(cache.add_texture(path));
+    if (!texture_paths.empty())
+        spdlog::info("scene references {} textures", texture_paths.size());
+    for (auto const &mesh : instances.meshes())
+        mesh->bind_textures(cache);
+}
+
+auto Scene::add_material(Material const &material) -> uint32_t {
+    materials.push_back(material);
+    return static_cast<uint32_t>(materials.size() - 1);
+}
+
+void Scene::add_quad(Vec3 p0, Vec3 p1, Vec3 p2, Vec3 p3, uint32_t material) {
+    auto const base = static_cast<uint32_t>(positions.size());
+    positions.append({p0, p1, p2, p3});
+    indices.append({base, base + 1, base + 2, base, base + 2, base + 3});
+    material_ids.append({material, material});
+}
+
+void Scene::add_box(Vec3 lo, Vec3 hi, float angle, uint32_t material) {
+    Vec3 const center = (lo + hi) * 0.5f;
+    float const c     = std::cos(angle);
+    float const s     = std::sin(angle);
+
+    auto corner = [&](int i) {
+        Vec3 const p{i & 1 ? hi.x : lo.x, i & 2 ? hi.y : lo.y, i & 4 ? hi.z : lo.z};
+        Vec3 const d = p - center;
+        return center + Vec3{c * d.x + s * d.z, d.y, -s * d.x + c * d.z};
+    };
+
+    // faces as corner indices, counter-clockwise seen from outside
+    constexpr int faces[6][4] = {{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4},
+                                 {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}};
+    for (auto const &f : faces)
+        add_quad(corner(f[0]), corner(f[1]), corner(f[2]), corner(f[3]), material);
+}
+
+void Scene::collect_lights() {
+    emissive_triangles.clear();
+    light_bvh = {};
+    for (size_t i = 0; i < triangle_count(); ++i) {
+        if (material(i).is_emissive())
+            emissive_triangles.push_back(static_cast<uint32_t>(i));
+    }
+}
+
+void Scene::build_acceleration(ThreadPool &pool, std::filesystem::path const &cache_path) {
+    PROFILE_SCOPE("build");
+    auto const start = std::chrono::steady_clock::now();
+    auto elapsed_ms  = [](std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since)
+            .count();
+    };
+
+    uint64_t const key = cache_path.empty() ? 0 : geometry_hash(*this);
+    if (!cache_path.empty() && bvh.load(cache_path, key, triangle_count())) {
+        spdlog::info("loaded BVH ({} nodes) from {} in {:.1f} ms", bvh.nodes().size(),
+                     cache_path.string(), elapsed_ms(start));
+    } else {
+        bvh.build(pool, *this);
+        spdlog::info("built BVH over {} triangles ({} nodes) in {:.1f} ms", triangle_count(),
+                     bvh.nodes().size(), elapsed_ms(start));
+
+        if (!cache_path.empty() && bvh.save(cache_path, key))
+            spdlog::info("cached BVH in {}", cache_path.string());
+    }
+
+    if (!instances.empty()) {
+        for (auto const &mesh : instances.meshes()) {
+            if (mesh->bvh.empty())
+                mesh->bvh.build(pool, *mesh);
+        }
+        instances.build(pool);
+        spdlog::info("built top level over {} instances of {} meshes in {:.1f} ms",
+                     instances.instances().size(), instances.meshes().size(), elapsed_ms(start));
+    }
+
+    if (!emissive_triangles.empty()) {
+        auto const light_start = std::chrono::steady_clock::now();
+        light_bvh.build(pool, *this);
+        spdlog::info("built light BVH over {} emissive triangles in {:.1f} ms",
+                     emissive_triangles.size(), elapsed_ms(light_start));
+    }
+
+    set_simd_level(default_simd_level());
+}
+
+void Scene::refit_acceleration(ThreadPool &pool) {
+    PROFILE_SCOPE("refit");
+    if (!compact.empty()) {
+        spdlog::error("compact geometry is static and can't be refit");
+        return;
+    }
+    if (!bvh.empty()) {
+        bvh.refit(pool, *this);
+        if (kernels)
+            wide_bvh.build(bvh, kernels->bvh_width);
+    }
+    if (!instances.empty())
+        instances.refit(pool);
+    if (!light_bvh.empty())
+        light_bvh.build(pool, *this);
+}
+
+auto Scene::make_compact(ThreadPool &pool, CompactSettings const &settings) -> bool {
+    bool meshes_changed = false;
+    for (auto const &mesh : instances.meshes()) {
+        if (mesh->compact.empty() && mesh->make_compact(pool, settings))
+            meshes_changed = true;
+    }
+    // quantized vertices may move a little outside the boxes the instances were placed with
+    if (meshes_changed)
+        instances.build(pool);
+
+    if (!compact.empty())
+        return true;
+    if (bvh.empty()) {
+        spdlog::error("the scene needs a BVH before it can be made compact");
+        return false;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    auto elapsed_ms  = [&start]() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+    };
+
+    size_t const bytes_before         = geometry_bytes();
+    std::vector<uint32_t> const order = compact.build(pool, *this, settings);
+    if (order.empty())
+        return false;
+
+    // per triangle attributes follow the triangles to their new place
+    std::vector<uint32_t> ids(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        ids[i] = material_ids[order[i]];
+    material_ids = std::move(ids);
+    if (!texcoords.empty()) {
+        std::vector<float> uv(texcoords.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            std::copy_n(texcoords.data() + 6 * size_t{order[i]}, 6, uv.data() + 6 * i);
+        texcoords = std::move(uv);
+    }
+    positions = {};
+    indices   = {};
+    bvh       = {};
+    wide_bvh  = {};
+    collect_lights();
+    light_bvh.build(pool, *this);
+
+    auto const triangles = static_cast<double>(std::max<size_t>(triangle_count(), 1));
+    spdlog::info("compacted {} triangles in {:.1f} ms: {:.1f} -> {:.1f} bytes per triangle, "
+                 "{:.0f}% of the vertices quantized, {:.0f}% of the indices 16 bit",
+                 triangle_count(), elapsed_ms(), static_cast<double>(bytes_before) / triangles,
+                 static_cast<double>(compact.memory_bytes()) / triangles,
+                 100.0f * compact.quantized_vertex_share(), 100.0f * compact.narrow_index_share());
+
+    set_simd_level(kernels ? kernels->level : default_simd_level());
+    return true;
+}
+
+auto Scene::bounds() const -> Aabb {
+    if (!compact.empty())
+        return compact.bounds();
+    if (!bvh.empty())
+        return bvh.nodes()[0].bounds;
+    return {};
+}
+
+auto Scene::geometry_bytes() const -> size_t {
+    if (!compact.empty())
+        return compact.memory_bytes();
+    return positions.size() * sizeof(Vec3) + indices.size() * sizeof(uint32_t) +
+           bvh.nodes().size() * sizeof(BvhNode) + bvh.prim_indices().size() * sizeof(uint32_t) +
+           wide_bvh.nodes4().size() * sizeof(WideBvhNode<4>) +
+           wide_bvh.nodes8().size() * sizeof(WideBvhNode<8>);
+}
+
+void Scene::set_simd_level(SimdLevel level) {
+    for (auto const &mesh : instances.meshes())
+        mesh->set_simd_level(level);
+    if (!compact.empty()) {
+        kernels = &compact_traversal_kernels(level);
+        spdlog::info("traversal kernels: {}, compressed 8-wide BVH with {} nodes",
+                     simd_level_name(kernels->level), compact.nodes().size());
+        return;
+    }
+    if (bvh.empty()) {
+        kernels = nullptr;
+        return;
+    }
+    kernels = &traversal_kernels(level);
+    wide_bvh.build(bvh, kernels->bvh_width);
+    spdlog::info("traversal kernels: {}, {}-wide BVH with {} nodes",
+                 simd_level_name(kernels->level), std::max(kernels->bvh_width, 2),
+                 kernels->bvh_width ? wide_bvh.node_count() : bvh.nodes().size());
+}
+
+auto Scene::intersect(Ray const &ray, Hit &hit) const -> bool {
+    bool found = false;
+    if (kernels) {
+        found = kernels->intersect(*this, ray, hit);
+    } else if (!bvh.empty()) {
+        found = bvh.intersect(*this, ray, hit);
+    } else {
+        for (size_t i = 0; i < triangle_count(); ++i) {
+            float t, u, v;
+            if (intersect_triangle(ray, vertex(i, 0), vertex(i, 1), vertex(i, 2), hit.t, t, u,
+                                   v)) {
+                hit   = {t, static_cast<uint32_t>(i), u, v};
+                found = true;
+            }
+        }
+    }
+    if (!instances.empty() && instances.intersect(ray, hit))
+        found = true;
+    return found;
+}
+
+auto Scene::occluded(Ray const &ray) const -> bool {
+    if (!instances.empty() && instances.occluded(ray))
+        return true;
+    if (kernels)
+        return kernels->occluded(*this, ray);
+    if (!bvh.empty())
+        return bvh.occluded(*this, ray);
+
+    for (size_t i = 0; i < triangle_count(); ++i) {
+        float t, u, v;
+        if (intersect_triangle(ray, vertex(i, 0), vertex(i, 1), vertex(i, 2), ray.t_max, t, u, v))
+            return true;
+    }
+    return false;
+}
+
+void Scene::intersect(RayPacket8 &packet) const {
+    if (kernels) {
+        kernels->intersect_packet8(*this, packet);
+        if (instances.empty())
+            return;
+    }
+    // instances are traced one ray at a time, after the packet found the closest triangles
+    for (int lane = 0; lane < 8; ++lane) {
+        if (!(packet.active & (1u << lane)))
+            continue;
+        Hit hit          = packet.hit(lane);
+        Ray const ray    = packet.ray(lane);
+        bool const found = kernels ? instances.intersect(ray, hit) : intersect(ray, hit);
+        if (found)
+            packet.set_hit(lane, hit);
+    }
+}
+
+auto Scene::make_cornell_box() -> Scene {
+    Scene scene;
+    auto const white = scene.add_material({Vec3{0.73f, 0.73f, 0.73f}});
+    auto const red   = scene.add_material({Vec3{0.65f, 0.05f, 0.05f}});
+    auto const green = scene.add_material({Vec3{0.12f, 0.45f, 0.15f}});
+    auto const light = scene.add_material({Vec3{0.78f}, Vec3{17.0f, 12.0f, 4.0f}});
+
+    // floor, ceiling, back wall
+    scene.add_quad({-1, 0, -1}, {-1, 0, 1}, {1, 0, 1}, {1, 0, -1}, white);
+    scene.add_quad({-1, 2, -1}, {1, 2, -1}, {1, 2, 1}, {-1, 2, 1}, white);
+    scene.add_quad({-1, 0, -1}, {1, 0, -1}, {1, 2, -1}, {-1, 2, -1}, white);
+    // left and right walls
+    scene.add_quad({-1, 0, -1}, {-1, 2, -1}, {-1, 2, 1}, {-1, 0, 1}, red);
+    scene.add_quad({1, 0, -1}, {1, 0, 1}, {1, 2, 1}, {1, 2, -1}, green);
+    // area light, slightly below the ceiling
+    scene.add_quad({-0.25f, 1.98f, -0.25f}, {0.25f, 1.98f, -0.25f}, {0.25f, 1.98f, 0.25f},
+                   {-0.25f, 1.98f, 0.25f}, light);
+
+    scene.add_box({-0.65f, 0.0f, -0.55f}, {-0.05f, 1.2f, 0.05f}, 0.3f, white);
+    scene.add_box({0.05f, 0.0f, -0.05f}, {0.65f, 0.6f, 0.55f}, -0.3f, white);
+
+    scene.collect_lights();
+    return scene;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "render/bvh.h"
+#include "render/compact_geometry.h"
+#include "render/instancing.h"
+#include "render/intersect.h"
+#include "render/light_bvh.h"
+#include "render/math.h"
+#include "render/texture_cache.h"
+#include "render/traversal.h"
+#include "render/wide_bvh.h"
+#include "utils/buffer.h"
+
+struct Material {
+    Vec3 albedo{0.8f};
+    Vec3 emission{0.0f};
+    /// index into `Scene::texture_paths`, the texture is multiplied with `albedo`
+    uint32_t albedo_texture = NO_TEXTURE;
+
+    auto is_emissive() const -> bool { return max_component(emission) > 0.0f; }
+};
+
+/// Triangle soup scene the CPU backend renders. The geometry buffers either own their data or
+/// point straight into a mapped scene file, see `load_scene_file()`.
+///
+/// Meshes placed many times go into `instances` instead of being copied into the soup. Only the
+/// triangles of the scene itself are sampled as lights, emissive instanced meshes are only found
+/// by paths that hit them.
+struct Scene {
+    Buffer<Vec3> positions;
+    /// three vertex indices per triangle
+    Buffer<uint32_t> indices;
+    /// one material index per triangle
+    Buffer<uint32_t> material_ids;
+    Buffer<Material> materials;
+    /// texture coordinates, two per triangle corner, empty if the scene has none
+    Buffer<float> texcoords;
+    /// image files the materials reference, see `Material::albedo_texture`
+    std::vector<std::string> texture_paths;
+
+    /// where the textures are looked up, set by `bind_textures()`
+    TextureCache *textures = nullptr;
+    /// id in `textures` of every entry of `texture_paths`
+    std::vector<uint32_t> texture_ids;
+
+    /// triangles with an emissive material, filled by `collect_lights()`
+    std::vector<uint32_t> emissive_triangles;
+    /// picks among `emissive_triangles` for next event estimation, see `build_acceleration()`
+    LightBvh light_bvh;
+
+    /// radiance of rays escaping the scene
+    Vec3 background{0.0f};
+
+    /// acceleration structure over the triangles, see `build_acceleration()`
+    Bvh bvh;
+    /// `bvh` collapsed to the node width of `kernels`
+    WideBvh wide_bvh;
+    /// SIMD traversal kernels, picked by `set_simd_level()`
+    TraversalKernels const *kernels = nullptr;
+    /// triangles and BVH in compressed form, replacing `positions`, `indices`, `bvh` and
+    /// `wide_bvh` after `make_compact()`
+    CompactGeometry compact;
+
+    /// meshes placed with a transform, intersected along with the triangles
+    InstanceLayer instances;
+
+    auto triangle_count() const -> size_t { return material_ids.size(); }
+
+    auto vertex(size_t triangle, int corner) const -> Vec3 {
+        if (!compact.empty())
+            return compact.vertex(triangle, corner);
+        return positions[indices[3 * triangle + corner]];
+    }
+
+    auto triangle_bounds(size_t triangle) const -> Aabb {
+        Aabb box;
+        for (int c = 0; c < 3; ++c)
+            box.extend(vertex(triangle, c));
+        return box;
+    }
+
+    auto geometric_normal(size_t triangle) const -> Vec3 {
+        Vec3 const p0 = vertex(triangle, 0);
+        return normalize(cross(vertex(triangle, 1) - p0, vertex(triangle, 2) - p0));
+    }
+
+    auto triangle_area(size_t triangle) const -> float {
+        Vec3 const p0 = vertex(triangle, 0);
+        return 0.5f * length(cross(vertex(triangle, 1) - p0, vertex(triangle, 2) - p0));
+    }
+
+    auto material(size_t triangle) const -> Material const & {
+        return materials[material_ids[triangle]];
+    }
+
+    /// the scene or instanced mesh the triangle of `hit` belongs to
+    auto hit_mesh(Hit const &hit) const -> Scene const & {
+        return hit.instance == ~0u ? *this : instances.mesh_of(hit.instance);
+    }
+
+    /// world space normal of the triangle at `hit`, which may be on an instance
+    auto geometric_normal(Hit const &hit) const -> Vec3;
+
+    auto material(Hit const &hit) const -> Material const & {
+        return hit_mesh(hit).material(hit.prim);
+    }
+
+    /// @brief albedo at `hit`, textured if its material has a texture
+    /// @param footprint width of the area the lookup stands for in world units, picks the mip level
+    auto albedo(Hit const &hit, float footprint) const -> Vec3;
+
+    /// registers `texture_paths` of the scene and of its instanced meshes with `cache`, textures
+    /// that can't be read are left out
+    void bind_textures(TextureCache &cache);
+
+    auto add_material(Material const &material) -> uint32_t;
+
+    /// adds the quad `p0, p1, p2, p3` (counter-clockwise) as two triangles
+    void add_quad(Vec3 p0, Vec3 p1, Vec3 p2, Vec3 p3, uint32_t material);
+
+    /// adds an axis aligned box rotated by `angle` radians around the y axis through its center
+    void add_box(Vec3 lo, Vec3 hi, float angle, uint32_t material);
+
+    /// rebuilds `emissive_triangles`, call after adding geometry. Drops `light_bvh`, lights are
+    /// picked uniformly until the next `build_acceleration()`.
+    void collect_lights();
+
+    /// @brief builds `bvh`, or loads it from `cache_path` if that holds a tree for this geometry,
+    /// and selects the traversal kernels for `default_simd_level()`. Instanced meshes that have no
+    /// BVH yet get one, then the top level of `instances` is built. Builds `light_bvh` too.
+    /// @param cache_path where the tree is cached, empty to always build and not cache it
+    void build_acceleration(ThreadPool &pool, std::filesystem::path const &cache_path = {});
+
+    /// @brief refits `bvh` after vertices moved, keeping the topology, and refits `instances`.
+    /// Much faster than `build_acceleration()` for animated meshes as long as they deform rather
+    /// than tear apart; the triangle count must not change. `light_bvh` is rebuilt, it is cheap.
+    void refit_acceleration(ThreadPool &pool);
+
+    /// @brief replaces the triangles and the BVH with a `CompactGeometry` built from them, for
+    /// scenes that would not fit into memory otherwise, and does the same for the instanced
+    /// meshes. The triangles are reordered, so triangle indices taken before are invalid after.
+    /// Needs the BVH, compact scenes can't be refit.
+    /// @return false if the scene has no BVH or it can't be compressed, the scene stays as it is
+    auto make_compact(ThreadPool &pool, CompactSettings const &settings = {}) -> bool;
+
+    /// bounds of the triangles, empty as long as there is no acceleration structure
+    auto bounds() const -> Aabb;
+
+    /// bytes of the vertex and index buffers and of the acceleration structure of the triangles,
+    /// not counting instanced meshes
+    auto geometry_bytes() const -> size_t;
+
+    /// selects the traversal kernels for `level` (or the best supported level below it) and
+    /// collapses the BVH to the node width they need, for the instanced meshes too
+    void set_simd_level(SimdLevel level);
+
+    /// closest hit along `ray`, uses the BVH if it was built, tests every triangle otherwise.
+    /// Instances are tested too.
+    auto intersect(Ray const &ray, Hit &hit) const -> bool;
+
+    /// any hit along `ray`
+    auto occluded(Ray const &ray) const -> bool;
+
+    /// closest hits of a coherent packet of rays
+    void intersect(RayPacket8 &packet) const;
+
+    /// the classic Cornell box, 2x2x2 units, open towards +z
+    static auto make_cornell_box() -> Scene;
+};
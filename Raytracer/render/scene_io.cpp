@@ -0,0 +1,718 @@
+#include "scene_io.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "utils/mapped_file.h"
+
+namespace {
+
+// ---- Binary container ---------------------------------------------------------------------------
+
+constexpr char SCENE_MAGIC[8]        = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+constexpr uint32_t SCENE_VERSION     = 2;
+constexpr uint32_t ENDIAN_TAG        = 0x01020304u;
+constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+enum Section : uint32_t {
+    Positions,
+    Indices,
+    MaterialIds,
+    Materials,
+    Texcoords,
+    /// texture paths, each terminated by a null character
+    TexturePaths,
+    SECTION_COUNT
+};
+
+struct SceneFileSection {
+    /// from the start of the file, a multiple of `SECTION_ALIGNMENT`
+    uint64_t offset;
+    /// number of elements
+    uint64_t count;
+};
+
+struct SceneFileHeader {
+    char magic[8];
+    uint32_t version;
+    /// `ENDIAN_TAG` as written by the producer, files are only read on machines of the same order
+    uint32_t endian;
+    float background[3];
+    uint32_t section_count;
+    SceneFileSection sections[SECTION_COUNT];
+};
+
+// the arrays are stored in their in-memory layout, changing any of these needs a new version
+static_assert(sizeof(Vec3) == 12 && alignof(Vec3) == 4);
+static_assert(sizeof(Material) == 28 && std::is_trivially_copyable_v<Material>);
+static_assert(std::is_trivially_copyable_v<SceneFileHeader>);
+
+auto align_up(uint64_t offset) -> uint64_t {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+/// @brief the elements of `section` as a view into `file`
+/// @return false if the section lies outside the file or is misaligned
+template <typename T>
+auto map_section(std::shared_ptr<MappedFile const> const &file, SceneFileSection const &section,
+                 Buffer<T> &buffer) -> bool {
+    if (section.offset % SECTION_ALIGNMENT != 0 || section.offset > file->size() ||
+        section.count > (file->size() - section.offset) / sizeof(T))
+        return false;
+    auto const *data = reinterpret_cast<T const *>(file->data() + section.offset);
+    buffer           = Buffer<T>::view(data, section.count, file);
+    return true;
+}
+
+auto milliseconds_since(std::chrono::steady_clock::time_point start) -> double {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// ---- Text parsing -------------------------------------------------------------------------------
+
+/// whitespace separated tokens of a memory mapped text file
+class TextCursor {
+    char const *m_pos;
+    char const *m_end;
+
+  public:
+    TextCursor(char const *begin, char const *end) : m_pos(begin), m_end(end) {}
+
+    auto at_end() const -> bool { return m_pos >= m_end; }
+    auto position() const -> char const * { return m_pos; }
+
+    void skip_spaces() {
+        while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\r'))
+            ++m_pos;
+    }
+
+    auto at_line_end() -> bool {
+        skip_spaces();
+        return m_pos >= m_end || *m_pos == '\n' || *m_pos == '#';
+    }
+
+    void next_line() {
+        while (m_pos < m_end && *m_pos != '\n')
+            ++m_pos;
+        if (m_pos < m_end)
+            ++m_pos;
+    }
+
+    /// the next token on the current line, empty at the end of the line
+    auto token() -> std::string_view {
+        if (at_line_end())
+            return {};
+        char const *begin = m_pos;
+        while (m_pos < m_end && !std::isspace(static_cast<unsigned char>(*m_pos)))
+            ++m_pos;
+        return {begin, static_cast<size_t>(m_pos - begin)};
+    }
+
+    /// the rest of the current line without surrounding whitespace
+    auto rest_of_line() -> std::string_view {
+        skip_spaces();
+        char const *begin = m_pos;
+        while (m_pos < m_end && *m_pos != '\n')
+            ++m_pos;
+        std::string_view line(begin, static_cast<size_t>(m_pos - begin));
+        while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back())))
+            line.remove_suffix(1);
+        return line;
+    }
+
+    /// the next token on any line, skipping line breaks, for formats that don't care about lines
+    auto any_token() -> std::string_view {
+        while (m_pos < m_end && std::isspace(static_cast<unsigned char>(*m_pos)))
+            ++m_pos;
+        return token();
+    }
+};
+
+template <typename T> auto parse_number(std::string_view text, T &value) -> bool {
+    if (!text.empty() && text.front() == '+')
+        text.remove_prefix(1);
+    auto const [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc{} && end == text.data() + text.size();
+}
+
+auto parse_vec3(TextCursor &cursor, Vec3 &v) -> bool {
+    return parse_number(cursor.token(), v.x) && parse_number(cursor.token(), v.y) &&
+           parse_number(cursor.token(), v.z);
+}
+
+/// every imported scene goes through this: lights are collected and scenes without emitters get
+/// a white sky so that they don't render black
+void finish_import(Scene &scene, std::filesystem::path const &path, double elapsed_ms) {
+    scene.collect_lights();
+    if (scene.emissive_triangles.empty()) {
+        scene.background = Vec3{1.0f};
+        spdlog::info("{} has no emissive materials, lighting it with a white background",
+                     path.string());
+    }
+    spdlog::info("imported {} ({} vertices, {} triangles, {} materials) in {:.1f} ms",
+                 path.string(), scene.positions.size(), scene.triangle_count(),
+                 scene.materials.size(), elapsed_ms);
+}
+
+/// appends the polygon `corners` as a triangle fan
+void add_polygon(std::vector<uint32_t> const &corners, uint32_t material,
+                 std::vector<uint32_t> &indices, std::vector<uint32_t> &material_ids) {
+    for (size_t i = 2; i < corners.size(); ++i) {
+        indices.insert(indices.end(), {corners[0], corners[i - 1], corners[i]});
+        material_ids.push_back(material);
+    }
+}
+
+// ---- OBJ ----------------------------------------------------------------------------------------
+
+/// @brief reads the `Kd` and `Ke` colors and `map_Kd` textures of the materials in an MTL file
+/// into `library`, texture files are appended to `texture_paths`
+void load_mtl(std::filesystem::path const &path, std::unordered_map<std::string, Material> &library,
+              std::vector<std::string> &texture_paths) {
+    auto file = MappedFile::open(path);
+    if (!file)
+        return;
+
+    auto const *text = reinterpret_cast<char const *>(file->data());
+    TextCursor cursor(text, text + file->size());
+    Material *current = nullptr;
+    for (; !cursor.at_end(); cursor.next_line()) {
+        auto const keyword = cursor.token();
+        if (keyword == "newmtl") {
+            current = &library[std::string(cursor.rest_of_line())];
+        } else if (current && keyword == "Kd") {
+            parse_vec3(cursor, current->albedo);
+        } else if (current && keyword == "Ke") {
+            parse_vec3(cursor, current->emission);
+        } else if (current && keyword == "map_Kd") {
+            // options like `-bm 1` aren't supported, the file name is the last token
+            auto const line  = cursor.rest_of_line();
+            auto const name  = line.substr(line.find_last_of(" \t") + 1);
+            auto const file  = (path.parent_path() / name).string();
+            auto const found = std::find(texture_paths.begin(), texture_paths.end(), file);
+
+            current->albedo_texture = static_cast<uint32_t>(found - texture_paths.begin());
+            if (found == texture_paths.end())
+                texture_paths.push_back(file);
+        }
+    }
+}
+
+/// @brief resolves a face corner like `7`, `7/2`, `7//3` or `-1/-1/-1` to a vertex index
+auto parse_obj_corner(std::string_view token, size_t vertex_count, uint32_t &index) -> bool {
+    int64_t value = 0;
+    if (!parse_number(token.substr(0, token.find('/')), value) || value == 0)
+        return false;
+    // 1-based, negative values count back from the last vertex
+    int64_t const resolved = value > 0 ? value - 1 : static_cast<int64_t>(vertex_count) + value;
+    if (resolved < 0 || resolved >= static_cast<int64_t>(vertex_count))
+        return false;
+    index = static_cast<uint32_t>(resolved);
+    return true;
+}
+
+/// @brief resolves the texture coordinate of a face corner like `7/2` or `7/2/3`
+/// @param index set to `~0u` if the corner has none
+auto parse_obj_texcoord(std::string_view token, size_t texcoord_count, uint32_t &index) -> bool {
+    index            = ~0u;
+    auto const slash = token.find('/');
+    if (slash == std::string_view::npos)
+        return true;
+    auto const text = token.substr(slash + 1, token.find('/', slash + 1) - slash - 1);
+    return text.empty() || parse_obj_corner(text, texcoord_count, index);
+}
+
+// ---- PLY ----------------------------------------------------------------------------------------
+
+enum class PlyFormat { Ascii, BinaryLittleEndian, BinaryBigEndian };
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Invalid };
+
+struct PlyProperty {
+    std::string name;
+    PlyType type       = PlyType::Invalid;
+    /// type of the element count of list properties, `Invalid` for scalar properties
+    PlyType count_type = PlyType::Invalid;
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+auto parse_ply_type(std::string_view name) -> PlyType {
+    if (name == "char" || name == "int8")
+        return PlyType::Int8;
+    if (name == "uchar" || name == "uint8")
+        return PlyType::UInt8;
+    if (name == "short" || name == "int16")
+        return PlyType::Int16;
+    if (name == "ushort" || name == "uint16")
+        return PlyType::UInt16;
+    if (name == "int" || name == "int32")
+        return PlyType::Int32;
+    if (name == "uint" || name == "uint32")
+        return PlyType::UInt32;
+    if (name == "float" || name == "float32")
+        return PlyType::Float32;
+    if (name == "double" || name == "float64")
+        return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+/// reads the values of the PLY body one by one, whatever their type and encoding
+class PlyReader {
+    TextCursor m_text;
+    std::byte const *m_pos;
+    std::byte const *m_end;
+    PlyFormat m_format;
+    bool m_ok = true;
+
+    template <typename T> auto read_binary() -> double {
+        if (static_cast<size_t>(m_end - m_pos) < sizeof(T)) {
+            m_ok = false;
+            return 0.0;
+        }
+        std::byte bytes[sizeof(T)];
+        std::memcpy(bytes, m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        bool const little_endian_host = std::endian::native == std::endian::little;
+        if ((m_format == PlyFormat::BinaryLittleEndian) != little_endian_host)
+            std::reverse(bytes, bytes + sizeof(T));
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return static_cast<double>(value);
+    }
+
+  public:
+    PlyReader(std::byte const *begin, std::byte const *end, PlyFormat format)
+        : m_text(reinterpret_cast<char const *>(begin), reinterpret_cast<char const *>(end)),
+          m_pos(begin), m_end(end), m_format(format) {}
+
+    auto ok() const -> bool { return m_ok; }
+
+    auto read(PlyType type) -> double {
+        if (m_format == PlyFormat::Ascii) {
+            double value = 0.0;
+            if (!parse_number(m_text.any_token(), value))
+                m_ok = false;
+            return value;
+        }
+        switch (type) {
+        case PlyType::Int8:
+            return read_binary<int8_t>();
+        case PlyType::UInt8:
+            return read_binary<uint8_t>();
+        case PlyType::Int16:
+            return read_binary<int16_t>();
+        case PlyType::UInt16:
+            return read_binary<uint16_t>();
+        case PlyType::Int32:
+            return read_binary<int32_t>();
+        case PlyType::UInt32:
+            return read_binary<uint32_t>();
+        case PlyType::Float32:
+            return read_binary<float>();
+        case PlyType::Float64:
+            return read_binary<double>();
+        default:
+            m_ok = false;
+            return 0.0;
+        }
+    }
+};
+
+} // namespace
+
+// ---- Binary container ---------------------------------------------------------------------------
+
+auto save_scene_file(std::filesystem::path const &path, Scene const &scene) -> bool {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        spdlog::error("couldn't open {} for writing", path.string());
+        return false;
+    }
+
+    SceneFileHeader header{};
+    std::memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+    header.version       = SCENE_VERSION;
+    header.endian        = ENDIAN_TAG;
+    header.background[0] = scene.background.x;
+    header.background[1] = scene.background.y;
+    header.background[2] = scene.background.z;
+    header.section_count = SECTION_COUNT;
+
+    std::string texture_paths;
+    for (auto const &texture : scene.texture_paths)
+        texture_paths.append(texture).push_back('\0');
+
+    struct Payload {
+        void const *data;
+        uint64_t count;
+        uint64_t element_size;
+    };
+    Payload const payloads[SECTION_COUNT] = {
+        {scene.positions.data(), scene.positions.size(), sizeof(Vec3)},
+        {scene.indices.data(), scene.indices.size(), sizeof(uint32_t)},
+        {scene.material_ids.data(), scene.material_ids.size(), sizeof(uint32_t)},
+        {scene.materials.data(), scene.materials.size(), sizeof(Material)},
+        {scene.texcoords.data(), scene.texcoords.size(), sizeof(float)},
+        {texture_paths.data(), texture_paths.size(), sizeof(char)},
+    };
+
+    uint64_t offset = align_up(sizeof(SceneFileHeader));
+    for (uint32_t i = 0; i < SECTION_COUNT; ++i) {
+        header.sections[i] = {offset, payloads[i].count};
+        offset             = align_up(offset + payloads[i].count * payloads[i].element_size);
+    }
+
+    char const padding[SECTION_ALIGNMENT] = {};
+    auto pad_to = [&](uint64_t target) {
+        auto const position = static_cast<uint64_t>(file.tellp());
+        file.write(padding, static_cast<std::streamsize>(target - position));
+    };
+
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    for (uint32_t i = 0; i < SECTION_COUNT; ++i) {
+        pad_to(header.sections[i].offset);
+        file.write(static_cast<char const *>(payloads[i].data),
+                   static_cast<std::streamsize>(payloads[i].count * payloads[i].element_size));
+    }
+
+    if (!file) {
+        spdlog::error("writing {} failed", path.string());
+        return false;
+    }
+    return true;
+}
+
+auto load_scene_file(std::filesystem::path const &path) -> std::optional<Scene> {
+    auto const start = std::chrono::steady_clock::now();
+    auto file        = MappedFile::open(path);
+    if (!file)
+        return std::nullopt;
+
+    SceneFileHeader header{};
+    if (file->size() < sizeof(header)) {
+        spdlog::error("{} is not a scene file", path.string());
+        return std::nullopt;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0) {
+        spdlog::error("{} is not a scene file", path.string());
+        return std::nullopt;
+    }
+    if (header.version != SCENE_VERSION || header.endian != ENDIAN_TAG ||
+        header.section_count != SECTION_COUNT) {
+        spdlog::error("{} was written by an incompatible version or machine", path.string());
+        return std::nullopt;
+    }
+
+    Scene scene;
+    Buffer<char> texture_paths;
+    scene.background = {header.background[0], header.background[1], header.background[2]};
+    if (!map_section(file, header.sections[Positions], scene.positions) ||
+        !map_section(file, header.sections[Indices], scene.indices) ||
+        !map_section(file, header.sections[MaterialIds], scene.material_ids) ||
+        !map_section(file, header.sections[Materials], scene.materials) ||
+        !map_section(file, header.sections[Texcoords], scene.texcoords) ||
+        !map_section(file, header.sections[TexturePaths], texture_paths)) {
+        spdlog::error("{} is truncated or damaged", path.string());
+        return std::nullopt;
+    }
+
+    // the buffers are used as they are, so make sure nothing indexes out of them. This touches
+    // the index pages once, the BVH build reads them right after anyway.
+    size_t const vertex_count   = scene.positions.size();
+    size_t const material_count = scene.materials.size();
+    bool valid = scene.indices.size() == 3 * scene.material_ids.size();
+    valid      = valid && std::all_of(scene.indices.begin(), scene.indices.end(),
+                                      [&](uint32_t i) { return i < vertex_count; });
+    valid      = valid && std::all_of(scene.material_ids.begin(), scene.material_ids.end(),
+                                      [&](uint32_t i) { return i < material_count; });
+    if (!valid) {
+        spdlog::error("{} has out of range vertex or material indices", path.string());
+        return std::nullopt;
+    }
+
+    for (auto it = texture_paths.begin(); it != texture_paths.end();) {
+        auto const end = std::find(it, texture_paths.end(), '\0');
+        scene.texture_paths.emplace_back(it, end);
+        it = end == texture_paths.end() ? end : end + 1;
+    }
+    size_t const texture_count = scene.texture_paths.size();
+    valid = scene.texcoords.empty() || scene.texcoords.size() == 6 * scene.triangle_count();
+    valid = valid && std::all_of(scene.materials.begin(), scene.materials.end(),
+                                 [&](Material const &m) {
+                                     return m.albedo_texture == NO_TEXTURE ||
+                                            m.albedo_texture < texture_count;
+                                 });
+    if (!valid) {
+        spdlog::error("{} has inconsistent texture coordinates or textures", path.string());
+        return std::nullopt;
+    }
+
+    scene.collect_lights();
+    spdlog::info("mapped {} ({} triangles, {:.1f} MB) in {:.1f} ms", path.string(),
+                 scene.triangle_count(), static_cast<double>(file->size()) / (1 << 20),
+                 milliseconds_since(start));
+    return scene;
+}
+
+// ---- Interchange formats ------------------------------------------------------------------------
+
+auto import_obj(std::filesystem::path const &path) -> std::optional<Scene> {
+    auto const start = std::chrono::steady_clock::now();
+    auto file        = MappedFile::open(path);
+    if (!file)
+        return std::nullopt;
+
+    std::vector<Vec3> positions;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> material_ids;
+    std::vector<Material> materials;
+    std::unordered_map<std::string, Material> library;
+    std::unordered_map<std::string, uint32_t> material_ids_by_name;
+    std::vector<std::string> texture_paths;
+    // `vt` lines, and two per triangle corner, zero for corners without
+    std::vector<float> obj_texcoords;
+    std::vector<float> texcoords;
+    bool has_texcoords = false;
+
+    // faces before the first `usemtl` get a default material
+    auto material_id = [&](std::string const &name) {
+        auto [it, inserted] = material_ids_by_name.try_emplace(name, 0);
+        if (inserted) {
+            auto const found = library.find(name);
+            materials.push_back(found != library.end() ? found->second : Material{});
+            it->second = static_cast<uint32_t>(materials.size() - 1);
+        }
+        return it->second;
+    };
+    uint32_t current_material = ~0u;
+
+    auto const *text = reinterpret_cast<char const *>(file->data());
+    TextCursor cursor(text, text + file->size());
+    std::vector<uint32_t> corners;
+    std::vector<uint32_t> corner_texcoords;
+    size_t line = 1;
+    for (; !cursor.at_end(); cursor.next_line(), ++line) {
+        auto const keyword = cursor.token();
+        if (keyword == "v") {
+            Vec3 p;
+            if (!parse_vec3(cursor, p)) {
+                spdlog::error("{}:{}: invalid vertex", path.string(), line);
+                return std::nullopt;
+            }
+            positions.push_back(p);
+        } else if (keyword == "vt") {
+            float u, v;
+            if (!parse_number(cursor.token(), u) || !parse_number(cursor.token(), v)) {
+                spdlog::error("{}:{}: invalid texture coordinate", path.string(), line);
+                return std::nullopt;
+            }
+            obj_texcoords.insert(obj_texcoords.end(), {u, v});
+        } else if (keyword == "f") {
+            corners.clear();
+            corner_texcoords.clear();
+            for (auto token = cursor.token(); !token.empty(); token = cursor.token()) {
+                uint32_t index, texcoord;
+                if (!parse_obj_corner(token, positions.size(), index) ||
+                    !parse_obj_texcoord(token, obj_texcoords.size() / 2, texcoord)) {
+                    spdlog::error("{}:{}: invalid face corner '{}'", path.string(), line, token);
+                    return std::nullopt;
+                }
+                corners.push_back(index);
+                corner_texcoords.push_back(texcoord);
+            }
+            if (current_material == ~0u)
+                current_material = material_id("");
+            add_polygon(corners, current_material, indices, material_ids);
+
+            // same fan as `add_polygon()`
+            auto add_texcoord = [&](uint32_t texcoord) {
+                bool const valid = texcoord != ~0u;
+                texcoords.push_back(valid ? obj_texcoords[2 * size_t{texcoord}] : 0.0f);
+                texcoords.push_back(valid ? obj_texcoords[2 * size_t{texcoord} + 1] : 0.0f);
+                has_texcoords = has_texcoords || valid;
+            };
+            for (size_t i = 2; i < corner_texcoords.size(); ++i) {
+                add_texcoord(corner_texcoords[0]);
+                add_texcoord(corner_texcoords[i - 1]);
+                add_texcoord(corner_texcoords[i]);
+            }
+        } else if (keyword == "usemtl") {
+            current_material = material_id(std::string(cursor.rest_of_line()));
+        } else if (keyword == "mtllib") {
+            for (auto name = cursor.token(); !name.empty(); name = cursor.token())
+                load_mtl(path.parent_path() / name, library, texture_paths);
+        }
+    }
+
+    Scene scene;
+    scene.positions     = std::move(positions);
+    scene.indices       = std::move(indices);
+    scene.material_ids  = std::move(material_ids);
+    scene.materials     = std::move(materials);
+    scene.texture_paths = std::move(texture_paths);
+    if (has_texcoords)
+        scene.texcoords = std::move(texcoords);
+    finish_import(scene, path, milliseconds_since(start));
+    return scene;
+}
+
+auto import_ply(std::filesystem::path const &path) -> std::optional<Scene> {
+    auto const start = std::chrono::steady_clock::now();
+    auto file        = MappedFile::open(path);
+    if (!file)
+        return std::nullopt;
+
+    auto fail = [&](char const *reason) -> std::optional<Scene> {
+        spdlog::error("{}: {}", path.string(), reason);
+        return std::nullopt;
+    };
+
+    // ---- header
+    auto const *text = reinterpret_cast<char const *>(file->data());
+    TextCursor cursor(text, text + file->size());
+    if (cursor.token() != "ply")
+        return fail("not a PLY file");
+    cursor.next_line();
+
+    std::optional<PlyFormat> format;
+    std::vector<PlyElement> elements;
+    for (bool done = false; !done; cursor.next_line()) {
+        if (cursor.at_end())
+            return fail("header is not terminated");
+        auto const keyword = cursor.token();
+        if (keyword == "format") {
+            auto const name = cursor.token();
+            if (name == "ascii")
+                format = PlyFormat::Ascii;
+            else if (name == "binary_little_endian")
+                format = PlyFormat::BinaryLittleEndian;
+            else if (name == "binary_big_endian")
+                format = PlyFormat::BinaryBigEndian;
+        } else if (keyword == "element") {
+            PlyElement element;
+            element.name = cursor.token();
+            if (!parse_number(cursor.token(), element.count))
+                return fail("invalid element count");
+            elements.push_back(std::move(element));
+        } else if (keyword == "property") {
+            if (elements.empty())
+                return fail("property outside of an element");
+            PlyProperty property;
+            auto const type = cursor.token();
+            if (type == "list") {
+                property.count_type = parse_ply_type(cursor.token());
+                property.type       = parse_ply_type(cursor.token());
+                if (property.count_type == PlyType::Invalid)
+                    return fail("unknown property type");
+            } else {
+                property.type = parse_ply_type(type);
+            }
+            if (property.type == PlyType::Invalid)
+                return fail("unknown property type");
+            property.name = cursor.token();
+            elements.back().properties.push_back(std::move(property));
+        } else if (keyword == "end_header") {
+            done = true;
+        }
+    }
+    if (!format)
+        return fail("unknown format");
+
+    // ---- body
+    auto const header_size = static_cast<size_t>(cursor.position() - text);
+    PlyReader reader(file->data() + header_size, file->data() + file->size(), *format);
+
+    std::vector<Vec3> positions;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> material_ids;
+    std::vector<uint32_t> corners;
+    for (auto const &element : elements) {
+        bool const is_vertex = element.name == "vertex";
+        bool const is_face   = element.name == "face";
+        if (is_vertex)
+            positions.reserve(element.count);
+
+        for (size_t i = 0; i < element.count && reader.ok(); ++i) {
+            Vec3 p;
+            corners.clear();
+            for (auto const &property : element.properties) {
+                if (property.count_type == PlyType::Invalid) {
+                    double const value = reader.read(property.type);
+                    if (is_vertex && property.name.size() == 1 && property.name[0] >= 'x' &&
+                        property.name[0] <= 'z')
+                        p[property.name[0] - 'x'] = static_cast<float>(value);
+                    continue;
+                }
+                auto const count = static_cast<size_t>(reader.read(property.count_type));
+                bool const is_corners = is_face && (property.name == "vertex_indices" ||
+                                                    property.name == "vertex_index");
+                for (size_t c = 0; c < count && reader.ok(); ++c) {
+                    double const value = reader.read(property.type);
+                    if (is_corners) {
+                        if (value < 0.0 || value >= static_cast<double>(positions.size()))
+                            return fail("face references a missing vertex");
+                        corners.push_back(static_cast<uint32_t>(value));
+                    }
+                }
+            }
+            if (is_vertex)
+                positions.push_back(p);
+            else if (is_face)
+                add_polygon(corners, 0, indices, material_ids);
+        }
+        if (!reader.ok())
+            return fail("file is truncated or has invalid values");
+    }
+
+    Scene scene;
+    scene.positions    = std::move(positions);
+    scene.indices      = std::move(indices);
+    scene.material_ids = std::move(material_ids);
+    scene.materials    = {Material{}};
+    finish_import(scene, path, milliseconds_since(start));
+    return scene;
+}
+
+auto load_scene(std::filesystem::path const &path) -> std::optional<Scene> {
+    auto const extension = path.extension();
+    if (extension == SCENE_FILE_EXTENSION)
+        return load_scene_file(path);
+    if (extension == ".obj")
+        return import_obj(path);
+    if (extension == ".ply")
+        return import_ply(path);
+    spdlog::error("unknown scene format '{}', use {}, .obj or .ply", extension.string(),
+                  SCENE_FILE_EXTENSION);
+    return std::nullopt;
+}
+
+auto convert_scene(std::filesystem::path const &input, std::filesystem::path const &output)
+    -> bool {
+    auto const scene = load_scene(input);
+    if (!scene)
+        return false;
+
+    auto const start = std::chrono::steady_clock::now();
+    if (!save_scene_file(output, *scene))
+        return false;
+    spdlog::info("wrote {} in {:.1f} ms", output.string(), milliseconds_since(start));
+    return true;
+}
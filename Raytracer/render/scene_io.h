@@ -0,0 +1,41 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+
+#include "render/scene.h"
+
+/// extension of the binary scene container
+inline constexpr char const *SCENE_FILE_EXTENSION = ".rtscene";
+
+// ---- Binary scene container ---------------------------------------------------------------------
+//
+// A fixed header followed by the position, index, material id, material, texture coordinate and
+// texture path arrays, each starting at a 64 byte aligned offset and stored exactly as `Scene`
+// keeps them in memory. Loading maps the file and points the scene buffers into the mapping,
+// only the texture paths are copied. Texture paths are stored as imported, they aren't rebased to
+// the location of the file.
+
+/// @brief writes the geometry and materials of `scene`
+auto save_scene_file(std::filesystem::path const &path, Scene const &scene) -> bool;
+
+/// @brief maps a file written by `save_scene_file()`, the scene buffers are views into the mapping
+/// @return nothing if the file can't be mapped or is damaged, the reason is logged
+auto load_scene_file(std::filesystem::path const &path) -> std::optional<Scene>;
+
+// ---- Interchange formats ------------------------------------------------------------------------
+
+/// @brief reads the triangles and texture coordinates of a Wavefront OBJ file, polygons are
+/// fanned, `Kd`/`Ke`/`map_Kd` of the referenced MTL files become the albedo/emission/albedo
+/// texture of the materials
+auto import_obj(std::filesystem::path const &path) -> std::optional<Scene>;
+
+/// @brief reads the vertices and faces of an ASCII or binary PLY file, polygons are fanned
+auto import_ply(std::filesystem::path const &path) -> std::optional<Scene>;
+
+/// @brief reads a scene in any supported format, picked by the extension of `path`
+auto load_scene(std::filesystem::path const &path) -> std::optional<Scene>;
+
+/// @brief imports an OBJ/PLY file and writes it as binary scene container
+auto convert_scene(std::filesystem::path const &input, std::filesystem::path const &output)
+    -> bool;
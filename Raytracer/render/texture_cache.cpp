@@ -0,0 +1,489 @@
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <system_error>
+#include <type_traits>
+
+#include <spdlog/spdlog.h>
+
+#include "render/framebuffer.h"
+#include "render/image_io.h"
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+// ---- Tiled file ---------------------------------------------------------------------------------
+//
+// A header, one `TextureFileLevel` per mip level from the full resolution down to 1x1, then the
+// tiles of all levels, row by row. Every tile holds `TILE_SIZE^2` RGBA8 sRGB texels, tiles at the
+// right and bottom edge are padded by repeating the last texel.
+
+constexpr char TEXTURE_MAGIC[8]    = {'R', 'T', 'T', 'E', 'X', '\0', '\0', '\0'};
+constexpr uint32_t TEXTURE_VERSION = 1;
+constexpr uint32_t ENDIAN_TAG      = 0x01020304u;
+constexpr int TILE_SIZE            = TextureCache::TILE_SIZE;
+constexpr size_t TILE_TEXELS       = static_cast<size_t>(TILE_SIZE) * TILE_SIZE;
+
+struct TextureFileHeader {
+    char magic[8];
+    uint32_t version;
+    /// `ENDIAN_TAG` as written by the producer, files are only read on machines of the same order
+    uint32_t endian;
+    uint32_t tile_size;
+    uint32_t level_count;
+};
+
+struct TextureFileLevel {
+    uint32_t width;
+    uint32_t height;
+    /// index of the first tile of the level
+    uint64_t first_tile;
+};
+
+static_assert(std::is_trivially_copyable_v<TextureFileHeader>);
+static_assert(std::is_trivially_copyable_v<TextureFileLevel>);
+
+auto tiles_along(int texels) -> int { return (texels + TILE_SIZE - 1) / TILE_SIZE; }
+
+auto srgb_to_linear(uint32_t value) -> float {
+    // same curve as `to_srgb8()`, inverted
+    static auto const table = []() {
+        std::array<float, 256> values{};
+        for (int i = 0; i < 256; ++i) {
+            float const v = static_cast<float>(i) / 255.0f;
+            values[i]     = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table[value & 0xff];
+}
+
+auto unpack_rgba8(uint32_t texel) -> Vec3 {
+    return {srgb_to_linear(texel), srgb_to_linear(texel >> 8), srgb_to_linear(texel >> 16)};
+}
+
+/// the next smaller mip level, 2x2 box filtered in linear space
+auto downsample(std::vector<Vec3> const &texels, int width, int height) -> std::vector<Vec3> {
+    int const next_width  = std::max(width / 2, 1);
+    int const next_height = std::max(height / 2, 1);
+    std::vector<Vec3> next(static_cast<size_t>(next_width) * next_height);
+    for (int y = 0; y < next_height; ++y) {
+        int const y0 = std::min(2 * y, height - 1);
+        int const y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < next_width; ++x) {
+            int const x0 = std::min(2 * x, width - 1);
+            int const x1 = std::min(2 * x + 1, width - 1);
+            next[static_cast<size_t>(y) * next_width + x] =
+                (texels[static_cast<size_t>(y0) * width + x0] +
+                 texels[static_cast<size_t>(y0) * width + x1] +
+                 texels[static_cast<size_t>(y1) * width + x0] +
+                 texels[static_cast<size_t>(y1) * width + x1]) *
+                0.25f;
+        }
+    }
+    return next;
+}
+
+/// cache key of a tile, spreads the ids over the bits the tile coordinates don't use
+auto tile_key(uint32_t texture, int level, int tile_x, int tile_y) -> uint64_t {
+    return (uint64_t{texture} << 40) | (uint64_t(level) << 36) | (uint64_t(tile_y) << 18) |
+           uint64_t(tile_x);
+}
+
+/// neighbouring tiles go to different shards
+auto shard_index(uint64_t key) -> size_t {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return static_cast<size_t>(key % TextureCache::SHARD_COUNT);
+}
+
+/// ids of the caches, see `TextureCache::m_id`
+std::atomic<uint64_t> next_cache_id{0};
+
+/// `i` wrapped into `[0, n)`
+auto wrap(int i, int n) -> int {
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+} // namespace
+
+auto convert_texture(std::filesystem::path const &input, std::filesystem::path const &output)
+    -> bool {
+    int width, height;
+    std::vector<uint32_t> pixels;
+    if (!read_ppm(input, width, height, pixels))
+        return false;
+
+    // mip levels down to a single texel
+    std::vector<std::vector<Vec3>> levels(1);
+    std::vector<TextureFileLevel> table;
+    levels[0].resize(pixels.size());
+    std::transform(pixels.begin(), pixels.end(), levels[0].begin(), unpack_rgba8);
+    table.push_back({static_cast<uint32_t>(width), static_cast<uint32_t>(height), 0});
+    while (table.back().width > 1 || table.back().height > 1) {
+        auto const &last = table.back();
+        levels.push_back(downsample(levels.back(), static_cast<int>(last.width),
+                                    static_cast<int>(last.height)));
+        uint64_t const first_tile = last.first_tile + uint64_t(tiles_along(last.width)) *
+                                                          tiles_along(last.height);
+        table.push_back({std::max(last.width / 2, 1u), std::max(last.height / 2, 1u), first_tile});
+    }
+
+    std::ofstream file(output, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        spdlog::error("couldn't open {} for writing", output.string());
+        return false;
+    }
+
+    TextureFileHeader header{};
+    std::memcpy(header.magic, TEXTURE_MAGIC, sizeof(TEXTURE_MAGIC));
+    header.version     = TEXTURE_VERSION;
+    header.endian      = ENDIAN_TAG;
+    header.tile_size   = TILE_SIZE;
+    header.level_count = static_cast<uint32_t>(table.size());
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const *>(table.data()),
+               static_cast<std::streamsize>(table.size() * sizeof(TextureFileLevel)));
+
+    std::vector<uint32_t> tile(TILE_TEXELS);
+    for (size_t l = 0; l < table.size(); ++l) {
+        int const level_width  = static_cast<int>(table[l].width);
+        int const level_height = static_cast<int>(table[l].height);
+        for (int ty = 0; ty < tiles_along(level_height); ++ty) {
+            for (int tx = 0; tx < tiles_along(level_width); ++tx) {
+                for (int y = 0; y < TILE_SIZE; ++y) {
+                    int const sy = std::min(ty * TILE_SIZE + y, level_height - 1);
+                    for (int x = 0; x < TILE_SIZE; ++x) {
+                        int const sx = std::min(tx * TILE_SIZE + x, level_width - 1);
+                        tile[static_cast<size_t>(y) * TILE_SIZE + x] =
+                            pack_rgba8(levels[l][static_cast<size_t>(sy) * level_width + sx]);
+                    }
+                }
+                file.write(reinterpret_cast<char const *>(tile.data()),
+                           static_cast<std::streamsize>(tile.size() * sizeof(uint32_t)));
+            }
+        }
+    }
+
+    if (!file) {
+        spdlog::error("writing {} failed", output.string());
+        return false;
+    }
+    spdlog::info("converted {} ({}x{}, {} mip levels) to {}", input.string(), width, height,
+                 table.size(), output.string());
+    return true;
+}
+
+TextureCache::TextureCache(size_t capacity_bytes)
+    : m_id(next_cache_id.fetch_add(1, std::memory_order_relaxed)), m_capacity(capacity_bytes) {}
+
+auto TextureCache::add_texture(std::filesystem::path const &path) -> uint32_t {
+    auto const found = m_ids_by_path.find(path.string());
+    if (found != m_ids_by_path.end())
+        return found->second;
+
+    // source images are converted once, and again whenever they change
+    auto tiled = path;
+    if (path.extension() != TEXTURE_FILE_EXTENSION) {
+        tiled = tiled_texture_path(path);
+        std::error_code error;
+        auto const source_time = std::filesystem::last_write_time(path, error);
+        if (error) {
+            spdlog::error("couldn't open texture {}", path.string());
+            return NO_TEXTURE;
+        }
+        auto const tiled_time = std::filesystem::last_write_time(tiled, error);
+        if ((error || tiled_time < source_time) && !convert_texture(path, tiled))
+            return NO_TEXTURE;
+    }
+
+    auto texture  = std::make_unique<Texture>();
+    texture->path = tiled;
+    texture->file.open(tiled, std::ios::binary);
+    if (!texture->file) {
+        spdlog::error("couldn't open texture {}", tiled.string());
+        return NO_TEXTURE;
+    }
+
+    TextureFileHeader header{};
+    texture->file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!texture->file || std::memcmp(header.magic, TEXTURE_MAGIC, sizeof(TEXTURE_MAGIC)) != 0) {
+        spdlog::error("{} is not a tiled texture", tiled.string());
+        return NO_TEXTURE;
+    }
+    if (header.version != TEXTURE_VERSION || header.endian != ENDIAN_TAG ||
+        header.tile_size != TILE_SIZE || header.level_count == 0 || header.level_count > 16) {
+        spdlog::error("{} was written by an incompatible version or machine", tiled.string());
+        return NO_TEXTURE;
+    }
+
+    std::vector<TextureFileLevel> table(header.level_count);
+    texture->file.read(reinterpret_cast<char *>(table.data()),
+                       static_cast<std::streamsize>(table.size() * sizeof(TextureFileLevel)));
+    uint64_t tile_count = 0;
+    for (auto const &level : table) {
+        int const width  = static_cast<int>(level.width);
+        int const height = static_cast<int>(level.height);
+        // coordinates have to fit into `tile_key()`
+        if (width <= 0 || height <= 0 || width > (1 << 24) || height > (1 << 24) ||
+            level.first_tile != tile_count)
+            break;
+        texture->levels.push_back({width, height, tiles_along(width), tiles_along(height),
+                                   level.first_tile});
+        tile_count += uint64_t(tiles_along(width)) * tiles_along(height);
+    }
+
+    texture->data_offset = sizeof(TextureFileHeader) + table.size() * sizeof(TextureFileLevel);
+    texture->file.seekg(0, std::ios::end);
+    auto const size = static_cast<uint64_t>(texture->file.tellg());
+    if (!texture->file || texture->levels.size() != table.size() ||
+        size < texture->data_offset + tile_count * TILE_TEXELS * sizeof(uint32_t)) {
+        spdlog::error("{} is truncated or damaged", tiled.string());
+        return NO_TEXTURE;
+    }
+
+    auto const id = static_cast<uint32_t>(m_textures.size());
+    if (id >= (1u << 24)) {
+        spdlog::error("too many textures, {} is ignored", path.string());
+        return NO_TEXTURE;
+    }
+    spdlog::debug("texture {}: {}x{}, {} tiles", tiled.string(), texture->levels[0].width,
+                  texture->levels[0].height, tile_count);
+    m_textures.push_back(std::move(texture));
+    m_ids_by_path.emplace(path.string(), id);
+    return id;
+}
+
+auto TextureCache::load_tile(uint32_t texture_id, int level, int tile_x, int tile_y)
+    -> std::shared_ptr<Tile> {
+    PROFILE_SCOPE("texture load");
+    Texture &texture     = *m_textures[texture_id];
+    Level const &info    = texture.levels[level];
+    uint64_t const index = info.first_tile + uint64_t(tile_y) * info.tiles_x + tile_x;
+
+    auto tile = std::make_shared<Tile>();
+    std::lock_guard lock(texture.mutex);
+    texture.file.clear();
+    texture.file.seekg(static_cast<std::streamoff>(texture.data_offset +
+                                                   index * TILE_TEXELS * sizeof(uint32_t)));
+    texture.file.read(reinterpret_cast<char *>(tile->texels), sizeof(tile->texels));
+    if (!texture.file)
+        return nullptr;
+    return tile;
+}
+
+void TextureCache::trim(Shard &shard) {
+    size_t const capacity = m_capacity.load(std::memory_order_relaxed);
+    // every shard keeps at least one tile, lookups would load the same tile over and over otherwise
+    size_t const max_tiles = std::max<size_t>(1, capacity / SHARD_COUNT / TILE_BYTES);
+    // threads keep setting the bits of the tiles they read, after two rounds the hand stops sparing
+    size_t spared = 0;
+    while (shard.slots.size() > max_tiles) {
+        if (shard.hand >= shard.slots.size())
+            shard.hand = 0;
+        Slot &slot = shard.slots[shard.hand];
+        if (slot.tile->referenced.exchange(false, std::memory_order_relaxed) &&
+            spared < 2 * shard.slots.size()) {
+            ++spared;
+            ++shard.hand;
+            continue;
+        }
+        shard.entries.erase(slot.key);
+        // the last slot takes its place and is looked at next
+        if (&slot != &shard.slots.back()) {
+            slot                    = std::move(shard.slots.back());
+            shard.entries[slot.key] = shard.hand;
+        }
+        shard.slots.pop_back();
+        ++shard.evictions;
+    }
+}
+
+auto TextureCache::tile(uint32_t texture, int level, int tile_x, int tile_y) -> Tile const * {
+    // the tile the thread looked up last, holding it keeps it alive if it is evicted meanwhile
+    thread_local struct {
+        uint64_t cache = ~uint64_t{0};
+        uint64_t key   = 0;
+        std::shared_ptr<Tile const> tile;
+        /// hits that weren't added to a shard yet
+        uint64_t hits = 0;
+    } last;
+
+    uint64_t const key = tile_key(texture, level, tile_x, tile_y);
+    if (last.cache == m_id && last.key == key) {
+        ++last.hits;
+        // only written when it changes, the cache line stays shared between the readers
+        if (!last.tile->referenced.load(std::memory_order_relaxed))
+            last.tile->referenced.store(true, std::memory_order_relaxed);
+        return last.tile.get();
+    }
+
+    Shard &shard = m_shards[shard_index(key)];
+    std::shared_ptr<Tile const> found;
+    {
+        std::lock_guard lock(shard.mutex);
+        // hits of another cache are dropped, it may not exist any more
+        if (last.cache == m_id)
+            shard.hits += last.hits;
+        last.hits = 0;
+        auto const entry = shard.entries.find(key);
+        if (entry != shard.entries.end()) {
+            ++shard.hits;
+            found = shard.slots[entry->second].tile;
+            found->referenced.store(true, std::memory_order_relaxed);
+        } else {
+            ++shard.misses;
+        }
+    }
+
+    if (!found) {
+        // loaded without holding the lock, other tiles of the shard stay available meanwhile
+        std::shared_ptr<Tile const> loaded = load_tile(texture, level, tile_x, tile_y);
+        if (!loaded) {
+            // lookups keep trying, so only the first failure is logged
+            if (m_failures.fetch_add(1, std::memory_order_relaxed) == 0)
+                spdlog::error("couldn't read tile {}, {} of level {} of {}", tile_x, tile_y, level,
+                              m_textures[texture]->path.string());
+            return nullptr;
+        }
+
+        std::lock_guard lock(shard.mutex);
+        auto const [entry, inserted] = shard.entries.try_emplace(key, shard.slots.size());
+        if (inserted) {
+            shard.slots.push_back({key, loaded});
+            trim(shard);
+            found = std::move(loaded);
+        } else {
+            // another thread loaded it first
+            found = shard.slots[entry->second].tile;
+        }
+    }
+
+    last.cache = m_id;
+    last.key   = key;
+    last.tile  = std::move(found);
+    return last.tile.get();
+}
+
+auto TextureCache::sample(uint32_t texture_id, float u, float v, float footprint) -> Vec3 {
+    Texture const &texture = *m_textures[texture_id];
+
+    // the finest level whose texels are at least as wide as the footprint
+    auto const &base     = texture.levels[0];
+    float const texels   = footprint * static_cast<float>(std::max(base.width, base.height));
+    int const last_level = static_cast<int>(texture.levels.size()) - 1;
+    int const level =
+        texels > 1.0f ? std::min(static_cast<int>(std::log2(texels)), last_level) : 0;
+    Level const &info = texture.levels[level];
+
+    // texel centers are at half integers, rows are stored top to bottom
+    float const x = (u - std::floor(u)) * static_cast<float>(info.width) - 0.5f;
+    float const y = (std::ceil(v) - v) * static_cast<float>(info.height) - 0.5f;
+
+    float const x_floor = std::floor(x);
+    float const y_floor = std::floor(y);
+    float const fx      = x - x_floor;
+    float const fy      = y - y_floor;
+    int const x0        = wrap(static_cast<int>(x_floor), info.width);
+    int const y0        = wrap(static_cast<int>(y_floor), info.height);
+    int const x1        = wrap(x0 + 1, info.width);
+    int const y1        = wrap(y0 + 1, info.height);
+
+    // the four texels mostly share a tile, look it up once
+    Tile const *current = nullptr;
+    int current_x = -1, current_y = -1;
+    auto texel = [&](int tx, int ty) {
+        int const tile_x = tx / TILE_SIZE;
+        int const tile_y = ty / TILE_SIZE;
+        if (tile_x != current_x || tile_y != current_y) {
+            current   = tile(texture_id, level, tile_x, tile_y);
+            current_x = tile_x;
+            current_y = tile_y;
+        }
+        if (!current)
+            return Vec3{0.5f};
+        return unpack_rgba8(current->texels[(ty % TILE_SIZE) * TILE_SIZE + tx % TILE_SIZE]);
+    };
+
+    return (texel(x0, y0) * (1.0f - fx) + texel(x1, y0) * fx) * (1.0f - fy) +
+           (texel(x0, y1) * (1.0f - fx) + texel(x1, y1) * fx) * fy;
+}
+
+auto TextureCache::prefetch(ThreadPool &pool, size_t max_bytes) -> size_t {
+    PROFILE_SCOPE("texture prefetch");
+    struct Request {
+        uint32_t texture;
+        int level, tile_x, tile_y;
+    };
+    // whole levels only, a level that doesn't fit any more ends the prefetch of finer ones
+    size_t const budget = std::min(max_bytes, m_capacity.load(std::memory_order_relaxed));
+    size_t bytes        = 0;
+    std::vector<Request> requests;
+    for (size_t step = 0;; ++step) {
+        bool any_level = false;
+        bool full      = false;
+        for (uint32_t texture = 0; texture < m_textures.size(); ++texture) {
+            auto const &levels = m_textures[texture]->levels;
+            if (step >= levels.size())
+                continue;
+            any_level          = true;
+            int const level    = static_cast<int>(levels.size() - 1 - step);
+            auto const &extent = levels[level];
+            size_t const tiles = static_cast<size_t>(extent.tiles_x) * extent.tiles_y;
+            if (bytes + tiles * TILE_BYTES > budget) {
+                full = true;
+                break;
+            }
+            bytes += tiles * TILE_BYTES;
+            for (int y = 0; y < extent.tiles_y; ++y)
+                for (int x = 0; x < extent.tiles_x; ++x)
+                    requests.push_back({texture, level, x, y});
+        }
+        if (!any_level || full)
+            break;
+    }
+
+    pool.parallel_for(0, requests.size(), 1, [&](size_t i) {
+        auto const &request = requests[i];
+        tile(request.texture, request.level, request.tile_x, request.tile_y);
+    });
+    return requests.size();
+}
+
+void TextureCache::set_capacity(size_t bytes) {
+    m_capacity.store(bytes, std::memory_order_relaxed);
+    for (auto &shard : m_shards) {
+        std::lock_guard lock(shard.mutex);
+        trim(shard);
+    }
+}
+
+void TextureCache::clear() {
+    for (auto &shard : m_shards) {
+        std::lock_guard lock(shard.mutex);
+        shard.evictions += shard.slots.size();
+        shard.slots.clear();
+        shard.entries.clear();
+        shard.hand = 0;
+    }
+}
+
+auto TextureCache::stats() const -> TextureCacheStats {
+    TextureCacheStats stats;
+    for (auto &shard : m_shards) {
+        std::lock_guard lock(shard.mutex);
+        stats.hits           += shard.hits;
+        stats.misses         += shard.misses;
+        stats.evictions      += shard.evictions;
+        stats.resident_tiles += shard.slots.size();
+    }
+    stats.failures       = m_failures.load(std::memory_order_relaxed);
+    stats.resident_bytes = stats.resident_tiles * TILE_BYTES;
+    stats.capacity_bytes = m_capacity.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "render/math.h"
+
+class ThreadPool;
+
+/// extension of the tiled texture format, see `convert_texture()`
+inline constexpr char const *TEXTURE_FILE_EXTENSION = ".rttex";
+
+/// texture index of materials without a texture
+inline constexpr uint32_t NO_TEXTURE = ~0u;
+
+/// source images are converted once and cached next to them, `wood.ppm` -> `wood.ppm.rttex`
+inline auto tiled_texture_path(std::filesystem::path const &image_path) -> std::filesystem::path {
+    auto path = image_path;
+    path += TEXTURE_FILE_EXTENSION;
+    return path;
+}
+
+/// @brief converts a binary PPM image into the tiled, mipmapped layout `TextureCache` reads:
+/// every mip level is split into square tiles of 8 bit sRGB texels that can be read on their own
+auto convert_texture(std::filesystem::path const &input, std::filesystem::path const &output)
+    -> bool;
+
+struct TextureCacheStats {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+    /// tiles that couldn't be read, their lookups return grey
+    uint64_t failures     = 0;
+    size_t resident_tiles = 0;
+    size_t resident_bytes = 0;
+    size_t capacity_bytes = 0;
+};
+
+/// Texture lookups for scenes that reference far more texture data than fits into memory.
+///
+/// `add_texture()` only reads the header of a texture. Its texels are loaded a tile at a time, the
+/// first time a lookup touches the tile, and kept in a cache of bounded size that evicts tiles with
+/// the clock algorithm. The cache is split into shards with a lock each, and every thread remembers
+/// the tile it looked up last, so consecutive lookups in the same tile take no lock at all. A tile
+/// that is evicted while a thread still reads it stays alive until the thread moves on.
+class TextureCache {
+  public:
+    /// texels along the side of a tile
+    static constexpr int TILE_SIZE   = 64;
+    static constexpr int SHARD_COUNT = 16;
+
+  private:
+    struct Level {
+        int width, height;
+        int tiles_x, tiles_y;
+        /// index of the first tile of the level in the file
+        uint64_t first_tile;
+    };
+
+    struct Texture {
+        std::filesystem::path path;
+        std::vector<Level> levels;
+        /// file offset of the first tile
+        uint64_t data_offset = 0;
+        /// tiles are read through one stream per texture
+        std::mutex mutex;
+        std::ifstream file;
+    };
+
+    /// RGBA8 sRGB texels as stored in the file, rows top to bottom, converted to linear on lookup
+    struct Tile {
+        uint32_t texels[TILE_SIZE * TILE_SIZE];
+        /// second chance bit of the clock, set by lookups without taking the shard lock
+        mutable std::atomic<bool> referenced{true};
+    };
+
+    struct Slot {
+        uint64_t key;
+        std::shared_ptr<Tile const> tile;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        /// resident tiles in no particular order, the clock hand sweeps over them
+        std::vector<Slot> slots;
+        /// index into `slots`
+        std::unordered_map<uint64_t, size_t> entries;
+        size_t hand = 0;
+        // counted under the lock that is taken anyway, shared atomics would bounce between cores
+        uint64_t hits      = 0;
+        uint64_t misses    = 0;
+        uint64_t evictions = 0;
+    };
+
+    std::vector<std::unique_ptr<Texture>> m_textures;
+    std::unordered_map<std::string, uint32_t> m_ids_by_path;
+    /// mutable for `stats()`, which locks them
+    mutable std::array<Shard, SHARD_COUNT> m_shards;
+
+    /// tells the caches apart in the per thread last tile, addresses may be reused
+    uint64_t const m_id;
+    std::atomic<size_t> m_capacity;
+    std::atomic<uint64_t> m_failures{0};
+
+    /// @return nullptr if the tile can't be read
+    auto load_tile(uint32_t texture, int level, int tile_x, int tile_y) -> std::shared_ptr<Tile>;
+    /// @brief the tile from the cache, loaded if it isn't there
+    /// @return nullptr if the tile can't be read, otherwise valid until the calling thread looks
+    /// up another tile
+    auto tile(uint32_t texture, int level, int tile_x, int tile_y) -> Tile const *;
+    /// evicts tiles of `shard` that weren't referenced since the clock hand last passed them until
+    /// the shard fits its share of the capacity, the shard has to be locked
+    void trim(Shard &shard);
+
+  public:
+    static constexpr size_t TILE_BYTES = sizeof(Tile);
+
+    explicit TextureCache(size_t capacity_bytes = size_t{256} << 20);
+
+    TextureCache(TextureCache const &)                     = delete;
+    auto operator=(TextureCache const &) -> TextureCache & = delete;
+
+    /// @brief registers a texture, converting it to the tiled format first if `path` isn't a
+    /// `TEXTURE_FILE_EXTENSION` file, see `tiled_texture_path()`. Only reads the header, textures
+    /// that were added before return the same id. Not safe to call while lookups run.
+    /// @return the id for `sample()`, `NO_TEXTURE` if the texture can't be read
+    auto add_texture(std::filesystem::path const &path) -> uint32_t;
+
+    auto texture_count() const -> size_t { return m_textures.size(); }
+
+    /// @brief bilinear lookup, wrapping around at the edges
+    /// @param u, v texture coordinates, `v = 0` is the bottom row as in OBJ files
+    /// @param footprint width of the area to average in texture coordinates, picks the mip level
+    /// @return linear RGB
+    auto sample(uint32_t texture, float u, float v, float footprint) -> Vec3;
+
+    /// @brief loads tiles ahead of the first lookups, the coarse mip levels of every texture first
+    /// since distant and blurry surfaces read those, then finer levels as long as the tiles fit
+    /// into `max_bytes` and the capacity. Blocks until the tiles are loaded.
+    /// @return the number of tiles loaded
+    auto prefetch(ThreadPool &pool, size_t max_bytes) -> size_t;
+
+    /// evicts tiles right away if the cache holds more than `bytes`
+    void set_capacity(size_t bytes);
+    /// drops every cached tile, textures stay registered
+    void clear();
+
+    /// hits of consecutive lookups in the same tile are counted when the thread next takes a
+    /// shard lock, so they may lag behind a little
+    auto stats() const -> TextureCacheStats;
+};
@@ -0,0 +1,329 @@
+#include "tile_renderer.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "render/wavefront.h"
+#include "utils/profiler.h"
+
+namespace {
+
+/// state of the tile being rendered, one entry per 4x2 block (8 per block for lanes), allocated
+/// from the arena of the rendering thread
+struct TileScratch {
+    Arena &arena;
+    size_t blocks;
+    uint32_t *lanes;
+    RayPacket8 *packets;
+    Sampler *samplers;
+    Vec3 *sum;
+    float *sum_sq;
+    // summed first hit features, see `Framebuffer::albedo()`
+    Vec3 *albedo;
+    Vec3 *normal;
+    float *depth;
+    /// rays traced for the tile
+    uint64_t rays = 0;
+
+    TileScratch(Arena &arena, size_t block_count)
+        : arena(arena), blocks(block_count), lanes(arena.allocate<uint32_t>(blocks)),
+          packets(arena.allocate<RayPacket8>(blocks)),
+          samplers(arena.allocate<Sampler>(8 * blocks)), sum(arena.allocate<Vec3>(8 * blocks)),
+          sum_sq(arena.allocate<float>(8 * blocks)),
+          albedo(arena.allocate<Vec3>(8 * blocks)), normal(arena.allocate<Vec3>(8 * blocks)),
+          depth(arena.allocate<float>(8 * blocks)) {
+        std::fill_n(lanes, blocks, 0u);
+        std::fill_n(sum, 8 * blocks, Vec3{0.0f});
+        std::fill_n(sum_sq, 8 * blocks, 0.0f);
+        std::fill_n(albedo, 8 * blocks, Vec3{0.0f});
+        std::fill_n(normal, 8 * blocks, Vec3{0.0f});
+        std::fill_n(depth, 8 * blocks, 0.0f);
+    }
+};
+
+/// origin of block `block` of `tile`, blocks are numbered row by row
+auto block_origin(Tile const &tile, size_t block) -> std::pair<int, int> {
+    int const columns = (tile.x1 - tile.x0 + 3) / 4;
+    int const index   = static_cast<int>(block);
+    return {tile.x0 + 4 * (index % columns), tile.y0 + 2 * (index / columns)};
+}
+
+auto block_count(Tile const &tile) -> size_t {
+    return static_cast<size_t>((tile.x1 - tile.x0 + 3) / 4) * ((tile.y1 - tile.y0 + 1) / 2);
+}
+
+/// index of sample `s` of a frame in the sequence of a pixel, the frames of a progressive estimate
+/// continue the sequence where the previous one stopped
+auto sample_index(uint32_t frame_index, int spp, int s) -> uint32_t {
+    return frame_index * static_cast<uint32_t>(spp) + static_cast<uint32_t>(s);
+}
+
+/// `trace_tile()` with `WavefrontIntegrator`: all samples of the tile are traced as one wave
+void trace_tile_wavefront(Scene const &scene, PinholeCamera const &projection,
+                          IntegratorSettings const &settings, Tile const &tile,
+                          uint32_t frame_index, int spp, TileScratch &scratch) {
+    size_t samples = 0;
+    for (size_t block = 0; block < scratch.blocks; ++block)
+        samples += static_cast<size_t>(std::popcount(scratch.lanes[block])) * spp;
+    WavefrontIntegrator wave(scratch.arena, samples);
+    // slot of every sample
+    auto *const slots = scratch.arena.allocate<uint32_t>(samples);
+    {
+        PROFILE_SCOPE("generate");
+        for (size_t block = 0; block < scratch.blocks; ++block) {
+            auto const [bx, by] = block_origin(tile, block);
+            for (int lane = 0; lane < 8; ++lane) {
+                if (!(scratch.lanes[block] & (1u << lane)))
+                    continue;
+                auto const x = static_cast<uint32_t>(bx + (lane & 3));
+                auto const y = static_cast<uint32_t>(by + (lane >> 2));
+                for (int s = 0; s < spp; ++s) {
+                    // a stream per sample, the first one is the one `trace_tile()` uses
+                    Sampler sampler(settings.sampler, x, y, frame_index,
+                                    static_cast<uint64_t>(s) + 1);
+                    sampler.start_sample(sample_index(frame_index, spp, s));
+                    auto const [jx, jy]   = sampler.next_2d();
+                    float const px        = static_cast<float>(x) + jx;
+                    float const py        = static_cast<float>(y) + jy;
+                    uint32_t const sample = wave.add_path(projection.generate_ray(px, py), sampler,
+                                                          projection.pixel_angle());
+                    slots[sample] = static_cast<uint32_t>(8 * block + lane);
+                }
+            }
+        }
+    }
+
+    wave.trace(scene, settings);
+    scratch.rays += wave.rays();
+
+    for (uint32_t sample = 0; sample < samples; ++sample) {
+        uint32_t const i    = slots[sample];
+        Vec3 const radiance = wave.radiance(sample);
+        float const y       = luminance(radiance);
+        scratch.sum[i]     += radiance;
+        scratch.sum_sq[i]  += y * y;
+        scratch.albedo[i]  += wave.albedo(sample);
+        scratch.normal[i]  += wave.normal(sample);
+        scratch.depth[i]   += wave.depth(sample);
+    }
+}
+
+/// @brief traces `spp` paths through every pixel of `tile` whose lane is set in `scratch.lanes`
+/// and sums their radiance and squared luminance into `scratch.sum`/`scratch.sum_sq`, and their
+/// first hit features into `scratch.albedo`/`normal`/`depth`. Each sample first intersects the
+/// primary packets of all blocks and then follows the paths from their hits, so the profiler can
+/// tell traversal and shading apart.
+void trace_tile(Scene const &scene, PinholeCamera const &projection,
+                IntegratorSettings const &settings, Tile const &tile, uint32_t frame_index,
+                int spp, TileScratch &scratch) {
+    if (settings.wavefront) {
+        trace_tile_wavefront(scene, projection, settings, tile, frame_index, spp, scratch);
+        return;
+    }
+
+    size_t const blocks = scratch.blocks;
+    for (size_t block = 0; block < blocks; ++block) {
+        auto const [bx, by] = block_origin(tile, block);
+        for (int lane = 0; lane < 8; ++lane) {
+            if (scratch.lanes[block] & (1u << lane)) {
+                auto const x                       = static_cast<uint32_t>(bx + (lane & 3));
+                auto const y                       = static_cast<uint32_t>(by + (lane >> 2));
+                scratch.samplers[8 * block + lane] = Sampler(settings.sampler, x, y, frame_index);
+            }
+        }
+    }
+
+    for (int s = 0; s < spp; ++s) {
+        {
+            PROFILE_SCOPE("trace");
+            for (size_t block = 0; block < blocks; ++block) {
+                uint32_t const lanes = scratch.lanes[block];
+                if (!lanes)
+                    continue;
+                auto const [bx, by] = block_origin(tile, block);
+                RayPacket8 &packet  = scratch.packets[block];
+                packet              = RayPacket8{};
+                for (int lane = 0; lane < 8; ++lane) {
+                    if (!(lanes & (1u << lane)))
+                        continue;
+                    Sampler &sampler = scratch.samplers[8 * block + lane];
+                    sampler.start_sample(sample_index(frame_index, spp, s));
+                    auto const [jx, jy] = sampler.next_2d();
+                    float const px      = static_cast<float>(bx + (lane & 3)) + jx;
+                    float const py      = static_cast<float>(by + (lane >> 2)) + jy;
+                    packet.set(lane, projection.generate_ray(px, py));
+                }
+                scene.intersect(packet);
+                scratch.rays += static_cast<uint64_t>(std::popcount(lanes));
+            }
+        }
+
+        PROFILE_SCOPE("shade");
+        for (size_t block = 0; block < blocks; ++block) {
+            uint32_t const lanes     = scratch.lanes[block];
+            RayPacket8 const &packet = scratch.packets[block];
+            for (int lane = 0; lane < 8; ++lane) {
+                if (!(lanes & (1u << lane)))
+                    continue;
+                size_t const i = 8 * block + lane;
+                Hit const hit  = packet.hit(lane);
+                Ray const ray  = packet.ray(lane);
+                if (hit.is_valid()) {
+                    Vec3 const n       = scene.geometric_normal(hit);
+                    scratch.albedo[i] += scene.albedo(hit, hit.t * projection.pixel_angle());
+                    scratch.normal[i] += dot(n, ray.direction) > 0.0f ? -n : n;
+                    scratch.depth[i]  += hit.t;
+                } else {
+                    scratch.albedo[i] += Vec3{1.0f};
+                }
+
+                Vec3 const radiance = trace_path(scene, ray, scratch.samplers[i], settings, &hit,
+                                                 projection.pixel_angle(), &scratch.rays);
+                float const y       = luminance(radiance);
+                scratch.sum[i]     += radiance;
+                scratch.sum_sq[i]  += y * y;
+            }
+        }
+    }
+}
+
+} // namespace
+
+auto TileRenderer::split(Tile const &region) const -> std::vector<Tile> {
+    // on the grid of the whole image, clipped to the region
+    std::vector<Tile> tiles;
+    for (int y = region.y0 / m_tile_size * m_tile_size; y < region.y1; y += m_tile_size) {
+        for (int x = region.x0 / m_tile_size * m_tile_size; x < region.x1; x += m_tile_size) {
+            tiles.push_back({std::max(x, region.x0), std::max(y, region.y0),
+                             std::min(x + m_tile_size, region.x1),
+                             std::min(y + m_tile_size, region.y1)});
+        }
+    }
+    return tiles;
+}
+
+void TileRenderer::resize(int width, int height) { m_tiles = split({0, 0, width, height}); }
+
+void TileRenderer::render(Scene const &scene, Camera const &camera, Framebuffer &target,
+                          uint32_t frame_index, int spp) {
+    render_tiles(scene, camera, target, m_tiles, frame_index, spp);
+}
+
+void TileRenderer::render_region(Scene const &scene, Camera const &camera, Framebuffer &target,
+                                 Tile const &region, uint32_t frame_index, int spp) {
+    render_tiles(scene, camera, target, split(region), frame_index, spp);
+}
+
+void TileRenderer::render_tiles(Scene const &scene, Camera const &camera, Framebuffer &target,
+                                std::vector<Tile> const &tiles, uint32_t frame_index, int spp) {
+    PinholeCamera const projection(camera, target.width(), target.height());
+    float const inv_spp = 1.0f / static_cast<float>(spp);
+    m_arenas.reset();
+
+    m_pool.parallel_for(0, tiles.size(), 1, [&](size_t index) {
+        PROFILE_SCOPE("tile");
+        Tile const &tile = tiles[index];
+        Arena &arena     = m_arenas.local();
+        ArenaScope const scope(arena);
+        TileScratch scratch(arena, block_count(tile));
+
+        for (size_t block = 0; block < scratch.blocks; ++block) {
+            auto const [bx, by] = block_origin(tile, block);
+            for (int lane = 0; lane < 8; ++lane) {
+                if (bx + (lane & 3) < tile.x1 && by + (lane >> 2) < tile.y1)
+                    scratch.lanes[block] |= 1u << lane;
+            }
+        }
+
+        trace_tile(scene, projection, settings, tile, frame_index, spp, scratch);
+        m_rays.fetch_add(scratch.rays, std::memory_order_relaxed);
+
+        for (size_t block = 0; block < scratch.blocks; ++block) {
+            auto const [bx, by] = block_origin(tile, block);
+            for (int lane = 0; lane < 8; ++lane) {
+                if (!(scratch.lanes[block] & (1u << lane)))
+                    continue;
+                int const x         = bx + (lane & 3);
+                int const y         = by + (lane >> 2);
+                size_t const i      = 8 * block + lane;
+                Vec3 const color    = scratch.sum[i] * inv_spp;
+                target.color(x, y)  = color;
+                target.rgba8(x, y)  = pack_rgba8(color);
+                target.albedo(x, y) = scratch.albedo[i] * inv_spp;
+                target.normal(x, y) = scratch.normal[i] * inv_spp;
+                target.depth(x, y)  = scratch.depth[i] * inv_spp;
+            }
+        }
+    });
+}
+
+void TileRenderer::accumulate(Scene const &scene, Camera const &camera, Accumulator &accumulator,
+                              Framebuffer &target, uint32_t frame_index, int spp) {
+    PinholeCamera const projection(camera, target.width(), target.height());
+    m_arenas.reset();
+
+    m_pool.parallel_for(0, m_tiles.size(), 1, [&](size_t index) {
+        Tile const &tile = m_tiles[index];
+        if (accumulator.is_tile_converged(index)) {
+            // nothing to trace, but the display target may be a different buffer every pass
+            for (int y = tile.y0; y < tile.y1; ++y) {
+                for (int x = tile.x0; x < tile.x1; ++x)
+                    target.rgba8(x, y) = pack_rgba8(accumulator.mean(x, y));
+            }
+            return;
+        }
+        PROFILE_SCOPE("tile");
+        Arena &arena = m_arenas.local();
+        ArenaScope const scope(arena);
+        TileScratch scratch(arena, block_count(tile));
+
+        // only pixels that still need samples take part in the packets
+        bool converged = true;
+        for (size_t block = 0; block < scratch.blocks; ++block) {
+            auto const [bx, by] = block_origin(tile, block);
+            for (int lane = 0; lane < 8; ++lane) {
+                int const x = bx + (lane & 3);
+                int const y = by + (lane >> 2);
+                if (x < tile.x1 && y < tile.y1 && !accumulator.is_converged(x, y, adaptive))
+                    scratch.lanes[block] |= 1u << lane;
+            }
+        }
+
+        trace_tile(scene, projection, settings, tile, frame_index, spp, scratch);
+        m_rays.fetch_add(scratch.rays, std::memory_order_relaxed);
+
+        for (size_t block = 0; block < scratch.blocks; ++block) {
+            auto const [bx, by] = block_origin(tile, block);
+            for (int lane = 0; lane < 8; ++lane) {
+                int const x = bx + (lane & 3);
+                int const y = by + (lane >> 2);
+                if (x >= tile.x1 || y >= tile.y1)
+                    continue;
+                if (scratch.lanes[block] & (1u << lane)) {
+                    // features are averaged over all samples, like the color
+                    size_t const i    = 8 * block + lane;
+                    float const old_n = static_cast<float>(accumulator.samples(x, y));
+                    float const inv_n = 1.0f / (old_n + static_cast<float>(spp));
+
+                    target.albedo(x, y) = (target.albedo(x, y) * old_n + scratch.albedo[i]) * inv_n;
+                    target.normal(x, y) = (target.normal(x, y) * old_n + scratch.normal[i]) * inv_n;
+                    target.depth(x, y)  = (target.depth(x, y) * old_n + scratch.depth[i]) * inv_n;
+
+                    accumulator.add(x, y, scratch.sum[i], scratch.sum_sq[i],
+                                    static_cast<uint32_t>(spp));
+                    converged = converged && accumulator.is_converged(x, y, adaptive);
+                }
+
+                // converged pixels are written too, the display target may have changed
+                Vec3 const color   = accumulator.mean(x, y);
+                target.color(x, y) = color;
+                target.rgba8(x, y) = pack_rgba8(color);
+            }
+        }
+
+        if (converged)
+            accumulator.set_tile_converged(index);
+    });
+
+    accumulator.finish_pass();
+}
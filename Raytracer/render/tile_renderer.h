@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "render/accumulator.h"
+#include "render/camera.h"
+#include "render/framebuffer.h"
+#include "render/integrator.h"
+#include "render/scene.h"
+#include "utils/arena.h"
+#include "utils/thread_pool.h"
+
+/// rectangular part of the image, `[x0, x1) x [y0, y1)`
+struct Tile {
+    int x0, y0, x1, y1;
+};
+
+/// Splits the image into tiles and renders them as tasks on a `ThreadPool`. Tiles are small
+/// enough that work-stealing evens out the cost differences between cheap (background) and
+/// expensive (many bounces) parts of the image.
+///
+/// Everything a tile needs while it renders (packets, sums, wavefront queues) comes from the
+/// arena of the thread rendering it, which is rewound after the tile and reset every frame, so
+/// frames don't touch the heap once the arenas have grown to fit.
+class TileRenderer {
+    ThreadPool &m_pool;
+    int m_tile_size;
+    std::vector<Tile> m_tiles;
+    WorkerArenas m_arenas;
+    std::atomic<uint64_t> m_rays{0};
+
+    /// the tiles of the image grid that overlap `region`, clipped to it
+    auto split(Tile const &region) const -> std::vector<Tile>;
+    void render_tiles(Scene const &scene, Camera const &camera, Framebuffer &target,
+                      std::vector<Tile> const &tiles, uint32_t frame_index, int spp);
+
+  public:
+    IntegratorSettings settings;
+    AdaptiveSettings adaptive;
+
+    explicit TileRenderer(ThreadPool &pool, int tile_size = 32)
+        : m_pool(pool), m_tile_size(tile_size), m_arenas(pool) {}
+
+    /// recomputes the tiling for an image of `width x height`
+    void resize(int width, int height);
+
+    auto tiles() const -> std::vector<Tile> const & { return m_tiles; }
+
+    /// memory use of the per-thread arenas, safe to call while a frame renders
+    auto arena_stats() const -> std::vector<ArenaStats> { return m_arenas.stats(); }
+
+    /// closest hit and shadow rays traced since construction, counted per tile so it only moves
+    /// once a tile is done
+    auto rays_traced() const -> uint64_t { return m_rays.load(std::memory_order_relaxed); }
+
+    /// @brief renders `spp` samples per pixel into `target`, overwriting its content
+    /// @param frame_index decorrelates the random streams of consecutive frames
+    void render(Scene const &scene, Camera const &camera, Framebuffer &target,
+                uint32_t frame_index, int spp = 1);
+
+    /// @brief like `render()`, but only the pixels in `region`, the rest of `target` keeps its
+    /// content. A pixel comes out the same as in `render()` if `region` starts on the tile grid.
+    void render_region(Scene const &scene, Camera const &camera, Framebuffer &target,
+                       Tile const &region, uint32_t frame_index, int spp = 1);
+
+    /// @brief adds `spp` samples to every pixel of `accumulator` that has not converged yet and
+    /// writes the updated estimates to `target`. Tiles whose pixels all converged are not traced
+    /// any more, but still written to `target`.
+    /// @param frame_index decorrelates the random streams of consecutive passes
+    void accumulate(Scene const &scene, Camera const &camera, Accumulator &accumulator,
+                    Framebuffer &target, uint32_t frame_index, int spp = 1);
+};
@@ -0,0 +1,157 @@
+#include "tonemap.h"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#ifdef RT_X86
+#include <immintrin.h>
+#endif
+
+#include "render/framebuffer.h"
+
+namespace {
+
+// `to_srgb8()` is monotonic and never steps up by more than one code between neighbouring
+// intervals of this table: [2^-13, 1] split into 256 intervals per power of two, indexed by the
+// exponent and the high 8 mantissa bits. Each interval keeps its first code and the input at which
+// the next code starts, which turns the `pow()` into two lookups and a compare. Everything below
+// 2^-13 comes out as 0.
+constexpr uint32_t TABLE_FIRST = 0x39000000u; // 2^-13
+constexpr uint32_t TABLE_LAST  = 0x3f800000u; // 1
+constexpr int TABLE_SHIFT      = 15;
+constexpr size_t TABLE_SIZE    = ((TABLE_LAST - TABLE_FIRST) >> TABLE_SHIFT) + 1;
+
+struct SrgbTable {
+    alignas(32) int32_t code[TABLE_SIZE];
+    /// first input of the interval that gets `code + 1`, infinity if there is none
+    alignas(32) float next[TABLE_SIZE];
+};
+
+auto srgb_table() -> SrgbTable const & {
+    static SrgbTable const table = []() {
+        SrgbTable t{};
+        for (size_t i = 0; i < TABLE_SIZE; ++i) {
+            uint32_t lo         = TABLE_FIRST + (static_cast<uint32_t>(i) << TABLE_SHIFT);
+            uint32_t hi         = lo + (1u << TABLE_SHIFT) - 1;
+            uint32_t const code = to_srgb8(std::bit_cast<float>(lo));
+            t.code[i]           = static_cast<int32_t>(code);
+            t.next[i]           = std::numeric_limits<float>::infinity();
+            if (to_srgb8(std::bit_cast<float>(hi)) == code)
+                continue;
+            // the code steps up somewhere in (lo, hi]
+            while (hi - lo > 1) {
+                uint32_t const mid = lo + (hi - lo) / 2;
+                (to_srgb8(std::bit_cast<float>(mid)) == code ? lo : hi) = mid;
+            }
+            t.next[i] = std::bit_cast<float>(hi);
+        }
+        return t;
+    }();
+    return table;
+}
+
+#ifdef RT_X86
+
+/// sRGB codes of 8 linear values, NaN and negative values give 0
+RT_TARGET("avx2") auto srgb8_avx2(SrgbTable const &table, __m256 v) -> __m256i {
+    // max/min return the second operand for NaN
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+
+    __m256i const bits = _mm256_min_epi32(
+        _mm256_max_epi32(_mm256_castps_si256(v), _mm256_set1_epi32(TABLE_FIRST)),
+        _mm256_set1_epi32(TABLE_LAST));
+    __m256i const index =
+        _mm256_srli_epi32(_mm256_sub_epi32(bits, _mm256_set1_epi32(TABLE_FIRST)), TABLE_SHIFT);
+    __m256i const code = _mm256_i32gather_epi32(table.code, index, 4);
+    __m256 const next  = _mm256_i32gather_ps(table.next, index, 4);
+    // the compare gives -1 where the next code has been reached
+    return _mm256_sub_epi32(code, _mm256_castps_si256(_mm256_cmp_ps(v, next, _CMP_GE_OQ)));
+}
+
+RT_TARGET("avx2")
+void tonemap_avx2(Vec3 const *color, uint32_t *rgba8, size_t count) {
+    SrgbTable const &table = srgb_table();
+    auto const *values     = reinterpret_cast<float const *>(color);
+    alignas(32) int32_t codes[24];
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // 8 pixels are 24 floats, the channels don't matter for the conversion
+        for (int part = 0; part < 3; ++part) {
+            __m256 const v = _mm256_loadu_ps(values + 3 * i + 8 * part);
+            _mm256_store_si256(reinterpret_cast<__m256i *>(codes + 8 * part),
+                               srgb8_avx2(table, v));
+        }
+        for (int p = 0; p < 8; ++p) {
+            rgba8[i + p] = static_cast<uint32_t>(codes[3 * p]) |
+                           (static_cast<uint32_t>(codes[3 * p + 1]) << 8) |
+                           (static_cast<uint32_t>(codes[3 * p + 2]) << 16) | 0xff000000u;
+        }
+    }
+    for (; i < count; ++i)
+        rgba8[i] = pack_rgba8(color[i]);
+}
+
+RT_TARGET("avx2,f16c")
+void convert_to_half_f16c(float const *values, uint16_t *halves, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i const h = _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(halves + i), h);
+    }
+    for (; i < count; ++i)
+        halves[i] = float_to_half(values[i]);
+}
+
+#endif
+
+} // namespace
+
+void tonemap_rgba8(Vec3 const *color, uint32_t *rgba8, size_t count, SimdLevel level) {
+#ifdef RT_X86
+    if (level >= SimdLevel::Avx2 && cpu_features().avx2) {
+        tonemap_avx2(color, rgba8, count);
+        return;
+    }
+#else
+    (void)level;
+#endif
+    for (size_t i = 0; i < count; ++i)
+        rgba8[i] = pack_rgba8(color[i]);
+}
+
+auto float_to_half(float value) -> uint16_t {
+    uint32_t const bits = std::bit_cast<uint32_t>(value);
+    auto const sign     = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    uint32_t const abs  = bits & 0x7fffffffu;
+    if (abs >= 0x7f800000u) {
+        // infinity stays infinity, NaN stays a quiet NaN with the high bits of its payload
+        uint32_t const nan = abs > 0x7f800000u ? 0x200u | ((abs >> 13) & 0x3ffu) : 0u;
+        return static_cast<uint16_t>(sign | 0x7c00u | nan);
+    }
+    // 65520 and up round to infinity
+    if (abs >= 0x477ff000u)
+        return static_cast<uint16_t>(sign | 0x7c00u);
+    // denormals are multiples of 2^-24, the scaling is exact and `nearbyint()` rounds to even
+    if (abs < 0x38800000u) {
+        float const scaled = std::bit_cast<float>(abs) * 16777216.0f;
+        return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(scaled)));
+    }
+    // rebias the exponent and round the mantissa to nearest even, carries go into the exponent
+    uint32_t const rounded = abs + 0xfffu + ((abs >> 13) & 1u);
+    return static_cast<uint16_t>(sign | ((rounded - 0x38000000u) >> 13));
+}
+
+void convert_to_half(float const *values, uint16_t *halves, size_t count, SimdLevel level) {
+#ifdef RT_X86
+    CpuFeatures const &cpu = cpu_features();
+    if (level >= SimdLevel::Avx2 && cpu.avx2 && cpu.f16c) {
+        convert_to_half_f16c(values, halves, count);
+        return;
+    }
+#else
+    (void)level;
+#endif
+    for (size_t i = 0; i < count; ++i)
+        halves[i] = float_to_half(values[i]);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "render/math.h"
+#include "utils/cpu_features.h"
+
+// Conversions of the float framebuffer to the storage formats of image files. The SIMD versions
+// give the same bits as the scalar ones, only faster.
+
+/// @brief `pack_rgba8()` of `count` colors, 8 at a time with AVX2 if `level` and the CPU allow
+void tonemap_rgba8(Vec3 const *color, uint32_t *rgba8, size_t count, SimdLevel level);
+
+/// IEEE 754 half precision of a float, rounded to nearest even
+auto float_to_half(float value) -> uint16_t;
+
+/// @brief `float_to_half()` of `count` floats, 8 at a time with F16C if `level` and the CPU allow
+void convert_to_half(float const *values, uint16_t *halves, size_t count, SimdLevel level);
@@ -0,0 +1,694 @@
+#include "traversal.h"
+
+#include <algorithm>
+#include <bit>
+
+#ifdef RT_X86
+#include <immintrin.h>
+#endif
+
+#include "render/compact_geometry.h"
+#include "render/scene.h"
+#include "render/wide_bvh.h"
+
+namespace {
+
+struct StackEntry {
+    uint32_t node;
+    float t;
+};
+
+/// enough for the widest nodes, the 8-wide ones
+constexpr int WIDE_STACK_SIZE = traversal_stack_size(8);
+
+template <bool Any>
+auto intersect_leaf(Scene const &scene, uint32_t first, uint32_t count, Ray const &ray, Hit &hit)
+    -> bool {
+    auto const &indices = scene.bvh.prim_indices();
+    bool found          = false;
+    for (uint32_t i = first; i < first + count; ++i) {
+        uint32_t const prim = indices[i];
+        float t, u, v;
+        if (intersect_triangle(ray, scene.vertex(prim, 0), scene.vertex(prim, 1),
+                               scene.vertex(prim, 2), hit.t, t, u, v)) {
+            if constexpr (Any)
+                return true;
+            hit   = {t, prim, u, v};
+            found = true;
+        }
+    }
+    return found;
+}
+
+/// Handles the children of a wide node that passed the box test: leaves are intersected right
+/// away, interior nodes pushed so that the nearest one ends up on top of the stack.
+/// @return true if `Any` is set and a hit was found
+template <bool Any, int N>
+auto visit_children(Scene const &scene, WideBvhNode<N> const &node, uint32_t mask,
+                    float const *t_near, Ray const &ray, Hit &hit, bool &found, StackEntry *stack,
+                    int &size) -> bool {
+    int const first = size;
+    while (mask) {
+        int const slot = std::countr_zero(mask);
+        mask &= mask - 1;
+        if (node.count[slot] > 0) {
+            if (intersect_leaf<Any>(scene, node.child[slot], node.count[slot], ray, hit)) {
+                if constexpr (Any)
+                    return true;
+                found = true;
+            }
+        } else {
+            // insertion sort by descending distance, the closest child is popped first
+            StackEntry const entry{node.child[slot], t_near[slot]};
+            int i = size++;
+            while (i > first && stack[i - 1].t < entry.t) {
+                stack[i] = stack[i - 1];
+                --i;
+            }
+            stack[i] = entry;
+        }
+    }
+    return false;
+}
+
+// ---- Scalar -------------------------------------------------------------------------------------
+
+auto intersect_scalar(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    return scene.bvh.intersect(scene, ray, hit);
+}
+
+auto occluded_scalar(Scene const &scene, Ray const &ray) -> bool {
+    return scene.bvh.occluded(scene, ray);
+}
+
+// ---- Compressed BVH -----------------------------------------------------------------------------
+
+/// triangles of a `CompactGeometry` leaf, which are stored in leaf order
+template <bool Any>
+auto intersect_compact_leaf(Scene const &scene, uint32_t first, uint32_t count, Ray const &ray,
+                            Hit &hit) -> bool {
+    bool found = false;
+    for (uint32_t prim = first; prim < first + count; ++prim) {
+        float t, u, v;
+        if (intersect_triangle(ray, scene.vertex(prim, 0), scene.vertex(prim, 1),
+                               scene.vertex(prim, 2), hit.t, t, u, v)) {
+            if constexpr (Any)
+                return true;
+            hit   = {t, prim, u, v};
+            found = true;
+        }
+    }
+    return found;
+}
+
+/// `visit_children()` for compressed nodes
+template <bool Any>
+auto visit_compact_children(Scene const &scene, CompressedBvhNode const &node, uint32_t mask,
+                            float const *t_near, Ray const &ray, Hit &hit, bool &found,
+                            StackEntry *stack, int &size) -> bool {
+    int const first = size;
+    while (mask) {
+        int const slot = std::countr_zero(mask);
+        mask &= mask - 1;
+        if (node.count[slot] > 0) {
+            if (intersect_compact_leaf<Any>(scene, node.first_prim(slot), node.count[slot], ray,
+                                            hit)) {
+                if constexpr (Any)
+                    return true;
+                found = true;
+            }
+        } else {
+            StackEntry const entry{node.child(slot), t_near[slot]};
+            int i = size++;
+            while (i > first && stack[i - 1].t < entry.t) {
+                stack[i] = stack[i - 1];
+                --i;
+            }
+            stack[i] = entry;
+        }
+    }
+    return false;
+}
+
+template <bool Any> auto traverse_compact(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    auto const &nodes = scene.compact.nodes();
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+
+    StackEntry stack[WIDE_STACK_SIZE];
+    int size      = 0;
+    stack[size++] = {0, ray.t_min};
+    bool found    = false;
+    float t_near[8];
+
+    while (size > 0) {
+        StackEntry const entry = stack[--size];
+        if (entry.t > hit.t)
+            continue;
+        CompressedBvhNode const &node = nodes[entry.node];
+
+        uint32_t used = node.used();
+        uint32_t mask = 0;
+        while (used) {
+            int const slot = std::countr_zero(used);
+            used &= used - 1;
+            if (intersect_aabb(node.child_bounds(slot), ray.origin, inv_dir, ray.t_min, hit.t,
+                               t_near[slot]))
+                mask |= 1u << slot;
+        }
+
+        if (visit_compact_children<Any>(scene, node, mask, t_near, ray, hit, found, stack, size))
+            return true;
+    }
+    return found;
+}
+
+auto intersect_compact(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    return traverse_compact<false>(scene, ray, hit);
+}
+
+auto occluded_compact(Scene const &scene, Ray const &ray) -> bool {
+    Hit hit;
+    hit.t = ray.t_max;
+    return traverse_compact<true>(scene, ray, hit);
+}
+
+/// packet fallback for hosts without AVX2: trace the lanes one by one
+template <auto Intersect> void intersect_packet8_lanes(Scene const &scene, RayPacket8 &packet) {
+    for (int lane = 0; lane < 8; ++lane) {
+        if (!(packet.active & (1u << lane)))
+            continue;
+        Hit hit = packet.hit(lane);
+        if (Intersect(scene, packet.ray(lane), hit)) {
+            packet.t[lane]    = hit.t;
+            packet.prim[lane] = hit.prim;
+            packet.u[lane]    = hit.u;
+            packet.v[lane]    = hit.v;
+        }
+    }
+}
+
+#ifdef RT_X86
+
+// Slab distances are `(plane - origin) * inv_dir`, which is NaN (0 * inf) only for an origin on a
+// plane the ray runs parallel to. SIMD max and min return their second operand if either one is
+// NaN, so chained with `t_min` and `t_max` innermost such distances drop out and the axis doesn't
+// constrain the ray, like in `intersect_aabb()`. The FMA form `plane * inv_dir - origin * inv_dir`
+// would give inf - inf = NaN for every zero direction component and cull nothing on that axis.
+
+RT_TARGET("sse4.1") inline auto slab_enter(__m128 x, __m128 y, __m128 z, __m128 t_min) -> __m128 {
+    return _mm_max_ps(x, _mm_max_ps(y, _mm_max_ps(z, t_min)));
+}
+
+RT_TARGET("sse4.1") inline auto slab_exit(__m128 x, __m128 y, __m128 z, __m128 t_max) -> __m128 {
+    return _mm_min_ps(x, _mm_min_ps(y, _mm_min_ps(z, t_max)));
+}
+
+/// `(plane - origin) * inv_dir` for the plane of all eight children
+RT_TARGET("avx2,fma")
+inline auto slab_distance(float const *plane, __m256 origin, __m256 inv_dir) -> __m256 {
+    return _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(plane), origin), inv_dir);
+}
+
+RT_TARGET("avx2,fma")
+inline auto slab_enter(__m256 x, __m256 y, __m256 z, __m256 t_min) -> __m256 {
+    return _mm256_max_ps(x, _mm256_max_ps(y, _mm256_max_ps(z, t_min)));
+}
+
+RT_TARGET("avx2,fma") inline auto slab_exit(__m256 x, __m256 y, __m256 z, __m256 t_max) -> __m256 {
+    return _mm256_min_ps(x, _mm256_min_ps(y, _mm256_min_ps(z, t_max)));
+}
+
+// ---- SSE4.1, 4-wide BVH ------------------------------------------------------------------------
+
+template <bool Any>
+RT_TARGET("sse4.1") auto traverse_sse41(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    auto const &nodes = scene.wide_bvh.nodes4();
+
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+    // rows of the near planes, the far planes are the other row of each pair
+    int const near_x = inv_dir.x < 0.0f ? 1 : 0;
+    int const near_y = inv_dir.y < 0.0f ? 3 : 2;
+    int const near_z = inv_dir.z < 0.0f ? 5 : 4;
+
+    __m128 const ox    = _mm_set1_ps(ray.origin.x);
+    __m128 const oy    = _mm_set1_ps(ray.origin.y);
+    __m128 const oz    = _mm_set1_ps(ray.origin.z);
+    __m128 const ix    = _mm_set1_ps(inv_dir.x);
+    __m128 const iy    = _mm_set1_ps(inv_dir.y);
+    __m128 const iz    = _mm_set1_ps(inv_dir.z);
+    __m128 const t_min = _mm_set1_ps(ray.t_min);
+
+    StackEntry stack[WIDE_STACK_SIZE];
+    int size      = 0;
+    stack[size++] = {0, ray.t_min};
+    bool found    = false;
+    alignas(16) float t_near[4];
+
+    while (size > 0) {
+        StackEntry const entry = stack[--size];
+        if (entry.t > hit.t)
+            continue;
+        WideBvhNode<4> const &node = nodes[entry.node];
+
+        __m128 const t_max = _mm_set1_ps(hit.t);
+        __m128 const tnx = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[near_x]), ox), ix);
+        __m128 const tny = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[near_y]), oy), iy);
+        __m128 const tnz = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[near_z]), oz), iz);
+        __m128 const tfx = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[near_x ^ 1]), ox), ix);
+        __m128 const tfy = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[near_y ^ 1]), oy), iy);
+        __m128 const tfz = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[near_z ^ 1]), oz), iz);
+        __m128 const tn  = slab_enter(tnx, tny, tnz, t_min);
+        __m128 const tf  = slab_exit(tfx, tfy, tfz, t_max);
+        auto const mask  = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tn, tf)));
+        _mm_store_ps(t_near, tn);
+
+        if (visit_children<Any>(scene, node, mask, t_near, ray, hit, found, stack, size))
+            return true;
+    }
+    return found;
+}
+
+RT_TARGET("sse4.1") auto intersect_sse41(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    return traverse_sse41<false>(scene, ray, hit);
+}
+
+RT_TARGET("sse4.1") auto occluded_sse41(Scene const &scene, Ray const &ray) -> bool {
+    Hit hit;
+    hit.t = ray.t_max;
+    return traverse_sse41<true>(scene, ray, hit);
+}
+
+// ---- AVX2, 8-wide BVH ---------------------------------------------------------------------------
+
+template <bool Any>
+RT_TARGET("avx2,fma") auto traverse_avx2(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    auto const &nodes = scene.wide_bvh.nodes8();
+
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+    int const near_x = inv_dir.x < 0.0f ? 1 : 0;
+    int const near_y = inv_dir.y < 0.0f ? 3 : 2;
+    int const near_z = inv_dir.z < 0.0f ? 5 : 4;
+
+    __m256 const ox    = _mm256_set1_ps(ray.origin.x);
+    __m256 const oy    = _mm256_set1_ps(ray.origin.y);
+    __m256 const oz    = _mm256_set1_ps(ray.origin.z);
+    __m256 const ix    = _mm256_set1_ps(inv_dir.x);
+    __m256 const iy    = _mm256_set1_ps(inv_dir.y);
+    __m256 const iz    = _mm256_set1_ps(inv_dir.z);
+    __m256 const t_min = _mm256_set1_ps(ray.t_min);
+
+    StackEntry stack[WIDE_STACK_SIZE];
+    int size      = 0;
+    stack[size++] = {0, ray.t_min};
+    bool found    = false;
+    alignas(32) float t_near[8];
+
+    while (size > 0) {
+        StackEntry const entry = stack[--size];
+        if (entry.t > hit.t)
+            continue;
+        WideBvhNode<8> const &node = nodes[entry.node];
+
+        __m256 const t_max = _mm256_set1_ps(hit.t);
+        __m256 const tnx   = slab_distance(node.bounds[near_x], ox, ix);
+        __m256 const tny   = slab_distance(node.bounds[near_y], oy, iy);
+        __m256 const tnz   = slab_distance(node.bounds[near_z], oz, iz);
+        __m256 const tfx   = slab_distance(node.bounds[near_x ^ 1], ox, ix);
+        __m256 const tfy   = slab_distance(node.bounds[near_y ^ 1], oy, iy);
+        __m256 const tfz   = slab_distance(node.bounds[near_z ^ 1], oz, iz);
+        __m256 const tn    = slab_enter(tnx, tny, tnz, t_min);
+        __m256 const tf    = slab_exit(tfx, tfy, tfz, t_max);
+        auto const mask =
+            static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ)));
+        _mm256_store_ps(t_near, tn);
+
+        if (visit_children<Any>(scene, node, mask, t_near, ray, hit, found, stack, size))
+            return true;
+    }
+    return found;
+}
+
+RT_TARGET("avx2,fma") auto intersect_avx2(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    return traverse_avx2<false>(scene, ray, hit);
+}
+
+RT_TARGET("avx2,fma") auto occluded_avx2(Scene const &scene, Ray const &ray) -> bool {
+    Hit hit;
+    hit.t = ray.t_max;
+    return traverse_avx2<true>(scene, ray, hit);
+}
+
+/// Eight rays against the binary BVH. A node is entered if any active ray hits its box, leaves
+/// test every triangle against all rays at once.
+RT_TARGET("avx2,fma") void intersect_packet8_avx2(Scene const &scene, RayPacket8 &packet) {
+    if (!packet.active)
+        return;
+    auto const &nodes   = scene.bvh.nodes();
+    auto const &indices = scene.bvh.prim_indices();
+
+    __m256 o[3], d[3], inv[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        o[axis]   = _mm256_load_ps(packet.origin[axis]);
+        d[axis]   = _mm256_load_ps(packet.direction[axis]);
+        inv[axis] = _mm256_div_ps(_mm256_set1_ps(1.0f), d[axis]);
+    }
+    __m256 const t_min = _mm256_load_ps(packet.t_min);
+    __m256 t           = _mm256_load_ps(packet.t);
+    __m256 u           = _mm256_load_ps(packet.u);
+    __m256 v           = _mm256_load_ps(packet.v);
+    __m256i prim       = _mm256_load_si256(reinterpret_cast<__m256i const *>(packet.prim));
+
+    __m256i const lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256 const active     = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+        _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(packet.active)), lane_bits),
+        lane_bits));
+
+    // children are visited front to back for the direction of the first active ray, which is
+    // right for all of them as long as the packet is coherent
+    int const leader       = std::countr_zero(packet.active);
+    bool const negative[3] = {packet.direction[0][leader] < 0.0f,
+                              packet.direction[1][leader] < 0.0f,
+                              packet.direction[2][leader] < 0.0f};
+
+    __m256 const eps      = _mm256_set1_ps(1.0e-12f);
+    __m256 const zero     = _mm256_setzero_ps();
+    __m256 const one      = _mm256_set1_ps(1.0f);
+    __m256 const abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 const pos_inf  = _mm256_set1_ps(INF);
+    __m256 const neg_inf  = _mm256_set1_ps(-INF);
+
+    // both children are pushed and one of them popped right away, like a binary traversal
+    uint32_t stack[traversal_stack_size(2)];
+    int size      = 0;
+    stack[size++] = 0;
+
+    while (size > 0) {
+        BvhNode const &node = nodes[stack[--size]];
+
+        __m256 tn = t_min;
+        __m256 tf = t;
+        for (int axis = 0; axis < 3; ++axis) {
+            __m256 const lo = _mm256_set1_ps(node.bounds.lo[axis]);
+            __m256 const hi = _mm256_set1_ps(node.bounds.hi[axis]);
+            // Not the `plane * inv - origin * inv` FMA of the single ray kernels, which is
+            // inf - inf = NaN for every zero direction component. This way only an origin on a
+            // face the ray runs parallel to gives NaN (0 * inf), and like `intersect_aabb()` the
+            // axis doesn't constrain such a ray.
+            __m256 const t0      = _mm256_mul_ps(_mm256_sub_ps(lo, o[axis]), inv[axis]);
+            __m256 const t1      = _mm256_mul_ps(_mm256_sub_ps(hi, o[axis]), inv[axis]);
+            __m256 const on_face = _mm256_cmp_ps(t0, t1, _CMP_UNORD_Q);
+            tn = _mm256_max_ps(tn, _mm256_blendv_ps(_mm256_min_ps(t0, t1), neg_inf, on_face));
+            tf = _mm256_min_ps(tf, _mm256_blendv_ps(_mm256_max_ps(t0, t1), pos_inf, on_face));
+        }
+        __m256 const box_hit = _mm256_and_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ), active);
+        if (_mm256_movemask_ps(box_hit) == 0)
+            continue;
+
+        if (!node.is_leaf()) {
+            uint32_t const first = node.offset;
+            if (negative[node.axis]) {
+                stack[size++] = first;
+                stack[size++] = first + 1;
+            } else {
+                stack[size++] = first + 1;
+                stack[size++] = first;
+            }
+            continue;
+        }
+
+        for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            uint32_t const index = indices[i];
+            Vec3 const p0        = scene.vertex(index, 0);
+            Vec3 const a         = scene.vertex(index, 1) - p0;
+            Vec3 const b         = scene.vertex(index, 2) - p0;
+            __m256 const e1[3]   = {_mm256_set1_ps(a.x), _mm256_set1_ps(a.y), _mm256_set1_ps(a.z)};
+            __m256 const e2[3]   = {_mm256_set1_ps(b.x), _mm256_set1_ps(b.y), _mm256_set1_ps(b.z)};
+
+            // p = d x e2
+            __m256 const px = _mm256_fmsub_ps(d[1], e2[2], _mm256_mul_ps(d[2], e2[1]));
+            __m256 const py = _mm256_fmsub_ps(d[2], e2[0], _mm256_mul_ps(d[0], e2[2]));
+            __m256 const pz = _mm256_fmsub_ps(d[0], e2[1], _mm256_mul_ps(d[1], e2[0]));
+            __m256 const det =
+                _mm256_fmadd_ps(e1[0], px, _mm256_fmadd_ps(e1[1], py, _mm256_mul_ps(e1[2], pz)));
+            __m256 const inv_det = _mm256_div_ps(one, det);
+
+            // s = o - p0
+            __m256 const sx = _mm256_sub_ps(o[0], _mm256_set1_ps(p0.x));
+            __m256 const sy = _mm256_sub_ps(o[1], _mm256_set1_ps(p0.y));
+            __m256 const sz = _mm256_sub_ps(o[2], _mm256_set1_ps(p0.z));
+            __m256 const hu = _mm256_mul_ps(
+                _mm256_fmadd_ps(sx, px, _mm256_fmadd_ps(sy, py, _mm256_mul_ps(sz, pz))), inv_det);
+
+            // q = s x e1
+            __m256 const qx = _mm256_fmsub_ps(sy, e1[2], _mm256_mul_ps(sz, e1[1]));
+            __m256 const qy = _mm256_fmsub_ps(sz, e1[0], _mm256_mul_ps(sx, e1[2]));
+            __m256 const qz = _mm256_fmsub_ps(sx, e1[1], _mm256_mul_ps(sy, e1[0]));
+            __m256 const hv = _mm256_mul_ps(
+                _mm256_fmadd_ps(d[0], qx, _mm256_fmadd_ps(d[1], qy, _mm256_mul_ps(d[2], qz))),
+                inv_det);
+            __m256 const ht = _mm256_mul_ps(
+                _mm256_fmadd_ps(e2[0], qx, _mm256_fmadd_ps(e2[1], qy, _mm256_mul_ps(e2[2], qz))),
+                inv_det);
+
+            __m256 const huv = _mm256_add_ps(hu, hv);
+            __m256 mask      = _mm256_cmp_ps(_mm256_and_ps(det, abs_mask), eps, _CMP_GE_OQ);
+            mask             = _mm256_and_ps(mask, box_hit);
+            mask             = _mm256_and_ps(mask, _mm256_cmp_ps(hu, zero, _CMP_GE_OQ));
+            mask             = _mm256_and_ps(mask, _mm256_cmp_ps(hv, zero, _CMP_GE_OQ));
+            mask             = _mm256_and_ps(mask, _mm256_cmp_ps(huv, one, _CMP_LE_OQ));
+            mask             = _mm256_and_ps(mask, _mm256_cmp_ps(ht, t_min, _CMP_GT_OQ));
+            mask             = _mm256_and_ps(mask, _mm256_cmp_ps(ht, t, _CMP_LT_OQ));
+            if (_mm256_movemask_ps(mask) == 0)
+                continue;
+
+            t    = _mm256_blendv_ps(t, ht, mask);
+            u    = _mm256_blendv_ps(u, hu, mask);
+            v    = _mm256_blendv_ps(v, hv, mask);
+            prim = _mm256_castps_si256(_mm256_blendv_ps(
+                _mm256_castsi256_ps(prim),
+                _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(index))), mask));
+        }
+    }
+
+    _mm256_store_ps(packet.t, t);
+    _mm256_store_ps(packet.u, u);
+    _mm256_store_ps(packet.v, v);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(packet.prim), prim);
+}
+
+// ---- AVX-512, 8-wide BVH ------------------------------------------------------------------------
+
+/// Same box test as the AVX2 kernel, but the hit mask lives in a mask register and the hit
+/// children and their distances are compressed into contiguous arrays, so the child loop only
+/// touches children that were actually hit.
+template <bool Any>
+RT_TARGET("avx2,fma,avx512f,avx512vl")
+auto traverse_avx512(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    auto const &nodes = scene.wide_bvh.nodes8();
+
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+    int const near_x = inv_dir.x < 0.0f ? 1 : 0;
+    int const near_y = inv_dir.y < 0.0f ? 3 : 2;
+    int const near_z = inv_dir.z < 0.0f ? 5 : 4;
+
+    __m256 const ox     = _mm256_set1_ps(ray.origin.x);
+    __m256 const oy     = _mm256_set1_ps(ray.origin.y);
+    __m256 const oz     = _mm256_set1_ps(ray.origin.z);
+    __m256 const ix     = _mm256_set1_ps(inv_dir.x);
+    __m256 const iy     = _mm256_set1_ps(inv_dir.y);
+    __m256 const iz     = _mm256_set1_ps(inv_dir.z);
+    __m256 const t_min  = _mm256_set1_ps(ray.t_min);
+    __m256i const slots = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    StackEntry stack[WIDE_STACK_SIZE];
+    int size      = 0;
+    stack[size++] = {0, ray.t_min};
+    bool found    = false;
+    alignas(32) float t_hit[8];
+    alignas(32) int32_t slot_hit[8];
+
+    while (size > 0) {
+        StackEntry const entry = stack[--size];
+        if (entry.t > hit.t)
+            continue;
+        WideBvhNode<8> const &node = nodes[entry.node];
+
+        __m256 const t_max = _mm256_set1_ps(hit.t);
+        __m256 const tnx   = slab_distance(node.bounds[near_x], ox, ix);
+        __m256 const tny   = slab_distance(node.bounds[near_y], oy, iy);
+        __m256 const tnz   = slab_distance(node.bounds[near_z], oz, iz);
+        __m256 const tfx   = slab_distance(node.bounds[near_x ^ 1], ox, ix);
+        __m256 const tfy   = slab_distance(node.bounds[near_y ^ 1], oy, iy);
+        __m256 const tfz   = slab_distance(node.bounds[near_z ^ 1], oz, iz);
+        __m256 const tn    = slab_enter(tnx, tny, tnz, t_min);
+        __m256 const tf    = slab_exit(tfx, tfy, tfz, t_max);
+        auto const mask    = _mm256_cmp_ps_mask(tn, tf, _CMP_LE_OQ);
+        if (mask == 0)
+            continue;
+
+        _mm256_mask_compressstoreu_ps(t_hit, mask, tn);
+        _mm256_mask_compressstoreu_epi32(slot_hit, mask, slots);
+        int const hit_count = std::popcount(static_cast<unsigned>(mask));
+
+        int const first = size;
+        for (int h = 0; h < hit_count; ++h) {
+            int const slot = slot_hit[h];
+            if (node.count[slot] > 0) {
+                if (intersect_leaf<Any>(scene, node.child[slot], node.count[slot], ray, hit)) {
+                    if constexpr (Any)
+                        return true;
+                    found = true;
+                }
+                continue;
+            }
+            StackEntry const child{node.child[slot], t_hit[h]};
+            int i = size++;
+            while (i > first && stack[i - 1].t < child.t) {
+                stack[i] = stack[i - 1];
+                --i;
+            }
+            stack[i] = child;
+        }
+    }
+    return found;
+}
+
+RT_TARGET("avx2,fma,avx512f,avx512vl")
+auto intersect_avx512(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    return traverse_avx512<false>(scene, ray, hit);
+}
+
+RT_TARGET("avx2,fma,avx512f,avx512vl")
+auto occluded_avx512(Scene const &scene, Ray const &ray) -> bool {
+    Hit hit;
+    hit.t = ray.t_max;
+    return traverse_avx512<true>(scene, ray, hit);
+}
+
+// ---- AVX2, compressed BVH -----------------------------------------------------------------------
+
+/// one plane of all eight children, `origin + q * scale`
+RT_TARGET("avx2,fma")
+inline auto decode_planes(uint8_t const *q, __m256 origin, __m256 scale) -> __m256 {
+    __m128i const packed = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(q));
+    return _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(packed)), scale, origin);
+}
+
+/// The AVX2 box test on `CompactGeometry` nodes, the 8 bit planes are widened and decoded in
+/// registers, relative to the ray origin, before the same slab test.
+template <bool Any>
+RT_TARGET("avx2,fma")
+auto traverse_compact_avx2(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    auto const &nodes = scene.compact.nodes();
+
+    Vec3 const inv_dir{1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z};
+    int const near_x = inv_dir.x < 0.0f ? 1 : 0;
+    int const near_y = inv_dir.y < 0.0f ? 3 : 2;
+    int const near_z = inv_dir.z < 0.0f ? 5 : 4;
+
+    __m256 const ix    = _mm256_set1_ps(inv_dir.x);
+    __m256 const iy    = _mm256_set1_ps(inv_dir.y);
+    __m256 const iz    = _mm256_set1_ps(inv_dir.z);
+    __m256 const t_min = _mm256_set1_ps(ray.t_min);
+
+    StackEntry stack[WIDE_STACK_SIZE];
+    int size      = 0;
+    stack[size++] = {0, ray.t_min};
+    bool found    = false;
+    alignas(32) float t_near[8];
+
+    while (size > 0) {
+        StackEntry const entry = stack[--size];
+        if (entry.t > hit.t)
+            continue;
+        CompressedBvhNode const &node = nodes[entry.node];
+
+        // planes relative to the ray origin, decoded as `(node origin - ray origin) + q * scale`
+        __m256 const ox    = _mm256_set1_ps(node.origin[0] - ray.origin.x);
+        __m256 const oy    = _mm256_set1_ps(node.origin[1] - ray.origin.y);
+        __m256 const oz    = _mm256_set1_ps(node.origin[2] - ray.origin.z);
+        __m256 const sx    = _mm256_set1_ps(node.scale(0));
+        __m256 const sy    = _mm256_set1_ps(node.scale(1));
+        __m256 const sz    = _mm256_set1_ps(node.scale(2));
+        __m256 const t_max = _mm256_set1_ps(hit.t);
+
+        __m256 const tnx = _mm256_mul_ps(decode_planes(node.bounds[near_x], ox, sx), ix);
+        __m256 const tny = _mm256_mul_ps(decode_planes(node.bounds[near_y], oy, sy), iy);
+        __m256 const tnz = _mm256_mul_ps(decode_planes(node.bounds[near_z], oz, sz), iz);
+        __m256 const tfx = _mm256_mul_ps(decode_planes(node.bounds[near_x ^ 1], ox, sx), ix);
+        __m256 const tfy = _mm256_mul_ps(decode_planes(node.bounds[near_y ^ 1], oy, sy), iy);
+        __m256 const tfz = _mm256_mul_ps(decode_planes(node.bounds[near_z ^ 1], oz, sz), iz);
+        __m256 const tn  = slab_enter(tnx, tny, tnz, t_min);
+        __m256 const tf  = slab_exit(tfx, tfy, tfz, t_max);
+
+        // unused slots have no triangles and aren't interior either
+        __m128i const counts  = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(node.count));
+        __m128i const no_prim = _mm_cmpeq_epi8(counts, _mm_setzero_si128());
+        __m256 const inside   = _mm256_cmp_ps(tn, tf, _CMP_LE_OQ);
+        uint32_t const leaves = ~static_cast<uint32_t>(_mm_movemask_epi8(no_prim)) & 0xffu;
+        uint32_t const mask   = (leaves | node.interior) & _mm256_movemask_ps(inside);
+        _mm256_store_ps(t_near, tn);
+
+        if (visit_compact_children<Any>(scene, node, mask, t_near, ray, hit, found, stack, size))
+            return true;
+    }
+    return found;
+}
+
+RT_TARGET("avx2,fma")
+auto intersect_compact_avx2(Scene const &scene, Ray const &ray, Hit &hit) -> bool {
+    return traverse_compact_avx2<false>(scene, ray, hit);
+}
+
+RT_TARGET("avx2,fma") auto occluded_compact_avx2(Scene const &scene, Ray const &ray) -> bool {
+    Hit hit;
+    hit.t = ray.t_max;
+    return traverse_compact_avx2<true>(scene, ray, hit);
+}
+
+#endif
+
+} // namespace
+
+auto traversal_kernels(SimdLevel level) -> TraversalKernels const & {
+    static TraversalKernels const scalar{SimdLevel::Scalar, 0, intersect_scalar, occluded_scalar,
+                                         intersect_packet8_lanes<intersect_scalar>};
+#ifdef RT_X86
+    static TraversalKernels const sse41{SimdLevel::Sse41, 4, intersect_sse41, occluded_sse41,
+                                        intersect_packet8_lanes<intersect_sse41>};
+    static TraversalKernels const avx2{SimdLevel::Avx2, 8, intersect_avx2, occluded_avx2,
+                                       intersect_packet8_avx2};
+    // 8 ray packets fill a 256 bit register, the AVX2 packet kernel is used as is
+    static TraversalKernels const avx512{SimdLevel::Avx512, 8, intersect_avx512, occluded_avx512,
+                                         intersect_packet8_avx2};
+
+    level = std::min(level, best_simd_level());
+    switch (level) {
+    case SimdLevel::Avx512:
+        return avx512;
+    case SimdLevel::Avx2:
+        return avx2;
+    case SimdLevel::Sse41:
+        return sse41;
+    case SimdLevel::Scalar:
+        break;
+    }
+#endif
+    return scalar;
+}
+
+auto compact_traversal_kernels(SimdLevel level) -> TraversalKernels const & {
+    static TraversalKernels const scalar{SimdLevel::Scalar, 8, intersect_compact, occluded_compact,
+                                         intersect_packet8_lanes<intersect_compact>};
+#ifdef RT_X86
+    // the nodes are 8-wide, SSE4.1 can't test them in one go and AVX-512 has nothing to add
+    static TraversalKernels const avx2{SimdLevel::Avx2, 8, intersect_compact_avx2,
+                                       occluded_compact_avx2,
+                                       intersect_packet8_lanes<intersect_compact_avx2>};
+    if (std::min(level, best_simd_level()) >= SimdLevel::Avx2)
+        return avx2;
+#else
+    (void)level;
+#endif
+    return scalar;
+}
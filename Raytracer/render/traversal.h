@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#include "render/intersect.h"
+#include "utils/cpu_features.h"
+
+struct Scene;
+
+/// Eight rays traced together, structure of arrays. Lanes that are not set in `active` are
+/// ignored by the traversal and keep their values.
+struct alignas(32) RayPacket8 {
+    float origin[3][8];
+    float direction[3][8];
+    float t_min[8];
+    /// distance to the closest hit so far, initialise with the ray's `t_max`
+    float t[8];
+    uint32_t prim[8];
+    float u[8];
+    float v[8];
+    /// filled by `Scene::intersect()` for hits on instances, the kernels only see triangles
+    uint32_t instance[8];
+    /// bit `i` set means lane `i` holds a ray
+    uint32_t active = 0;
+
+    void set(int lane, Ray const &ray) {
+        for (int axis = 0; axis < 3; ++axis) {
+            origin[axis][lane]    = ray.origin[axis];
+            direction[axis][lane] = ray.direction[axis];
+        }
+        t_min[lane]    = ray.t_min;
+        t[lane]        = ray.t_max;
+        prim[lane]     = ~0u;
+        u[lane]        = 0.0f;
+        v[lane]        = 0.0f;
+        instance[lane] = ~0u;
+        active |= 1u << lane;
+    }
+
+    auto ray(int lane) const -> Ray {
+        return {{origin[0][lane], origin[1][lane], origin[2][lane]},
+                {direction[0][lane], direction[1][lane], direction[2][lane]},
+                t_min[lane],
+                t[lane]};
+    }
+
+    auto hit(int lane) const -> Hit {
+        return {t[lane], prim[lane], u[lane], v[lane], instance[lane]};
+    }
+
+    void set_hit(int lane, Hit const &hit) {
+        t[lane]        = hit.t;
+        prim[lane]     = hit.prim;
+        u[lane]        = hit.u;
+        v[lane]        = hit.v;
+        instance[lane] = hit.instance;
+    }
+};
+
+/// Ray traversal entry points for one SIMD level, see `traversal_kernels()`.
+///
+/// Single rays traverse the `WideBvh` of the scene (4-wide for SSE, 8-wide for AVX2/AVX-512, the
+/// binary `Bvh` for scalar). Packets traverse the binary `Bvh` with all eight rays in one register.
+struct TraversalKernels {
+    SimdLevel level;
+    /// width of the `WideBvh` the kernels expect, `0` means they only use the binary `Bvh`. The
+    /// compact kernels give the width of the compressed nodes.
+    int bvh_width;
+    auto (*intersect)(Scene const &scene, Ray const &ray, Hit &hit) -> bool;
+    auto (*occluded)(Scene const &scene, Ray const &ray) -> bool;
+    void (*intersect_packet8)(Scene const &scene, RayPacket8 &packet);
+};
+
+/// the kernels for `level`, or for the best level below it the host supports
+auto traversal_kernels(SimdLevel level) -> TraversalKernels const &;
+
+/// kernels that traverse `Scene::compact` instead, scalar or AVX2, packets are traced one ray at a
+/// time
+auto compact_traversal_kernels(SimdLevel level) -> TraversalKernels const &;
@@ -0,0 +1,242 @@
+#include "wavefront.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "utils/profiler.h"
+
+namespace {
+
+/// spreads the low 9 bits of `v` out to every third bit
+auto spread_bits(uint32_t v) -> uint32_t {
+    v &= 0x1ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+/// @brief sorts `keys` by their high 32 bits, stable, so the path indices in the low bits stay in
+/// order within equal keys. LSD radix sort with a byte per pass, passes over bytes that are the
+/// same in every key are skipped, which leaves one or two passes for the material keys.
+/// @param scratch room for `count` keys
+/// @return `keys` or `scratch`, whichever holds the sorted keys
+auto sort_keys(uint64_t *keys, uint64_t *scratch, size_t count) -> uint64_t * {
+    for (int shift = 32; shift < 64; shift += 8) {
+        std::array<uint32_t, 256> counts{};
+        for (size_t i = 0; i < count; ++i)
+            ++counts[(keys[i] >> shift) & 0xff];
+        if (count == 0 || counts[(keys[0] >> shift) & 0xff] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (auto &c : counts)
+            offset += std::exchange(c, offset);
+        for (size_t i = 0; i < count; ++i)
+            scratch[counts[(keys[i] >> shift) & 0xff]++] = keys[i];
+        std::swap(keys, scratch);
+    }
+    return keys;
+}
+
+/// sort key of a bounce ray: the direction octant, then the Morton code of its origin
+auto ray_key(Vec3 origin, Vec3 direction, Aabb const &bounds) -> uint32_t {
+    uint32_t const octant = (direction.x < 0.0f ? 1u : 0u) | (direction.y < 0.0f ? 2u : 0u) |
+                            (direction.z < 0.0f ? 4u : 0u);
+    Vec3 const extent = bounds.extent();
+    uint32_t morton   = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float const x =
+            extent[axis] > 0.0f ? (origin[axis] - bounds.lo[axis]) / extent[axis] : 0.0f;
+        auto const cell = static_cast<uint32_t>(std::clamp(x * 512.0f, 0.0f, 511.0f));
+        morton |= spread_bits(cell) << axis;
+    }
+    return (octant << 27) | morton;
+}
+
+/// sort key of a hit: the mesh and material, misses first
+auto material_key(Scene const &scene, Hit const &hit) -> uint32_t {
+    if (!hit.is_valid())
+        return 0;
+    uint32_t const mesh =
+        hit.instance == ~0u ? 0 : scene.instances.instance(hit.instance).mesh + 1;
+    return ((mesh << 16) ^ scene.hit_mesh(hit).material_ids[hit.prim]) + 1;
+}
+
+} // namespace
+
+PathQueue::PathQueue(Arena &arena, size_t capacity)
+    : origin(arena.allocate<Vec3>(capacity)), direction(arena.allocate<Vec3>(capacity)),
+      throughput(arena.allocate<Vec3>(capacity)), footprint(arena.allocate<float>(capacity)),
+      spread(arena.allocate<float>(capacity)), sample(arena.allocate<uint32_t>(capacity)),
+      hit(arena.allocate<Hit>(capacity)) {}
+
+void PathQueue::push(Ray const &ray, Vec3 path_throughput, float path_footprint,
+                     float path_spread, uint32_t path_sample) {
+    origin[size]     = ray.origin;
+    direction[size]  = ray.direction;
+    throughput[size] = path_throughput;
+    footprint[size]  = path_footprint;
+    spread[size]     = path_spread;
+    sample[size]     = path_sample;
+    hit[size]        = Hit{};
+    ++size;
+}
+
+void PathQueue::gather(PathQueue const &from, uint64_t const *keys, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        auto const j  = static_cast<uint32_t>(keys[i]);
+        origin[i]     = from.origin[j];
+        direction[i]  = from.direction[j];
+        throughput[i] = from.throughput[j];
+        footprint[i]  = from.footprint[j];
+        spread[i]     = from.spread[j];
+        sample[i]     = from.sample[j];
+        hit[i]        = from.hit[j];
+    }
+    size = count;
+}
+
+ShadowQueue::ShadowQueue(Arena &arena, size_t capacity)
+    : ray(arena.allocate<Ray>(capacity)), radiance(arena.allocate<Vec3>(capacity)),
+      sample(arena.allocate<uint32_t>(capacity)) {}
+
+// ---- WavefrontIntegrator ------------------------------------------------------------------------
+
+WavefrontIntegrator::WavefrontIntegrator(Arena &arena, size_t capacity)
+    : m_paths(arena, capacity), m_next(arena, capacity), m_shadows(arena, capacity),
+      m_keys(arena.allocate<uint64_t>(capacity)),
+      m_sort_scratch(arena.allocate<uint64_t>(capacity)),
+      m_sampler(arena.allocate<Sampler>(capacity)), m_radiance(arena.allocate<Vec3>(capacity)),
+      m_albedo(arena.allocate<Vec3>(capacity)), m_normal(arena.allocate<Vec3>(capacity)),
+      m_depth(arena.allocate<float>(capacity)) {}
+
+auto WavefrontIntegrator::add_path(Ray const &ray, Sampler const &sampler, float spread)
+    -> uint32_t {
+    auto const sample  = static_cast<uint32_t>(m_samples++);
+    m_sampler[sample]  = sampler;
+    m_radiance[sample] = Vec3{0.0f};
+    m_albedo[sample]   = Vec3{1.0f};
+    m_normal[sample]   = Vec3{0.0f};
+    m_depth[sample]    = 0.0f;
+    m_paths.push(ray, Vec3{1.0f}, 0.0f, spread, sample);
+    return sample;
+}
+
+void WavefrontIntegrator::trace(Scene const &scene, IntegratorSettings const &settings) {
+    for (int depth = 0; depth < settings.max_depth && m_paths.size > 0; ++depth) {
+        // camera rays come in pixel order, which is as coherent as it gets
+        extend(scene, depth > 0);
+        shade(scene, settings, depth);
+        connect(scene);
+    }
+    m_paths.size = 0;
+}
+
+void WavefrontIntegrator::sort_paths() {
+    uint64_t const *sorted = sort_keys(m_keys, m_sort_scratch, m_paths.size);
+    m_next.gather(m_paths, sorted, m_paths.size);
+    std::swap(m_paths, m_next);
+}
+
+void WavefrontIntegrator::extend(Scene const &scene, bool sort) {
+    PROFILE_SCOPE("extend");
+    size_t const n = m_paths.size;
+    if (sort) {
+        Aabb bounds;
+        for (size_t i = 0; i < n; ++i)
+            bounds.extend(m_paths.origin[i]);
+        for (size_t i = 0; i < n; ++i) {
+            m_keys[i] = uint64_t{ray_key(m_paths.origin[i], m_paths.direction[i], bounds)} << 32 |
+                        i;
+        }
+        sort_paths();
+    }
+
+    m_rays += n;
+    for (size_t first = 0; first < n; first += 8) {
+        int const lanes = static_cast<int>(std::min<size_t>(8, n - first));
+        RayPacket8 packet{};
+        for (int lane = 0; lane < lanes; ++lane)
+            packet.set(lane, Ray{m_paths.origin[first + lane], m_paths.direction[first + lane]});
+        scene.intersect(packet);
+        for (int lane = 0; lane < lanes; ++lane)
+            m_paths.hit[first + lane] = packet.hit(lane);
+    }
+}
+
+void WavefrontIntegrator::shade(Scene const &scene, IntegratorSettings const &settings,
+                                int depth) {
+    PROFILE_SCOPE("shade");
+    size_t const n = m_paths.size;
+    for (size_t i = 0; i < n; ++i)
+        m_keys[i] = uint64_t{material_key(scene, m_paths.hit[i])} << 32 | i;
+    sort_paths();
+
+    m_next.size    = 0;
+    m_shadows.size = 0;
+    bool const last = depth + 1 >= settings.max_depth;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t const sample = m_paths.sample[i];
+        Hit const &hit        = m_paths.hit[i];
+        Vec3 throughput       = m_paths.throughput[i];
+        if (!hit.is_valid()) {
+            m_radiance[sample] += throughput * scene.background;
+            continue;
+        }
+
+        // the same steps as `trace_path()`, see there
+        Material const &material = scene.material(hit);
+        if (depth == 0 || hit.instance != ~0u)
+            m_radiance[sample] += throughput * material.emission;
+
+        Vec3 const direction = m_paths.direction[i];
+        Vec3 const p         = m_paths.origin[i] + direction * hit.t;
+        Vec3 n               = scene.geometric_normal(hit);
+        if (dot(n, direction) > 0.0f)
+            n = -n;
+
+        float const footprint = m_paths.footprint[i] + hit.t * m_paths.spread[i];
+        Vec3 const albedo     = scene.albedo(hit, footprint);
+        if (depth == 0) {
+            m_albedo[sample] = albedo;
+            m_normal[sample] = n;
+            m_depth[sample]  = hit.t;
+        }
+
+        Sampler &sampler = m_sampler[sample];
+        Ray shadow;
+        Vec3 const direct = sample_light(scene, p, n, albedo, sampler, shadow);
+        if (max_component(direct) > 0.0f) {
+            m_shadows.ray[m_shadows.size]      = shadow;
+            m_shadows.radiance[m_shadows.size] = throughput * direct;
+            m_shadows.sample[m_shadows.size]   = sample;
+            ++m_shadows.size;
+        }
+        if (last)
+            continue;
+
+        throughput = throughput * albedo;
+        if (depth + 1 >= settings.rr_depth) {
+            float const survive = std::min(0.95f, max_component(throughput));
+            if (sampler.next_1d() >= survive)
+                continue;
+            throughput = throughput / survive;
+        }
+        auto const [u1, u2] = sampler.next_2d();
+        m_next.push(Ray{p, sample_cosine_hemisphere(n, u1, u2)}, throughput, footprint,
+                    std::max(m_paths.spread[i], DIFFUSE_SPREAD), sample);
+    }
+    std::swap(m_paths, m_next);
+}
+
+void WavefrontIntegrator::connect(Scene const &scene) {
+    PROFILE_SCOPE("connect");
+    m_rays += m_shadows.size;
+    for (size_t i = 0; i < m_shadows.size; ++i) {
+        if (!scene.occluded(m_shadows.ray[i]))
+            m_radiance[m_shadows.sample[i]] += m_shadows.radiance[i];
+    }
+}
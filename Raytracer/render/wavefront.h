@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+
+#include "render/integrator.h"
+#include "render/sampler.h"
+#include "render/scene.h"
+#include "utils/arena.h"
+
+/// Paths in flight, structure of arrays so every stage only streams through the fields it uses.
+/// The arrays come from an arena and hold up to the capacity given at construction.
+struct PathQueue {
+    Vec3 *origin;
+    Vec3 *direction;
+    Vec3 *throughput;
+    /// width of the ray cone at `origin` and the angle it widens by, see `trace_path()`
+    float *footprint;
+    float *spread;
+    /// the sample the path adds its radiance to
+    uint32_t *sample;
+    /// closest hit, filled by the extend stage
+    Hit *hit;
+    size_t size = 0;
+
+    PathQueue(Arena &arena, size_t capacity);
+
+    void push(Ray const &ray, Vec3 throughput, float footprint, float spread, uint32_t sample);
+    /// replaces the content with the paths of `from`, in the order of the low 32 bits of `keys`
+    void gather(PathQueue const &from, uint64_t const *keys, size_t count);
+};
+
+/// Shadow rays of next event estimation, `radiance` counts if the ray is unoccluded.
+struct ShadowQueue {
+    Ray *ray;
+    Vec3 *radiance;
+    uint32_t *sample;
+    size_t size = 0;
+
+    ShadowQueue(Arena &arena, size_t capacity);
+};
+
+/// Path tracer that runs a whole wave of paths through one stage at a time instead of following
+/// every path to its end: generate (`add_path()`), extend (closest hits), shade (emission, next
+/// event estimation and the next bounce) and connect (shadow rays). Computes the same estimate as
+/// `trace_path()` and consumes the random numbers of every path in the same order.
+///
+/// Each stage works through large queues, which keeps the code and data of one stage in cache
+/// while the per-path loop keeps switching between traversal and shading. Before the extend stage
+/// bounce rays are sorted by direction octant and origin, so consecutive rays traverse similar
+/// parts of the BVH and packets of them share nodes; before shading hits are sorted by material
+/// so lookups of the same material and texture come together.
+///
+/// All queues are allocated from an arena up front and live as long as it isn't rewound.
+class WavefrontIntegrator {
+    PathQueue m_paths;
+    /// bounce rays written by the shade stage, also the target of sorting
+    PathQueue m_next;
+    ShadowQueue m_shadows;
+    /// sort key in the high, path index in the low 32 bits, and room to sort them
+    uint64_t *m_keys;
+    uint64_t *m_sort_scratch;
+
+    // per sample
+    size_t m_samples = 0;
+    Sampler *m_sampler;
+    Vec3 *m_radiance;
+    Vec3 *m_albedo;
+    Vec3 *m_normal;
+    float *m_depth;
+    /// closest hit and shadow rays traced so far
+    uint64_t m_rays = 0;
+
+    /// sorts `m_keys` and reorders `m_paths` to match
+    void sort_paths();
+    void extend(Scene const &scene, bool sort);
+    void shade(Scene const &scene, IntegratorSettings const &settings, int depth);
+    void connect(Scene const &scene);
+
+  public:
+    /// @param capacity the most paths `add_path()` will be called for
+    WavefrontIntegrator(Arena &arena, size_t capacity);
+
+    /// @brief generate stage: adds a path starting with the camera ray `ray`
+    /// @param sampler random numbers of the path, it continues where the camera sample left it
+    /// @param spread angle of the cone around `ray`, see `trace_path()`
+    /// @return the index of the sample the results are stored under
+    auto add_path(Ray const &ray, Sampler const &sampler, float spread) -> uint32_t;
+
+    /// follows every path of the wave until it ends
+    void trace(Scene const &scene, IntegratorSettings const &settings);
+
+    auto sample_count() const -> size_t { return m_samples; }
+    /// rays traced by all `trace()` calls, closest hit and shadow rays
+    auto rays() const -> uint64_t { return m_rays; }
+    /// radiance arriving along the camera ray of `sample`, valid after `trace()`
+    auto radiance(uint32_t sample) const -> Vec3 { return m_radiance[sample]; }
+    /// @brief first hit features of `sample`, see `Framebuffer::albedo()`. Misses have a white
+    /// albedo, zero normal and zero depth.
+    auto albedo(uint32_t sample) const -> Vec3 { return m_albedo[sample]; }
+    auto normal(uint32_t sample) const -> Vec3 { return m_normal[sample]; }
+    auto depth(uint32_t sample) const -> float { return m_depth[sample]; }
+};
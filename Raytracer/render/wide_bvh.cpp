@@ -0,0 +1,96 @@
+#include "wide_bvh.h"
+
+#include "utils/profiler.h"
+
+namespace {
+
+template <int N> void set_slot(WideBvhNode<N> &node, int slot, BvhNode const &child) {
+    for (int axis = 0; axis < 3; ++axis) {
+        node.bounds[2 * axis][slot]     = child.bounds.lo[axis];
+        node.bounds[2 * axis + 1][slot] = child.bounds.hi[axis];
+    }
+    node.child[slot] = child.offset;
+    node.count[slot] = child.count;
+}
+
+template <int N> auto empty_node() -> WideBvhNode<N> {
+    WideBvhNode<N> node{};
+    for (int slot = 0; slot < N; ++slot) {
+        for (int axis = 0; axis < 3; ++axis) {
+            node.bounds[2 * axis][slot]     = INF;
+            node.bounds[2 * axis + 1][slot] = -INF;
+        }
+    }
+    return node;
+}
+
+} // namespace
+
+template <int N> auto WideBvh::collapse(Bvh const &bvh, uint32_t binary_index) -> uint32_t {
+    auto &nodes = [this]() -> auto & {
+        if constexpr (N == 4)
+            return m_nodes4;
+        else
+            return m_nodes8;
+    }();
+    auto const &binary = bvh.nodes();
+    auto const index   = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(empty_node<N>());
+
+    // open up the interior child with the largest surface area until all slots are used
+    uint32_t children[N] = {binary[binary_index].offset, binary[binary_index].offset + 1};
+    int child_count      = 2;
+    while (child_count < N) {
+        int best        = -1;
+        float best_area = -1.0f;
+        for (int i = 0; i < child_count; ++i) {
+            BvhNode const &c = binary[children[i]];
+            if (!c.is_leaf() && c.bounds.area() > best_area) {
+                best      = i;
+                best_area = c.bounds.area();
+            }
+        }
+        if (best < 0)
+            break;
+        uint32_t const opened   = binary[children[best]].offset;
+        children[best]          = opened;
+        children[child_count++] = opened + 1;
+    }
+
+    for (int slot = 0; slot < child_count; ++slot) {
+        BvhNode const &c = binary[children[slot]];
+        // `nodes` may grow in the recursion, so don't keep a reference to this node around
+        uint32_t const target = c.is_leaf() ? c.offset : collapse<N>(bvh, children[slot]);
+        set_slot(nodes[index], slot, c);
+        nodes[index].child[slot] = target;
+    }
+    return index;
+}
+
+void WideBvh::build(Bvh const &bvh, int width) {
+    PROFILE_SCOPE("wide bvh");
+    m_nodes4.clear();
+    m_nodes8.clear();
+    m_width = 0;
+    if (bvh.empty())
+        return;
+
+    m_width = width == 8 ? 8 : 4;
+    BvhNode const &root = bvh.nodes()[0];
+    if (root.is_leaf()) {
+        // a single leaf, wrap it in a node of its own
+        if (m_width == 8) {
+            m_nodes8.push_back(empty_node<8>());
+            set_slot(m_nodes8[0], 0, root);
+        } else {
+            m_nodes4.push_back(empty_node<4>());
+            set_slot(m_nodes4[0], 0, root);
+        }
+        return;
+    }
+
+    if (m_width == 8)
+        collapse<8>(bvh, 0);
+    else
+        collapse<4>(bvh, 0);
+}
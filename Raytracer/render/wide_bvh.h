@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "render/bvh.h"
+
+/// A node with up to `N` children whose boxes are stored as structure of arrays, so a SIMD
+/// kernel tests a ray against all of them with one load per plane.
+template <int N> struct alignas(64) WideBvhNode {
+    /// per child planes: lo.x, hi.x, lo.y, hi.y, lo.z, hi.z. Unused slots hold an empty box.
+    float bounds[6][N];
+    /// interior children: node index, leaves: first primitive in `Bvh::prim_indices()`
+    uint32_t child[N];
+    /// number of primitives of leaf children, `0` for interior children and unused slots
+    uint32_t count[N];
+};
+
+/// 4- or 8-wide BVH, collapsed from a binary `Bvh` and sharing its primitive indices
+class WideBvh {
+    int m_width = 0;
+    std::vector<WideBvhNode<4>> m_nodes4;
+    std::vector<WideBvhNode<8>> m_nodes8;
+
+    template <int N> auto collapse(Bvh const &bvh, uint32_t binary_index) -> uint32_t;
+
+  public:
+    /// @param width 4 or 8, the number of children per node
+    void build(Bvh const &bvh, int width);
+
+    auto width() const -> int { return m_width; }
+    auto empty() const -> bool { return m_width == 0; }
+    auto nodes4() const -> std::vector<WideBvhNode<4>> const & { return m_nodes4; }
+    auto nodes8() const -> std::vector<WideBvhNode<8>> const & { return m_nodes8; }
+    auto node_count() const -> size_t { return m_width == 8 ? m_nodes8.size() : m_nodes4.size(); }
+};
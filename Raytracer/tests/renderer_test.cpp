@@ -0,0 +1,168 @@
+// renderer_test : a job rendered through the `Renderer` queue has to give the same image as a
+// `TileRenderer` rendering the same scene directly, invalid jobs have to come back without an
+// image, and a scene added while jobs render has to wait for them before it registers its
+// textures, with the jobs submitted meanwhile still rendering.
+
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "render/framebuffer.h"
+#include "render/procedural.h"
+#include "render/renderer.h"
+#include "render/tile_renderer.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// small enough to keep the test quick, big enough to span several tiles
+auto small_job() -> RenderJob {
+    RenderJob job;
+    job.width       = 80;
+    job.height      = 60;
+    job.spp         = 4;
+    job.frame_index = 3;
+    job.albedo      = true;
+    return job;
+}
+
+auto is_ready(std::future<RenderResult> const &future) -> bool {
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+/// @return the number of failures
+auto check_same_image(Renderer &renderer, std::shared_ptr<Scene const> const &scene) -> int {
+    RenderJob const job       = small_job();
+    RenderResult const result = renderer.submit(scene, job).get();
+    if (!result.ok || result.width != job.width || result.height != job.height ||
+        result.albedo.size() != result.color.size() || !result.normal.empty()) {
+        spdlog::error("job of {}x{} pixels came back as {} with {}x{} pixels", job.width,
+                      job.height, result.ok ? "ok" : "failed", result.width, result.height);
+        return 1;
+    }
+
+    ThreadPool pool(renderer.thread_count());
+    TileRenderer tiles(pool);
+    Framebuffer image;
+    image.resize(job.width, job.height);
+    tiles.resize(job.width, job.height);
+    tiles.settings = job.integrator;
+    tiles.render(*scene, job.camera, image, job.frame_index, job.spp);
+
+    int differing = 0;
+    for (int y = 0; y < job.height; ++y) {
+        for (int x = 0; x < job.width; ++x) {
+            Vec3 const a = result.color[static_cast<size_t>(y) * job.width + x];
+            Vec3 const b = image.color(x, y);
+            differing += a.x != b.x || a.y != b.y || a.z != b.z;
+        }
+    }
+    spdlog::info("job vs tile renderer: {} of {} pixels differ", differing,
+                 job.width * job.height);
+    return differing == 0 ? 0 : 1;
+}
+
+/// @return the number of failures
+auto check_invalid_jobs(Renderer &renderer, std::shared_ptr<Scene const> const &scene) -> int {
+    int failures = 0;
+    auto expect_rejected = [&](std::shared_ptr<Scene const> const &job_scene, RenderJob const &job,
+                               char const *what) {
+        RenderResult const result = renderer.submit(job_scene, job).get();
+        if (result.ok || !result.color.empty()) {
+            spdlog::error("job {} was rendered", what);
+            ++failures;
+        }
+    };
+
+    RenderJob job = small_job();
+    expect_rejected(nullptr, job, "without a scene");
+    job.width = 0;
+    expect_rejected(scene, job, "without columns");
+    job        = small_job();
+    job.height = -1;
+    expect_rejected(scene, job, "with negative rows");
+    job     = small_job();
+    job.spp = 0;
+    expect_rejected(scene, job, "without samples");
+    return failures;
+}
+
+/// when the render of `result` finished, on the clock of the test
+auto finished_at(Clock::time_point submitted, RenderResult const &result) -> Clock::time_point {
+    std::chrono::duration<double, std::milli> const ms(result.queued_ms + result.render_ms);
+    return submitted + std::chrono::duration_cast<Clock::duration>(ms);
+}
+
+/// @return the number of failures
+auto check_add_scene_waits(Renderer &renderer, std::shared_ptr<Scene const> const &scene) -> int {
+    // two jobs long enough to still render when the scene is added
+    RenderJob long_job = small_job();
+    long_job.width     = 160;
+    long_job.height    = 120;
+    long_job.spp       = 8;
+
+    auto const long_submitted = Clock::now();
+    std::future<RenderResult> running[] = {renderer.submit(scene, long_job),
+                                           renderer.submit(scene, long_job)};
+    while (renderer.queued() > 0)
+        std::this_thread::yield();
+
+    // the futures are only set after the jobs are done
+    bool const conclusive = !is_ready(running[0]) && !is_ready(running[1]);
+    auto added            = std::async(std::launch::async, [&renderer]() {
+        return renderer.add_scene(*make_procedural_scene("cornell"));
+    });
+    // when the scene registers its textures is up to the pool, which the running jobs keep busy,
+    // so this job may start before or after that, but has to render either way
+    std::future<RenderResult> meanwhile          = renderer.submit(scene, small_job());
+    std::shared_ptr<Scene const> const new_scene = added.get();
+    auto const scene_added                       = Clock::now();
+
+    RenderResult const first  = running[0].get();
+    RenderResult const second = running[1].get();
+    RenderResult const third  = meanwhile.get();
+    if (!new_scene || !first.ok || !second.ok || !third.ok) {
+        spdlog::error("adding a scene while jobs render failed a job or the scene");
+        return 1;
+    }
+    if (!renderer.submit(new_scene, small_job()).get().ok) {
+        spdlog::error("the scene added while jobs rendered can't be rendered");
+        return 1;
+    }
+    if (!conclusive) {
+        spdlog::warn("the jobs finished before the scene was added, its waiting isn't checked");
+        return 0;
+    }
+
+    int failures = 0;
+    for (RenderResult const *result : {&first, &second}) {
+        if (finished_at(long_submitted, *result) > scene_added) {
+            spdlog::error("the scene was added while jobs still rendered");
+            ++failures;
+        }
+    }
+    spdlog::info("adding a scene waited for the running jobs: {}", failures == 0);
+    return failures;
+}
+
+} // namespace
+
+int main() {
+    RendererSettings settings;
+    settings.concurrent_jobs = 3;
+    Renderer renderer(settings);
+    auto const scene = renderer.load_scene("cornell");
+    if (!scene)
+        return 1;
+
+    int failures = 0;
+    failures += check_same_image(renderer, scene);
+    failures += check_invalid_jobs(renderer, scene);
+    failures += check_add_scene_waits(renderer, scene);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+// traversal_test : every traversal kernel the host supports, single rays and packets, over the
+// BVH and over compact geometry, has to find the same closest hits as the scalar kernel, and may
+// not be much slower. The rays include axis-aligned directions and directions with zero
+// components, whose infinite inverses the SIMD slab tests have to handle without giving up culling
+// on that axis.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "render/procedural.h"
+#include "render/rng.h"
+#include "render/scene.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+/// SIMD kernels may not take this many times longer than the scalar one for the same rays. A slab
+/// test that turns a zero direction component into NaN stops culling on that axis and walks most
+/// of the tree, which is thousands of times slower.
+constexpr double MAX_SLOWDOWN = 10.0;
+
+auto make_rays() -> std::vector<Ray> {
+    std::vector<Ray> rays;
+    Vec3 const origins[] = {{0.1f, 0.7f, 0.3f}, {0.0f, 1.0f, 0.0f}, {-0.5f, 0.25f, -0.5f}};
+    for (Vec3 const origin : origins) {
+        // every direction with components in {-1, 0, 1}, slightly skewed so the diagonals don't
+        // run along the edges of tessellated spheres, where the FMA triangle test of packets
+        // and the scalar one may round to different sides
+        for (int x = -1; x <= 1; ++x) {
+            for (int y = -1; y <= 1; ++y) {
+                for (int z = -1; z <= 1; ++z) {
+                    if (x != 0 || y != 0 || z != 0) {
+                        Vec3 const d{static_cast<float>(x), 1.03f * static_cast<float>(y),
+                                     1.07f * static_cast<float>(z)};
+                        rays.push_back({origin, normalize(d)});
+                    }
+                }
+            }
+        }
+        // random directions with one component zeroed
+        Pcg32 rng(17);
+        for (int i = 0; i < 600; ++i) {
+            Vec3 d{rng.next_float() * 2.0f - 1.0f, rng.next_float() * 2.0f - 1.0f,
+                   rng.next_float() * 2.0f - 1.0f};
+            d[i % 3] = 0.0f;
+            rays.push_back({origin, normalize(d)});
+        }
+    }
+    return rays;
+}
+
+/// hits agree when they are at the same distance
+auto same_hit(Hit const &a, Hit const &b) -> bool {
+    if (a.is_valid() != b.is_valid())
+        return false;
+    // coplanar triangles (quad diagonals, touching boxes) tie at the same distance, and which of
+    // them wins depends on the visiting order
+    return !a.is_valid() || std::fabs(a.t - b.t) <= 1.0e-4f * a.t;
+}
+
+/// @return the number of rays whose hits differ from `expected`
+auto check(Scene const &scene, std::vector<Ray> const &rays, std::vector<Hit> const &expected,
+           char const *what) -> int {
+    int mismatches = 0;
+    for (size_t first = 0; first < rays.size(); first += 8) {
+        RayPacket8 packet{};
+        int const lanes = static_cast<int>(std::min<size_t>(8, rays.size() - first));
+        for (int lane = 0; lane < lanes; ++lane)
+            packet.set(lane, rays[first + lane]);
+        scene.intersect(packet);
+
+        for (int lane = 0; lane < lanes; ++lane) {
+            Ray const &ray = rays[first + lane];
+            Hit single;
+            single.t = ray.t_max;
+            scene.intersect(ray, single);
+            Hit const hits[2] = {single, packet.hit(lane)};
+            for (int kind = 0; kind < 2; ++kind) {
+                Hit const &hit = hits[kind];
+                if (same_hit(hit, expected[first + lane]))
+                    continue;
+                ++mismatches;
+                spdlog::error("{} {}: ray ({}, {}, {}) -> ({}, {}, {}) hits {} at {}, expected {} "
+                              "at {}",
+                              what, kind == 0 ? "single" : "packet", ray.origin.x, ray.origin.y,
+                              ray.origin.z, ray.direction.x, ray.direction.y, ray.direction.z,
+                              hit.prim, hit.t, expected[first + lane].prim,
+                              expected[first + lane].t);
+            }
+        }
+    }
+    return mismatches;
+}
+
+/// milliseconds `scene` takes to trace `rays` one at a time
+auto trace_ms(Scene const &scene, std::vector<Ray> const &rays) -> double {
+    auto const start = std::chrono::steady_clock::now();
+    for (Ray const &ray : rays) {
+        Hit hit;
+        hit.t = ray.t_max;
+        scene.intersect(ray, hit);
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+/// @brief checks the hits and the time of every level from `first` on that the host supports
+/// @param scalar_ms time of the scalar kernel for `rays`
+/// @return the number of failures
+auto check_levels(Scene &scene, std::vector<Ray> const &rays, std::vector<Hit> const &expected,
+                  double scalar_ms, SimdLevel first, std::string_view name) -> int {
+    int failures = 0;
+    for (auto level : {SimdLevel::Scalar, SimdLevel::Sse41, SimdLevel::Avx2, SimdLevel::Avx512}) {
+        if (level > best_simd_level())
+            break;
+        if (level < first)
+            continue;
+        scene.set_simd_level(level);
+        auto const what = fmt::format("{} {}", name, simd_level_name(level));
+        int const count = check(scene, rays, expected, what.c_str());
+        spdlog::info("{}: {} of {} rays differ", what, count, rays.size());
+        failures += count;
+
+        // the floor keeps timer noise on tiny scenes from failing the check
+        double const ms    = trace_ms(scene, rays);
+        double const limit = MAX_SLOWDOWN * std::max(scalar_ms, 1.0);
+        spdlog::info("{}: {:.2f} ms, scalar {:.2f} ms", what, ms, scalar_ms);
+        if (ms > limit) {
+            spdlog::error("{} took {:.2f} ms, more than {:.2f} ms", what, ms, limit);
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+} // namespace
+
+int main() {
+    ThreadPool pool(0);
+    std::vector<Ray> const rays = make_rays();
+    int failures                = 0;
+
+    for (std::string_view const name : {"cornell", "spheres"}) {
+        auto scene = make_procedural_scene(name);
+        scene->build_acceleration(pool);
+
+        scene->set_simd_level(SimdLevel::Scalar);
+        std::vector<Hit> expected(rays.size());
+        for (size_t i = 0; i < rays.size(); ++i) {
+            expected[i].t = rays[i].t_max;
+            scene->intersect(rays[i], expected[i]);
+        }
+        double const scalar_ms = trace_ms(*scene, rays);
+        failures += check_levels(*scene, rays, expected, scalar_ms, SimdLevel::Sse41, name);
+
+        // compact geometry has kernels of its own, down to scalar. Unquantized positions keep the
+        // hit distances exact, only the triangle order changes.
+        CompactSettings settings;
+        settings.quantize_positions = false;
+        if (!scene->make_compact(pool, settings))
+            return 1;
+        failures += check_levels(*scene, rays, expected, scalar_ms, SimdLevel::Scalar,
+                                 fmt::format("{} compact", name));
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -1,86 +1,206 @@
 #include "application.h"
 #include <spdlog/spdlog.h>
 
-Application::Application(int width, int height)
-    : m_window_width(width), m_window_height(height), left_margin(static_cast<int>(0.25f * width)),
-      m_fps_counter(1000) {
-
-    // init GLFW
-    if (!glfwInit()) {
-        cerr << "Coudln't initialise GLFW" << endl;
-        return;
-    }
-    m_glfw_valid = true;
-
-    m_window = glfwCreateWindow(m_window_width, m_window_height, "Title", NULL, NULL);
-
-    if (!m_window) {
-        cerr << "Couldn't create window" << endl;
-        return;
-    }
+#include "ui/batch_application.h"
 
-    glfwMakeContextCurrent(m_window);
-    glfwSwapInterval(0);
+namespace {
 
-    // init GLEW
-    if (glewInit() != GL_NO_ERROR) {
-        spdlog::error("Couldn't initialise GLEW");
-        return;
-    }
+/// texture tiles loaded during startup, the coarse mip levels of every texture come first
+constexpr size_t TEXTURE_PREFETCH_BYTES = size_t{64} << 20;
 
-    // setup ImGui
-    ImGui::CreateContext();
-    ImGui_ImplGlfw_InitForOpenGL(m_window, true);
-    ImGui_ImplOpenGL3_Init();
+} // namespace
 
-    auto &io = ImGui::GetIO();
-    /*
-    io.Fonts->AddFontFromFileTTF(
-        "C:\\Users\\andiw\\AppData\\Local\\Microsoft\\Windows\\Fonts\\FiraCode-SemiBold.ttf", 30.0f);
-        */
-
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui_ImplGlfw_NewFrame();
-    ImGui::NewFrame();
-    ImGui::Render();
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-    // init OpenGL
-    spdlog::info("setup OpenGL");
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glViewport(0, 0, m_window_width, m_window_height);
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
+Application::Application(int width, int height, std::string scene)
+    : m_window_width(width), m_window_height(height), left_margin(static_cast<int>(0.25f * width)),
+      m_fps_counter(1000), m_scene_name(std::move(scene)) {
 
-    m_cu_application = CUApplication::make_application();
+    Profiler::instance().set_thread_name("main");
+    add_startup_tasks();
+    m_startup.start(m_startup_pool);
 
-    if (!m_cu_application) {
-        render_gpu = false;
-        spdlog::warn("GPU rendering disabled");
-    }
+    // the scene loads in the background while the window comes up, the remaining tasks finish
+    // while frames are drawn, see `begin_frame()`
+    if (!m_startup.run_until(m_imgui_task))
+        return;
 
     // now we can safely set this to valid
     m_is_valid = true;
+    // the UI sleeps in glfwWaitEvents(), a finished task has to wake it up
+    m_startup.set_notify([]() { glfwPostEmptyEvent(); });
 
     // create sink only now, because any logging after its creation will only be visible in the
     // window. And if window creation failed, we won't be able to see the error message.
     m_sink = dear_sink_mt();
+
+    // the ImGui sink takes a lock per message, so threads only queue their messages and the UI
+    // thread hands them over once per frame
+    m_log_queue      = std::make_shared<AsyncLogSink>(m_sink);
+    m_startup_logger = spdlog::default_logger();
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("raytracer", m_log_queue));
     spdlog::info("Application successfully started");
+    spdlog::info("window ready after {:.1f} ms", m_startup.end_ms(m_imgui_task));
     spdlog::warn("warning");
 
     for (int i = 0; i < 100; ++i)
         spdlog::info("info entry {}", i);
 }
 
+void Application::add_startup_tasks() {
+    // ---- Main thread ----------------------------------------------------------------------------
+    // GLFW, OpenGL and ImGui belong to the thread that created the context
+
+    auto const window = m_startup.add(
+        "window",
+        [this]() {
+            if (!glfwInit()) {
+                cerr << "Coudln't initialise GLFW" << endl;
+                return false;
+            }
+            m_glfw_valid = true;
+
+            m_window = glfwCreateWindow(m_window_width, m_window_height, "Title", NULL, NULL);
+
+            if (!m_window) {
+                cerr << "Couldn't create window" << endl;
+                return false;
+            }
+
+            glfwMakeContextCurrent(m_window);
+            glfwSwapInterval(0);
+            return true;
+        },
+        {}, true);
+
+    auto const gl = m_startup.add(
+        "OpenGL",
+        [this]() {
+            if (glewInit() != GL_NO_ERROR) {
+                spdlog::error("Couldn't initialise GLEW");
+                return false;
+            }
+
+            spdlog::info("setup OpenGL");
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glViewport(0, 0, m_window_width, m_window_height);
+
+            glMatrixMode(GL_PROJECTION);
+            glLoadIdentity();
+
+            glMatrixMode(GL_MODELVIEW);
+            glLoadIdentity();
+
+            glDisable(GL_CULL_FACE);
+            glDisable(GL_DEPTH_TEST);
+            return true;
+        },
+        {window}, true);
+
+    m_imgui_task = m_startup.add(
+        "ImGui",
+        [this]() {
+            ImGui::CreateContext();
+            ImGui_ImplGlfw_InitForOpenGL(m_window, true);
+            ImGui_ImplOpenGL3_Init();
+
+            auto &io = ImGui::GetIO();
+            /*
+            io.Fonts->AddFontFromFileTTF(
+                "C:\\Users\\andiw\\AppData\\Local\\Microsoft\\Windows\\Fonts\\FiraCode-SemiBold.ttf", 30.0f);
+                */
+            return true;
+        },
+        {gl}, true);
+
+    // ---- Background -----------------------------------------------------------------------------
+
+    auto const scene = m_startup.add("scene", [this]() {
+        m_startup_scene = make_batch_scene(m_scene_name);
+        return m_startup_scene.has_value();
+    });
+
+    auto const cuda = m_startup.add("CUDA", [this]() {
+        m_cu_application = CUApplication::make_application();
+        return true;
+    });
+
+    auto const renderer = m_startup.add(
+        "CPU renderer",
+        [this]() {
+            if (m_cu_application)
+                return true;
+            render_gpu = false;
+            spdlog::warn("GPU rendering disabled, falling back to CPU rendering");
+            m_cpu_application = CPUApplication::make_application();
+            return true;
+        },
+        {cuda});
+
+    // the two touch different parts of the scene, the BVH and the texture ids, so they overlap
+    auto const bvh = m_startup.add(
+        "BVH",
+        [this]() {
+            if (m_cpu_application) {
+                m_startup_scene->build_acceleration(m_cpu_application->pool(),
+                                                    batch_bvh_cache(m_scene_name));
+            }
+            return true;
+        },
+        {scene, renderer});
+
+    auto const textures = m_startup.add(
+        "textures",
+        [this]() {
+            if (!m_cpu_application)
+                return true;
+            auto &cache = m_cpu_application->textures();
+            m_startup_scene->bind_textures(cache);
+            size_t const tiles = cache.prefetch(m_cpu_application->pool(), TEXTURE_PREFETCH_BYTES);
+            if (tiles > 0)
+                spdlog::info("prefetched {} texture tiles", tiles);
+            return true;
+        },
+        {scene, renderer});
+
+    // ---- Main thread again ----------------------------------------------------------------------
+
+    auto const display = m_startup.add(
+        "display",
+        [this]() {
+            if (!m_cpu_application)
+                return true;
+            m_cpu_application->resize(viewport_width(), viewport_height());
+            m_display.resize(viewport_width(), viewport_height());
+            return true;
+        },
+        {gl, renderer}, true);
+
+    m_render_loop_task = m_startup.add(
+        "render loop",
+        [this]() {
+            if (!m_cpu_application)
+                return true;
+            m_cpu_application->adopt_scene(std::move(*m_startup_scene));
+            m_startup_scene.reset();
+
+            std::array<uint32_t *, 3> slots;
+            for (int i = 0; i < 3; ++i)
+                slots[i] = m_display.slot_pixels(i);
+            // the UI sleeps in glfwWaitEvents(), a new frame has to wake it up
+            m_render_loop = std::make_unique<RenderLoop>(*m_cpu_application, slots,
+                                                         []() { glfwPostEmptyEvent(); });
+            return true;
+        },
+        {display, bvh, textures}, true);
+}
+
 Application::~Application() {
+    // the startup threads work on the members below
+    m_startup.cancel();
     if (m_is_valid) {
+        // the render thread writes into the mapped pixel buffers, it has to stop before they go.
+        // The display owns GL objects, they have to go while the context is still there.
+        m_render_loop.reset();
+        m_display.resize(0, 0);
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
     }
@@ -89,12 +209,55 @@ Application::~Application() {
 }
 
 void Application::begin_frame() {
-    glfwPollEvents();
+    // everything since the last call is one frame of the profiler
+    Profiler::instance().end_frame();
+
+    bool const starting = !m_startup.finished();
+    {
+        // sleeps until there is input or the render thread finished a frame, during startup the
+        // progress is redrawn now and then
+        PROFILE_SCOPE("events");
+        if (starting)
+            glfwWaitEventsTimeout(0.1);
+        else
+            glfwWaitEvents();
+    }
+    if (starting) {
+        PROFILE_SCOPE("startup");
+        m_startup.run_main_tasks();
+        if (m_startup.finished()) {
+            m_startup.log_report();
+            if (m_startup.succeeded(m_render_loop_task))
+                spdlog::info("interactive after {:.1f} ms", m_startup.end_ms(m_render_loop_task));
+        }
+    }
+    {
+        PROFILE_SCOPE("log");
+        m_log_queue->drain();
+    }
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     m_fps_counter.tick(&m_fps);
 
+    if (m_render_loop) {
+        if (m_render_loop->has_frame()) {
+            PROFILE_SCOPE("upload");
+            // the current front slot goes back to the renderer, so the GPU has to be done with it
+            m_display.wait(m_render_loop->front_index());
+            m_render_loop->update();
+            auto const &frame = m_render_loop->front();
+            m_display.upload(m_render_loop->front_index(), frame.pixels, frame.width,
+                             frame.height);
+            m_frame_stats = frame.stats;
+        }
+
+        // the image goes into the top left corner of the viewport
+        m_display.draw(static_cast<int>(left_margin), m_window_height, viewport_width(),
+                       viewport_height());
+    }
+
+    PROFILE_SCOPE("ui");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -108,16 +271,150 @@ void Application::begin_frame() {
     if (ImGui::CollapsingHeader("Window")) {
         ImGui::Text("Size: %dx%d", m_window_width, m_window_height);
         ImGui::Text("FPS: %.3f", m_fps);
+        ImGui::Text("Log messages lost: %llu queue full, %llu rate limited",
+                    static_cast<unsigned long long>(m_log_queue->dropped()),
+                    static_cast<unsigned long long>(m_log_queue->rate_limited()));
     }
     if (ImGui::CollapsingHeader("Render")) {
+        // the backend is picked by a startup task
+        if (starting)
+            ImGui::Text("Backend: starting up");
+        else
+            ImGui::Text("Backend: %s", render_gpu ? "OptiX" : "CPU");
+        if (m_render_loop) {
+            ImGui::Text("Threads: %u", m_cpu_application->thread_count());
+            ImGui::Text("Render time: %.2f ms", m_frame_stats.render_ms);
+            // the render thread starts over whenever the settings change
+            auto &settings = m_render_settings;
+            ImGui::Checkbox("Progressive", &settings.progressive);
+            if (settings.progressive) {
+                ImGui::Text("Passes: %u", m_frame_stats.passes);
+                ImGui::Text("Converged tiles: %zu / %zu", m_frame_stats.converged_tiles,
+                            m_frame_stats.tile_count);
+                ImGui::Checkbox("Adaptive sampling", &settings.adaptive.enabled);
+                ImGui::SliderFloat("Error threshold", &settings.adaptive.threshold, 0.001f, 0.2f,
+                                   "%.3f", ImGuiSliderFlags_Logarithmic);
+                if (ImGui::Button("Restart"))
+                    ++settings.restart;
+            }
+
+            // lower resolution and more samples per pixel while the camera moves
+            ImGui::Checkbox("Frame budget", &settings.budget.enabled);
+            if (settings.budget.enabled) {
+                ImGui::SliderFloat("Target frame time", &settings.budget.target_ms, 4.0f, 200.0f,
+                                   "%.1f ms", ImGuiSliderFlags_Logarithmic);
+                ImGui::SliderFloat("Min. resolution", &settings.budget.min_scale, 0.0625f, 1.0f,
+                                   "%.2f");
+                ImGui::SliderInt("Max. spp", &settings.budget.max_spp, 1, 64);
+            }
+
+            // stage by stage with sorted ray queues instead of path by path
+            ImGui::Checkbox("Wavefront", &settings.integrator.wavefront);
+            // every sampler converges to the same image, the estimate goes on with the new one
+            static char const *const samplers[] = {"Independent", "Sobol", "Blue noise"};
+            int sampler = static_cast<int>(settings.integrator.sampler);
+            if (ImGui::Combo("Sampler", &sampler, samplers, IM_ARRAYSIZE(samplers)))
+                settings.integrator.sampler = static_cast<SamplerType>(sampler);
+
+            ImGui::Checkbox("Denoise", &settings.denoise.enabled);
+            if (settings.denoise.enabled) {
+                ImGui::SliderInt("Passes", &settings.denoise.iterations, 1, MAX_DENOISER_ITERATIONS);
+                ImGui::SliderFloat("Color sigma", &settings.denoise.sigma_color, 0.01f, 10.0f,
+                                   "%.2f", ImGuiSliderFlags_Logarithmic);
+                ImGui::SliderFloat("Depth sigma", &settings.denoise.sigma_depth, 0.001f, 1.0f,
+                                   "%.3f", ImGuiSliderFlags_Logarithmic);
+            }
+            auto const &frame = m_render_loop->front();
+            ImGui::Text("Resolution: %dx%d, %d spp%s", frame.width, frame.height,
+                        m_frame_stats.spp, m_frame_stats.interactive ? " (moving)" : "");
+        }
         if (ImGui::CollapsingHeader("Camera")) {
             ImGui::SliderFloat("FOV", &m_cam_fov, 0.0f, 180.0f);
         }
     }
+    if (m_render_loop && ImGui::CollapsingHeader("Textures")) {
+        auto &textures         = m_cpu_application->textures();
+        auto const stats       = textures.stats();
+        uint64_t const lookups = stats.hits + stats.misses;
+        ImGui::Text("Textures: %zu", textures.texture_count());
+        ImGui::Text("Tiles: %zu, %.1f / %.1f MB", stats.resident_tiles,
+                    static_cast<double>(stats.resident_bytes) / (1 << 20),
+                    static_cast<double>(stats.capacity_bytes) / (1 << 20));
+        ImGui::Text("Hits: %llu (%.1f%%)", static_cast<unsigned long long>(stats.hits),
+                    lookups ? 100.0 * static_cast<double>(stats.hits) / lookups : 0.0);
+        ImGui::Text("Misses: %llu, evictions: %llu, failures: %llu",
+                    static_cast<unsigned long long>(stats.misses),
+                    static_cast<unsigned long long>(stats.evictions),
+                    static_cast<unsigned long long>(stats.failures));
+        int capacity_mb = static_cast<int>(stats.capacity_bytes >> 20);
+        if (ImGui::SliderInt("Cache size (MB)", &capacity_mb, 16, 16384, "%d",
+                             ImGuiSliderFlags_Logarithmic))
+            textures.set_capacity(static_cast<size_t>(capacity_mb) << 20);
+    }
+    if (m_render_loop && ImGui::CollapsingHeader("Arenas")) {
+        // one per render thread, the last one is the render loop's own
+        auto const arenas = m_cpu_application->arena_stats();
+        for (size_t i = 0; i < arenas.size(); ++i) {
+            ImGui::Text("%zu: %.1f / %.1f MB high water, %llu blocks", i,
+                        static_cast<double>(arenas[i].high_water) / (1 << 20),
+                        static_cast<double>(arenas[i].capacity) / (1 << 20),
+                        static_cast<unsigned long long>(arenas[i].block_allocations));
+        }
+    }
+    if (ImGui::CollapsingHeader("Profiler"))
+        draw_profiler();
+    ImGui::End();
+
+    if (starting)
+        draw_startup_progress();
+
+    if (m_render_loop) {
+        m_render_settings.camera.fov = m_cam_fov;
+        m_render_loop->set_settings(m_render_settings);
+    }
+}
+
+void Application::draw_profiler() {
+    auto &profiler = Profiler::instance();
+
+    bool enabled = profiler.enabled();
+    if (ImGui::Checkbox("Enabled", &enabled))
+        profiler.set_enabled(enabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Export trace"))
+        profiler.export_chrome_trace("trace.json");
+
+    auto const &frame = profiler.last_frame();
+    ImGui::Text("Frame: %.2f ms", frame.duration_ms());
+    if (profiler.dropped_events() > 0)
+        ImGui::Text("Dropped zones: %llu",
+                    static_cast<unsigned long long>(profiler.dropped_events()));
+
+    // worker zones are summed over all threads, so they can add up to more than the frame
+    for (auto const &zone : frame.summary()) {
+        ImGui::Text("%*s%s: %.2f ms (%u)", static_cast<int>(2 * zone.depth), "", zone.name,
+                    zone.total_ms, zone.calls);
+    }
+}
+
+void Application::draw_startup_progress() {
+    // over the middle of the viewport, where the image is going to be
+    ImGui::SetNextWindowPos(
+        {left_margin + 0.5f * viewport_width(), 0.5f * static_cast<float>(viewport_height())},
+        ImGuiCond_Always, {0.5f, 0.5f});
+    ImGui::SetNextWindowSize({320.0f, 0.0f});
+    ImGui::Begin("Loading", nullptr,
+                 ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse |
+                     ImGuiWindowFlags_NoSavedSettings);
+    ImGui::Text("Loading %s", m_scene_name.c_str());
+    ImGui::ProgressBar(m_startup.progress());
+    for (char const *name : m_startup.running())
+        ImGui::BulletText("%s", name);
     ImGui::End();
 }
 
 void Application::end_frame() const {
+    PROFILE_SCOPE("present");
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
     glfwSwapBuffers(m_window);
@@ -9,6 +9,8 @@
 #include <optix.h>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <string>
 
 #include <dear_sink.h>
 #include <imgui.h>
@@ -19,8 +21,15 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "utils/async_log_sink.h"
+#include "utils/profiler.h"
+#include "utils/task_graph.h"
+#include "utils/thread_pool.h"
 #include "utils/timer.h"
+#include "ui/cpu_application.h"
 #include "ui/cu_application.h"
+#include "ui/pbo_display.h"
+#include "ui/render_loop.h"
 
 using std::cout, std::cerr, std::endl;
 using std::chrono::steady_clock;
@@ -41,14 +50,41 @@ class Application {
 
     // debug
     dear_sink_mt_t m_sink;
+    /// what spdlog logs into, forwards to `m_sink` once per frame
+    std::shared_ptr<AsyncLogSink> m_log_queue;
+    /// the default logger before `m_log_queue` took over, startup threads may still be logging
+    /// into it
+    std::shared_ptr<spdlog::logger> m_startup_logger;
     FpsCounter m_fps_counter;
     float m_fps;
 
     std::unique_ptr<CUApplication> m_cu_application;
+    std::unique_ptr<CPUApplication> m_cpu_application;
+    PboDisplay m_display;
+    /// renders on its own thread into the slots of `m_display`
+    std::unique_ptr<RenderLoop> m_render_loop;
+    RenderSettings m_render_settings;
+    /// of the frame on screen
+    FrameStats m_frame_stats;
 
     // debugging, this should be moved into subclasses
     float m_cam_fov = 90.0f;
 
+    // startup, the scene is loaded and prepared while the window comes up
+    std::string m_scene_name;
+    /// loaded and prepared by the startup tasks, then handed to the renderer
+    std::optional<Scene> m_startup_scene;
+    ThreadPool m_startup_pool{2, "startup"};
+    TaskGraph m_startup;
+    TaskGraph::TaskId m_imgui_task       = 0;
+    TaskGraph::TaskId m_render_loop_task = 0;
+
+    /// builds the startup graph: window, OpenGL and ImGui on the main thread, scene loading,
+    /// the renderer, the acceleration structure and the textures in the background
+    void add_startup_tasks();
+    /// progress of the startup, over the viewport until the first frame shows up
+    void draw_startup_progress();
+
   public:
     // ---- Init and Destruction -------------------------------------------------------------------
 
@@ -56,7 +92,8 @@ class Application {
     /// The **main** <b>application</b>, _hosts_ *the* GLFW window, OpenGL and CUDA contexts and the renderer
     /// @param width the width
     /// @param height the window height
-    Application(int width, int height);
+    /// @param scene generated scene or scene file to show, see `make_batch_scene()`
+    Application(int width, int height, std::string scene = "cornell");
     ~Application();
 
     // ---- Frames ---------------------------------------------------------------------------------
@@ -76,8 +113,17 @@ class Application {
     /// <returns></returns>
     void end_frame() const;
 
+    /// per-frame zone breakdown of the profiler, part of the properties panel
+    void draw_profiler();
+
     void get_system_information();
 
+    /// size of the area right of the properties panel and above the log, where the render goes
+    auto viewport_width() const -> int { return m_window_width - static_cast<int>(left_margin); }
+    auto viewport_height() const -> int {
+        return m_window_height - static_cast<int>(bottom_margin);
+    }
+
     auto should_close() const -> bool { return glfwWindowShouldClose(m_window); }
 
     auto is_valid() const -> bool { return m_is_valid; }
@@ -0,0 +1,337 @@
+#include "batch_application.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+
+#include <spdlog/spdlog.h>
+
+#include "render/procedural.h"
+#include "render/scene_io.h"
+#include "ui/cpu_application.h"
+#include "utils/profiler.h"
+#include "utils/socket.h"
+
+using std::chrono::steady_clock;
+
+namespace {
+
+constexpr char const *USAGE = R"(usage: Raytracer --headless [options]
+
+  --scene NAME|FILE   generated scene (cornell, spheres, soup, instances, city) or
+                      .rtscene/.obj/.ply file to render (cornell)
+  --size WxH          image resolution (1280x720)
+  --spp N             samples per pixel (64)
+  --frames A[-B]      inclusive frame range (0)
+  --output PATTERN    output file, .ppm, .pfm, .png or .exr, '#'s are replaced by the
+                      frame number (frame_####.ppm)
+  --exr-type TYPE     half or float channels in EXR files (half)
+  --exr-layers WHICH  color, or all to add depth, albedo and normal layers to EXR
+                      files (color)
+  --output-threads N  threads compressing and writing the output files (2)
+  --output-queue N    frames rendered ahead of the writers before rendering waits (2)
+  --threads N         render threads, 0 uses every hardware thread (0)
+  --simd LEVEL        scalar, sse4.1, avx2 or avx512 (best supported)
+  --compact MODE      off, exact (compressed BVH and indices) or quantized (also
+                      16 bit positions) to save memory on large scenes (off)
+  --fov DEGREES       vertical field of view (90)
+  --texture-cache MB  memory for texture tiles (256)
+  --denoise N         denoiser passes up to 8, 0 writes the noisy image (0)
+  --integrator NAME   path (one path after the other) or wavefront (stage by stage) (path)
+  --sampler NAME      independent, sobol (Owen scrambled) or blue-noise (sobol)
+  --trace FILE        write the profiler zones as Chrome trace JSON
+  --coordinator PORT  hand the tiles out to worker processes connecting on PORT
+                      instead of rendering them here
+  --worker HOST:PORT  render tiles for a coordinator; scene, size, spp, camera and
+                      integrator come from there, the scene must load here too
+  --worker-timeout S  seconds a worker may go silent before its tiles are handed
+                      to others (300)
+  --worker-startup-timeout S
+                      seconds a worker may take to load the scene before it's
+                      dropped (3600)
+  --help              print this message
+)";
+
+template <typename T> auto parse_number(std::string_view text, T &value) -> bool {
+    auto const [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc{} && end == text.data() + text.size();
+}
+
+/// "A" or "A-B"
+auto parse_range(std::string_view text, int &first, int &last) -> bool {
+    auto const dash = text.find('-', 1);
+    if (dash == std::string_view::npos) {
+        if (!parse_number(text, first))
+            return false;
+        last = first;
+        return true;
+    }
+    return parse_number(text.substr(0, dash), first) &&
+           parse_number(text.substr(dash + 1), last) && first <= last;
+}
+
+/// "WxH"
+auto parse_size(std::string_view text, int &width, int &height) -> bool {
+    auto const x = text.find('x');
+    return x != std::string_view::npos && parse_number(text.substr(0, x), width) &&
+           parse_number(text.substr(x + 1), height) && width > 0 && height > 0;
+}
+
+auto milliseconds_since(steady_clock::time_point start) -> double {
+    return std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
+} // namespace
+
+auto is_procedural_scene(std::string const &name) -> bool {
+    auto const names = procedural_scene_names();
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+auto make_batch_scene(std::string const &name) -> std::optional<Scene> {
+    return is_procedural_scene(name) ? make_procedural_scene(name) : load_scene(name);
+}
+
+auto batch_bvh_cache(std::string const &name) -> std::filesystem::path {
+    // files cache their BVH next to them, generated scenes have nowhere to put it
+    return is_procedural_scene(name) ? std::filesystem::path{} : bvh_cache_path(name);
+}
+
+auto is_batch_invocation(int argc, char **argv) -> bool {
+    return std::any_of(argv + 1, argv + argc,
+                       [](char const *arg) { return std::string_view(arg) == "--headless"; });
+}
+
+auto parse_batch_settings(int argc, char **argv, BatchSettings &settings) -> bool {
+    auto fail = [](std::string_view option, std::string_view value) {
+        spdlog::error("invalid value '{}' for {}", value, option);
+        std::fputs(USAGE, stderr);
+        return false;
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view const option = argv[i];
+        if (option == "--headless")
+            continue;
+        if (option == "--help") {
+            std::fputs(USAGE, stdout);
+            return false;
+        }
+        if (i + 1 == argc || !option.starts_with("--")) {
+            spdlog::error("unknown option or missing value: {}", option);
+            std::fputs(USAGE, stderr);
+            return false;
+        }
+
+        std::string_view const value = argv[++i];
+        if (option == "--scene") {
+            settings.scene = value;
+        } else if (option == "--size") {
+            if (!parse_size(value, settings.width, settings.height))
+                return fail(option, value);
+        } else if (option == "--spp") {
+            if (!parse_number(value, settings.spp) || settings.spp < 1)
+                return fail(option, value);
+        } else if (option == "--frames") {
+            if (!parse_range(value, settings.first_frame, settings.last_frame))
+                return fail(option, value);
+        } else if (option == "--output") {
+            settings.output = value;
+        } else if (option == "--exr-type") {
+            if (value != "half" && value != "float")
+                return fail(option, value);
+            settings.writer.image.exr_half = value == "half";
+        } else if (option == "--exr-layers") {
+            if (value != "color" && value != "all")
+                return fail(option, value);
+            settings.writer.image.exr_layers = value == "all";
+        } else if (option == "--output-threads") {
+            if (!parse_number(value, settings.writer.threads))
+                return fail(option, value);
+        } else if (option == "--output-queue") {
+            if (!parse_number(value, settings.writer.queue) || settings.writer.queue == 0)
+                return fail(option, value);
+        } else if (option == "--threads") {
+            if (!parse_number(value, settings.threads))
+                return fail(option, value);
+        } else if (option == "--simd") {
+            SimdLevel level;
+            if (!parse_simd_level(value, level))
+                return fail(option, value);
+            settings.simd              = level;
+            settings.writer.image.simd = level;
+        } else if (option == "--compact") {
+            if (value != "off" && value != "exact" && value != "quantized")
+                return fail(option, value);
+            settings.compact.reset();
+            if (value != "off") {
+                settings.compact.emplace();
+                settings.compact->quantize_positions = value == "quantized";
+            }
+        } else if (option == "--fov") {
+            if (!parse_number(value, settings.camera.fov))
+                return fail(option, value);
+        } else if (option == "--texture-cache") {
+            if (!parse_number(value, settings.texture_cache_mb) || settings.texture_cache_mb == 0)
+                return fail(option, value);
+        } else if (option == "--denoise") {
+            if (!parse_number(value, settings.denoise.iterations) ||
+                settings.denoise.iterations < 0 ||
+                settings.denoise.iterations > MAX_DENOISER_ITERATIONS)
+                return fail(option, value);
+            settings.denoise.enabled = settings.denoise.iterations > 0;
+        } else if (option == "--integrator") {
+            if (value != "path" && value != "wavefront")
+                return fail(option, value);
+            settings.integrator.wavefront = value == "wavefront";
+        } else if (option == "--sampler") {
+            if (!parse_sampler_type(value, settings.integrator.sampler))
+                return fail(option, value);
+        } else if (option == "--trace") {
+            settings.trace = value;
+        } else if (option == "--coordinator") {
+            if (!parse_number(value, settings.coordinator_port) || settings.coordinator_port == 0)
+                return fail(option, value);
+        } else if (option == "--worker") {
+            std::string host;
+            uint16_t port;
+            if (!parse_host_port(std::string(value), host, port))
+                return fail(option, value);
+            settings.worker = value;
+        } else if (option == "--worker-timeout") {
+            if (!parse_number(value, settings.worker_timeout) || settings.worker_timeout < 1)
+                return fail(option, value);
+        } else if (option == "--worker-startup-timeout") {
+            if (!parse_number(value, settings.worker_startup_timeout) ||
+                settings.worker_startup_timeout < 1)
+                return fail(option, value);
+        } else {
+            spdlog::error("unknown option: {}", option);
+            std::fputs(USAGE, stderr);
+            return false;
+        }
+    }
+    return true;
+}
+
+auto batch_output_path(std::string const &pattern, int frame) -> std::filesystem::path {
+    auto const first = pattern.find('#');
+    if (first == std::string::npos)
+        return pattern;
+    auto const last  = pattern.find_first_not_of('#', first);
+    auto const count = (last == std::string::npos ? pattern.size() : last) - first;
+
+    char number[32];
+    std::snprintf(number, sizeof(number), "%0*d", static_cast<int>(count), frame);
+    return pattern.substr(0, first) + number + pattern.substr(first + count);
+}
+
+auto BatchApplication::run() -> int {
+    auto const start = steady_clock::now();
+
+    // without a trace nobody drains the zones, so don't record them in the first place
+    auto &profiler        = Profiler::instance();
+    int const frame_count = m_settings.last_frame - m_settings.first_frame + 1;
+    profiler.set_enabled(!m_settings.trace.empty());
+    // setup, the frames and the output that's still going on after the last one
+    profiler.set_history_size(static_cast<size_t>(frame_count) + 2);
+    profiler.set_thread_name("main");
+
+    auto scene = make_batch_scene(m_settings.scene);
+    if (!scene) {
+        spdlog::error("couldn't load scene '{}'", m_settings.scene);
+        return 1;
+    }
+
+    auto app = CPUApplication::make_application(m_settings.threads);
+    app->textures().set_capacity(m_settings.texture_cache_mb << 20);
+    app->set_scene(std::move(*scene), batch_bvh_cache(m_settings.scene));
+    if (m_settings.compact)
+        app->make_compact(*m_settings.compact);
+    if (m_settings.simd)
+        app->set_simd_level(*m_settings.simd);
+    app->denoiser_settings()   = m_settings.denoise;
+    app->integrator_settings() = m_settings.integrator;
+    app->resize(m_settings.width, m_settings.height);
+    double const setup_ms = milliseconds_since(start);
+    profiler.end_frame();
+
+    if (frame_count > 1 && m_settings.output.find('#') == std::string::npos)
+        spdlog::warn("output pattern has no '#', every frame overwrites {}", m_settings.output);
+
+    double render_ms_total = 0.0;
+    double render_ms_min   = 1.0e30;
+    double render_ms_max   = 0.0;
+    double submit_ms_total = 0.0;
+
+    OutputPipeline output(m_settings.writer);
+    for (int frame = m_settings.first_frame; frame <= m_settings.last_frame; ++frame) {
+        auto const render_start = steady_clock::now();
+        {
+            PROFILE_SCOPE("render");
+            app->set_frame_index(static_cast<uint32_t>(frame));
+            app->render(m_settings.camera, m_settings.spp);
+        }
+        double const render_ms = milliseconds_since(render_start);
+
+        // only waits if the writers are behind, see the "output stall" zone
+        auto const submit_start = steady_clock::now();
+        auto const path         = batch_output_path(m_settings.output, frame);
+        output.submit(app->framebuffer(), path);
+        double const submit_ms = milliseconds_since(submit_start);
+        profiler.end_frame();
+
+        render_ms_total += render_ms;
+        render_ms_min    = std::min(render_ms_min, render_ms);
+        render_ms_max    = std::max(render_ms_max, render_ms);
+        submit_ms_total += submit_ms;
+        spdlog::info("frame {}: {:.1f} ms render, {:.1f} ms handing off -> {}", frame, render_ms,
+                     submit_ms, path.string());
+    }
+    auto const finish_start   = steady_clock::now();
+    OutputStats const written = output.finish();
+    double const finish_ms    = milliseconds_since(finish_start);
+    profiler.end_frame();
+
+    double const samples = static_cast<double>(m_settings.width) * m_settings.height *
+                           m_settings.spp * frame_count;
+    spdlog::info("{} frames of {}x{} at {} spp on {} threads", frame_count, m_settings.width,
+                 m_settings.height, m_settings.spp, app->thread_count());
+    spdlog::info("setup {:.1f} ms, render {:.1f} ms (min {:.1f}, avg {:.1f}, max {:.1f}), "
+                 "output {:.1f} ms + {:.1f} ms after the last frame, total {:.1f} ms",
+                 setup_ms, render_ms_total, render_ms_min, render_ms_total / frame_count,
+                 render_ms_max, submit_ms_total, finish_ms, milliseconds_since(start));
+    spdlog::info("output: {:.1f} ms encoding on {} threads, {:.1f} ms of rendering stalled "
+                 "waiting for it",
+                 written.encode_ms, output.thread_count(), written.stall_ms);
+    spdlog::info("{:.2f} Msamples/s", samples / (render_ms_total * 1.0e3));
+    if (app->textures().texture_count() > 0) {
+        auto const textures = app->textures().stats();
+        spdlog::info("texture tiles: {} hits, {} misses, {} evictions, {:.1f} MB resident",
+                     textures.hits, textures.misses, textures.evictions,
+                     static_cast<double>(textures.resident_bytes) / (1 << 20));
+    }
+    size_t arena_high_water = 0;
+    uint64_t arena_blocks   = 0;
+    for (auto const &arena : app->arena_stats()) {
+        arena_high_water  = std::max(arena_high_water, arena.high_water);
+        arena_blocks     += arena.block_allocations;
+    }
+    spdlog::info("frame arenas: {:.1f} MB high water per thread, {} block allocations",
+                 static_cast<double>(arena_high_water) / (1 << 20), arena_blocks);
+
+    if (!m_settings.trace.empty()) {
+        if (profiler.dropped_events() > 0)
+            spdlog::warn("{} profiler zones were dropped, the trace is incomplete",
+                         profiler.dropped_events());
+        profiler.export_chrome_trace(m_settings.trace);
+    }
+
+    if (written.failed > 0) {
+        spdlog::error("{} of {} frames couldn't be written", written.failed, frame_count);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#ifndef _BATCH_APPLICATION_H
+#define _BATCH_APPLICATION_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include "render/camera.h"
+#include "render/denoiser.h"
+#include "render/integrator.h"
+#include "render/output_pipeline.h"
+#include "render/scene.h"
+#include "utils/cpu_features.h"
+
+/// everything a headless render job is configured with, see `parse_batch_settings()`
+struct BatchSettings {
+    /// a generated scene, see `make_procedural_scene()`, or a scene file, see `load_scene()`
+    std::string scene = "cornell";
+    int width         = 1280;
+    int height        = 720;
+    int spp           = 64;
+    /// inclusive range of frames to render, each frame gets its own random streams
+    int first_frame = 0;
+    int last_frame  = 0;
+    /// output file, a run of `#` is replaced by the zero padded frame number
+    std::string output = "frame_####.ppm";
+    /// encoding of the output files and the threads writing them
+    OutputSettings writer;
+    /// render threads, `0` uses every hardware thread
+    unsigned threads = 0;
+    std::optional<SimdLevel> simd;
+    /// replace the triangles with their compact form once the BVH is built, see
+    /// `Scene::make_compact()`
+    std::optional<CompactSettings> compact;
+    Camera camera;
+    DenoiserSettings denoise;
+    IntegratorSettings integrator;
+    /// memory for texture tiles
+    size_t texture_cache_mb = 256;
+    /// Chrome trace of the profiler zones, one profiler frame per rendered frame, empty for none
+    std::string trace;
+    /// hand the tiles out to workers connecting on this port instead of rendering, see
+    /// `CoordinatorApplication`, `0` renders locally
+    uint16_t coordinator_port = 0;
+    /// "HOST:PORT" of the coordinator to render tiles for, see `WorkerApplication`
+    std::string worker;
+    /// seconds a worker may go without sending a result before it counts as failed
+    int worker_timeout = 300;
+    /// seconds a worker may take to load the scene and build its BVH before it's dropped, apart
+    /// from `worker_timeout` since large scenes take far longer than a tile
+    int worker_startup_timeout = 3600;
+};
+
+/// true if `name` is one of `procedural_scene_names()` rather than a file
+auto is_procedural_scene(std::string const &name) -> bool;
+
+/// the generated scene or scene file `name`, see `BatchSettings::scene`
+auto make_batch_scene(std::string const &name) -> std::optional<Scene>;
+
+/// where the BVH of the scene `name` is cached, empty for generated scenes
+auto batch_bvh_cache(std::string const &name) -> std::filesystem::path;
+
+/// true if the command line asks for a headless run (`--headless`)
+auto is_batch_invocation(int argc, char **argv) -> bool;
+
+/// @brief parses the headless command line options into `settings`
+/// @return false on invalid options or `--help`, the usage has been printed then
+auto parse_batch_settings(int argc, char **argv, BatchSettings &settings) -> bool;
+
+/// the file frame `frame` is written to, see `BatchSettings::output`
+auto batch_output_path(std::string const &pattern, int frame) -> std::filesystem::path;
+
+/// Renders a frame range straight to image files, without any window, OpenGL or ImGui, and logs
+/// timing statistics when done. This is what render farm nodes run. Frames are written by an
+/// `OutputPipeline` while the next one renders.
+class BatchApplication {
+    BatchSettings m_settings;
+
+  public:
+    explicit BatchApplication(BatchSettings settings) : m_settings(std::move(settings)) {}
+
+    /// @return the process exit code, `0` if every frame was written
+    auto run() -> int;
+};
+
+#endif
@@ -0,0 +1,72 @@
+
+#include "cpu_application.h"
+
+#include <spdlog/spdlog.h>
+
+std::unique_ptr<CPUApplication> CPUApplication::make_application(unsigned threads) {
+
+    auto app = std::make_unique<CPUApplication>();
+
+    spdlog::info("setup CPU renderer");
+    app->m_pool     = std::make_unique<ThreadPool>(threads);
+    app->m_renderer = std::make_unique<TileRenderer>(*app->m_pool);
+    app->m_denoiser = std::make_unique<Denoiser>(*app->m_pool);
+    app->m_textures = std::make_unique<TextureCache>();
+    spdlog::info("CPU renderer uses {} threads", app->m_pool->size());
+
+    return app;
+}
+
+void CPUApplication::set_scene(Scene scene, std::filesystem::path const &bvh_cache) {
+    m_scene = std::move(scene);
+    spdlog::info("scene has {} triangles, {} of them emissive", m_scene.triangle_count(),
+                 m_scene.emissive_triangles.size());
+    m_scene.build_acceleration(*m_pool, bvh_cache);
+    m_scene.bind_textures(*m_textures);
+    reset_accumulation();
+}
+
+void CPUApplication::adopt_scene(Scene scene) {
+    m_scene = std::move(scene);
+    spdlog::info("scene has {} triangles, {} of them emissive", m_scene.triangle_count(),
+                 m_scene.emissive_triangles.size());
+    reset_accumulation();
+}
+
+void CPUApplication::update_scene(std::function<void(Scene &)> const &update) {
+    update(m_scene);
+    m_scene.refit_acceleration(*m_pool);
+    reset_accumulation();
+}
+
+void CPUApplication::make_compact(CompactSettings const &settings) {
+    m_scene.make_compact(*m_pool, settings);
+    reset_accumulation();
+}
+
+void CPUApplication::resize(int width, int height) {
+    m_framebuffer.resize(width, height);
+    m_renderer->resize(width, height);
+    reset_accumulation();
+}
+
+void CPUApplication::render(Camera const &camera, int spp) {
+    m_renderer->render(m_scene, camera, m_framebuffer, m_frame_index++, spp);
+    if (m_denoiser_settings.enabled)
+        m_denoiser->denoise(m_framebuffer, m_denoiser_settings, true);
+}
+
+void CPUApplication::render_region(Camera const &camera, Tile const &region, int spp) {
+    m_renderer->render_region(m_scene, camera, m_framebuffer, region, m_frame_index, spp);
+}
+
+void CPUApplication::render_progressive(Camera const &camera, int spp) {
+    if (m_accumulated_camera != camera) {
+        m_accumulator.reset(m_framebuffer.width(), m_framebuffer.height(),
+                            m_renderer->tiles().size());
+        m_accumulated_camera = camera;
+    }
+    m_renderer->accumulate(m_scene, camera, m_accumulator, m_framebuffer, m_frame_index++, spp);
+    if (m_denoiser_settings.enabled)
+        m_denoiser->denoise(m_framebuffer, m_denoiser_settings, false);
+}
@@ -0,0 +1,111 @@
+#ifndef _CPU_APPLICATION_H
+#define _CPU_APPLICATION_H
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include "render/camera.h"
+#include "render/denoiser.h"
+#include "render/framebuffer.h"
+#include "render/scene.h"
+#include "render/texture_cache.h"
+#include "render/tile_renderer.h"
+#include "utils/thread_pool.h"
+
+/// CPU counterpart of `CUApplication`: owns the worker threads, the scene, the tile renderer and
+/// the denoiser. Used when CUDA/OptiX are not available.
+class CPUApplication {
+
+    std::unique_ptr<ThreadPool> m_pool;
+    std::unique_ptr<TileRenderer> m_renderer;
+    std::unique_ptr<Denoiser> m_denoiser;
+    std::unique_ptr<TextureCache> m_textures;
+    DenoiserSettings m_denoiser_settings;
+    Scene m_scene;
+    Framebuffer m_framebuffer;
+    uint32_t m_frame_index = 0;
+
+    // progressive rendering, samples are kept as long as the camera doesn't move
+    Accumulator m_accumulator;
+    std::optional<Camera> m_accumulated_camera;
+
+  public:
+    /// @brief sets up the render threads, the scene is empty until `set_scene()`
+    /// @param threads number of render threads, `0` uses every hardware thread
+    static std::unique_ptr<CPUApplication> make_application(unsigned threads = 0);
+
+    /// @brief replaces the scene, builds its acceleration structure and registers its textures
+    /// @param bvh_cache where to cache the BVH, usually `bvh_cache_path()` of the scene file
+    void set_scene(Scene scene, std::filesystem::path const &bvh_cache = {});
+
+    /// @brief replaces the scene with one whose acceleration structure was already built and
+    /// whose textures were bound to `textures()`, e.g. on another thread during startup
+    void adopt_scene(Scene scene);
+
+    /// @brief animates the scene: `update` moves instances (`InstanceLayer::set_transform()`) or
+    /// vertices, then the acceleration structures are refit rather than rebuilt and the
+    /// progressive estimate starts over. Must not overlap with rendering.
+    void update_scene(std::function<void(Scene &)> const &update);
+
+    /// trades the triangles of the scene for their compact form, see `Scene::make_compact()`.
+    /// The scene can't be updated after.
+    void make_compact(CompactSettings const &settings);
+
+    void resize(int width, int height);
+
+    /// renders one frame of `spp` samples per pixel into the framebuffer, blocks until done. The
+    /// color is denoised if `denoiser_settings()` say so.
+    void render(Camera const &camera, int spp = 1);
+
+    /// @brief renders only `region` of the frame into the framebuffer, with the frame index of
+    /// the last `set_frame_index()` and without denoising, see `TileRenderer::render_region()`
+    void render_region(Camera const &camera, Tile const &region, int spp = 1);
+
+    /// @brief adds `spp` samples per pixel to the progressive estimate and shows it in the
+    /// framebuffer. The estimate starts over when `camera` differs from the previous call. Only
+    /// the display version is denoised, the color stays the raw estimate.
+    void render_progressive(Camera const &camera, int spp = 1);
+
+    /// drops the progressive estimate, the next `render_progressive()` starts from scratch
+    void reset_accumulation() { m_accumulated_camera.reset(); }
+
+    auto accumulator() const -> Accumulator const & { return m_accumulator; }
+    /// pixels and tiles that already converged stay converged until the estimate is reset
+    auto adaptive_settings() -> AdaptiveSettings & { return m_renderer->adaptive; }
+    auto integrator_settings() -> IntegratorSettings & { return m_renderer->settings; }
+    /// applied after every `render()`/`render_progressive()`
+    auto denoiser_settings() -> DenoiserSettings & { return m_denoiser_settings; }
+
+    /// the random streams of the next frame are seeded with `index`, counts up from there
+    void set_frame_index(uint32_t index) { m_frame_index = index; }
+
+    /// forces the traversal kernels of `level`, see `Scene::set_simd_level()`
+    void set_simd_level(SimdLevel level) {
+        m_scene.set_simd_level(level);
+        m_denoiser->set_simd_level(level);
+    }
+
+    /// true if the progressive estimate for `camera` has converged everywhere
+    auto is_converged(Camera const &camera) const -> bool {
+        return m_accumulated_camera == camera &&
+               m_accumulator.converged_tiles() == m_accumulator.tile_count();
+    }
+
+    /// renders the display version of the next frames into `pixels`, see
+    /// `Framebuffer::set_display_target()`
+    void set_display_target(uint32_t *pixels) { m_framebuffer.set_display_target(pixels); }
+
+    auto framebuffer() const -> Framebuffer const & { return m_framebuffer; }
+    auto scene() const -> Scene const & { return m_scene; }
+    /// tiles of the scene textures, loaded as the renderer touches them
+    auto textures() -> TextureCache & { return *m_textures; }
+    auto thread_count() const -> unsigned { return m_pool->size(); }
+    /// the render threads, free to use for scene preparation while nothing renders
+    auto pool() -> ThreadPool & { return *m_pool; }
+    /// memory use of the render threads' arenas, see `TileRenderer::arena_stats()`
+    auto arena_stats() const -> std::vector<ArenaStats> { return m_renderer->arena_stats(); }
+};
+
+#endif
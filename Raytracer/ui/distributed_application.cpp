@@ -0,0 +1,449 @@
+#include "distributed_application.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "render/tile_renderer.h"
+#include "ui/cpu_application.h"
+#include "utils/socket.h"
+
+using std::chrono::steady_clock;
+
+namespace {
+
+/// bumped whenever a message changes, coordinator and workers have to agree on it
+constexpr uint32_t PROTOCOL_VERSION = 1;
+/// a multiple of the renderer's tile size, so workers trace the same packets as a local render
+constexpr int FARM_TILE_SIZE = 64;
+/// tiles a worker holds at once, it starts on the next one while the result of the last is sent
+constexpr size_t TILES_IN_FLIGHT = 2;
+
+enum class MessageType : uint32_t {
+    /// worker -> coordinator, `HelloMessage`
+    Hello,
+    /// coordinator -> worker, `JobMessage` followed by the scene name
+    Job,
+    /// worker -> coordinator, the scene is loaded, no payload
+    Ready,
+    /// coordinator -> worker, `TileMessage`
+    Tile,
+    /// worker -> coordinator, `TileMessage` followed by a `PixelMessage` per pixel, row by row
+    Result,
+    /// coordinator -> worker, no more tiles, no payload
+    Done,
+};
+
+// Messages go over the wire as they are in memory, coordinator and workers are expected to be the
+// same build on machines of the same byte order.
+struct MessageHeader {
+    MessageType type;
+    /// bytes of payload after the header
+    uint32_t size;
+};
+
+struct HelloMessage {
+    uint32_t version;
+    uint32_t threads;
+};
+
+struct JobMessage {
+    int32_t width;
+    int32_t height;
+    int32_t spp;
+    Camera camera;
+    IntegratorSettings integrator;
+};
+
+struct TileMessage {
+    int32_t frame;
+    Tile tile;
+};
+
+struct PixelMessage {
+    Vec3 color;
+    Vec3 albedo;
+    Vec3 normal;
+    float depth;
+};
+
+static_assert(std::is_trivially_copyable_v<JobMessage> &&
+              std::is_trivially_copyable_v<TileMessage> &&
+              std::is_trivially_copyable_v<PixelMessage>);
+
+auto send_header(Socket &socket, MessageType type, size_t size) -> bool {
+    MessageHeader const header{type, static_cast<uint32_t>(size)};
+    return socket.send(&header, sizeof(header));
+}
+
+/// @brief receives the header of the next message
+/// @return false if the receive fails or the message isn't of type `expected`
+auto receive_header(Socket &socket, MessageType expected, uint32_t &size) -> bool {
+    MessageHeader header{};
+    if (!socket.receive(&header, sizeof(header)))
+        return false;
+    if (header.type != expected) {
+        spdlog::error("unexpected message {} from {}", static_cast<uint32_t>(header.type),
+                      socket.peer_name());
+        return false;
+    }
+    size = header.size;
+    return true;
+}
+
+auto pixel_count(Tile const &tile) -> size_t {
+    return static_cast<size_t>(tile.x1 - tile.x0) * static_cast<size_t>(tile.y1 - tile.y0);
+}
+
+auto same_tile(TileMessage const &a, TileMessage const &b) -> bool {
+    return a.frame == b.frame && a.tile.x0 == b.tile.x0 && a.tile.y0 == b.tile.y0 &&
+           a.tile.x1 == b.tile.x1 && a.tile.y1 == b.tile.y1;
+}
+
+/// the tiles of an image, row by row
+auto farm_tiles(int width, int height) -> std::vector<Tile> {
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += FARM_TILE_SIZE) {
+        for (int x = 0; x < width; x += FARM_TILE_SIZE) {
+            tiles.push_back({x, y, std::min(x + FARM_TILE_SIZE, width),
+                             std::min(y + FARM_TILE_SIZE, height)});
+        }
+    }
+    return tiles;
+}
+
+auto milliseconds_since(steady_clock::time_point start) -> double {
+    return std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
+/// what the frame loop of the coordinator shares with the threads talking to the workers
+struct Farm {
+    BatchSettings const &settings;
+    std::mutex mutex;
+    std::condition_variable changed;
+    /// tiles no worker holds: those of the current frame and those of failed workers
+    std::deque<TileMessage> pending;
+    /// tiles of the current frame whose result hasn't been merged yet
+    size_t remaining = 0;
+    Framebuffer frame;
+    unsigned workers = 0;
+    std::atomic<bool> done{false};
+
+    explicit Farm(BatchSettings const &batch) : settings(batch) {}
+};
+
+/// @brief receives the result of `expected` into `pixels`
+auto receive_result(Socket &socket, TileMessage const &expected, std::vector<PixelMessage> &pixels)
+    -> bool {
+    uint32_t size = 0;
+    TileMessage tile{};
+    if (!receive_header(socket, MessageType::Result, size) || !socket.receive(&tile, sizeof(tile)))
+        return false;
+    size_t const count = pixel_count(expected.tile);
+    if (!same_tile(tile, expected) || size != sizeof(tile) + count * sizeof(PixelMessage)) {
+        spdlog::error("{} sent the result of another tile", socket.peer_name());
+        return false;
+    }
+    pixels.resize(count);
+    return socket.receive(pixels.data(), count * sizeof(PixelMessage));
+}
+
+void merge_result(Framebuffer &frame, Tile const &tile, std::vector<PixelMessage> const &pixels) {
+    auto pixel = pixels.begin();
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        for (int x = tile.x0; x < tile.x1; ++x, ++pixel) {
+            frame.color(x, y)  = pixel->color;
+            frame.rgba8(x, y)  = pack_rgba8(pixel->color);
+            frame.albedo(x, y) = pixel->albedo;
+            frame.normal(x, y) = pixel->normal;
+            frame.depth(x, y)  = pixel->depth;
+        }
+    }
+}
+
+/// @brief introduces the job to a newly connected worker and waits until it's ready
+/// @param scene the scene name as the worker should load it
+auto start_worker(Farm &farm, Socket &socket, std::string const &scene) -> bool {
+    HelloMessage hello{};
+    uint32_t size = 0;
+    if (!receive_header(socket, MessageType::Hello, size) || size != sizeof(hello) ||
+        !socket.receive(&hello, sizeof(hello)))
+        return false;
+    if (hello.version != PROTOCOL_VERSION) {
+        spdlog::error("{} speaks protocol version {}, this is version {}", socket.peer_name(),
+                      hello.version, PROTOCOL_VERSION);
+        return false;
+    }
+
+    BatchSettings const &settings = farm.settings;
+    JobMessage const job{settings.width, settings.height, settings.spp, settings.camera,
+                         settings.integrator};
+    if (!send_header(socket, MessageType::Job, sizeof(job) + scene.size()) ||
+        !socket.send(&job, sizeof(job)) || !socket.send(scene.data(), scene.size()))
+        return false;
+
+    spdlog::info("worker {} with {} threads is loading the scene", socket.peer_name(),
+                 hello.threads);
+    return receive_header(socket, MessageType::Ready, size);
+}
+
+/// hands tiles to the worker behind `socket` until the farm is done or the worker fails
+void serve_worker(Farm &farm, Socket socket, std::string const &scene) {
+    std::string const name = socket.peer_name();
+    // loading the scene and building the BVH takes far longer than a tile
+    socket.set_receive_timeout(farm.settings.worker_startup_timeout);
+    if (!start_worker(farm, socket, scene)) {
+        spdlog::warn("dropped {}, it didn't start", name);
+        return;
+    }
+    socket.set_receive_timeout(farm.settings.worker_timeout);
+    {
+        std::lock_guard lock(farm.mutex);
+        ++farm.workers;
+    }
+    spdlog::info("worker {} joined", name);
+
+    std::deque<TileMessage> in_flight;
+    std::vector<PixelMessage> pixels;
+    size_t tiles  = 0;
+    bool finished = false;
+    while (true) {
+        size_t const sent = in_flight.size();
+        {
+            std::unique_lock lock(farm.mutex);
+            if (in_flight.empty()) {
+                farm.changed.wait(lock, [&]() { return farm.done || !farm.pending.empty(); });
+                if (farm.pending.empty()) {
+                    finished = true;
+                    break;
+                }
+            }
+            while (in_flight.size() < TILES_IN_FLIGHT && !farm.pending.empty()) {
+                in_flight.push_back(farm.pending.front());
+                farm.pending.pop_front();
+            }
+        }
+
+        bool ok = true;
+        for (size_t i = sent; i < in_flight.size() && ok; ++i)
+            ok = send_header(socket, MessageType::Tile, sizeof(TileMessage)) &&
+                 socket.send(&in_flight[i], sizeof(TileMessage));
+        // results come back in the order the tiles went out
+        if (!ok || !receive_result(socket, in_flight.front(), pixels))
+            break;
+
+        std::lock_guard lock(farm.mutex);
+        merge_result(farm.frame, in_flight.front().tile, pixels);
+        in_flight.pop_front();
+        --farm.remaining;
+        ++tiles;
+        farm.changed.notify_all();
+    }
+
+    if (finished) {
+        send_header(socket, MessageType::Done, 0);
+        spdlog::info("worker {} is done after {} tiles", name, tiles);
+    } else {
+        spdlog::warn("worker {} failed, {} of its tiles go to the others", name, in_flight.size());
+    }
+
+    std::lock_guard lock(farm.mutex);
+    // to the front, they are the oldest tiles of the frame
+    farm.pending.insert(farm.pending.begin(), in_flight.begin(), in_flight.end());
+    --farm.workers;
+    if (farm.workers == 0 && !farm.pending.empty())
+        spdlog::warn("no workers left, waiting for one to connect");
+    farm.changed.notify_all();
+}
+
+} // namespace
+
+auto CoordinatorApplication::run() -> int {
+    auto const start = steady_clock::now();
+
+    // the workers load the scene themselves, from the same path if it's a file
+    std::string scene = m_settings.scene;
+    if (!is_procedural_scene(scene)) {
+        if (!std::filesystem::exists(scene)) {
+            spdlog::error("couldn't find scene '{}'", scene);
+            return 1;
+        }
+        scene = std::filesystem::absolute(scene).string();
+    }
+
+    auto listener = Socket::listen(m_settings.coordinator_port);
+    if (!listener)
+        return 1;
+    spdlog::info("waiting for workers on port {}", m_settings.coordinator_port);
+
+    Farm farm(m_settings);
+    farm.frame.resize(m_settings.width, m_settings.height);
+
+    // the workers render, the pool here only denoises
+    std::unique_ptr<ThreadPool> pool;
+    std::unique_ptr<Denoiser> denoiser;
+    if (m_settings.denoise.enabled) {
+        pool     = std::make_unique<ThreadPool>(m_settings.threads);
+        denoiser = std::make_unique<Denoiser>(*pool);
+        if (m_settings.simd)
+            denoiser->set_simd_level(*m_settings.simd);
+    }
+
+    std::thread acceptor([&]() {
+        std::vector<std::thread> connections;
+        while (!farm.done) {
+            if (auto socket = listener->accept(200))
+                connections.emplace_back(serve_worker, std::ref(farm), std::move(*socket), scene);
+        }
+        for (auto &connection : connections)
+            connection.join();
+    });
+
+    if (m_settings.last_frame > m_settings.first_frame &&
+        m_settings.output.find('#') == std::string::npos)
+        spdlog::warn("output pattern has no '#', every frame overwrites {}", m_settings.output);
+
+    std::vector<Tile> const tiles = farm_tiles(m_settings.width, m_settings.height);
+    OutputPipeline output(m_settings.writer);
+    for (int frame = m_settings.first_frame; frame <= m_settings.last_frame; ++frame) {
+        auto const frame_start = steady_clock::now();
+        unsigned workers       = 0;
+        {
+            std::unique_lock lock(farm.mutex);
+            for (Tile const &tile : tiles)
+                farm.pending.push_back({frame, tile});
+            farm.remaining = tiles.size();
+            farm.changed.notify_all();
+            farm.changed.wait(lock, [&]() { return farm.remaining == 0; });
+            workers = farm.workers;
+        }
+        double const render_ms = milliseconds_since(frame_start);
+
+        if (denoiser)
+            denoiser->denoise(farm.frame, m_settings.denoise, true);
+        // written while the workers render the next frame
+        auto const path = batch_output_path(m_settings.output, frame);
+        output.submit(farm.frame, path);
+        spdlog::info("frame {}: {:.1f} ms render on {} workers -> {}", frame, render_ms, workers,
+                     path.string());
+    }
+
+    {
+        std::lock_guard lock(farm.mutex);
+        farm.done = true;
+    }
+    farm.changed.notify_all();
+    acceptor.join();
+    OutputStats const written = output.finish();
+
+    spdlog::info("{} frames of {}x{} at {} spp in {} tiles each, total {:.1f} ms",
+                 m_settings.last_frame - m_settings.first_frame + 1, m_settings.width,
+                 m_settings.height, m_settings.spp, tiles.size(), milliseconds_since(start));
+    return written.failed == 0 ? 0 : 1;
+}
+
+auto WorkerApplication::run() -> int {
+    std::string host;
+    uint16_t port = 0;
+    if (!parse_host_port(m_settings.worker, host, port)) {
+        // same as a bad command line, see `parse_batch_settings()`
+        spdlog::error("invalid value '{}' for --worker", m_settings.worker);
+        return 2;
+    }
+
+    // the coordinator may still be starting up
+    std::optional<Socket> socket;
+    for (int attempt = 0; attempt < 10 && !socket; ++attempt) {
+        if (attempt > 0)
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        socket = Socket::connect(host, port);
+    }
+    if (!socket)
+        return 1;
+
+    auto app = CPUApplication::make_application(m_settings.threads);
+    HelloMessage const hello{PROTOCOL_VERSION, app->thread_count()};
+    if (!send_header(*socket, MessageType::Hello, sizeof(hello)) ||
+        !socket->send(&hello, sizeof(hello)))
+        return 1;
+
+    JobMessage job{};
+    std::string scene_name;
+    uint32_t size = 0;
+    if (!receive_header(*socket, MessageType::Job, size) || size < sizeof(job) ||
+        !socket->receive(&job, sizeof(job)))
+        return 1;
+    scene_name.resize(size - sizeof(job));
+    if (!socket->receive(scene_name.data(), scene_name.size()))
+        return 1;
+
+    auto const start = steady_clock::now();
+    auto scene       = make_batch_scene(scene_name);
+    if (!scene) {
+        spdlog::error("couldn't load scene '{}'", scene_name);
+        return 1;
+    }
+    app->textures().set_capacity(m_settings.texture_cache_mb << 20);
+    app->set_scene(std::move(*scene), batch_bvh_cache(scene_name));
+    if (m_settings.compact)
+        app->make_compact(*m_settings.compact);
+    if (m_settings.simd)
+        app->set_simd_level(*m_settings.simd);
+    app->integrator_settings() = job.integrator;
+    app->resize(job.width, job.height);
+    if (!send_header(*socket, MessageType::Ready, 0))
+        return 1;
+    spdlog::info("rendering {} at {}x{}, {} spp for {}:{}, setup {:.1f} ms", scene_name,
+                 job.width, job.height, job.spp, host, port, milliseconds_since(start));
+
+    Framebuffer const &frame = app->framebuffer();
+    std::vector<PixelMessage> pixels;
+    size_t tiles         = 0;
+    double render_ms     = 0.0;
+    auto const rendering = steady_clock::now();
+    while (true) {
+        MessageHeader header{};
+        if (!socket->receive(&header, sizeof(header)))
+            return 1;
+        if (header.type == MessageType::Done)
+            break;
+
+        TileMessage tile{};
+        if (header.type != MessageType::Tile || header.size != sizeof(tile) ||
+            !socket->receive(&tile, sizeof(tile))) {
+            spdlog::error("unexpected message {} from the coordinator",
+                          static_cast<uint32_t>(header.type));
+            return 1;
+        }
+
+        auto const render_start = steady_clock::now();
+        app->set_frame_index(static_cast<uint32_t>(tile.frame));
+        app->render_region(job.camera, tile.tile, job.spp);
+        render_ms += milliseconds_since(render_start);
+
+        pixels.clear();
+        for (int y = tile.tile.y0; y < tile.tile.y1; ++y) {
+            for (int x = tile.tile.x0; x < tile.tile.x1; ++x) {
+                size_t const i = static_cast<size_t>(y) * frame.width() + x;
+                pixels.push_back({frame.color(x, y), frame.albedo_data()[i],
+                                  frame.normal_data()[i], frame.depth_data()[i]});
+            }
+        }
+        if (!send_header(*socket, MessageType::Result,
+                         sizeof(tile) + pixels.size() * sizeof(PixelMessage)) ||
+            !socket->send(&tile, sizeof(tile)) ||
+            !socket->send(pixels.data(), pixels.size() * sizeof(PixelMessage)))
+            return 1;
+        ++tiles;
+    }
+
+    spdlog::info("rendered {} tiles, {:.1f} ms of {:.1f} ms rendering", tiles, render_ms,
+                 milliseconds_since(rendering));
+    return 0;
+}
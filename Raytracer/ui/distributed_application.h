@@ -0,0 +1,39 @@
+#ifndef _DISTRIBUTED_APPLICATION_H
+#define _DISTRIBUTED_APPLICATION_H
+
+#include "ui/batch_application.h"
+
+/// Headless render of a frame range whose tiles are rendered by `WorkerApplication` processes
+/// on this or other hosts (`--coordinator PORT`).
+///
+/// The coordinator doesn't load the scene, it only checks that it exists and sends its name and
+/// the render settings to every worker that connects. Every frame is split into tiles, each
+/// worker gets a couple of them in flight at a time and streams back the pixels (color and the
+/// denoiser features), which are merged into the frame. Tiles of a worker that disconnects or
+/// goes silent for `BatchSettings::worker_timeout` seconds go back to the queue for the others.
+/// Workers may join at any time; with none connected the render waits for one. Frames are
+/// denoised here once all their tiles are in and come out the same as with `BatchApplication`.
+class CoordinatorApplication {
+    BatchSettings m_settings;
+
+  public:
+    explicit CoordinatorApplication(BatchSettings settings) : m_settings(std::move(settings)) {}
+
+    /// @return the process exit code, `0` if every frame was written
+    auto run() -> int;
+};
+
+/// Renders tiles for a `CoordinatorApplication` until it says it's done (`--worker HOST:PORT`).
+/// Only the local options (threads, SIMD level, texture cache) are taken from the command line,
+/// everything else comes from the coordinator.
+class WorkerApplication {
+    BatchSettings m_settings;
+
+  public:
+    explicit WorkerApplication(BatchSettings settings) : m_settings(std::move(settings)) {}
+
+    /// @return the process exit code, `0` if the coordinator finished the job
+    auto run() -> int;
+};
+
+#endif
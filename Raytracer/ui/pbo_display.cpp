@@ -0,0 +1,140 @@
+#include "pbo_display.h"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "utils/profiler.h"
+
+PboDisplay::~PboDisplay() { release(); }
+
+void PboDisplay::release_buffers() {
+    for (auto &slot : m_slots) {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.buffer) {
+            if (slot.pixels) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            // deleting the buffer also unbinds it
+            glDeleteBuffers(1, &slot.buffer);
+        }
+        slot = {};
+    }
+    m_persistent = false;
+}
+
+void PboDisplay::release() {
+    release_buffers();
+    if (m_framebuffer)
+        glDeleteFramebuffers(1, &m_framebuffer);
+    if (m_texture)
+        glDeleteTextures(1, &m_texture);
+    m_framebuffer = 0;
+    m_texture     = 0;
+}
+
+auto PboDisplay::create_buffers() -> bool {
+    if (!GLEW_ARB_buffer_storage) {
+        spdlog::warn("no ARB_buffer_storage, framebuffer uploads are synchronous");
+        return false;
+    }
+
+    // coherent mappings make the renderer's writes visible to the copy without any flushing
+    auto const size        = static_cast<GLsizeiptr>(m_width) * m_height * sizeof(uint32_t);
+    GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (auto &slot : m_slots) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+        slot.pixels =
+            static_cast<uint32_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+        if (!slot.pixels) {
+            spdlog::error("couldn't map pixel buffer, framebuffer uploads are synchronous");
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            release_buffers();
+            return false;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return true;
+}
+
+void PboDisplay::resize(int width, int height) {
+    release();
+    m_width        = width;
+    m_height       = height;
+    m_image_width  = 0;
+    m_image_height = 0;
+    if (width <= 0 || height <= 0)
+        return;
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // blitting from a framebuffer object flips and scales without any shader
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    m_persistent = create_buffers();
+    if (m_persistent)
+        spdlog::info("display streams {}x{} through {} persistently mapped pixel buffers", width,
+                     height, SLOT_COUNT);
+}
+
+void PboDisplay::wait(int slot_index) {
+    Slot &slot = m_slots[slot_index];
+    if (!slot.fence)
+        return;
+    // the copy was started a frame ago, so this hardly ever waits
+    PROFILE_SCOPE("upload wait");
+    while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000) ==
+           GL_TIMEOUT_EXPIRED) {
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+}
+
+void PboDisplay::upload(int slot_index, uint32_t const *pixels, int width, int height) {
+    if (!m_texture)
+        return;
+    m_image_width  = std::min(width, m_width);
+    m_image_height = std::min(height, m_height);
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    if (m_persistent) {
+        // with a pixel buffer bound the last argument is an offset and the call returns right
+        // away, the copy runs while the renderer works on the next frame
+        Slot &slot = m_slots[slot_index];
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_image_width, m_image_height, GL_RGBA,
+                        GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    } else if (pixels) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_image_width, m_image_height, GL_RGBA,
+                        GL_UNSIGNED_BYTE, pixels);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void PboDisplay::draw(int x, int top, int width, int height) const {
+    if (!m_framebuffer || m_image_width == 0)
+        return;
+
+    // texture rows are top to bottom, so the destination rectangle is given upside down
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, m_image_width, m_image_height, x, top, x + width, top - height,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
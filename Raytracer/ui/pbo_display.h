@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+/// Shows CPU rendered RGBA8 images in the window through a texture.
+///
+/// Images are streamed in through persistently mapped pixel buffer objects, one per slot of the
+/// frame handoff (see `RenderLoop`): the renderer writes its pixels straight into the mapped memory
+/// of a slot, `upload()` starts an asynchronous copy from it into the texture, and rendering goes
+/// on in the other slots while the copy is in flight. A fence per slot tells when the GPU is done
+/// reading it, `wait()` has to be called before a slot is handed back to the renderer.
+///
+/// Without `ARB_buffer_storage` (OpenGL < 4.4) nothing is mapped, `slot_pixels()` returns
+/// `nullptr` and `upload()` copies from client memory instead.
+class PboDisplay {
+  public:
+    static constexpr int SLOT_COUNT = 3;
+
+  private:
+    /// capacity of the texture and of every slot
+    int m_width          = 0;
+    int m_height         = 0;
+    GLuint m_texture     = 0;
+    GLuint m_framebuffer = 0;
+    /// part of the texture the last upload filled
+    int m_image_width  = 0;
+    int m_image_height = 0;
+
+    struct Slot {
+        GLuint buffer    = 0;
+        uint32_t *pixels = nullptr;
+        /// signalled when the GPU is done reading the slot
+        GLsync fence = nullptr;
+    };
+    std::array<Slot, SLOT_COUNT> m_slots;
+    bool m_persistent = false;
+
+    void release();
+    void release_buffers();
+    /// creates and maps the slots, false if that isn't supported
+    auto create_buffers() -> bool;
+
+  public:
+    PboDisplay() = default;
+    ~PboDisplay();
+
+    PboDisplay(PboDisplay const &)                     = delete;
+    auto operator=(PboDisplay const &) -> PboDisplay & = delete;
+
+    /// (re)creates the texture and the pixel buffers for images of up to `width x height`
+    void resize(int width, int height);
+
+    auto width() const -> int { return m_width; }
+    auto height() const -> int { return m_height; }
+    auto is_persistent() const -> bool { return m_persistent; }
+
+    /// @brief mapped memory of `slot`, `width * height` pixels that stay valid until `resize()`
+    /// @return `nullptr` if pixel buffers can't be mapped
+    auto slot_pixels(int slot) const -> uint32_t * { return m_slots[slot].pixels; }
+
+    /// blocks until the GPU no longer reads `slot`
+    void wait(int slot);
+
+    /// @brief copies an image of `width x height`, rows top to bottom, into the texture
+    /// @param slot the slot holding the image, it's copied asynchronously
+    /// @param pixels the image if `slot_pixels()` returned `nullptr`, ignored otherwise
+    void upload(int slot, uint32_t const *pixels, int width, int height);
+
+    /// draws the last uploaded image into the window rectangle whose top left corner is
+    /// `(x, top)`, in window coordinates with the origin bottom left, scaled to `width x height`
+    void draw(int x, int top, int width, int height) const;
+};
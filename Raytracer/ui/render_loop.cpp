@@ -0,0 +1,136 @@
+#include "render_loop.h"
+
+#include <chrono>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+#include "utils/profiler.h"
+
+RenderLoop::RenderLoop(CPUApplication &app, std::array<uint32_t *, 3> const &slot_pixels,
+                       std::function<void()> on_frame)
+    : m_app(app), m_on_frame(std::move(on_frame)), m_full_width(app.framebuffer().width()),
+      m_full_height(app.framebuffer().height()) {
+    auto const &framebuffer = m_app.framebuffer();
+    for (int i = 0; i < 3; ++i) {
+        if (!slot_pixels[i]) {
+            m_fallback[i].assign(static_cast<size_t>(framebuffer.width()) * framebuffer.height(),
+                                 0xff000000u);
+        }
+        m_frames.slot(i).pixels = slot_pixels[i] ? slot_pixels[i] : m_fallback[i].data();
+    }
+    m_thread = std::thread([this]() { run(); });
+}
+
+RenderLoop::~RenderLoop() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+void RenderLoop::set_settings(RenderSettings const &settings) {
+    {
+        std::lock_guard lock(m_mutex);
+        if (settings == m_settings)
+            return;
+        m_settings         = settings;
+        m_settings_changed = true;
+    }
+    m_wake.notify_one();
+}
+
+void RenderLoop::run() {
+    Profiler::instance().set_thread_name("render");
+    spdlog::info("render thread started");
+
+    RenderSettings applied;
+    bool first = true;
+    // frames stay interactive for a moment after the camera last changed
+    std::chrono::steady_clock::time_point last_motion;
+    while (true) {
+        RenderSettings settings;
+        {
+            // nothing but a settings change can make a converged estimate worth rendering again
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stop || m_settings_changed || !m_idle; });
+            if (m_stop)
+                return;
+            settings           = m_settings;
+            m_settings_changed = false;
+            m_idle             = false;
+        }
+
+        // converged pixels are judged by the old settings, so start over on changes
+        if (first || settings.adaptive != applied.adaptive || settings.restart != applied.restart ||
+            settings.progressive != applied.progressive) {
+            m_app.adaptive_settings() = settings.adaptive;
+            m_app.reset_accumulation();
+        }
+        // the denoiser only changes what is shown, a converged estimate is shown again
+        bool const redisplay      = !first && settings.denoise != applied.denoise;
+        m_app.denoiser_settings() = settings.denoise;
+        // both integrators compute the same estimate, samples can keep being added
+        m_app.integrator_settings() = settings.integrator;
+
+        auto const now = std::chrono::steady_clock::now();
+        if (!first && settings.camera != applied.camera)
+            last_motion = now;
+        applied = settings;
+        first   = false;
+
+        // while the camera moves frames have to be quick, once it stops the image converges at
+        // full resolution
+        bool const interactive =
+            settings.budget.enabled &&
+            std::chrono::duration<float, std::milli>(now - last_motion).count() <
+                settings.budget.settle_ms;
+        int width  = m_full_width;
+        int height = m_full_height;
+        if (interactive) {
+            width  = std::max(1, static_cast<int>(std::lround(m_budget.scale() * width)));
+            height = std::max(1, static_cast<int>(std::lround(m_budget.scale() * height)));
+        }
+        if (m_app.framebuffer().width() != width || m_app.framebuffer().height() != height)
+            m_app.resize(width, height);
+
+        if (!interactive && !redisplay && settings.progressive &&
+            m_app.is_converged(settings.camera)) {
+            std::lock_guard lock(m_mutex);
+            m_idle = !m_settings_changed;
+            continue;
+        }
+
+        PROFILE_SCOPE("render");
+        RenderedFrame &frame = m_frames.back();
+        m_app.set_display_target(frame.pixels);
+
+        int const spp    = interactive ? m_budget.spp() : 1;
+        auto const start = std::chrono::steady_clock::now();
+        if (settings.progressive && !interactive)
+            m_app.render_progressive(settings.camera);
+        else
+            m_app.render(settings.camera, spp);
+        auto const elapsed    = std::chrono::steady_clock::now() - start;
+        float const render_ms = std::chrono::duration<float, std::milli>(elapsed).count();
+        if (interactive)
+            m_budget.update(settings.budget, render_ms);
+
+        bool const accumulating     = settings.progressive && !interactive;
+        auto const &accumulator     = m_app.accumulator();
+        frame.width                 = width;
+        frame.height                = height;
+        frame.stats.render_ms       = render_ms;
+        frame.stats.passes          = accumulating ? accumulator.passes() : 0;
+        frame.stats.converged_tiles = accumulating ? accumulator.converged_tiles() : 0;
+        frame.stats.tile_count      = accumulator.tile_count();
+        frame.stats.interactive     = interactive;
+        frame.stats.spp             = spp;
+
+        m_frames.publish();
+        if (m_on_frame)
+            m_on_frame();
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "render/accumulator.h"
+#include "render/camera.h"
+#include "render/denoiser.h"
+#include "render/frame_budget.h"
+#include "ui/cpu_application.h"
+#include "utils/triple_buffer.h"
+
+/// what the UI wants rendered, handed to the render thread once per frame
+struct RenderSettings {
+    Camera camera;
+    bool progressive = true;
+    AdaptiveSettings adaptive;
+    /// resolution and samples per pixel while the camera moves
+    FrameBudgetSettings budget;
+    DenoiserSettings denoise;
+    IntegratorSettings integrator;
+    /// bumped to throw away the progressive estimate
+    uint32_t restart = 0;
+
+    auto operator==(RenderSettings const &) const -> bool = default;
+};
+
+/// what the render thread reports about a finished frame
+struct FrameStats {
+    float render_ms        = 0.0f;
+    uint32_t passes        = 0;
+    size_t converged_tiles = 0;
+    size_t tile_count      = 0;
+    /// rendered at reduced resolution because the camera moves, see `FrameBudget`
+    bool interactive = false;
+    int spp          = 1;
+};
+
+/// one slot of the handoff between render and UI thread
+struct RenderedFrame {
+    /// the display version of the image, rows top to bottom, tightly packed
+    uint32_t *pixels = nullptr;
+    int width        = 0;
+    int height       = 0;
+    FrameStats stats;
+};
+
+/// Renders on its own thread so input, window dragging and ImGui never wait for tracing and a slow
+/// frame never freezes the UI.
+///
+/// Finished frames are handed over through a `TripleBuffer`: the UI always shows the latest one
+/// and the renderer never waits for the UI. Once the progressive estimate has converged the thread
+/// sleeps until the settings change.
+class RenderLoop {
+    CPUApplication &m_app;
+    TripleBuffer<RenderedFrame> m_frames;
+    /// client memory for slots without a mapped pixel buffer
+    std::array<std::vector<uint32_t>, 3> m_fallback;
+    /// called on the render thread after every published frame, wakes the UI
+    std::function<void()> m_on_frame;
+
+    /// resolution of the framebuffer at construction, what converged frames are rendered at
+    int m_full_width;
+    int m_full_height;
+    /// touched by the render thread only
+    FrameBudget m_budget;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    RenderSettings m_settings;
+    bool m_settings_changed = true;
+    bool m_stop             = false;
+    /// nothing left to render for the current settings
+    bool m_idle = false;
+
+    std::thread m_thread;
+
+    void run();
+
+  public:
+    /// @brief starts the render thread
+    /// @param slot_pixels memory for the image of every slot, at least as large as the
+    /// framebuffer of `app`. `nullptr` entries get client memory.
+    /// @param on_frame called from the render thread whenever a frame is published
+    RenderLoop(CPUApplication &app, std::array<uint32_t *, 3> const &slot_pixels,
+               std::function<void()> on_frame);
+    /// stops and joins the render thread
+    ~RenderLoop();
+
+    RenderLoop(RenderLoop const &)                     = delete;
+    auto operator=(RenderLoop const &) -> RenderLoop & = delete;
+
+    /// takes effect at the start of the next frame, wakes the thread if it was idle
+    void set_settings(RenderSettings const &settings);
+
+    // ---- UI thread ------------------------------------------------------------------------------
+
+    /// true if a newer frame than `front()` is ready
+    auto has_frame() const -> bool { return m_frames.has_update(); }
+    /// makes the newest frame `front()`, its old slot goes back to the renderer
+    auto update() -> bool { return m_frames.update(); }
+    auto front() -> RenderedFrame & { return m_frames.front(); }
+    auto front_index() const -> int { return m_frames.front_index(); }
+};
@@ -0,0 +1,99 @@
+#include "arena.h"
+
+#include <algorithm>
+
+#include "utils/thread_pool.h"
+
+Arena::Arena(size_t block_size) : m_block_size(block_size) {}
+
+void Arena::add_block(size_t size) {
+    m_blocks.push_back({std::make_unique_for_overwrite<std::byte[]>(size), size});
+    m_capacity.fetch_add(size, std::memory_order_relaxed);
+    m_block_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+auto Arena::allocate_slow(size_t bytes, size_t alignment) -> void * {
+    // move on to the next block that fits, adding one if there is none
+    if (!m_blocks.empty())
+        m_base += m_blocks[m_current].size;
+    size_t next = m_blocks.empty() ? 0 : m_current + 1;
+    while (next < m_blocks.size() && m_blocks[next].size < bytes + alignment) {
+        m_base += m_blocks[next].size;
+        ++next;
+    }
+    if (next == m_blocks.size()) {
+        size_t const previous = m_blocks.empty() ? m_block_size / 2 : m_blocks.back().size;
+        add_block(std::max(2 * previous, bytes + alignment));
+    }
+    m_current = next;
+    m_offset  = 0;
+    return allocate(bytes, alignment);
+}
+
+void Arena::rewind(Marker marker) {
+    if (marker.block != m_current) {
+        m_base = 0;
+        for (size_t i = 0; i < marker.block; ++i)
+            m_base += m_blocks[i].size;
+    }
+    m_current = marker.block;
+    m_offset  = marker.offset;
+    m_used.store(m_base + m_offset, std::memory_order_relaxed);
+}
+
+void Arena::reset() {
+    if (m_blocks.size() > 1) {
+        size_t const total = m_capacity.load(std::memory_order_relaxed);
+        m_blocks.clear();
+        m_capacity.store(0, std::memory_order_relaxed);
+        add_block(total);
+    }
+    rewind({0, 0});
+}
+
+auto Arena::stats() const -> ArenaStats {
+    return {m_used.load(std::memory_order_relaxed), m_high_water.load(std::memory_order_relaxed),
+            m_capacity.load(std::memory_order_relaxed),
+            m_block_allocations.load(std::memory_order_relaxed)};
+}
+
+// ---- WorkerArenas -------------------------------------------------------------------------------
+
+WorkerArenas::WorkerArenas(ThreadPool &pool, size_t block_size)
+    : m_pool(pool), m_block_size(block_size) {
+    for (unsigned i = 0; i < pool.size(); ++i)
+        m_arenas.push_back(std::make_unique<Arena>(block_size));
+}
+
+auto WorkerArenas::local() -> Arena & {
+    int const worker = m_pool.worker_index();
+    if (worker >= 0)
+        return *m_arenas[static_cast<size_t>(worker)];
+
+    auto const id = std::this_thread::get_id();
+    std::lock_guard lock(m_outside_mutex);
+    for (auto const &[thread, arena] : m_outside) {
+        if (thread == id)
+            return *arena;
+    }
+    return *m_outside.emplace_back(id, std::make_unique<Arena>(m_block_size)).second;
+}
+
+void WorkerArenas::reset() {
+    for (auto &arena : m_arenas)
+        arena->reset();
+    std::lock_guard lock(m_outside_mutex);
+    for (auto &[thread, arena] : m_outside)
+        arena->reset();
+}
+
+auto WorkerArenas::stats() const -> std::vector<ArenaStats> {
+    std::vector<ArenaStats> stats;
+    stats.reserve(m_arenas.size());
+    for (auto const &arena : m_arenas)
+        stats.push_back(arena->stats());
+    std::lock_guard lock(m_outside_mutex);
+    for (auto const &[thread, arena] : m_outside)
+        stats.push_back(arena->stats());
+    return stats;
+}
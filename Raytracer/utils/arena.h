@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+struct ArenaStats {
+    /// bytes handed out since the last reset
+    size_t used = 0;
+    /// most bytes that were in use at once since the arena was created
+    size_t high_water = 0;
+    /// bytes of memory the arena holds
+    size_t capacity = 0;
+    /// blocks requested from the system since the arena was created, stops growing once the
+    /// arena has seen the largest frame
+    uint64_t block_allocations = 0;
+};
+
+/// Bump allocator for data that lives for a tile or a frame.
+///
+/// Allocating moves a pointer, freeing happens all at once by rewinding to a `marker()` or with
+/// `reset()`, both without touching the system allocator. When a frame needs more than the
+/// current block another block is added; `reset()` then merges the blocks into one that fits the
+/// whole frame, so in steady state every frame runs out of a single block and allocates nothing.
+///
+/// Only trivially destructible types can live in an arena, nothing is destroyed. An arena belongs
+/// to one thread, only the stats may be read from others.
+class Arena {
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> m_blocks;
+    /// block allocations come from and the offset of its free space
+    size_t m_current = 0;
+    size_t m_offset  = 0;
+    /// bytes in the blocks before `m_current`
+    size_t m_base       = 0;
+    size_t m_block_size = 0;
+
+    std::atomic<size_t> m_used{0};
+    std::atomic<size_t> m_high_water{0};
+    std::atomic<size_t> m_capacity{0};
+    std::atomic<uint64_t> m_block_allocations{0};
+
+    void add_block(size_t size);
+    auto allocate_slow(size_t bytes, size_t alignment) -> void *;
+
+  public:
+    /// position to go back to with `rewind()`
+    struct Marker {
+        size_t block;
+        size_t offset;
+    };
+
+    /// @param block_size size of the first block, later blocks double
+    explicit Arena(size_t block_size = size_t{1} << 20);
+
+    Arena(Arena const &)                     = delete;
+    auto operator=(Arena const &) -> Arena & = delete;
+
+    /// @brief uninitialised memory for `bytes` bytes
+    /// @param alignment a power of two
+    auto allocate(size_t bytes, size_t alignment) -> void * {
+        if (!m_blocks.empty()) {
+            auto const start   = reinterpret_cast<uintptr_t>(m_blocks[m_current].data.get());
+            auto const aligned = (start + m_offset + alignment - 1) & ~(alignment - 1);
+            size_t const end   = aligned - start + bytes;
+            if (end <= m_blocks[m_current].size) {
+                m_offset = end;
+                note_used(m_base + end);
+                return reinterpret_cast<void *>(aligned);
+            }
+        }
+        return allocate_slow(bytes, alignment);
+    }
+
+    /// uninitialised array of `count` elements
+    template <typename T> auto allocate(size_t count) -> T * {
+        static_assert(std::is_trivially_destructible_v<T>,
+                      "arena memory is released without running destructors");
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    auto marker() const -> Marker { return {m_current, m_offset}; }
+    /// frees everything allocated after `marker` was taken
+    void rewind(Marker marker);
+
+    /// frees everything, merging the blocks into one if there is more than one
+    void reset();
+
+    auto stats() const -> ArenaStats;
+
+  private:
+    void note_used(size_t used) {
+        m_used.store(used, std::memory_order_relaxed);
+        if (used > m_high_water.load(std::memory_order_relaxed))
+            m_high_water.store(used, std::memory_order_relaxed);
+    }
+};
+
+/// rewinds an arena to where it was at construction when it goes out of scope
+class ArenaScope {
+    Arena &m_arena;
+    Arena::Marker m_marker;
+
+  public:
+    explicit ArenaScope(Arena &arena) : m_arena(arena), m_marker(arena.marker()) {}
+    ~ArenaScope() { m_arena.rewind(m_marker); }
+
+    ArenaScope(ArenaScope const &)                     = delete;
+    auto operator=(ArenaScope const &) -> ArenaScope & = delete;
+};
+
+/// One arena per worker of a `ThreadPool`, plus one for every thread outside of it that takes part
+/// in `parallel_for()`, created when it first asks. Several outside threads may share the pool,
+/// e.g. the job threads of a `Renderer` that help with each other's tiles while they wait.
+class WorkerArenas {
+    ThreadPool &m_pool;
+    size_t m_block_size;
+    std::vector<std::unique_ptr<Arena>> m_arenas;
+    mutable std::mutex m_outside_mutex;
+    std::vector<std::pair<std::thread::id, std::unique_ptr<Arena>>> m_outside;
+
+  public:
+    explicit WorkerArenas(ThreadPool &pool, size_t block_size = size_t{1} << 20);
+
+    /// the arena of the calling thread
+    auto local() -> Arena &;
+
+    /// resets every arena, at frame boundaries while no task runs
+    void reset();
+
+    /// stats of every arena, the workers' first, then the outside threads' in the order they
+    /// first used theirs
+    auto stats() const -> std::vector<ArenaStats>;
+};
@@ -0,0 +1,133 @@
+#include "async_log_sink.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <spdlog/details/log_msg.h>
+#include <spdlog/fmt/fmt.h>
+
+namespace {
+// the ring of the calling thread and the sink it belongs to
+struct ThreadSlot {
+    AsyncLogSink const *owner = nullptr;
+    std::shared_ptr<AsyncLogSink::ThreadRing> ring;
+};
+thread_local ThreadSlot t_slot;
+} // namespace
+
+AsyncLogSink::AsyncLogSink(std::shared_ptr<spdlog::sinks::sink> target, AsyncLogSettings settings)
+    : m_target(std::move(target)), m_settings(settings) {
+    m_settings.capacity = std::max<size_t>(m_settings.capacity, 1);
+}
+
+auto AsyncLogSink::thread_ring() -> ThreadRing & {
+    if (t_slot.owner != this) {
+        auto ring = std::make_shared<ThreadRing>();
+        ring->entries.resize(m_settings.capacity);
+        ring->tokens   = m_settings.burst;
+        ring->refilled = spdlog::log_clock::now();
+        {
+            std::lock_guard lock(m_rings_mutex);
+            m_rings.push_back(ring);
+        }
+        t_slot = {this, std::move(ring)};
+    }
+    return *t_slot.ring;
+}
+
+void AsyncLogSink::log(spdlog::details::log_msg const &msg) {
+    if (!should_log(msg.level))
+        return;
+    ThreadRing &ring = thread_ring();
+
+    // token bucket: refill by the time since the last message, errors always get through
+    double const seconds = std::chrono::duration<double>(msg.time - ring.refilled).count();
+    ring.refilled        = msg.time;
+    ring.tokens          = std::min(m_settings.burst, ring.tokens + seconds * m_settings.rate);
+    if (msg.level < spdlog::level::err) {
+        if (ring.tokens < 1.0) {
+            ring.rate_limited.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring.tokens -= 1.0;
+    }
+
+    uint64_t const head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= ring.entries.size()) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Entry &entry    = ring.entries[head % ring.entries.size()];
+    size_t const n  = std::min(msg.payload.size(), Entry::MAX_TEXT);
+    entry.time      = msg.time;
+    entry.thread_id = msg.thread_id;
+    entry.level     = msg.level;
+    entry.length    = static_cast<uint16_t>(n);
+    std::memcpy(entry.text, msg.payload.data(), n);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+auto AsyncLogSink::drain() -> size_t {
+    std::lock_guard drain_lock(m_drain_mutex);
+
+    uint64_t dropped      = 0;
+    uint64_t rate_limited = 0;
+    m_pending.clear();
+    {
+        std::lock_guard lock(m_rings_mutex);
+        for (auto it = m_rings.begin(); it != m_rings.end();) {
+            ThreadRing &ring    = **it;
+            uint64_t const head = ring.head.load(std::memory_order_acquire);
+            uint64_t tail       = ring.tail.load(std::memory_order_relaxed);
+            for (; tail != head; ++tail)
+                m_pending.push_back(ring.entries[tail % ring.entries.size()]);
+            ring.tail.store(tail, std::memory_order_release);
+            dropped      += ring.dropped.exchange(0, std::memory_order_relaxed);
+            rate_limited += ring.rate_limited.exchange(0, std::memory_order_relaxed);
+
+            // the thread is gone and its ring is empty
+            if (it->use_count() == 1)
+                it = m_rings.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // every ring is in order, merge them into the order the messages were logged in
+    std::stable_sort(m_pending.begin(), m_pending.end(),
+                     [](Entry const &a, Entry const &b) { return a.time < b.time; });
+
+    for (Entry const &entry : m_pending) {
+        spdlog::details::log_msg msg(entry.time, {}, {}, entry.level,
+                                     spdlog::string_view_t(entry.text, entry.length));
+        msg.thread_id = entry.thread_id;
+        m_target->log(msg);
+    }
+
+    if (dropped + rate_limited > 0) {
+        m_dropped_total.fetch_add(dropped, std::memory_order_relaxed);
+        m_rate_limited_total.fetch_add(rate_limited, std::memory_order_relaxed);
+        auto const text =
+            fmt::format("{} log messages lost ({} over the rate limit, {} queue full)",
+                        dropped + rate_limited, rate_limited, dropped);
+        m_target->log(spdlog::details::log_msg({}, spdlog::level::warn, text));
+    }
+    return m_pending.size();
+}
+
+void AsyncLogSink::flush() {
+    drain();
+    std::lock_guard lock(m_drain_mutex);
+    m_target->flush();
+}
+
+void AsyncLogSink::set_pattern(std::string const &pattern) {
+    std::lock_guard lock(m_drain_mutex);
+    m_target->set_pattern(pattern);
+}
+
+void AsyncLogSink::set_formatter(std::unique_ptr<spdlog::formatter> formatter) {
+    std::lock_guard lock(m_drain_mutex);
+    m_target->set_formatter(std::move(formatter));
+}
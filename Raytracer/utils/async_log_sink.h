@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <spdlog/sinks/sink.h>
+
+struct AsyncLogSettings {
+    /// messages each thread can hold between two drains
+    size_t capacity = 512;
+    /// messages per second and thread that are let through on average
+    double rate = 100.0;
+    /// messages a thread may log in one go before the rate kicks in
+    double burst = 256.0;
+};
+
+/// Non-blocking front end for a slow sink (like the mutex-protected ImGui sink).
+///
+/// Every thread logs into its own single-producer ring, so logging from render threads neither
+/// takes a lock nor waits for the UI. `drain()` forwards the collected messages to the wrapped
+/// sink in the order they were logged, once per frame. Threads that log faster than the rate
+/// limit, or fill their ring before the next drain, lose messages, which is counted and reported.
+class AsyncLogSink final : public spdlog::sinks::sink {
+  public:
+    /// a message, copied out of the `log_msg` that only lives during `log()`
+    struct Entry {
+        static constexpr size_t MAX_TEXT = 240;
+
+        spdlog::log_clock::time_point time;
+        size_t thread_id;
+        spdlog::level::level_enum level;
+        uint16_t length;
+        char text[MAX_TEXT];
+    };
+
+    /// per-thread ring, written by its thread, drained by `drain()`
+    struct ThreadRing {
+        std::vector<Entry> entries;
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> rate_limited{0};
+        // token bucket, only touched by the owning thread
+        double tokens = 0.0;
+        spdlog::log_clock::time_point refilled;
+    };
+
+  private:
+    std::shared_ptr<spdlog::sinks::sink> m_target;
+    AsyncLogSettings m_settings;
+
+    std::mutex m_rings_mutex;
+    std::vector<std::shared_ptr<ThreadRing>> m_rings;
+
+    // consumer side, serialises `drain()`/`flush()` and the formatter of the target
+    std::mutex m_drain_mutex;
+    std::vector<Entry> m_pending;
+    std::atomic<uint64_t> m_dropped_total{0};
+    std::atomic<uint64_t> m_rate_limited_total{0};
+
+    auto thread_ring() -> ThreadRing &;
+
+  public:
+    explicit AsyncLogSink(std::shared_ptr<spdlog::sinks::sink> target,
+                          AsyncLogSettings settings = {});
+
+    /// queues `msg`, never blocks
+    void log(spdlog::details::log_msg const &msg) override;
+    /// same as `drain()`, so `logger->flush()` still gets everything out
+    void flush() override;
+    void set_pattern(std::string const &pattern) override;
+    void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
+
+    /// @brief forwards every queued message to the target sink, plus a warning with the number of
+    /// messages lost since the last drain. Call once per frame.
+    /// @return number of forwarded messages
+    auto drain() -> size_t;
+
+    /// messages lost to full rings, since the start
+    auto dropped() const -> uint64_t { return m_dropped_total.load(std::memory_order_relaxed); }
+    /// messages lost to the rate limit, since the start
+    auto rate_limited() const -> uint64_t {
+        return m_rate_limited_total.load(std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+/// Contiguous array that either owns its elements or is a read only view into memory owned by
+/// someone else, e.g. a mapped file, which it keeps alive. Mutating a view first copies its
+/// elements into owned storage.
+///
+/// The element pointer is cached so that reads cost the same as for a `std::vector`.
+template <typename T> class Buffer {
+    std::vector<T> m_owned;
+    T const *m_data = nullptr;
+    size_t m_size   = 0;
+    /// set for views only
+    std::shared_ptr<void const> m_owner;
+
+    void sync() {
+        if (!m_owner) {
+            m_data = m_owned.data();
+            m_size = m_owned.size();
+        }
+    }
+
+  public:
+    Buffer() = default;
+    Buffer(std::initializer_list<T> values) : m_owned(values) { sync(); }
+    Buffer(std::vector<T> values) : m_owned(std::move(values)) { sync(); }
+
+    Buffer(Buffer const &other)
+        : m_owned(other.m_owned), m_data(other.m_data), m_size(other.m_size),
+          m_owner(other.m_owner) {
+        sync();
+    }
+    Buffer(Buffer &&other) noexcept
+        : m_owned(std::move(other.m_owned)), m_data(other.m_data), m_size(other.m_size),
+          m_owner(std::move(other.m_owner)) {
+        sync();
+        other.m_owned.clear();
+        other.m_owner.reset();
+        other.sync();
+    }
+    auto operator=(Buffer other) noexcept -> Buffer & {
+        std::swap(m_owned, other.m_owned);
+        std::swap(m_owner, other.m_owner);
+        m_data = other.m_data;
+        m_size = other.m_size;
+        sync();
+        return *this;
+    }
+
+    /// @brief a view of `size` elements at `data`
+    /// @param owner keeps `data` alive as long as the view (or a copy of it) exists
+    static auto view(T const *data, size_t size, std::shared_ptr<void const> owner) -> Buffer {
+        Buffer buffer;
+        buffer.m_data  = data;
+        buffer.m_size  = size;
+        buffer.m_owner = std::move(owner);
+        return buffer;
+    }
+
+    auto is_view() const -> bool { return m_owner != nullptr; }
+
+    auto size() const -> size_t { return m_size; }
+    auto empty() const -> bool { return m_size == 0; }
+    auto data() const -> T const * { return m_data; }
+    auto operator[](size_t i) const -> T const & { return m_data[i]; }
+    auto begin() const -> T const * { return m_data; }
+    auto end() const -> T const * { return m_data + m_size; }
+
+    // ---- Mutation, turns views into owned storage -----------------------------------------------
+
+    void push_back(T const &value) {
+        detach().push_back(value);
+        sync();
+    }
+    void append(std::initializer_list<T> values) {
+        detach().insert(m_owned.end(), values);
+        sync();
+    }
+    void clear() {
+        detach().clear();
+        sync();
+    }
+
+  private:
+    auto detach() -> std::vector<T> & {
+        if (m_owner) {
+            m_owned.assign(m_data, m_data + m_size);
+            m_owner.reset();
+        }
+        return m_owned;
+    }
+};
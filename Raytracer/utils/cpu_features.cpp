@@ -0,0 +1,141 @@
+#include "cpu_features.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef RT_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#ifdef RT_X86
+void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+    for (int i = 0; i < 4; ++i)
+        regs[i] = static_cast<uint32_t>(r[i]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/// register state the OS saves on context switches, tells whether AVX/AVX-512 registers are usable
+auto xgetbv0() -> uint64_t {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+auto query() -> CpuFeatures {
+    CpuFeatures features;
+#ifdef RT_X86
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    uint32_t const max_leaf = regs[0];
+
+    cpuid(1, 0, regs);
+    features.sse41      = regs[2] & (1u << 19);
+    bool const osxsave  = regs[2] & (1u << 27);
+    bool const avx_bit  = regs[2] & (1u << 28);
+    bool const fma_bit  = regs[2] & (1u << 12);
+    bool const f16c_bit = regs[2] & (1u << 29);
+
+    uint64_t const xcr0  = osxsave ? xgetbv0() : 0;
+    bool const os_avx    = (xcr0 & 0x6) == 0x6;
+    bool const os_avx512 = (xcr0 & 0xe6) == 0xe6;
+
+    features.avx  = avx_bit && os_avx;
+    features.fma  = fma_bit && os_avx;
+    features.f16c = f16c_bit && os_avx;
+
+    if (max_leaf >= 7) {
+        cpuid(7, 0, regs);
+        features.avx2     = features.avx && (regs[1] & (1u << 5));
+        features.avx512f  = os_avx512 && (regs[1] & (1u << 16));
+        features.avx512vl = os_avx512 && (regs[1] & (1u << 31));
+    }
+
+    // the brand string is spread over three extended leaves, 16 characters each
+    cpuid(0x80000000u, 0, regs);
+    if (regs[0] >= 0x80000004u) {
+        char brand[49] = {};
+        for (uint32_t leaf = 0; leaf < 3; ++leaf) {
+            cpuid(0x80000002u + leaf, 0, regs);
+            std::memcpy(brand + 16 * leaf, regs, 16);
+        }
+        features.brand = brand;
+        auto const first = features.brand.find_first_not_of(' ');
+        auto const last  = features.brand.find_last_not_of(' ');
+        features.brand   = first == std::string::npos
+                               ? std::string{}
+                               : features.brand.substr(first, last - first + 1);
+    }
+#endif
+    return features;
+}
+
+} // namespace
+
+auto cpu_features() -> CpuFeatures const & {
+    static CpuFeatures const features = query();
+    return features;
+}
+
+auto simd_level_name(SimdLevel level) -> char const * {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return "scalar";
+    case SimdLevel::Sse41:
+        return "sse4.1";
+    case SimdLevel::Avx2:
+        return "avx2";
+    case SimdLevel::Avx512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+auto parse_simd_level(std::string_view name, SimdLevel &level) -> bool {
+    for (auto candidate :
+         {SimdLevel::Scalar, SimdLevel::Sse41, SimdLevel::Avx2, SimdLevel::Avx512}) {
+        if (name == simd_level_name(candidate)) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+auto best_simd_level() -> SimdLevel {
+    auto const &f = cpu_features();
+    if (f.avx512f && f.avx512vl && f.avx2 && f.fma)
+        return SimdLevel::Avx512;
+    if (f.avx2 && f.fma)
+        return SimdLevel::Avx2;
+    if (f.sse41)
+        return SimdLevel::Sse41;
+    return SimdLevel::Scalar;
+}
+
+auto default_simd_level() -> SimdLevel {
+    SimdLevel level = best_simd_level();
+    if (char const *name = std::getenv("RT_SIMD")) {
+        SimdLevel requested;
+        if (parse_simd_level(name, requested))
+            level = std::min(level, requested);
+    }
+    return level;
+}
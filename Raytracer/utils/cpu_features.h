@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RT_X86 1
+#endif
+
+/// Marks a function as compiled for the given instruction set extensions (GCC/Clang spelling,
+/// e.g. `RT_TARGET("avx2,fma")`). MSVC emits any intrinsic without extra flags, so it's empty
+/// there. Only call such functions after checking `cpu_features()`.
+#if defined(RT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define RT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RT_TARGET(isa)
+#endif
+
+/// instruction set extensions of the host CPU that are also enabled by the OS
+struct CpuFeatures {
+    bool sse41    = false;
+    bool avx      = false;
+    bool avx2     = false;
+    bool fma      = false;
+    bool f16c     = false;
+    bool avx512f  = false;
+    bool avx512vl = false;
+    /// processor name as reported by CPUID, empty if unknown
+    std::string brand;
+};
+
+/// queried once via CPUID/XGETBV
+auto cpu_features() -> CpuFeatures const &;
+
+/// SIMD code paths, ordered from least to most capable
+enum class SimdLevel { Scalar, Sse41, Avx2, Avx512 };
+
+auto simd_level_name(SimdLevel level) -> char const *;
+
+/// parses the names returned by `simd_level_name()`, returns false for unknown names
+auto parse_simd_level(std::string_view name, SimdLevel &level) -> bool;
+
+/// the best level the host supports
+auto best_simd_level() -> SimdLevel;
+
+/// `best_simd_level()`, unless the `RT_SIMD` environment variable names a lower one
+auto default_simd_level() -> SimdLevel;
@@ -0,0 +1,237 @@
+#include "json_reader.h"
+
+#include <charconv>
+#include <cstdint>
+
+#include <spdlog/spdlog.h>
+
+namespace {
+
+/// nesting depth at which parsing gives up instead of overflowing the stack
+constexpr int MAX_DEPTH = 256;
+
+void append_utf8(std::string &out, uint32_t code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+} // namespace
+
+/// recursive descent over the text, stops at the first error
+class JsonValue::Parser {
+    std::string_view m_text;
+    size_t m_pos = 0;
+    std::string m_error;
+
+    void skip_whitespace() {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' ||
+                                         m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+            ++m_pos;
+    }
+
+    auto fail(std::string_view what) -> bool {
+        if (m_error.empty())
+            m_error = fmt::format("{} at offset {}", what, m_pos);
+        return false;
+    }
+
+    auto consume(char c) -> bool {
+        skip_whitespace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    auto literal(std::string_view word) -> bool {
+        if (m_text.substr(m_pos, word.size()) != word)
+            return fail("invalid literal");
+        m_pos += word.size();
+        return true;
+    }
+
+    auto hex4(uint32_t &code) -> bool {
+        if (m_pos + 4 > m_text.size())
+            return fail("truncated escape");
+        char const *begin       = m_text.data() + m_pos;
+        auto const [end, error] = std::from_chars(begin, begin + 4, code, 16);
+        if (error != std::errc{} || end != begin + 4)
+            return fail("invalid escape");
+        m_pos += 4;
+        return true;
+    }
+
+    auto parse_string(std::string &out) -> bool {
+        // the opening quote is consumed by the caller
+        for (;;) {
+            if (m_pos >= m_text.size())
+                return fail("unterminated string");
+            char const c = m_text[m_pos++];
+            if (c == '"')
+                return true;
+            if (static_cast<unsigned char>(c) < 0x20)
+                return fail("control character in string");
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (m_pos >= m_text.size())
+                return fail("unterminated string");
+            switch (char const escaped = m_text[m_pos++]) {
+            case '"':
+            case '\\':
+            case '/':
+                out += escaped;
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u': {
+                uint32_t code = 0;
+                if (!hex4(code))
+                    return false;
+                // a high surrogate followed by a low one encodes a code point above the BMP
+                if (code >= 0xD800 && code < 0xDC00 && m_text.substr(m_pos, 2) == "\\u") {
+                    m_pos        += 2;
+                    uint32_t low  = 0;
+                    if (!hex4(low))
+                        return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(out, code);
+                break;
+            }
+            default:
+                return fail("invalid escape");
+            }
+        }
+    }
+
+    auto parse_number(double &out) -> bool {
+        size_t const begin = m_pos;
+        while (m_pos < m_text.size() &&
+               std::string_view("+-0123456789.eE").find(m_text[m_pos]) != std::string_view::npos)
+            ++m_pos;
+        auto const [end, error] =
+            std::from_chars(m_text.data() + begin, m_text.data() + m_pos, out);
+        if (error != std::errc{} || end != m_text.data() + m_pos)
+            return fail("invalid number");
+        return true;
+    }
+
+  public:
+    explicit Parser(std::string_view text) : m_text(text) {}
+
+    auto error() const -> std::string const & { return m_error; }
+
+    auto parse_value(JsonValue &value, int depth) -> bool {
+        if (depth > MAX_DEPTH)
+            return fail("nested too deeply");
+        skip_whitespace();
+        if (m_pos >= m_text.size())
+            return fail("unexpected end");
+
+        char const c = m_text[m_pos];
+        if (c == '{') {
+            ++m_pos;
+            value.m_type = Type::Object;
+            if (consume('}'))
+                return true;
+            do {
+                if (!consume('"'))
+                    return fail("expected a member name");
+                std::string key;
+                if (!parse_string(key))
+                    return false;
+                if (!consume(':'))
+                    return fail("expected ':'");
+                value.m_keys.push_back(std::move(key));
+                if (!parse_value(value.m_elements.emplace_back(), depth + 1))
+                    return false;
+            } while (consume(','));
+            return consume('}') || fail("expected ',' or '}'");
+        }
+        if (c == '[') {
+            ++m_pos;
+            value.m_type = Type::Array;
+            if (consume(']'))
+                return true;
+            do {
+                if (!parse_value(value.m_elements.emplace_back(), depth + 1))
+                    return false;
+            } while (consume(','));
+            return consume(']') || fail("expected ',' or ']'");
+        }
+        if (c == '"') {
+            ++m_pos;
+            value.m_type = Type::String;
+            return parse_string(value.m_string);
+        }
+        if (c == 't' || c == 'f') {
+            value.m_type = Type::Bool;
+            value.m_bool = c == 't';
+            return literal(value.m_bool ? "true" : "false");
+        }
+        if (c == 'n')
+            return literal("null");
+        value.m_type = Type::Number;
+        return parse_number(value.m_number);
+    }
+
+    auto at_end() -> bool {
+        skip_whitespace();
+        return m_pos == m_text.size() || fail("trailing characters");
+    }
+};
+
+auto JsonValue::parse(std::string_view text) -> std::optional<JsonValue> {
+    Parser parser(text);
+    JsonValue value;
+    if (!parser.parse_value(value, 0) || !parser.at_end()) {
+        spdlog::error("invalid JSON: {}", parser.error());
+        return std::nullopt;
+    }
+    return value;
+}
+
+auto JsonValue::operator[](size_t index) const -> JsonValue const & {
+    static JsonValue const null;
+    return m_type == Type::Array && index < m_elements.size() ? m_elements[index] : null;
+}
+
+auto JsonValue::operator[](std::string_view key) const -> JsonValue const & {
+    static JsonValue const null;
+    if (m_type == Type::Object) {
+        for (size_t i = 0; i < m_keys.size(); ++i) {
+            if (m_keys[i] == key)
+                return m_elements[i];
+        }
+    }
+    return null;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Parsed JSON document, the counterpart of `JsonWriter` for reading reports back in. Lookups
+/// never fail: a missing member or element, or one of another type, reads as `null`, so
+/// optional parts of a document can be walked without checking every step.
+///
+///     auto report = JsonValue::parse(text);
+///     double const ms = (*report)["scenes"][0]["build_ms"].number();
+class JsonValue {
+  public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+  private:
+    Type m_type     = Type::Null;
+    bool m_bool     = false;
+    double m_number = 0.0;
+    std::string m_string;
+    /// elements of arrays and member values of objects
+    std::vector<JsonValue> m_elements;
+    /// member names of objects, in the order of the document
+    std::vector<std::string> m_keys;
+
+    class Parser;
+
+  public:
+    /// @brief parses a complete document
+    /// @return nothing if `text` isn't valid JSON, the reason is logged
+    static auto parse(std::string_view text) -> std::optional<JsonValue>;
+
+    auto type() const -> Type { return m_type; }
+    auto is_null() const -> bool { return m_type == Type::Null; }
+    auto is_number() const -> bool { return m_type == Type::Number; }
+
+    auto boolean(bool fallback = false) const -> bool {
+        return m_type == Type::Bool ? m_bool : fallback;
+    }
+    auto number(double fallback = 0.0) const -> double {
+        return m_type == Type::Number ? m_number : fallback;
+    }
+    /// empty unless this is a string
+    auto string() const -> std::string const & { return m_string; }
+
+    /// elements of an array, empty for other types
+    auto elements() const -> std::vector<JsonValue> const & {
+        static std::vector<JsonValue> const none;
+        return m_type == Type::Array ? m_elements : none;
+    }
+    auto size() const -> size_t { return elements().size(); }
+
+    auto operator[](size_t index) const -> JsonValue const &;
+    /// the first member named `key` of an object
+    auto operator[](std::string_view key) const -> JsonValue const &;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Minimal streaming JSON writer for reports and traces. Commas and nesting are tracked, values
+/// are written as soon as they come in.
+///
+///     JsonWriter json(out);
+///     json.begin_object();
+///     json.key("threads").value(8);
+///     json.end_object();
+class JsonWriter {
+    std::ostream &m_out;
+    /// one entry per open object/array, true once it has its first element
+    std::vector<bool> m_has_elements;
+    bool m_after_key = false;
+
+    void separate() {
+        if (m_after_key) {
+            m_after_key = false;
+            return;
+        }
+        if (!m_has_elements.empty()) {
+            if (m_has_elements.back())
+                m_out << ',';
+            m_has_elements.back() = true;
+            m_out << '\n' << std::string(2 * m_has_elements.size(), ' ');
+        }
+    }
+
+    void close(char bracket) {
+        bool const had_elements = m_has_elements.back();
+        m_has_elements.pop_back();
+        if (had_elements)
+            m_out << '\n' << std::string(2 * m_has_elements.size(), ' ');
+        m_out << bracket;
+        if (m_has_elements.empty())
+            m_out << '\n';
+    }
+
+    void write_string(std::string_view text) {
+        m_out << '"';
+        for (char c : text) {
+            switch (c) {
+            case '"':
+                m_out << "\\\"";
+                break;
+            case '\\':
+                m_out << "\\\\";
+                break;
+            case '\n':
+                m_out << "\\n";
+                break;
+            case '\t':
+                m_out << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    m_out << escaped;
+                } else {
+                    m_out << c;
+                }
+            }
+        }
+        m_out << '"';
+    }
+
+  public:
+    explicit JsonWriter(std::ostream &out) : m_out(out) {}
+
+    auto begin_object() -> JsonWriter & {
+        separate();
+        m_out << '{';
+        m_has_elements.push_back(false);
+        return *this;
+    }
+    auto end_object() -> JsonWriter & {
+        close('}');
+        return *this;
+    }
+    auto begin_array() -> JsonWriter & {
+        separate();
+        m_out << '[';
+        m_has_elements.push_back(false);
+        return *this;
+    }
+    auto end_array() -> JsonWriter & {
+        close(']');
+        return *this;
+    }
+
+    /// the key of the next value, only valid inside objects
+    auto key(std::string_view name) -> JsonWriter & {
+        separate();
+        write_string(name);
+        m_out << ": ";
+        m_after_key = true;
+        return *this;
+    }
+
+    auto value(std::string_view text) -> JsonWriter & {
+        separate();
+        write_string(text);
+        return *this;
+    }
+    auto value(char const *text) -> JsonWriter & { return value(std::string_view(text)); }
+    auto value(bool b) -> JsonWriter & {
+        separate();
+        m_out << (b ? "true" : "false");
+        return *this;
+    }
+    auto value(int64_t i) -> JsonWriter & {
+        separate();
+        m_out << i;
+        return *this;
+    }
+    auto value(int i) -> JsonWriter & { return value(static_cast<int64_t>(i)); }
+    auto value(unsigned i) -> JsonWriter & { return value(static_cast<int64_t>(i)); }
+    auto value(uint64_t i) -> JsonWriter & {
+        separate();
+        m_out << i;
+        return *this;
+    }
+    /// non-finite numbers have no JSON representation and are written as `null`
+    auto value(double d) -> JsonWriter & {
+        separate();
+        if (std::isfinite(d)) {
+            char number[32];
+            std::snprintf(number, sizeof(number), "%.10g", d);
+            m_out << number;
+        } else {
+            m_out << "null";
+        }
+        return *this;
+    }
+};
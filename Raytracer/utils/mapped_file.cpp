@@ -0,0 +1,92 @@
+#include "mapped_file.h"
+
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+auto MappedFile::open(std::filesystem::path const &path) -> std::shared_ptr<MappedFile const> {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+
+    file->m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file->m_file == INVALID_HANDLE_VALUE) {
+        file->m_file = nullptr;
+        spdlog::error("couldn't open {}", path.string());
+        return nullptr;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->m_file, &size)) {
+        spdlog::error("couldn't get the size of {}", path.string());
+        return nullptr;
+    }
+    file->m_size = static_cast<size_t>(size.QuadPart);
+    if (file->m_size == 0)
+        return file;
+
+    file->m_mapping = CreateFileMappingW(file->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file->m_mapping)
+        file->m_data = MapViewOfFile(file->m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!file->m_data) {
+        spdlog::error("couldn't map {}", path.string());
+        return nullptr;
+    }
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+}
+
+#else
+
+auto MappedFile::open(std::filesystem::path const &path) -> std::shared_ptr<MappedFile const> {
+    int const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        spdlog::error("couldn't open {}", path.string());
+        return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    struct stat info {};
+    if (fstat(fd, &info) != 0) {
+        spdlog::error("couldn't get the size of {}", path.string());
+        ::close(fd);
+        return nullptr;
+    }
+    file->m_size = static_cast<size_t>(info.st_size);
+
+    if (file->m_size > 0) {
+        void *data = mmap(nullptr, file->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            spdlog::error("couldn't map {}", path.string());
+            ::close(fd);
+            return nullptr;
+        }
+        file->m_data = data;
+    }
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (m_data)
+        munmap(const_cast<void *>(m_data), m_size);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+
+/// A file mapped read only into memory. The mapping starts on a page boundary, so data placed at
+/// aligned file offsets is equally aligned in memory.
+class MappedFile {
+    void const *m_data = nullptr;
+    size_t m_size      = 0;
+#ifdef _WIN32
+    void *m_file    = nullptr;
+    void *m_mapping = nullptr;
+#endif
+
+    MappedFile() = default;
+
+  public:
+    /// @brief maps the whole of `path`
+    /// @return nullptr if the file can't be opened or mapped, the reason is logged
+    static auto open(std::filesystem::path const &path) -> std::shared_ptr<MappedFile const>;
+
+    MappedFile(MappedFile const &)                     = delete;
+    auto operator=(MappedFile const &) -> MappedFile & = delete;
+    ~MappedFile();
+
+    auto data() const -> std::byte const * { return static_cast<std::byte const *>(m_data); }
+    auto size() const -> size_t { return m_size; }
+};
@@ -0,0 +1,176 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+#include "utils/json_writer.h"
+
+namespace {
+// the calling thread's buffer, also owned by the profiler so it survives until it's drained
+thread_local std::shared_ptr<Profiler::ThreadBuffer> t_buffer;
+
+auto clock_ns() -> int64_t {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+} // namespace
+
+auto FrameProfile::summary() const -> std::vector<ZoneSummary> {
+    std::vector<ZoneSummary> zones;
+    std::vector<int64_t> first_start;
+    for (auto const &thread : threads) {
+        for (auto const &event : thread.events) {
+            size_t i = 0;
+            while (i < zones.size() &&
+                   (zones[i].depth != event.depth || std::string_view(zones[i].name) != event.name))
+                ++i;
+            if (i == zones.size()) {
+                zones.push_back({event.name, event.depth, 0, 0.0});
+                first_start.push_back(event.start);
+            }
+            zones[i].calls    += 1;
+            zones[i].total_ms += static_cast<double>(event.end - event.start) * 1.0e-6;
+            first_start[i]     = std::min(first_start[i], event.start);
+        }
+    }
+
+    std::vector<size_t> order(zones.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return first_start[a] < first_start[b]; });
+
+    std::vector<ZoneSummary> sorted;
+    sorted.reserve(zones.size());
+    for (size_t i : order)
+        sorted.push_back(zones[i]);
+    return sorted;
+}
+
+Profiler::Profiler() : m_epoch(clock_ns()), m_frame_start(0) {}
+
+auto Profiler::instance() -> Profiler & {
+    static Profiler profiler;
+    return profiler;
+}
+
+auto Profiler::now() const -> int64_t { return clock_ns() - m_epoch; }
+
+auto Profiler::thread_buffer() -> ThreadBuffer & {
+    if (!t_buffer) {
+        auto buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard lock(m_threads_mutex);
+        buffer->id   = m_next_thread_id++;
+        buffer->name = "thread " + std::to_string(buffer->id);
+        m_threads.push_back(buffer);
+        t_buffer = std::move(buffer);
+    }
+    return *t_buffer;
+}
+
+void Profiler::set_thread_name(std::string name) {
+    auto &buffer = thread_buffer();
+    std::lock_guard lock(m_threads_mutex);
+    buffer.name = std::move(name);
+}
+
+void Profiler::end_frame() {
+    FrameProfile frame;
+    frame.start   = m_frame_start;
+    frame.end     = now();
+    m_frame_start = frame.end;
+
+    std::lock_guard lock(m_threads_mutex);
+    for (auto it = m_threads.begin(); it != m_threads.end();) {
+        auto &buffer = **it;
+
+        FrameProfile::Thread thread{buffer.id, buffer.name, {}};
+        uint64_t const head = buffer.head.load(std::memory_order_acquire);
+        uint64_t tail       = buffer.tail.load(std::memory_order_relaxed);
+        thread.events.reserve(head - tail);
+        for (; tail != head; ++tail)
+            thread.events.push_back(buffer.events[tail % ThreadBuffer::CAPACITY]);
+        buffer.tail.store(tail, std::memory_order_release);
+        m_dropped += buffer.dropped.exchange(0, std::memory_order_relaxed);
+
+        // zones are pushed when they close, so parents come after their children
+        std::sort(thread.events.begin(), thread.events.end(),
+                  [](ProfileEvent const &a, ProfileEvent const &b) {
+                      return a.start < b.start || (a.start == b.start && a.depth < b.depth);
+                  });
+        if (!thread.events.empty())
+            frame.threads.push_back(std::move(thread));
+
+        // the thread has exited and everything it recorded is collected
+        if (it->use_count() == 1)
+            it = m_threads.erase(it);
+        else
+            ++it;
+    }
+
+    m_history.push_back(std::move(frame));
+    while (m_history.size() > m_history_size)
+        m_history.pop_front();
+}
+
+auto Profiler::last_frame() const -> FrameProfile const & {
+    static FrameProfile const empty;
+    return m_history.empty() ? empty : m_history.back();
+}
+
+auto Profiler::export_chrome_trace(std::filesystem::path const &path) const -> bool {
+    std::ofstream out(path);
+    if (!out) {
+        spdlog::error("Can't write trace \"{}\"", path.string());
+        return false;
+    }
+
+    JsonWriter json(out);
+    json.begin_object();
+    json.key("displayTimeUnit").value("ms");
+    json.key("traceEvents").begin_array();
+
+    std::vector<std::pair<uint32_t, std::string>> names;
+    size_t events = 0;
+    for (auto const &frame : m_history) {
+        for (auto const &thread : frame.threads) {
+            if (std::find(names.begin(), names.end(), std::pair{thread.id, thread.name}) ==
+                names.end())
+                names.emplace_back(thread.id, thread.name);
+            for (auto const &event : thread.events) {
+                json.begin_object();
+                json.key("name").value(event.name);
+                json.key("ph").value("X");
+                json.key("ts").value(static_cast<double>(event.start) * 1.0e-3);
+                json.key("dur").value(static_cast<double>(event.end - event.start) * 1.0e-3);
+                json.key("pid").value(0);
+                json.key("tid").value(thread.id);
+                json.end_object();
+                ++events;
+            }
+        }
+    }
+
+    for (auto const &[id, name] : names) {
+        json.begin_object();
+        json.key("name").value("thread_name");
+        json.key("ph").value("M");
+        json.key("pid").value(0);
+        json.key("tid").value(id);
+        json.key("args").begin_object().key("name").value(name).end_object();
+        json.end_object();
+    }
+
+    json.end_array();
+    json.end_object();
+
+    if (!out) {
+        spdlog::error("Failed writing trace \"{}\"", path.string());
+        return false;
+    }
+    spdlog::info("Wrote {} zones of {} frames to \"{}\"", events, m_history.size(), path.string());
+    return true;
+}
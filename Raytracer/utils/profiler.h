@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// one closed zone, times in nanoseconds since the profiler started
+struct ProfileEvent {
+    /// must outlive the profiler, zones are named with string literals
+    char const *name;
+    int64_t start;
+    int64_t end;
+    /// nesting level on the recording thread, `0` for outermost zones
+    uint32_t depth;
+};
+
+/// time spent in zones of one name on one level, summed over a frame
+struct ZoneSummary {
+    char const *name;
+    uint32_t depth;
+    uint32_t calls;
+    double total_ms;
+};
+
+/// everything recorded between two `Profiler::end_frame()` calls
+struct FrameProfile {
+    int64_t start = 0;
+    int64_t end   = 0;
+
+    struct Thread {
+        uint32_t id;
+        std::string name;
+        std::vector<ProfileEvent> events;
+    };
+    std::vector<Thread> threads;
+
+    auto duration_ms() const -> double { return static_cast<double>(end - start) * 1.0e-6; }
+
+    /// @brief zones of every thread merged by name and nesting level, in the order they first
+    /// started. Worker time is summed over the threads, so it can exceed the frame time.
+    auto summary() const -> std::vector<ZoneSummary>;
+};
+
+/// Hierarchical zone profiler, see `PROFILE_SCOPE`.
+///
+/// Every thread records into its own single-producer ring buffer, so recording a zone is two clock
+/// reads and a few stores, without locks or allocations. `end_frame()` drains the rings once per
+/// frame into a short history that can be shown in the UI or exported as a Chrome trace.
+class Profiler {
+  public:
+    /// per-thread ring of closed zones, written by its thread, drained by `end_frame()`
+    struct ThreadBuffer {
+        static constexpr size_t CAPACITY = 1 << 16;
+
+        uint32_t id = 0;
+        std::string name;
+        uint32_t depth = 0;
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+        ProfileEvent events[CAPACITY];
+
+        void push(ProfileEvent const &event) {
+            uint64_t const h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            events[h % CAPACITY] = event;
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+  private:
+    std::atomic<bool> m_enabled{true};
+    int64_t m_epoch;
+    int64_t m_frame_start;
+
+    std::mutex m_threads_mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_threads;
+    uint32_t m_next_thread_id = 0;
+
+    std::deque<FrameProfile> m_history;
+    size_t m_history_size = 300;
+    uint64_t m_dropped    = 0;
+
+    Profiler();
+
+  public:
+    static auto instance() -> Profiler &;
+
+    /// nanoseconds since the profiler was created
+    auto now() const -> int64_t;
+
+    auto enabled() const -> bool { return m_enabled.load(std::memory_order_relaxed); }
+    void set_enabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+    /// the calling thread's buffer, created on first use
+    auto thread_buffer() -> ThreadBuffer &;
+
+    /// names the calling thread in the UI and in exported traces
+    void set_thread_name(std::string name);
+
+    /// @brief closes the current frame: collects the zones of all threads and starts a new one.
+    /// Call once per frame from the thread that owns the profiler UI.
+    void end_frame();
+
+    /// the last completed frame, empty before the first `end_frame()`
+    auto last_frame() const -> FrameProfile const &;
+
+    /// zones lost because a thread's ring was full, since the start
+    auto dropped_events() const -> uint64_t { return m_dropped; }
+
+    /// number of frames kept for export
+    void set_history_size(size_t frames) { m_history_size = std::max<size_t>(frames, 1); }
+
+    /// @brief writes the kept frames as Chrome `trace_event` JSON, for chrome://tracing or Perfetto
+    auto export_chrome_trace(std::filesystem::path const &path) const -> bool;
+};
+
+/// records the time between its construction and destruction as a zone of the calling thread
+class ProfileZone {
+    Profiler::ThreadBuffer *m_buffer = nullptr;
+    char const *m_name;
+    int64_t m_start;
+
+  public:
+    explicit ProfileZone(char const *name) : m_name(name) {
+        auto &profiler = Profiler::instance();
+        if (!profiler.enabled())
+            return;
+        m_buffer = &profiler.thread_buffer();
+        ++m_buffer->depth;
+        m_start = profiler.now();
+    }
+    ~ProfileZone() {
+        if (!m_buffer)
+            return;
+        --m_buffer->depth;
+        m_buffer->push({m_name, m_start, Profiler::instance().now(), m_buffer->depth});
+    }
+
+    ProfileZone(ProfileZone const &)                     = delete;
+    auto operator=(ProfileZone const &) -> ProfileZone & = delete;
+};
+
+#define RT_PROFILE_CONCAT_(a, b) a##b
+#define RT_PROFILE_CONCAT(a, b) RT_PROFILE_CONCAT_(a, b)
+
+/// times the enclosing scope as a zone named `name` (a string literal)
+#define PROFILE_SCOPE(name) ProfileZone RT_PROFILE_CONCAT(profile_zone_, __LINE__)(name)
@@ -0,0 +1,239 @@
+#include "socket.h"
+
+#include <algorithm>
+#include <charconv>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+auto last_error() -> std::string { return std::to_string(WSAGetLastError()); }
+void close_handle(uintptr_t handle) { closesocket(static_cast<SOCKET>(handle)); }
+auto poll_handles(pollfd *handles, size_t count, int timeout_ms) -> int {
+    return WSAPoll(handles, static_cast<ULONG>(count), timeout_ms);
+}
+
+/// Winsock has to be initialised once per process before the first call
+auto init_sockets() -> bool {
+    static bool const initialised = []() {
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) == 0)
+            return true;
+        spdlog::error("couldn't initialise Winsock: {}", last_error());
+        return false;
+    }();
+    return initialised;
+}
+#else
+auto last_error() -> std::string { return std::strerror(errno); }
+void close_handle(int handle) { ::close(handle); }
+auto poll_handles(pollfd *handles, size_t count, int timeout_ms) -> int {
+    return ::poll(handles, static_cast<nfds_t>(count), timeout_ms);
+}
+auto init_sockets() -> bool { return true; }
+#endif
+
+#ifdef MSG_NOSIGNAL
+// a peer that went away must fail the send, not kill the process with SIGPIPE
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+/// small messages (tile requests) go out right away instead of waiting to be coalesced
+template <typename Handle> void disable_nagle(Handle handle) {
+    int const on = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const *>(&on), sizeof(on));
+}
+
+} // namespace
+
+Socket::Socket(Socket &&other) noexcept : m_handle(std::exchange(other.m_handle, INVALID)) {}
+
+auto Socket::operator=(Socket &&other) noexcept -> Socket & {
+    if (this != &other) {
+        close();
+        m_handle = std::exchange(other.m_handle, INVALID);
+    }
+    return *this;
+}
+
+Socket::~Socket() { close(); }
+
+void Socket::close() {
+    if (m_handle != INVALID)
+        close_handle(std::exchange(m_handle, INVALID));
+}
+
+auto Socket::listen(uint16_t port) -> std::optional<Socket> {
+    if (!init_sockets())
+        return std::nullopt;
+
+    Socket socket(static_cast<Handle>(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)));
+    if (!socket.is_open()) {
+        spdlog::error("couldn't create a socket: {}", last_error());
+        return std::nullopt;
+    }
+    // a restarted coordinator can take the port over right away
+    int const on = 1;
+    setsockopt(socket.m_handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char const *>(&on),
+               sizeof(on));
+
+    sockaddr_in address{};
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(port);
+    bool const listening =
+        ::bind(socket.m_handle, reinterpret_cast<sockaddr const *>(&address), sizeof(address)) ==
+            0 &&
+        ::listen(socket.m_handle, SOMAXCONN) == 0;
+    if (!listening) {
+        spdlog::error("couldn't listen on port {}: {}", port, last_error());
+        return std::nullopt;
+    }
+    return socket;
+}
+
+auto Socket::connect(std::string const &host, uint16_t port) -> std::optional<Socket> {
+    if (!init_sockets())
+        return std::nullopt;
+
+    addrinfo hints{};
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    addrinfo *addresses = nullptr;
+    if (int const error =
+            getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses);
+        error != 0) {
+        spdlog::error("couldn't resolve {}: {}", host, gai_strerror(error));
+        return std::nullopt;
+    }
+
+    std::optional<Socket> connected;
+    for (addrinfo const *address = addresses; address && !connected; address = address->ai_next) {
+        Socket socket(static_cast<Handle>(
+            ::socket(address->ai_family, address->ai_socktype, address->ai_protocol)));
+        if (socket.is_open() &&
+            ::connect(socket.m_handle, address->ai_addr,
+                      static_cast<socklen_t>(address->ai_addrlen)) == 0) {
+            disable_nagle(socket.m_handle);
+            connected = std::move(socket);
+        }
+    }
+    freeaddrinfo(addresses);
+    if (!connected)
+        spdlog::error("couldn't connect to {}:{}: {}", host, port, last_error());
+    return connected;
+}
+
+auto Socket::accept(int timeout_ms) -> std::optional<Socket> {
+    pollfd listening{};
+    listening.fd     = m_handle;
+    listening.events = POLLIN;
+    if (poll_handles(&listening, 1, timeout_ms) <= 0)
+        return std::nullopt;
+
+    Socket socket(static_cast<Handle>(::accept(m_handle, nullptr, nullptr)));
+    if (!socket.is_open()) {
+        spdlog::error("couldn't accept a connection: {}", last_error());
+        return std::nullopt;
+    }
+    disable_nagle(socket.m_handle);
+    return socket;
+}
+
+void Socket::set_receive_timeout(int seconds) {
+#ifdef _WIN32
+    DWORD const timeout = static_cast<DWORD>(seconds) * 1000;
+#else
+    timeval const timeout{seconds, 0};
+#endif
+    setsockopt(m_handle, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<char const *>(&timeout),
+               sizeof(timeout));
+}
+
+auto Socket::send(void const *data, size_t size) -> bool {
+    auto const *bytes = static_cast<char const *>(data);
+    while (size > 0) {
+        // Winsock takes int sizes, stay well below
+        int const chunk = static_cast<int>(std::min<size_t>(size, size_t{1} << 30));
+        auto const sent = ::send(m_handle, bytes, chunk, SEND_FLAGS);
+        if (sent <= 0) {
+            spdlog::error("couldn't send to {}: {}", peer_name(), last_error());
+            return false;
+        }
+        bytes += sent;
+        size  -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+auto Socket::receive(void *data, size_t size) -> bool {
+    auto *bytes = static_cast<char *>(data);
+    while (size > 0) {
+        int const chunk     = static_cast<int>(std::min<size_t>(size, size_t{1} << 30));
+        auto const received = ::recv(m_handle, bytes, chunk, 0);
+        if (received == 0) {
+            spdlog::error("{} closed the connection", peer_name());
+            return false;
+        }
+        if (received < 0) {
+            spdlog::error("couldn't receive from {}: {}", peer_name(), last_error());
+            return false;
+        }
+        bytes += received;
+        size  -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+auto Socket::peer_name() const -> std::string {
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    if (getpeername(m_handle, reinterpret_cast<sockaddr *>(&address), &length) != 0)
+        return "unknown peer";
+
+    char host[INET6_ADDRSTRLEN] = {};
+    uint16_t port               = 0;
+    if (address.ss_family == AF_INET) {
+        auto const &ipv4 = reinterpret_cast<sockaddr_in const &>(address);
+        inet_ntop(AF_INET, &ipv4.sin_addr, host, sizeof(host));
+        port = ntohs(ipv4.sin_port);
+    } else if (address.ss_family == AF_INET6) {
+        auto const &ipv6 = reinterpret_cast<sockaddr_in6 const &>(address);
+        inet_ntop(AF_INET6, &ipv6.sin6_addr, host, sizeof(host));
+        port = ntohs(ipv6.sin6_port);
+    }
+    return std::string(host) + ":" + std::to_string(port);
+}
+
+auto parse_host_port(std::string const &text, std::string &host, uint16_t &port) -> bool {
+    auto const colon = text.rfind(':');
+    if (colon == std::string::npos || colon == 0)
+        return false;
+    char const *first       = text.data() + colon + 1;
+    char const *last        = text.data() + text.size();
+    auto const [end, error] = std::from_chars(first, last, port);
+    if (error != std::errc{} || end != last || port == 0)
+        return false;
+    host = text.substr(0, colon);
+    return true;
+}
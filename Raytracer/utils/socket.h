@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/// A blocking TCP socket. Failures are logged and reported through the return values; a socket
+/// whose send or receive failed should be dropped, the stream may be out of sync.
+class Socket {
+#ifdef _WIN32
+    using Handle = uintptr_t;
+#else
+    using Handle = int;
+#endif
+    static constexpr Handle INVALID = static_cast<Handle>(~Handle{0});
+
+    Handle m_handle = INVALID;
+
+    explicit Socket(Handle handle) : m_handle(handle) {}
+
+  public:
+    Socket() = default;
+    Socket(Socket &&other) noexcept;
+    auto operator=(Socket &&other) noexcept -> Socket &;
+    ~Socket();
+
+    /// @brief listens on `port` on every interface
+    static auto listen(uint16_t port) -> std::optional<Socket>;
+    /// @brief connects to `host` (a name or an address) on `port`
+    static auto connect(std::string const &host, uint16_t port) -> std::optional<Socket>;
+
+    /// @brief waits for the next connection of a listening socket
+    /// @return nothing if none came in within `timeout_ms`, or on errors
+    auto accept(int timeout_ms) -> std::optional<Socket>;
+
+    /// @brief fails receives that get no data for `seconds`, `0` waits forever
+    void set_receive_timeout(int seconds);
+
+    /// sends all of `data` or fails
+    auto send(void const *data, size_t size) -> bool;
+    /// receives exactly `size` bytes or fails, also when the peer closed the connection
+    auto receive(void *data, size_t size) -> bool;
+
+    auto is_open() const -> bool { return m_handle != INVALID; }
+    /// address and port of the peer, for log messages
+    auto peer_name() const -> std::string;
+
+    void close();
+};
+
+/// @brief parses "HOST:PORT"
+auto parse_host_port(std::string const &text, std::string &host, uint16_t &port) -> bool;
@@ -0,0 +1,234 @@
+#include "task_graph.h"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
+
+namespace {
+
+auto state_name(TaskGraph::State state) -> char const * {
+    switch (state) {
+    case TaskGraph::State::Waiting:
+        return "waiting";
+    case TaskGraph::State::Running:
+        return "running";
+    case TaskGraph::State::Done:
+        return "done";
+    case TaskGraph::State::Failed:
+        return "failed";
+    case TaskGraph::State::Skipped:
+        return "skipped";
+    }
+    return "";
+}
+
+} // namespace
+
+TaskGraph::~TaskGraph() { cancel(); }
+
+auto TaskGraph::since_start() const -> double {
+    return std::chrono::duration<double, std::milli>(Clock::now() - m_start).count();
+}
+
+auto TaskGraph::add(char const *name, std::function<bool()> work,
+                    std::vector<TaskId> const &dependencies, bool main_thread) -> TaskId {
+    TaskId const id = m_tasks.size();
+    Task task;
+    task.name        = name;
+    task.work        = std::move(work);
+    task.pending     = dependencies.size();
+    task.main_thread = main_thread;
+    for (TaskId dependency : dependencies)
+        m_tasks[dependency].dependents.push_back(id);
+    m_tasks.push_back(std::move(task));
+    return id;
+}
+
+void TaskGraph::set_notify(std::function<void()> notify) {
+    std::lock_guard lock(m_mutex);
+    m_notify = std::move(notify);
+}
+
+void TaskGraph::start(ThreadPool &pool) {
+    std::lock_guard lock(m_mutex);
+    m_pool       = &pool;
+    m_start      = Clock::now();
+    m_unfinished = m_tasks.size();
+    for (TaskId id = 0; id < m_tasks.size(); ++id) {
+        if (m_tasks[id].pending == 0)
+            make_ready(id);
+    }
+}
+
+void TaskGraph::make_ready(TaskId id) {
+    if (m_tasks[id].main_thread) {
+        m_main_ready.push_back(id);
+        m_changed.notify_all();
+        return;
+    }
+    ++m_in_flight;
+    m_pool->submit([this, id]() { run(id); });
+}
+
+void TaskGraph::skip(TaskId id) {
+    Task &task = m_tasks[id];
+    if (task.state != State::Waiting)
+        return;
+    task.state  = State::Skipped;
+    task.end_ms = since_start();
+    --m_unfinished;
+    for (TaskId dependent : task.dependents)
+        skip(dependent);
+}
+
+void TaskGraph::run(TaskId id) {
+    Task &task = m_tasks[id];
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_cancelled) {
+            // queued on the pool before `cancel()`, already marked as skipped there
+            if (!task.main_thread)
+                --m_in_flight;
+            m_changed.notify_all();
+            return;
+        }
+        task.state    = State::Running;
+        task.start_ms = since_start();
+    }
+
+    bool ok;
+    {
+        ProfileZone zone(task.name);
+        ok = task.work();
+    }
+    if (!ok)
+        spdlog::error("startup task \"{}\" failed", task.name);
+
+    std::function<void()> notify;
+    {
+        std::lock_guard lock(m_mutex);
+        task.state  = ok ? State::Done : State::Failed;
+        task.end_ms = since_start();
+        --m_unfinished;
+        for (TaskId dependent : task.dependents) {
+            Task &next = m_tasks[dependent];
+            if (!ok)
+                skip(dependent);
+            else if (--next.pending == 0 && next.state == State::Waiting)
+                make_ready(dependent);
+        }
+        if (!task.main_thread)
+            --m_in_flight;
+        m_changed.notify_all();
+        notify = m_notify;
+    }
+    if (notify)
+        notify();
+}
+
+auto TaskGraph::run_one_main_task() -> bool {
+    TaskId id;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_cancelled || m_main_ready.empty())
+            return false;
+        id = m_main_ready.front();
+        m_main_ready.erase(m_main_ready.begin());
+    }
+    run(id);
+    return true;
+}
+
+void TaskGraph::run_main_tasks() {
+    while (run_one_main_task()) {
+    }
+}
+
+auto TaskGraph::run_until(TaskId id) -> bool {
+    for (;;) {
+        run_main_tasks();
+        std::unique_lock lock(m_mutex);
+        m_changed.wait(lock, [&]() {
+            State const state = m_tasks[id].state;
+            return !m_main_ready.empty() || (state != State::Waiting && state != State::Running);
+        });
+        if (m_main_ready.empty())
+            return m_tasks[id].state == State::Done;
+    }
+}
+
+void TaskGraph::wait() {
+    for (;;) {
+        run_main_tasks();
+        std::unique_lock lock(m_mutex);
+        m_changed.wait(lock, [&]() { return !m_main_ready.empty() || m_unfinished == 0; });
+        if (m_unfinished == 0)
+            return;
+    }
+}
+
+void TaskGraph::cancel() {
+    std::unique_lock lock(m_mutex);
+    m_cancelled = true;
+    m_main_ready.clear();
+    for (TaskId id = 0; id < m_tasks.size(); ++id)
+        skip(id);
+    m_changed.wait(lock, [&]() { return m_in_flight == 0; });
+}
+
+auto TaskGraph::finished() const -> bool {
+    std::lock_guard lock(m_mutex);
+    return m_unfinished == 0;
+}
+
+auto TaskGraph::state(TaskId id) const -> State {
+    std::lock_guard lock(m_mutex);
+    return m_tasks[id].state;
+}
+
+auto TaskGraph::end_ms(TaskId id) const -> double {
+    std::lock_guard lock(m_mutex);
+    return m_tasks[id].end_ms;
+}
+
+auto TaskGraph::progress() const -> float {
+    std::lock_guard lock(m_mutex);
+    if (m_tasks.empty())
+        return 1.0f;
+    return static_cast<float>(m_tasks.size() - m_unfinished) / static_cast<float>(m_tasks.size());
+}
+
+auto TaskGraph::running() const -> std::vector<char const *> {
+    std::lock_guard lock(m_mutex);
+    std::vector<char const *> names;
+    for (auto const &task : m_tasks) {
+        if (task.state == State::Running)
+            names.push_back(task.name);
+    }
+    return names;
+}
+
+void TaskGraph::log_report() const {
+    std::lock_guard lock(m_mutex);
+    double total_ms      = 0.0;
+    double main_ms       = 0.0;
+    double background_ms = 0.0;
+    for (auto const &task : m_tasks) {
+        double const duration_ms = task.end_ms - task.start_ms;
+        total_ms                 = std::max(total_ms, task.end_ms);
+        if (task.state == State::Skipped) {
+            spdlog::info("startup: {:<14} {}", task.name, state_name(task.state));
+            continue;
+        }
+        (task.main_thread ? main_ms : background_ms) += duration_ms;
+        spdlog::info("startup: {:<14} {} after {:.1f} ms on the {} thread, {:.1f} -> {:.1f} ms",
+                     task.name, state_name(task.state), duration_ms,
+                     task.main_thread ? "main" : "startup", task.start_ms, task.end_ms);
+    }
+    spdlog::info("startup took {:.1f} ms: {:.1f} ms of work on the main thread, {:.1f} ms in the "
+                 "background",
+                 total_ms, main_ms, background_ms);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class ThreadPool;
+
+/// A fixed graph of tasks that run as soon as the tasks they depend on are done, used to overlap
+/// the steps of the application startup.
+///
+/// Background tasks run on a thread pool. Main thread tasks (window, OpenGL and ImGui setup, which
+/// must not leave the thread that owns the context) are queued until the main thread calls
+/// `run_main_tasks()` or one of the blocking waits. A task that fails skips everything depending
+/// on it. The graph records when and where every task ran for `log_report()`.
+class TaskGraph {
+  public:
+    using TaskId = size_t;
+
+    enum class State { Waiting, Running, Done, Failed, Skipped };
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task {
+        char const *name;
+        std::function<bool()> work;
+        std::vector<TaskId> dependents;
+        /// dependencies that are not done yet
+        size_t pending   = 0;
+        bool main_thread = false;
+        State state      = State::Waiting;
+        // since `start()`
+        double start_ms = 0.0;
+        double end_ms   = 0.0;
+    };
+
+    std::vector<Task> m_tasks;
+    ThreadPool *m_pool = nullptr;
+    Clock::time_point m_start;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed;
+    /// main thread tasks whose dependencies are done, in the order they got ready
+    std::vector<TaskId> m_main_ready;
+    /// tasks that are neither done, failed nor skipped
+    size_t m_unfinished = 0;
+    /// background tasks submitted to the pool that haven't returned yet
+    size_t m_in_flight = 0;
+    bool m_cancelled   = false;
+    std::function<void()> m_notify;
+
+    auto since_start() const -> double;
+    /// queues `id` on the pool or for the main thread, `m_mutex` has to be held
+    void make_ready(TaskId id);
+    /// skips `id` and everything depending on it, `m_mutex` has to be held
+    void skip(TaskId id);
+    void run(TaskId id);
+    /// runs the first main thread task that is ready, false if there is none
+    auto run_one_main_task() -> bool;
+
+  public:
+    TaskGraph() = default;
+    /// cancels, see `cancel()`
+    ~TaskGraph();
+
+    TaskGraph(TaskGraph const &)            = delete;
+    TaskGraph &operator=(TaskGraph const &) = delete;
+
+    /// @brief adds a task, only before `start()`
+    /// @param name shown in the progress and the report, has to outlive the graph (a literal)
+    /// @param work returns false if the task failed, its dependents are skipped then
+    /// @param dependencies tasks added before that have to be done first
+    /// @param main_thread run by the thread calling `run_main_tasks()` instead of the pool
+    auto add(char const *name, std::function<bool()> work,
+             std::vector<TaskId> const &dependencies = {}, bool main_thread = false) -> TaskId;
+
+    /// called from the thread that finished a task, after every task, e.g. to wake up the UI
+    void set_notify(std::function<void()> notify);
+
+    /// starts the tasks without dependencies, the pool has to outlive the graph
+    void start(ThreadPool &pool);
+
+    /// runs the main thread tasks that are ready, without waiting for background tasks
+    void run_main_tasks();
+
+    /// @brief blocks until `id` has finished, running main thread tasks meanwhile
+    /// @return true if it succeeded
+    auto run_until(TaskId id) -> bool;
+
+    /// blocks until every task has finished, running main thread tasks meanwhile
+    void wait();
+
+    /// skips the tasks that haven't started and waits for the running background tasks. Used on
+    /// shutdown, running tasks can't be interrupted.
+    void cancel();
+
+    auto finished() const -> bool;
+    auto state(TaskId id) const -> State;
+    auto succeeded(TaskId id) const -> bool { return state(id) == State::Done; }
+    /// when `id` finished, in milliseconds since `start()`
+    auto end_ms(TaskId id) const -> double;
+    /// share of the tasks that have finished, in [0, 1]
+    auto progress() const -> float;
+    /// names of the tasks running right now
+    auto running() const -> std::vector<char const *>;
+
+    /// logs when, how long and on which thread every task ran
+    void log_report() const;
+};
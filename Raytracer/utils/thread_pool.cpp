@@ -0,0 +1,144 @@
+#include "thread_pool.h"
+
+#include <string>
+
+#include "utils/profiler.h"
+
+namespace {
+// the pool (if any) the current thread is a worker of, and its index in there
+thread_local ThreadPool const *t_pool = nullptr;
+thread_local int t_index              = -1;
+} // namespace
+
+void ThreadPool::Queue::push_back(std::function<void()> task) {
+    if (count == ring.size()) {
+        // unroll into a ring twice the size
+        std::vector<std::function<void()>> grown(std::max<size_t>(2 * ring.size(), 64));
+        for (size_t i = 0; i < count; ++i)
+            grown[i] = std::move(ring[(head + i) % ring.size()]);
+        ring = std::move(grown);
+        head = 0;
+    }
+    ring[(head + count) % ring.size()] = std::move(task);
+    ++count;
+}
+
+auto ThreadPool::Queue::pop_back() -> std::function<void()> {
+    --count;
+    return std::move(ring[(head + count) % ring.size()]);
+}
+
+auto ThreadPool::Queue::pop_front() -> std::function<void()> {
+    auto task = std::move(ring[head]);
+    head      = (head + 1) % ring.size();
+    --count;
+    return task;
+}
+
+ThreadPool::ThreadPool(unsigned threads, std::string name) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    m_queues.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i)
+        m_queues.push_back(std::make_unique<Queue>());
+
+    m_threads.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i)
+        m_threads.emplace_back([this, i, name]() { worker_loop(i, name); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto &thread : m_threads)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    int const self = worker_index();
+    unsigned const queue =
+        self >= 0 ? static_cast<unsigned>(self)
+                  : m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    {
+        // taking the sleep mutex makes sure a worker can't miss the wake-up between checking
+        // `m_queued` and going to sleep. The counter is bumped before the push so it never
+        // underflows when the task gets popped right away.
+        std::lock_guard lock(m_sleep_mutex);
+        m_queued.fetch_add(1, std::memory_order_release);
+    }
+    {
+        std::lock_guard lock(m_queues[queue]->mutex);
+        m_queues[queue]->push_back(std::move(task));
+    }
+    m_wake.notify_one();
+}
+
+auto ThreadPool::try_run_one() -> bool {
+    std::function<void()> task;
+    if (!pop_task(worker_index(), task))
+        return false;
+    task();
+    return true;
+}
+
+auto ThreadPool::worker_index() const -> int { return t_pool == this ? t_index : -1; }
+
+auto ThreadPool::pop_task(int self, std::function<void()> &task) -> bool {
+    if (m_queued.load(std::memory_order_acquire) == 0)
+        return false;
+
+    auto const count = static_cast<int>(m_queues.size());
+
+    // own queue first, newest task
+    if (self >= 0) {
+        auto &queue = *m_queues[self];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.empty()) {
+            task = queue.pop_back();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // then steal the oldest task of somebody else
+    int const start = self >= 0 ? self + 1 : 0;
+    for (int i = 0; i < count; ++i) {
+        int const victim = (start + i) % count;
+        if (victim == self)
+            continue;
+        auto &queue = *m_queues[victim];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.empty()) {
+            task = queue.pop_front();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(unsigned index, std::string const &name) {
+    t_pool  = this;
+    t_index = static_cast<int>(index);
+    Profiler::instance().set_thread_name(name + " " + std::to_string(index));
+
+    std::function<void()> task;
+    while (true) {
+        if (pop_task(t_index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock lock(m_sleep_mutex);
+        m_wake.wait(lock, [this]() {
+            return m_stop.load() || m_queued.load(std::memory_order_acquire) > 0;
+        });
+        if (m_stop)
+            return;
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// A work-stealing thread pool.
+///
+/// Every worker owns a deque of tasks. Workers pop their own deque from the back (LIFO, good for
+/// cache locality of recursively spawned tasks) and steal from the front of the other deques when
+/// they run dry. Tasks submitted from outside the pool are distributed round-robin.
+class ThreadPool {
+    /// Tasks of one worker in a ring buffer that only grows, so once it has seen the most tasks
+    /// queued at once pushing and popping don't allocate (a `std::deque` frees and allocates its
+    /// blocks as it drains and fills).
+    struct Queue {
+        std::mutex mutex;
+        std::vector<std::function<void()>> ring;
+        size_t head  = 0;
+        size_t count = 0;
+
+        auto empty() const -> bool { return count == 0; }
+        void push_back(std::function<void()> task);
+        auto pop_back() -> std::function<void()>;
+        auto pop_front() -> std::function<void()>;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::atomic<size_t> m_queued{0};
+    std::atomic<unsigned> m_next_queue{0};
+    std::atomic<bool> m_stop{false};
+
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+
+    void worker_loop(unsigned index, std::string const &name);
+    auto pop_task(int self, std::function<void()> &task) -> bool;
+
+  public:
+    /// @brief creates the pool
+    /// @param threads number of worker threads, `0` means one per hardware thread
+    /// @param name prefix of the thread names in the profiler, followed by the worker index
+    explicit ThreadPool(unsigned threads = 0, std::string name = "worker");
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &)            = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    /// Queues a task. If called from one of the pool's workers, the task goes to that worker's
+    /// own deque.
+    void submit(std::function<void()> task);
+
+    /// Runs one queued task on the calling thread, if there is any. Used to help out while
+    /// waiting for other tasks to finish.
+    auto try_run_one() -> bool;
+
+    /// Index of the calling worker thread in this pool, `-1` if the caller is not a worker.
+    auto worker_index() const -> int;
+
+    auto size() const -> unsigned { return static_cast<unsigned>(m_threads.size()); }
+
+    /// Calls `f(i)` for every `i` in `[begin, end)`, in chunks of `grain` indices, and blocks
+    /// until all of them are done. The calling thread takes part in the work.
+    template <typename F> void parallel_for(size_t begin, size_t end, size_t grain, F &&f);
+};
+
+/// A set of tasks that can be waited on. Waiting threads execute queued tasks instead of blocking
+/// so that nested parallelism (tasks spawning and waiting on tasks) can't deadlock the pool.
+class TaskGroup {
+    friend class ThreadPool;
+
+    ThreadPool &m_pool;
+    std::atomic<int> m_pending{0};
+
+  public:
+    explicit TaskGroup(ThreadPool &pool) : m_pool(pool) {}
+    ~TaskGroup() { wait(); }
+
+    template <typename F> void run(F &&f) {
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        m_pool.submit([this, f = std::forward<F>(f)]() mutable {
+            f();
+            m_pending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    void wait() {
+        while (m_pending.load(std::memory_order_acquire) > 0) {
+            if (!m_pool.try_run_one())
+                std::this_thread::yield();
+        }
+    }
+};
+
+template <typename F> void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, F &&f) {
+    if (begin >= end)
+        return;
+    grain = std::max<size_t>(grain, 1);
+
+    // the tasks capture no more than two pointers, which `std::function` stores inline, so a loop
+    // doesn't allocate per chunk
+    TaskGroup group(*this);
+    struct Loop {
+        F &f;
+        size_t end;
+        size_t grain;
+        TaskGroup &group;
+    } const loop{f, end, grain, group};
+    for (size_t chunk = begin; chunk < end; chunk += grain) {
+        group.m_pending.fetch_add(1, std::memory_order_relaxed);
+        submit([&loop, chunk]() {
+            size_t const chunk_end = std::min(chunk + loop.grain, loop.end);
+            for (size_t i = chunk; i < chunk_end; ++i)
+                loop.f(i);
+            loop.group.m_pending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    group.wait();
+}
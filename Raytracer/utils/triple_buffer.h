@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/// Lock-free handoff of the latest value from one producer thread to one consumer thread.
+///
+/// There are three slots: the producer fills `back()` and `publish()`es it, which swaps it with the
+/// middle slot. The consumer reads `front()` and calls `update()` to swap in the middle slot if
+/// something new was published since. Neither side ever waits for the other, the producer simply
+/// overwrites values the consumer was too slow to pick up.
+template <typename T> class TripleBuffer {
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    /// set in `m_middle` when the middle slot holds a value the consumer hasn't seen
+    static constexpr uint8_t NEW_BIT = 0x4;
+
+    std::array<T, 3> m_slots{};
+    std::atomic<uint8_t> m_middle{1};
+    uint8_t m_back  = 0;
+    uint8_t m_front = 2;
+
+  public:
+    /// slot `index` for setting up all three slots before the threads start
+    auto slot(int index) -> T & { return m_slots[index]; }
+
+    // ---- Producer -------------------------------------------------------------------------------
+
+    auto back() -> T & { return m_slots[m_back]; }
+    auto back_index() const -> int { return m_back; }
+
+    /// hands `back()` to the consumer, `back()` is another slot afterwards
+    void publish() {
+        m_back = m_middle.exchange(m_back | NEW_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // ---- Consumer -------------------------------------------------------------------------------
+
+    auto front() -> T & { return m_slots[m_front]; }
+    auto front_index() const -> int { return m_front; }
+
+    /// true if `update()` would swap in a new value
+    auto has_update() const -> bool {
+        return (m_middle.load(std::memory_order_acquire) & NEW_BIT) != 0;
+    }
+
+    /// @brief makes the latest published value `front()`, the old front goes back to the producer
+    /// @return false if nothing new was published, `front()` is unchanged then
+    auto update() -> bool {
+        if (!has_update())
+            return false;
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+};